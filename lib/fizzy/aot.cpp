@@ -0,0 +1,1197 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "aot.hpp"
+#include "instructions.hpp"
+#include "limits.hpp"
+#include "register_ir.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch"  // Superinstruction opcodes are not Instr enumerators.
+
+namespace fizzy
+{
+namespace
+{
+/// The version of the interface between the generated code and fizzy.
+/// It must be changed with every incompatible change of the generated code.
+constexpr uint32_t AotAbiVersion = 2;
+
+/// The beginning of the generated C source: the interface to fizzy and the helpers.
+/// The FizzyAotContext and FizzyAotGlobal must match AotContext and ExternalGlobal.
+constexpr auto c_prelude = R"(/* Generated by fizzy-aot. Compile as a shared object. */
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct FizzyAotGlobal
+{
+    uint64_t* value;
+    _Bool is_mutable;
+} FizzyAotGlobal;
+
+typedef struct FizzyAotContext FizzyAotContext;
+
+/* The function takes the arguments in args and stores the result to args[0].
+   Returns non-zero if the execution trapped. */
+typedef int (*FizzyAotFunction)(FizzyAotContext* ctx, uint64_t* args);
+
+struct FizzyAotContext
+{
+    uint8_t* memory_data;
+    uint64_t memory_size;
+    uint64_t* globals;
+    FizzyAotGlobal* imported_globals;
+    int32_t depth;
+    int (*call_imported)(FizzyAotContext* ctx, uint32_t func_idx, uint64_t* args);
+    int (*call_indirect)(
+        FizzyAotContext* ctx, uint32_t elem_idx, uint32_t type_idx, uint64_t* args);
+    uint32_t (*memory_grow)(FizzyAotContext* ctx, uint32_t delta);
+};
+
+static inline int fizzy_call(FizzyAotContext* ctx, FizzyAotFunction func, uint64_t* args)
+{
+    int trapped;
+    if (ctx->depth >= FIZZY_CALL_STACK_LIMIT)
+        return 1;
+    ++ctx->depth;
+    trapped = func(ctx, args);
+    --ctx->depth;
+    return trapped;
+}
+
+static inline uint16_t fizzy_load_u16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t fizzy_load_u32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t fizzy_load_u64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void fizzy_store_u16(uint8_t* p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void fizzy_store_u32(uint8_t* p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void fizzy_store_u64(uint8_t* p, uint64_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t fizzy_rotl32(uint32_t x, uint64_t k)
+{
+    k &= 31;
+    return k == 0 ? x : (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t fizzy_rotr32(uint32_t x, uint64_t k)
+{
+    k &= 31;
+    return k == 0 ? x : (x >> k) | (x << (32 - k));
+}
+
+static inline uint64_t fizzy_rotl64(uint64_t x, uint64_t k)
+{
+    k &= 63;
+    return k == 0 ? x : (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t fizzy_rotr64(uint64_t x, uint64_t k)
+{
+    k &= 63;
+    return k == 0 ? x : (x >> k) | (x << (64 - k));
+}
+
+static inline uint32_t fizzy_clz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return x == 0 ? 64 : (uint32_t)__builtin_clzll(x);
+#else
+    uint32_t n = 0;
+    if (x == 0)
+        return 64;
+    while ((x & (UINT64_C(1) << 63)) == 0)
+    {
+        x <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+static inline uint32_t fizzy_ctz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return x == 0 ? 64 : (uint32_t)__builtin_ctzll(x);
+#else
+    uint32_t n = 0;
+    if (x == 0)
+        return 64;
+    while ((x & 1) == 0)
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+static inline uint32_t fizzy_popcnt64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_popcountll(x);
+#else
+    uint32_t n = 0;
+    for (; x != 0; x &= x - 1)
+        ++n;
+    return n;
+#endif
+}
+
+static inline uint32_t fizzy_clz32(uint32_t x)
+{
+    return fizzy_clz64(x) - 32;
+}
+
+static inline uint32_t fizzy_ctz32(uint32_t x)
+{
+    return x == 0 ? 32 : fizzy_ctz64(x);
+}
+
+/* The floating point values are kept as their bits, f32 zero-extended. */
+static inline float fizzy_f32(uint64_t v)
+{
+    uint32_t bits = (uint32_t)v;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline double fizzy_f64(uint64_t v)
+{
+    double f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline uint64_t fizzy_f32_bits(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline uint64_t fizzy_f64_bits(double f)
+{
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/* The NaN operand gives the canonical NaN and -0 is less than +0. */
+#define FIZZY_MIN_MAX(name, T, nan, cmp, zero) \
+    static inline T name(T a, T b)             \
+    {                                          \
+        if (a != a || b != b)                  \
+            return nan;                        \
+        if (a == 0 && b == 0)                  \
+            return zero;                       \
+        return a cmp b ? a : b;                \
+    }
+FIZZY_MIN_MAX(fizzy_f32_min, float, (float)NAN, <, signbit(a) ? a : b)
+FIZZY_MIN_MAX(fizzy_f32_max, float, (float)NAN, >, signbit(a) ? b : a)
+FIZZY_MIN_MAX(fizzy_f64_min, double, (double)NAN, <, signbit(a) ? a : b)
+FIZZY_MIN_MAX(fizzy_f64_max, double, (double)NAN, >, signbit(a) ? b : a)
+
+/* Stores the truncated value to *r. Returns non-zero if the value is NaN or out of range.
+   The bounds are powers of 2, so they are represented exactly. */
+#define FIZZY_TRUNC(name, T, trunc_fn, DstT, ResultT, lower, upper) \
+    static inline int name(T x, uint64_t* r)                        \
+    {                                                               \
+        T t = trunc_fn(x);                                          \
+        if (!(t >= lower && t < upper))                             \
+            return 1;                                               \
+        *r = (ResultT)(DstT)t;                                      \
+        return 0;                                                   \
+    }
+FIZZY_TRUNC(fizzy_i32_trunc_f32_s, float, truncf, int32_t, uint32_t, -0x1p31f, 0x1p31f)
+FIZZY_TRUNC(fizzy_i32_trunc_f32_u, float, truncf, uint32_t, uint32_t, 0.0f, 0x1p32f)
+FIZZY_TRUNC(fizzy_i32_trunc_f64_s, double, trunc, int32_t, uint32_t, -0x1p31, 0x1p31)
+FIZZY_TRUNC(fizzy_i32_trunc_f64_u, double, trunc, uint32_t, uint32_t, 0.0, 0x1p32)
+FIZZY_TRUNC(fizzy_i64_trunc_f32_s, float, truncf, int64_t, uint64_t, -0x1p63f, 0x1p63f)
+FIZZY_TRUNC(fizzy_i64_trunc_f32_u, float, truncf, uint64_t, uint64_t, 0.0f, 0x1p64f)
+FIZZY_TRUNC(fizzy_i64_trunc_f64_s, double, trunc, int64_t, uint64_t, -0x1p63, 0x1p63)
+FIZZY_TRUNC(fizzy_i64_trunc_f64_u, double, trunc, uint64_t, uint64_t, 0.0, 0x1p64)
+)";
+
+const FuncType& function_type(const Module& module, FuncIdx idx)
+{
+    if (idx < module.imported_function_types.size())
+        return module.imported_function_types[idx];
+
+    const auto type_idx = module.funcsec[idx - module.imported_function_types.size()];
+    assert(type_idx < module.typesec.size());
+    return module.typesec[type_idx];
+}
+
+/// Translates the register IR of a single function to the C function.
+class CTranslator
+{
+    const Module& m_module;
+    const RegCode& m_code;
+    std::ostream& m_out;
+
+    /// Whether the instruction of the given index is a jump target, so it needs a label.
+    std::vector<bool> m_is_target;
+
+public:
+    CTranslator(const Module& module, const RegCode& code, std::ostream& out)
+      : m_module{module}, m_code{code}, m_out{out}
+    {}
+
+    void translate(FuncIdx func_idx);
+
+private:
+    void translate_instruction(const RegInstr& instr, size_t index);
+
+    static std::string s(uint64_t slot) { return "s" + std::to_string(slot); }
+
+    static std::string u32(uint64_t slot) { return "(uint32_t)" + s(slot); }
+
+    static std::string i32(uint64_t slot) { return "(int32_t)" + s(slot); }
+
+    static std::string i64(uint64_t slot) { return "(int64_t)" + s(slot); }
+
+    static std::string constant(uint64_t value)
+    {
+        return "UINT64_C(" + std::to_string(value) + ")";
+    }
+
+    void assign(const RegInstr& instr, const std::string& expr)
+    {
+        m_out << "    " << s(instr.dst) << " = " << expr << ";\n";
+    }
+
+    void copy(uint32_t dst, uint32_t src)
+    {
+        if (dst != src)
+            m_out << "    " << s(dst) << " = " << s(src) << ";\n";
+    }
+
+    void trap_if(const std::string& condition)
+    {
+        m_out << "    if (" << condition << ")\n        return 1;\n";
+    }
+
+    void reload_memory()
+    {
+        m_out << "    mem = ctx->memory_data;\n    mem_size = ctx->memory_size;\n";
+    }
+
+    void i32_binary(const RegInstr& instr, const char* op)
+    {
+        assign(instr, "(uint32_t)(" + u32(instr.a) + " " + op + " " + u32(instr.b) + ")");
+    }
+
+    void i64_binary(const RegInstr& instr, const char* op)
+    {
+        assign(instr, s(instr.a) + " " + op + " " + s(instr.b));
+    }
+
+    void compare(const RegInstr& instr, std::string (*cast)(uint64_t), const char* op)
+    {
+        assign(instr, cast(instr.a) + " " + op + " " + cast(instr.b));
+    }
+
+    /// Returns the expression of the floating point value of the slot, f32 or f64.
+    static std::string f(bool wide, uint64_t slot)
+    {
+        return (wide ? "fizzy_f64(" : "fizzy_f32(") + s(slot) + ")";
+    }
+
+    /// Assigns the floating point value of the expression, f32 or f64.
+    void float_assign(const RegInstr& instr, bool wide, const std::string& expr)
+    {
+        assign(instr, (wide ? "fizzy_f64_bits(" : "fizzy_f32_bits(") + expr + ")");
+    }
+
+    /// Applies the math.h function, e.g. "sqrt" is sqrtf() for f32.
+    void float_unary(const RegInstr& instr, bool wide, const char* fn)
+    {
+        float_assign(instr, wide, fn + std::string{wide ? "" : "f"} + "(" + f(wide, instr.a) + ")");
+    }
+
+    void float_binary(const RegInstr& instr, bool wide, const char* op)
+    {
+        float_assign(instr, wide, f(wide, instr.a) + " " + op + " " + f(wide, instr.b));
+    }
+
+    void float_compare(const RegInstr& instr, bool wide, const char* op)
+    {
+        assign(instr, f(wide, instr.a) + " " + op + " " + f(wide, instr.b));
+    }
+
+    void float_call(const RegInstr& instr, bool wide, const char* fn)
+    {
+        float_assign(instr, wide, fn + ("(" + f(wide, instr.a) + ", " + f(wide, instr.b) + ")"));
+    }
+
+    void trunc(const RegInstr& instr, bool wide, const char* fn)
+    {
+        trap_if(fn + ("(" + f(wide, instr.a) + ", &" + s(instr.dst) + ")"));
+    }
+
+    void call(const RegInstr& instr, const FuncType& type, const std::string& call_expr);
+
+    /// Checks the memory bounds and returns the pointer expression of the accessed memory.
+    std::string memory_access(const RegInstr& instr, uint64_t size);
+
+    void store(const RegInstr& instr, uint64_t size, const char* store_fn, const std::string& value)
+    {
+        const auto ptr = memory_access(instr, size);
+        m_out << "    " << store_fn << "(" << ptr << ", " << value << ");\n";
+    }
+};
+
+void CTranslator::translate(FuncIdx func_idx)
+{
+    const auto& instructions = m_code.instructions;
+    m_is_target.assign(instructions.size() + 1, false);
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        const auto& instr = instructions[i];
+        switch (instr.op)
+        {
+        case Instr::if_:
+        case Instr::br:
+        case Instr::br_if:
+            m_is_target[instr.imm] = true;
+            break;
+        case Instr::br_table:
+            for (size_t j = 0; j <= instr.b; ++j)
+                m_is_target[i + 1 + j] = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_out << "\nstatic int f" << func_idx << "(FizzyAotContext* ctx, uint64_t* args)\n{\n";
+    m_out << "    uint8_t* mem = ctx->memory_data;\n";
+    m_out << "    uint64_t mem_size = ctx->memory_size;\n";
+    for (uint32_t i = 0; i < m_code.frame_size; ++i)
+    {
+        m_out << "    uint64_t " << s(i) << " = ";
+        if (i < m_code.num_args)
+            m_out << "args[" << i << "];\n";
+        else
+            m_out << "0;\n";
+    }
+    m_out << "    (void)args;\n    (void)mem;\n    (void)mem_size;\n";
+
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        if (m_is_target[i])
+            m_out << "L" << i << ":;\n";
+        translate_instruction(instructions[i], i);
+    }
+    if (m_is_target[instructions.size()])
+        m_out << "L" << instructions.size() << ":;\n";
+    m_out << "    return 1;\n}\n";
+}
+
+void CTranslator::call(const RegInstr& instr, const FuncType& type, const std::string& call_expr)
+{
+    // The arguments are passed in the array, which also receives the result.
+    const auto num_args = type.inputs.size();
+    m_out << "    {\n        uint64_t a[" << std::max(num_args, size_t{1}) << "] = {";
+    for (size_t i = 0; i < num_args; ++i)
+        m_out << (i != 0 ? ", " : "") << s(instr.dst + i);
+    if (num_args == 0)
+        m_out << "0";
+    m_out << "};\n";
+    m_out << "        if (" << call_expr << ")\n            return 1;\n";
+    if (!type.outputs.empty())
+        m_out << "        " << s(instr.dst) << " = a[0];\n";
+    m_out << "    }\n";
+    // The memory may have been grown by the called function.
+    reload_memory();
+}
+
+std::string CTranslator::memory_access(const RegInstr& instr, uint64_t size)
+{
+    // Addressing is 32-bit, but the sum is 64-bit to detect overflows.
+    trap_if("(uint64_t)" + u32(instr.a) + " + " + constant(instr.imm + size) + " > mem_size");
+    return "mem + " + u32(instr.a) + " + " + constant(instr.imm);
+}
+
+void CTranslator::translate_instruction(const RegInstr& instr, size_t index)
+{
+    switch (instr.op)
+    {
+    case Instr::unreachable:
+        m_out << "    return 1;\n";
+        break;
+    case Instr::if_:
+        m_out << "    if (" << u32(instr.a) << " == 0)\n        goto L" << instr.imm << ";\n";
+        break;
+    case Instr::br:
+        copy(instr.dst, instr.a);
+        m_out << "    goto L" << instr.imm << ";\n";
+        break;
+    case Instr::br_if:
+        m_out << "    if (" << u32(instr.b) << " != 0)\n    {\n";
+        if (instr.dst != instr.a)
+            m_out << "        " << s(instr.dst) << " = " << s(instr.a) << ";\n";
+        m_out << "        goto L" << instr.imm << ";\n    }\n";
+        break;
+    case Instr::br_table:
+    {
+        // The br instructions of the labels follow, the last one is for the default label.
+        m_out << "    switch (" << u32(instr.a) << ")\n    {\n";
+        for (size_t i = 0; i < instr.b; ++i)
+            m_out << "    case " << i << ":\n        goto L" << index + 1 + i << ";\n";
+        m_out << "    default:\n        goto L" << index + 1 + instr.b << ";\n    }\n";
+        break;
+    }
+    case Instr::return_:
+        if (instr.b != 0)
+            m_out << "    args[0] = " << s(instr.a) << ";\n";
+        m_out << "    return 0;\n";
+        break;
+    case Instr::call:
+    {
+        const auto func_idx = static_cast<FuncIdx>(instr.imm);
+        const auto& type = function_type(m_module, func_idx);
+        if (func_idx < m_module.imported_function_types.size())
+            call(instr, type, "ctx->call_imported(ctx, " + std::to_string(func_idx) + ", a)");
+        else
+            call(instr, type, "fizzy_call(ctx, f" + std::to_string(func_idx) + ", a)");
+        break;
+    }
+    case Instr::call_indirect:
+        call(instr, m_module.typesec[instr.imm],
+            "ctx->call_indirect(ctx, " + u32(instr.a) + ", " + std::to_string(instr.imm) + ", a)");
+        break;
+    case Instr::select:
+        assign(instr, u32(instr.imm) + " != 0 ? " + s(instr.a) + " : " + s(instr.b));
+        break;
+    case Instr::local_get:
+        copy(instr.dst, instr.a);
+        break;
+    case Instr::global_get:
+    case Instr::global_set:
+    {
+        const auto num_imported_globals = m_module.imported_globals_mutability.size();
+        const auto global =
+            instr.imm < num_imported_globals ?
+                "*ctx->imported_globals[" + std::to_string(instr.imm) + "].value" :
+                "ctx->globals[" + std::to_string(instr.imm - num_imported_globals) + "]";
+        if (instr.op == Instr::global_get)
+            assign(instr, global);
+        else
+            m_out << "    " << global << " = " << s(instr.a) << ";\n";
+        break;
+    }
+    case Instr::i32_load:
+    case Instr::i64_load32_u:
+        assign(instr, "fizzy_load_u32(" + memory_access(instr, 4) + ")");
+        break;
+    case Instr::i64_load:
+        assign(instr, "fizzy_load_u64(" + memory_access(instr, 8) + ")");
+        break;
+    case Instr::i32_load8_s:
+        assign(instr, "(uint32_t)(int8_t)*(" + memory_access(instr, 1) + ")");
+        break;
+    case Instr::i32_load8_u:
+    case Instr::i64_load8_u:
+        assign(instr, "*(" + memory_access(instr, 1) + ")");
+        break;
+    case Instr::i32_load16_s:
+        assign(instr, "(uint32_t)(int16_t)fizzy_load_u16(" + memory_access(instr, 2) + ")");
+        break;
+    case Instr::i32_load16_u:
+    case Instr::i64_load16_u:
+        assign(instr, "fizzy_load_u16(" + memory_access(instr, 2) + ")");
+        break;
+    case Instr::i64_load8_s:
+        assign(instr, "(uint64_t)(int8_t)*(" + memory_access(instr, 1) + ")");
+        break;
+    case Instr::i64_load16_s:
+        assign(instr, "(uint64_t)(int16_t)fizzy_load_u16(" + memory_access(instr, 2) + ")");
+        break;
+    case Instr::i64_load32_s:
+        assign(instr, "(uint64_t)(int32_t)fizzy_load_u32(" + memory_access(instr, 4) + ")");
+        break;
+    case Instr::i32_store:
+    case Instr::i64_store32:
+        store(instr, 4, "fizzy_store_u32", u32(instr.b));
+        break;
+    case Instr::i64_store:
+        store(instr, 8, "fizzy_store_u64", s(instr.b));
+        break;
+    case Instr::i32_store8:
+    case Instr::i64_store8:
+    {
+        const auto ptr = memory_access(instr, 1);
+        m_out << "    *(" << ptr << ") = (uint8_t)" << s(instr.b) << ";\n";
+        break;
+    }
+    case Instr::i32_store16:
+    case Instr::i64_store16:
+        store(instr, 2, "fizzy_store_u16", "(uint16_t)" + s(instr.b));
+        break;
+    case Instr::memory_size:
+        assign(instr, "(uint32_t)(mem_size / " + std::to_string(PageSize) + ")");
+        break;
+    case Instr::memory_grow:
+        assign(instr, "ctx->memory_grow(ctx, " + u32(instr.a) + ")");
+        reload_memory();
+        break;
+    case Instr::i32_const:
+    case Instr::i64_const:
+        assign(instr, constant(instr.imm));
+        break;
+    case Instr::i32_eqz:
+        assign(instr, u32(instr.a) + " == 0");
+        break;
+    case Instr::i32_eq:
+        compare(instr, u32, "==");
+        break;
+    case Instr::i32_ne:
+        compare(instr, u32, "!=");
+        break;
+    case Instr::i32_lt_s:
+        compare(instr, i32, "<");
+        break;
+    case Instr::i32_lt_u:
+        compare(instr, u32, "<");
+        break;
+    case Instr::i32_gt_s:
+        compare(instr, i32, ">");
+        break;
+    case Instr::i32_gt_u:
+        compare(instr, u32, ">");
+        break;
+    case Instr::i32_le_s:
+        compare(instr, i32, "<=");
+        break;
+    case Instr::i32_le_u:
+        compare(instr, u32, "<=");
+        break;
+    case Instr::i32_ge_s:
+        compare(instr, i32, ">=");
+        break;
+    case Instr::i32_ge_u:
+        compare(instr, u32, ">=");
+        break;
+    case Instr::i64_eqz:
+        assign(instr, s(instr.a) + " == 0");
+        break;
+    case Instr::i64_eq:
+        compare(instr, s, "==");
+        break;
+    case Instr::i64_ne:
+        compare(instr, s, "!=");
+        break;
+    case Instr::i64_lt_s:
+        compare(instr, i64, "<");
+        break;
+    case Instr::i64_lt_u:
+        compare(instr, s, "<");
+        break;
+    case Instr::i64_gt_s:
+        compare(instr, i64, ">");
+        break;
+    case Instr::i64_gt_u:
+        compare(instr, s, ">");
+        break;
+    case Instr::i64_le_s:
+        compare(instr, i64, "<=");
+        break;
+    case Instr::i64_le_u:
+        compare(instr, s, "<=");
+        break;
+    case Instr::i64_ge_s:
+        compare(instr, i64, ">=");
+        break;
+    case Instr::i64_ge_u:
+        compare(instr, s, ">=");
+        break;
+    case Instr::i32_clz:
+        assign(instr, "fizzy_clz32(" + u32(instr.a) + ")");
+        break;
+    case Instr::i32_ctz:
+        assign(instr, "fizzy_ctz32(" + u32(instr.a) + ")");
+        break;
+    case Instr::i32_popcnt:
+        assign(instr, "fizzy_popcnt64(" + u32(instr.a) + ")");
+        break;
+    case Instr::i32_add:
+        i32_binary(instr, "+");
+        break;
+    case Instr::i32_sub:
+        i32_binary(instr, "-");
+        break;
+    case Instr::i32_mul:
+        i32_binary(instr, "*");
+        break;
+    case Instr::i32_div_s:
+        trap_if(u32(instr.b) + " == 0 || (" + i32(instr.a) + " == INT32_MIN && " + i32(instr.b) +
+                " == -1)");
+        assign(instr, "(uint32_t)(" + i32(instr.a) + " / " + i32(instr.b) + ")");
+        break;
+    case Instr::i32_div_u:
+        trap_if(u32(instr.b) + " == 0");
+        i32_binary(instr, "/");
+        break;
+    case Instr::i32_rem_s:
+        // The remainder of the division of the minimum value by -1 is 0, but overflows in C.
+        trap_if(u32(instr.b) + " == 0");
+        assign(instr, i32(instr.b) + " == -1 ? 0 : (uint32_t)(" + i32(instr.a) + " % " +
+                          i32(instr.b) + ")");
+        break;
+    case Instr::i32_rem_u:
+        trap_if(u32(instr.b) + " == 0");
+        i32_binary(instr, "%");
+        break;
+    case Instr::i32_and:
+        i32_binary(instr, "&");
+        break;
+    case Instr::i32_or:
+        i32_binary(instr, "|");
+        break;
+    case Instr::i32_xor:
+        i32_binary(instr, "^");
+        break;
+    case Instr::i32_shl:
+        assign(instr, "(uint32_t)(" + u32(instr.a) + " << (" + s(instr.b) + " & 31))");
+        break;
+    case Instr::i32_shr_s:
+        assign(instr, "(uint32_t)(" + i32(instr.a) + " >> (" + s(instr.b) + " & 31))");
+        break;
+    case Instr::i32_shr_u:
+        assign(instr, u32(instr.a) + " >> (" + s(instr.b) + " & 31)");
+        break;
+    case Instr::i32_rotl:
+        assign(instr, "fizzy_rotl32(" + u32(instr.a) + ", " + s(instr.b) + ")");
+        break;
+    case Instr::i32_rotr:
+        assign(instr, "fizzy_rotr32(" + u32(instr.a) + ", " + s(instr.b) + ")");
+        break;
+    case Instr::i64_clz:
+        assign(instr, "fizzy_clz64(" + s(instr.a) + ")");
+        break;
+    case Instr::i64_ctz:
+        assign(instr, "fizzy_ctz64(" + s(instr.a) + ")");
+        break;
+    case Instr::i64_popcnt:
+        assign(instr, "fizzy_popcnt64(" + s(instr.a) + ")");
+        break;
+    case Instr::i64_add:
+        i64_binary(instr, "+");
+        break;
+    case Instr::i64_sub:
+        i64_binary(instr, "-");
+        break;
+    case Instr::i64_mul:
+        i64_binary(instr, "*");
+        break;
+    case Instr::i64_div_s:
+        trap_if(s(instr.b) + " == 0 || (" + i64(instr.a) + " == INT64_MIN && " + i64(instr.b) +
+                " == -1)");
+        assign(instr, "(uint64_t)(" + i64(instr.a) + " / " + i64(instr.b) + ")");
+        break;
+    case Instr::i64_div_u:
+        trap_if(s(instr.b) + " == 0");
+        i64_binary(instr, "/");
+        break;
+    case Instr::i64_rem_s:
+        trap_if(s(instr.b) + " == 0");
+        assign(instr, i64(instr.b) + " == -1 ? 0 : (uint64_t)(" + i64(instr.a) + " % " +
+                          i64(instr.b) + ")");
+        break;
+    case Instr::i64_rem_u:
+        trap_if(s(instr.b) + " == 0");
+        i64_binary(instr, "%");
+        break;
+    case Instr::i64_and:
+        i64_binary(instr, "&");
+        break;
+    case Instr::i64_or:
+        i64_binary(instr, "|");
+        break;
+    case Instr::i64_xor:
+        i64_binary(instr, "^");
+        break;
+    case Instr::i64_shl:
+        assign(instr, s(instr.a) + " << (" + s(instr.b) + " & 63)");
+        break;
+    case Instr::i64_shr_s:
+        assign(instr, "(uint64_t)(" + i64(instr.a) + " >> (" + s(instr.b) + " & 63))");
+        break;
+    case Instr::i64_shr_u:
+        assign(instr, s(instr.a) + " >> (" + s(instr.b) + " & 63)");
+        break;
+    case Instr::i64_rotl:
+        assign(instr, "fizzy_rotl64(" + s(instr.a) + ", " + s(instr.b) + ")");
+        break;
+    case Instr::i64_rotr:
+        assign(instr, "fizzy_rotr64(" + s(instr.a) + ", " + s(instr.b) + ")");
+        break;
+    case Instr::i32_wrap_i64:
+        assign(instr, u32(instr.a));
+        break;
+    case Instr::i64_extend_i32_s:
+        assign(instr, "(uint64_t)(int64_t)" + i32(instr.a));
+        break;
+    case superinstr::i32_add_imm:
+        assign(instr, "(uint32_t)(" + u32(instr.a) + " + " + constant(instr.imm) + ")");
+        break;
+    case superinstr::i64_and_imm:
+        assign(instr, s(instr.a) + " & " + constant(instr.imm));
+        break;
+    case superinstr::i64_shr_u_imm:
+        assign(instr, s(instr.a) + " >> " + std::to_string(instr.imm & 63));
+        break;
+    case Instr::f32_eq:
+        float_compare(instr, false, "==");
+        break;
+    case Instr::f32_ne:
+        float_compare(instr, false, "!=");
+        break;
+    case Instr::f32_lt:
+        float_compare(instr, false, "<");
+        break;
+    case Instr::f32_gt:
+        float_compare(instr, false, ">");
+        break;
+    case Instr::f32_le:
+        float_compare(instr, false, "<=");
+        break;
+    case Instr::f32_ge:
+        float_compare(instr, false, ">=");
+        break;
+    case Instr::f64_eq:
+        float_compare(instr, true, "==");
+        break;
+    case Instr::f64_ne:
+        float_compare(instr, true, "!=");
+        break;
+    case Instr::f64_lt:
+        float_compare(instr, true, "<");
+        break;
+    case Instr::f64_gt:
+        float_compare(instr, true, ">");
+        break;
+    case Instr::f64_le:
+        float_compare(instr, true, "<=");
+        break;
+    case Instr::f64_ge:
+        float_compare(instr, true, ">=");
+        break;
+    case Instr::f32_abs:
+        assign(instr, s(instr.a) + " & UINT64_C(0x7fffffff)");
+        break;
+    case Instr::f32_neg:
+        assign(instr, s(instr.a) + " ^ UINT64_C(0x80000000)");
+        break;
+    case Instr::f32_ceil:
+        float_unary(instr, false, "ceil");
+        break;
+    case Instr::f32_floor:
+        float_unary(instr, false, "floor");
+        break;
+    case Instr::f32_trunc:
+        float_unary(instr, false, "trunc");
+        break;
+    case Instr::f32_nearest:
+        float_unary(instr, false, "nearbyint");
+        break;
+    case Instr::f32_sqrt:
+        float_unary(instr, false, "sqrt");
+        break;
+    case Instr::f32_add:
+        float_binary(instr, false, "+");
+        break;
+    case Instr::f32_sub:
+        float_binary(instr, false, "-");
+        break;
+    case Instr::f32_mul:
+        float_binary(instr, false, "*");
+        break;
+    case Instr::f32_div:
+        float_binary(instr, false, "/");
+        break;
+    case Instr::f32_min:
+        float_call(instr, false, "fizzy_f32_min");
+        break;
+    case Instr::f32_max:
+        float_call(instr, false, "fizzy_f32_max");
+        break;
+    case Instr::f32_copysign:
+        assign(instr, "(" + s(instr.a) + " & UINT64_C(0x7fffffff)) | (" + s(instr.b) +
+                          " & UINT64_C(0x80000000))");
+        break;
+    case Instr::f64_abs:
+        assign(instr, s(instr.a) + " & UINT64_C(0x7fffffffffffffff)");
+        break;
+    case Instr::f64_neg:
+        assign(instr, s(instr.a) + " ^ UINT64_C(0x8000000000000000)");
+        break;
+    case Instr::f64_ceil:
+        float_unary(instr, true, "ceil");
+        break;
+    case Instr::f64_floor:
+        float_unary(instr, true, "floor");
+        break;
+    case Instr::f64_trunc:
+        float_unary(instr, true, "trunc");
+        break;
+    case Instr::f64_nearest:
+        float_unary(instr, true, "nearbyint");
+        break;
+    case Instr::f64_sqrt:
+        float_unary(instr, true, "sqrt");
+        break;
+    case Instr::f64_add:
+        float_binary(instr, true, "+");
+        break;
+    case Instr::f64_sub:
+        float_binary(instr, true, "-");
+        break;
+    case Instr::f64_mul:
+        float_binary(instr, true, "*");
+        break;
+    case Instr::f64_div:
+        float_binary(instr, true, "/");
+        break;
+    case Instr::f64_min:
+        float_call(instr, true, "fizzy_f64_min");
+        break;
+    case Instr::f64_max:
+        float_call(instr, true, "fizzy_f64_max");
+        break;
+    case Instr::f64_copysign:
+        assign(instr, "(" + s(instr.a) + " & UINT64_C(0x7fffffffffffffff)) | (" + s(instr.b) +
+                          " & UINT64_C(0x8000000000000000))");
+        break;
+    case Instr::i32_trunc_f32_s:
+        trunc(instr, false, "fizzy_i32_trunc_f32_s");
+        break;
+    case Instr::i32_trunc_f32_u:
+        trunc(instr, false, "fizzy_i32_trunc_f32_u");
+        break;
+    case Instr::i32_trunc_f64_s:
+        trunc(instr, true, "fizzy_i32_trunc_f64_s");
+        break;
+    case Instr::i32_trunc_f64_u:
+        trunc(instr, true, "fizzy_i32_trunc_f64_u");
+        break;
+    case Instr::i64_trunc_f32_s:
+        trunc(instr, false, "fizzy_i64_trunc_f32_s");
+        break;
+    case Instr::i64_trunc_f32_u:
+        trunc(instr, false, "fizzy_i64_trunc_f32_u");
+        break;
+    case Instr::i64_trunc_f64_s:
+        trunc(instr, true, "fizzy_i64_trunc_f64_s");
+        break;
+    case Instr::i64_trunc_f64_u:
+        trunc(instr, true, "fizzy_i64_trunc_f64_u");
+        break;
+    case Instr::f32_convert_i32_s:
+        float_assign(instr, false, "(float)" + i32(instr.a));
+        break;
+    case Instr::f32_convert_i32_u:
+        float_assign(instr, false, "(float)" + u32(instr.a));
+        break;
+    case Instr::f32_convert_i64_s:
+        float_assign(instr, false, "(float)" + i64(instr.a));
+        break;
+    case Instr::f32_convert_i64_u:
+        float_assign(instr, false, "(float)" + s(instr.a));
+        break;
+    case Instr::f32_demote_f64:
+        float_assign(instr, false, "(float)" + f(true, instr.a));
+        break;
+    case Instr::f64_convert_i32_s:
+        float_assign(instr, true, "(double)" + i32(instr.a));
+        break;
+    case Instr::f64_convert_i32_u:
+        float_assign(instr, true, "(double)" + u32(instr.a));
+        break;
+    case Instr::f64_convert_i64_s:
+        float_assign(instr, true, "(double)" + i64(instr.a));
+        break;
+    case Instr::f64_convert_i64_u:
+        float_assign(instr, true, "(double)" + s(instr.a));
+        break;
+    case Instr::f64_promote_f32:
+        float_assign(instr, true, "(double)" + f(false, instr.a));
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+/// The execution context of the generated code, starting with the FizzyAotContext
+/// of the generated C source.
+struct AotContext
+{
+    uint8_t* memory_data = nullptr;
+    uint64_t memory_size = 0;
+    uint64_t* globals = nullptr;
+    ExternalGlobal* imported_globals = nullptr;
+    int32_t depth = 0;
+    int (*call_imported)(AotContext* context, uint32_t func_idx, uint64_t* args) = nullptr;
+    int (*call_indirect)(
+        AotContext* context, uint32_t elem_idx, uint32_t type_idx, uint64_t* args) = nullptr;
+    uint32_t (*memory_grow)(AotContext* context, uint32_t delta) = nullptr;
+
+    // The fields not accessed by the generated code.
+    Instance* instance = nullptr;
+    const AotCode* code = nullptr;
+    /// The exception thrown by a host function, to be rethrown after the generated code returns.
+    /// The exceptions must not be propagated through the frames of the generated code.
+    std::exception_ptr exception;
+};
+
+using AotFunction = int (*)(AotContext* context, uint64_t* args);
+
+void update_memory(AotContext& context) noexcept
+{
+    auto* const memory = context.instance->memory.get();
+    context.memory_data = memory != nullptr ? memory->data() : nullptr;
+    context.memory_size = memory != nullptr ? memory->size() : 0;
+}
+}  // namespace
+
+class AotCode
+{
+    void* m_handle = nullptr;
+    const AotFunction* m_functions = nullptr;
+
+public:
+    AotCode(const std::string& path, const Module& module);
+    ~AotCode();
+
+    AotCode(const AotCode&) = delete;
+    AotCode& operator=(const AotCode&) = delete;
+
+    /// Returns the function of the given index in the module's code section.
+    AotFunction function(size_t code_idx) const noexcept { return m_functions[code_idx]; }
+};
+
+namespace
+{
+/// Calls the function outside of the generated code, see invoke_external_function().
+int call_external(AotContext& context, const ExternalFunction& func, uint64_t* args) noexcept
+{
+    bool ok = false;
+    try
+    {
+        ok = invoke_external_function(func, *context.instance, args, context.depth);
+    }
+    catch (...)
+    {
+        context.exception = std::current_exception();
+    }
+    // The memory may have been grown by the called function.
+    update_memory(context);
+    return ok ? 0 : 1;
+}
+
+int call_imported(AotContext* context, uint32_t func_idx, uint64_t* args) noexcept
+{
+    return call_external(*context, context->instance->imported_functions[func_idx], args);
+}
+
+int call_indirect(
+    AotContext* context, uint32_t elem_idx, uint32_t type_idx, uint64_t* args) noexcept
+{
+    auto& instance = *context->instance;
+    assert(instance.table != nullptr);
+
+    if (elem_idx >= instance.table->size())
+        return 1;
+
+    const auto& called_func = (*instance.table)[elem_idx];
+    if (!called_func.has_value())
+        return 1;
+
+    // check actual type against expected type
+    if (called_func->type_id != instance.type_ids[type_idx])
+        return 1;
+
+    // The function of this instance is called directly in the generated code.
+    if (called_func->instance == &instance)
+    {
+        if (context->depth >= CallStackLimit)
+            return 1;
+
+        const auto code_idx = called_func->func_idx - instance.imported_functions.size();
+        ++context->depth;
+        const auto trapped = context->code->function(code_idx)(context, args);
+        --context->depth;
+        return trapped;
+    }
+
+    return call_external(*context, *called_func, args);
+}
+
+uint32_t memory_grow(AotContext* context, uint32_t delta) noexcept
+{
+    auto& instance = *context->instance;
+    const auto ret = instance.memory->grow_pages(delta, instance.memory_max_pages);
+    update_memory(*context);
+    return ret;
+}
+}  // namespace
+
+#if defined(__unix__) || defined(__APPLE__)
+AotCode::AotCode(const std::string& path, const Module& module)
+{
+    m_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (m_handle == nullptr)
+        throw std::runtime_error{"Cannot load " + path + ": " + dlerror()};
+
+    const auto* const abi_version =
+        static_cast<const uint32_t*>(dlsym(m_handle, "fizzy_aot_abi_version"));
+    const auto* const num_functions =
+        static_cast<const uint32_t*>(dlsym(m_handle, "fizzy_aot_num_functions"));
+    m_functions = static_cast<const AotFunction*>(dlsym(m_handle, "fizzy_aot_functions"));
+    if (abi_version == nullptr || *abi_version != AotAbiVersion || num_functions == nullptr ||
+        *num_functions != module.funcsec.size() || m_functions == nullptr)
+    {
+        dlclose(m_handle);
+        throw std::runtime_error{path + " does not match the module"};
+    }
+}
+
+AotCode::~AotCode()
+{
+    dlclose(m_handle);
+}
+#else
+AotCode::AotCode(const std::string&, const Module&)
+{
+    throw std::runtime_error{"Loading shared objects is not supported on this platform"};
+}
+
+AotCode::~AotCode() = default;
+#endif
+
+std::string translate_to_c(const Module& module)
+{
+    const auto code = translate_to_register_ir(module);
+    const auto num_imported_functions = module.imported_function_types.size();
+
+    std::ostringstream out;
+    out << "#define FIZZY_CALL_STACK_LIMIT " << CallStackLimit << "\n";
+    out << c_prelude;
+
+    for (size_t i = 0; i < code.size(); ++i)
+        out << "\nstatic int f" << num_imported_functions + i
+            << "(FizzyAotContext* ctx, uint64_t* args);";
+    out << "\n";
+
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        CTranslator{module, code[i], out}.translate(
+            static_cast<FuncIdx>(num_imported_functions + i));
+    }
+
+    out << "\nconst uint32_t fizzy_aot_abi_version = " << AotAbiVersion << ";\n";
+    out << "const uint32_t fizzy_aot_num_functions = " << code.size() << ";\n";
+    out << "const FizzyAotFunction fizzy_aot_functions[] = {";
+    for (size_t i = 0; i < code.size(); ++i)
+        out << (i != 0 ? ", " : "") << "f" << num_imported_functions + i;
+    if (code.empty())
+        out << "0";
+    out << "};\n";
+    return out.str();
+}
+
+std::shared_ptr<const AotCode> load_aot(const std::string& path, const Module& module)
+{
+    return std::make_shared<AotCode>(path, module);
+}
+
+ExecutionResult execute_aot(Instance& instance, const AotCode& code, FuncIdx func_idx,
+    span<const uint64_t> args, int depth)
+{
+    assert(depth >= 0 && depth <= CallStackLimit);
+    const auto num_imported_functions = instance.imported_functions.size();
+    assert(func_idx >= num_imported_functions);
+    const auto code_idx = func_idx - num_imported_functions;
+    const auto type_idx = instance.module->funcsec[code_idx];
+    const auto has_result = !instance.module->typesec[type_idx].outputs.empty();
+
+    AotContext context;
+    context.globals = instance.globals.data();
+    context.imported_globals = instance.imported_globals.data();
+    context.depth = depth;
+    context.call_imported = call_imported;
+    context.call_indirect = call_indirect;
+    context.memory_grow = memory_grow;
+    context.instance = &instance;
+    context.code = &code;
+    update_memory(context);
+
+    // The arguments array receives the result, so it has at least 1 item.
+    constexpr size_t NumInlineArgs = 8;
+    uint64_t inline_args[NumInlineArgs]{};
+    std::vector<uint64_t> heap_args;
+    uint64_t* call_args = inline_args;
+    if (args.size() > NumInlineArgs)
+    {
+        heap_args.resize(args.size());
+        call_args = heap_args.data();
+    }
+    std::copy(args.begin(), args.end(), call_args);
+
+    const auto trapped = code.function(code_idx)(&context, call_args) != 0;
+
+    if (context.exception)
+        std::rethrow_exception(context.exception);
+
+    if (trapped)
+        return {true, {}};
+    return {false, has_result ? call_args[0] : std::optional<uint64_t>{}};
+}
+}  // namespace fizzy
+
+#pragma GCC diagnostic pop
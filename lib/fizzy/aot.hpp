@@ -0,0 +1,49 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "execute.hpp"
+#include "types.hpp"
+#include <memory>
+#include <string>
+
+namespace fizzy
+{
+/// The functions of a module translated ahead of time to C by translate_to_c(), compiled to
+/// a shared object with the system C compiler and loaded with load_aot().
+class AotCode;
+
+/// Translates the functions defined in the module to the portable C source.
+///
+/// Each wasm function becomes a C function operating on the C local variables, one for each
+/// frame slot of the function's register IR (see translate_to_register_ir()). The memory,
+/// globals, table and imported functions are accessed through the context provided by fizzy
+/// at execution, so the compiled code shares the Instance with the interpreter. The traps are
+/// reported the same way as by the interpreter. The floating point instructions use the C float
+/// and double arithmetic and the math library.
+///
+/// The module is expected to be validated, i.e. to come from parse().
+/// The source is to be compiled as the shared object, e.g.
+/// `cc -O2 -shared -fPIC module.c -o module.so -lm`.
+std::string translate_to_c(const Module& module);
+
+/// Loads the shared object compiled from the C source produced by translate_to_c() for the module.
+///
+/// The returned code is to be set as the aot_code of the module's instances, so that execute()
+/// dispatches the calls of the module's functions into it.
+///
+/// @throws std::runtime_error  if the shared object cannot be loaded or it does not match
+///                             the module.
+std::shared_ptr<const AotCode> load_aot(const std::string& path, const Module& module);
+
+/// Executes the function defined in the instance's module in the loaded code.
+///
+/// This is used by execute() for the instances having the aot_code set.
+///
+/// @param code      The code loaded by load_aot() for the instance's module.
+/// @param func_idx  The index of the function defined in the module, not imported.
+ExecutionResult execute_aot(Instance& instance, const AotCode& code, FuncIdx func_idx,
+    span<const uint64_t> args, int depth);
+}  // namespace fizzy
@@ -3,27 +3,182 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "execute.hpp"
+#include "aot.hpp"
+#include "instructions.hpp"
+#include "jit.hpp"
 #include "limits.hpp"
+#include "numeric.hpp"
+#include "parser.hpp"
 #include "stack.hpp"
 #include "types.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cstring>
-#include <stack>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace fizzy
 {
 namespace
 {
-struct LabelContext
+/// The call frame of a function defined in the module.
+///
+/// A call frame does not own any memory. Its locals (arguments included) are placed directly
+/// on the value stack and are followed by the frame's operands. The frame is identified only by
+/// the offset of its locals, so wasm-to-wasm calls do not allocate.
+struct Frame
 {
-    const Instr* pc = nullptr;           ///< The jump target instruction.
-    const uint8_t* immediate = nullptr;  ///< The jump target immediate pointer.
-    size_t arity = 0;                    ///< The type arity of the label instruction.
-    size_t stack_height = 0;             ///< The stack height at the label instruction.
+    const Code* code = nullptr;           ///< The code of the function.
+    const Instr* pc = nullptr;            ///< The instruction to resume from after a call.
+    const uint8_t* immediates = nullptr;  ///< The immediate pointer to resume from after a call.
+    size_t locals_base = 0;               ///< The value stack offset of the first local.
+    size_t num_locals = 0;                ///< The number of locals, arguments included.
 };
 
-using LabelStack = std::stack<LabelContext, std::vector<LabelContext>>;
+/// The execution state shared by all call frames of a single execute() invocation.
+struct ExecutionContext
+{
+    /// The value stack memory of all frames: locals followed by operands of each frame.
+    ///
+    /// During the execution the size of the vector is the capacity of the value stack, reserved
+    /// by each frame entry for the frame's locals and maximum operand stack height. The value
+    /// stack itself is tracked by CachedStack.
+    Stack<uint64_t> stack;
+
+    /// The frames of the calling functions suspended until the callee returns.
+    Stack<Frame> frames;
+};
+
+/// The value stack with the top item cached in a variable.
+///
+/// The top item is kept outside of the stack memory, so the compiler can keep it in a register:
+/// the unary instructions do not access the stack memory and the binary instructions only read
+/// their first operand from it. The stack memory holds all the items below the top item,
+/// the locals of all frames included.
+///
+/// The stack memory is not owned and its capacity is not checked: the space is reserved
+/// in advance for the whole frame, see enter_frame().
+class CachedStack
+{
+    uint64_t* m_bottom = nullptr;
+    uint64_t* m_end = nullptr;  ///< The end of the items in the stack memory.
+    uint64_t m_top = 0;
+
+public:
+    CachedStack(uint64_t* bottom, size_t size) noexcept : m_bottom{bottom}, m_end{bottom + size} {}
+
+    /// The number of items in the stack memory (the top item excluded).
+    size_t size() const noexcept { return static_cast<size_t>(m_end - m_bottom); }
+
+    /// The stack memory.
+    uint64_t* data() noexcept { return m_bottom; }
+
+    /// Changes the number of items in the stack memory. The new items are not initialized.
+    void resize(size_t size) noexcept { m_end = m_bottom + size; }
+
+    /// Moves the stack to the new memory, where the items have been copied to.
+    void rebase(uint64_t* bottom) noexcept
+    {
+        m_end = bottom + size();
+        m_bottom = bottom;
+    }
+
+    uint64_t& top() noexcept { return m_top; }
+
+    void push(uint64_t value) noexcept
+    {
+        *m_end++ = m_top;
+        m_top = value;
+    }
+
+    uint64_t pop() noexcept
+    {
+        const auto value = m_top;
+        m_top = *--m_end;
+        return value;
+    }
+
+    uint64_t peek(size_t depth = 0) const noexcept { return depth == 0 ? m_top : m_end[-depth]; }
+
+    /// Drops @a num_elements elements from the top of the stack.
+    void drop(size_t num_elements = 1) noexcept
+    {
+        if (num_elements == 0)
+            return;
+        m_top = m_end[-static_cast<ptrdiff_t>(num_elements)];
+        m_end -= num_elements;
+    }
+
+    /// Drops @a num_elements elements below the top item.
+    void drop_below_top(size_t num_elements) noexcept { m_end -= num_elements; }
+
+    /// Moves the top item to the stack memory, so the memory holds the entire stack,
+    /// e.g. for the function call arguments to be accessible in the memory.
+    void spill() noexcept { *m_end++ = m_top; }
+
+    /// Takes the top item back from the stack memory, the reverse of spill().
+    void fill() noexcept { m_top = *--m_end; }
+};
+
+/// The registry of the canonical function type ids of the process.
+class CanonicalTypeRegistry
+{
+    std::mutex m_mutex;
+
+    /// The canonical ids by the function type encoded as the string of input and output types.
+    std::unordered_map<std::string, CanonicalTypeId> m_ids;
+
+    static std::string make_key(const FuncType& type)
+    {
+        std::string key;
+        key.reserve(type.inputs.size() + 1 + type.outputs.size());
+        for (const auto t : type.inputs)
+            key.push_back(static_cast<char>(t));
+        key.push_back('\0');  // ValType values are never 0.
+        for (const auto t : type.outputs)
+            key.push_back(static_cast<char>(t));
+        return key;
+    }
+
+    /// Returns the id of the type of the key, must be called with the mutex locked.
+    CanonicalTypeId get_locked(std::string key)
+    {
+        const auto new_id = static_cast<CanonicalTypeId>(m_ids.size() + 1);
+        return m_ids.try_emplace(std::move(key), new_id).first->second;
+    }
+
+public:
+    CanonicalTypeId get(const FuncType& type)
+    {
+        auto key = make_key(type);
+        const std::lock_guard lock{m_mutex};
+        return get_locked(std::move(key));
+    }
+
+    /// Returns the ids of the types, locking the mutex once.
+    std::vector<CanonicalTypeId> get(const std::vector<FuncType>& types)
+    {
+        std::vector<std::string> keys;
+        keys.reserve(types.size());
+        for (const auto& type : types)
+            keys.emplace_back(make_key(type));
+
+        std::vector<CanonicalTypeId> ids;
+        ids.reserve(types.size());
+        const std::lock_guard lock{m_mutex};
+        for (auto& key : keys)
+            ids.push_back(get_locked(std::move(key)));
+        return ids;
+    }
+};
+
+CanonicalTypeRegistry& type_registry()
+{
+    static CanonicalTypeRegistry registry;
+    return registry;
+}
 
 inline bool operator==(const FuncType& lhs, const FuncType& rhs)
 {
@@ -172,16 +327,25 @@ table_ptr allocate_table(
     if (module_tables.size() == 1)
         return {new table_elements(module_tables[0].limits.min), table_delete};
     else if (imported_tables.size() == 1)
+    {
+        // The elements placed in the table by the host get their type ids here, so call_indirect
+        // only compares the ids.
+        for (auto& element : *imported_tables[0].table)
+        {
+            if (element.has_value() && element->type_id == 0)
+                element->type_id = canonical_type_id(element->type);
+        }
         return {imported_tables[0].table, null_delete};
+    }
     else
         return {nullptr, null_delete};
 }
 
-std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_memories,
-    const std::vector<ExternalMemory>& imported_memories)
+std::tuple<memory_ptr, size_t> allocate_memory(const std::vector<Memory>& module_memories,
+    const std::vector<ExternalMemory>& imported_memories, MemoryMode memory_mode)
 {
-    static const auto bytes_delete = [](bytes* b) noexcept { delete b; };
-    static const auto null_delete = [](bytes*) noexcept {};
+    static const auto memory_delete = [](LinearMemory* m) noexcept { delete m; };
+    static const auto null_delete = [](LinearMemory*) noexcept {};
 
     assert(module_memories.size() + imported_memories.size() <= 1);
 
@@ -198,8 +362,11 @@ std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_
                                     std::to_string(MemoryPagesLimit * PageSize) + " bytes.");
         }
 
-        // NOTE: fill it with zeroes
-        bytes_ptr memory{new bytes(memory_min * PageSize, 0), bytes_delete};
+        // NOTE: the memory is not filled here, the pages are zeroed by the kernel on first touch,
+        // so the instantiation only pays for the pages written by the data segments.
+        memory_ptr memory{
+            new LinearMemory(memory_min * PageSize, memory_mode, memory_max * PageSize),
+            memory_delete};
         return {std::move(memory), memory_max};
     }
     else if (imported_memories.size() == 1)
@@ -216,12 +383,13 @@ std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_
                                     std::to_string(MemoryPagesLimit * PageSize) + " bytes.");
         }
 
-        bytes_ptr memory{imported_memories[0].data, null_delete};
-        return {std::move(memory), memory_max};
+        // The imported memory cannot grow beyond its own maximum size.
+        memory_ptr memory{imported_memories[0].data, null_delete};
+        return {std::move(memory), std::min(memory_max, memory->max_size() / PageSize)};
     }
     else
     {
-        bytes_ptr memory{nullptr, null_delete};
+        memory_ptr memory{nullptr, null_delete};
         return {std::move(memory), MemoryPagesLimit};
     }
 }
@@ -248,62 +416,123 @@ uint64_t eval_constant_expression(ConstantExpression expr,
         return globals[global_idx - imported_globals.size()];
 }
 
-void branch(uint32_t label_idx, LabelStack& labels, Stack<uint64_t>& stack, const Instr*& pc,
-    const uint8_t*& immediates) noexcept
+const FuncType& function_type(const Instance& instance, FuncIdx idx)
 {
-    assert(labels.size() > label_idx);
-    while (label_idx-- > 0)
-        labels.pop();  // Drop skipped labels (does nothing for labelidx == 0).
-    const auto label = labels.top();
-    labels.pop();
+    assert(idx < instance.imported_functions.size() + instance.module->funcsec.size());
 
-    pc = label.pc;
-    immediates = label.immediate;
+    if (idx < instance.imported_functions.size())
+        return instance.imported_functions[idx].type;
 
-    // When branch is taken, additional stack items must be dropped.
-    assert(stack.size() >= label.stack_height + label.arity);
-    if (label.arity != 0)
-    {
-        assert(label.arity == 1);
-        const auto result = stack.peek();
-        stack.resize(label.stack_height);
-        stack.push(result);
-    }
-    else
-        stack.resize(label.stack_height);
+    const auto type_idx = instance.module->funcsec[idx - instance.imported_functions.size()];
+    assert(type_idx < instance.module->typesec.size());
+
+    return instance.module->typesec[type_idx];
 }
 
-const FuncType& function_type(const Instance& instance, FuncIdx idx)
+CanonicalTypeId function_type_id(const Instance& instance, FuncIdx idx)
 {
-    assert(idx < instance.imported_functions.size() + instance.module.funcsec.size());
+    assert(idx < instance.imported_functions.size() + instance.module->funcsec.size());
 
     if (idx < instance.imported_functions.size())
-        return instance.imported_functions[idx].type;
+        return instance.imported_functions[idx].type_id;
 
-    const auto type_idx = instance.module.funcsec[idx - instance.imported_functions.size()];
-    assert(type_idx < instance.module.typesec.size());
+    const auto type_idx = instance.module->funcsec[idx - instance.imported_functions.size()];
+    assert(type_idx < instance.type_ids.size());
 
-    return instance.module.typesec[type_idx];
+    return instance.type_ids[type_idx];
 }
 
-template <class F>
+/// Returns the table element of the function of the given index of the instance.
+ExternalFunction table_function(Instance& instance, FuncIdx idx)
+{
+    // The low-level host functions are put in the table directly,
+    // so they are called without allocations also by call_indirect.
+    if (idx < instance.imported_functions.size() &&
+        instance.imported_functions[idx].host_function != nullptr)
+        return instance.imported_functions[idx];
+
+    auto func = [idx, &instance](fizzy::Instance&, std::vector<uint64_t> args, int depth) {
+        return execute(instance, idx, std::move(args), depth);
+    };
+
+    // The functions defined in the module are referenced directly, the interpreter
+    // calls them without the std::function, which is only for the other users of
+    // the table.
+    auto* const func_instance = idx >= instance.imported_functions.size() ? &instance : nullptr;
+
+    return ExternalFunction{std::move(func), function_type(instance, idx), nullptr, nullptr,
+        function_type_id(instance, idx), func_instance, idx};
+}
+
+/// Calls the external function taking the arguments from the top of the value stack and
+/// replacing them with the results.
+///
+/// The memory guard of the caller is suspended, so the faults of the called code (which may keep
+/// C++ objects alive) never jump back to the caller. The calls into the guarded instances install
+/// their own guards.
+///
+/// @return  false if the execution trapped.
 bool invoke_function(
-    const FuncType& func_type, const F& func, Instance& instance, Stack<uint64_t>& stack, int depth)
+    const ExternalFunction& func, Instance& instance, CachedStack& stack, int depth)
 {
-    const auto num_args = func_type.inputs.size();
-    assert(stack.size() >= num_args);
-    std::vector<uint64_t> call_args(stack.end() - static_cast<ptrdiff_t>(num_args), stack.end());
-    stack.resize(stack.size() - num_args);
+    const MemoryGuardSuspension suspension;
 
-    const auto ret = func(instance, std::move(call_args), depth + 1);
+    const auto num_args = func.type.inputs.size();
+    const auto num_outputs = func.type.outputs.size();
+    // NOTE: we can assume this from validation
+    assert(num_outputs <= 1);
+
+    if (func.host_function != nullptr)
+    {
+        // The arguments are passed directly from the stack memory.
+        stack.spill();
+        assert(stack.size() >= num_args);
+        const auto args_base = stack.size() - num_args;
+
+        uint64_t result;
+        if (!func.host_function(func.host_context, instance, {stack.data() + args_base, num_args},
+                {&result, num_outputs}, depth + 1))
+            return false;
+
+        stack.resize(args_base);
+        if (num_outputs != 0)
+            stack.top() = result;
+        else
+            stack.fill();
+        return true;
+    }
+
+    if (func.instance != nullptr)
+    {
+        // The function of another instance, executed with the arguments taken directly
+        // from the stack memory.
+        stack.spill();
+        assert(stack.size() >= num_args);
+        const auto args_base = stack.size() - num_args;
+
+        const auto ret = execute_span(
+            *func.instance, func.func_idx, {stack.data() + args_base, num_args}, depth + 1);
+        if (ret.trapped)
+            return false;
+
+        stack.resize(args_base);
+        if (ret.value.has_value())
+            stack.top() = *ret.value;
+        else
+            stack.fill();
+        return true;
+    }
+
+    std::vector<uint64_t> call_args(num_args);
+    for (auto it = call_args.rbegin(); it != call_args.rend(); ++it)
+        *it = stack.pop();
+
+    const auto ret = func.function(instance, std::move(call_args), depth + 1);
     // Bubble up traps
     if (ret.trapped)
         return false;
 
-    const auto num_outputs = func_type.outputs.size();
-    // NOTE: we can assume these two from validation
     assert(ret.stack.size() == num_outputs);
-    assert(num_outputs <= 1);
     // Push back the result
     if (num_outputs != 0)
         stack.push(ret.stack[0]);
@@ -311,26 +540,17 @@ bool invoke_function(
     return true;
 }
 
-inline bool invoke_function(const FuncType& func_type, uint32_t func_idx, Instance& instance,
-    Stack<uint64_t>& stack, int depth)
-{
-    const auto func = [func_idx](Instance& _instance, std::vector<uint64_t> args, int _depth) {
-        return execute(_instance, func_idx, std::move(args), _depth);
-    };
-    return invoke_function(func_type, func, instance, stack, depth);
-}
-
 template <typename T>
-inline void store(bytes& input, size_t offset, T value) noexcept
+inline void store(uint8_t* input, uint64_t offset, T value) noexcept
 {
-    __builtin_memcpy(input.data() + offset, &value, sizeof(value));
+    __builtin_memcpy(input + offset, &value, sizeof(value));
 }
 
 template <typename T>
-inline T load(bytes_view input, size_t offset) noexcept
+inline T load(const uint8_t* input, uint64_t offset) noexcept
 {
     T ret;
-    __builtin_memcpy(&ret, input.data() + offset, sizeof(ret));
+    __builtin_memcpy(&ret, input + offset, sizeof(ret));
     return ret;
 }
 
@@ -343,180 +563,167 @@ inline T read(const uint8_t*& input) noexcept
     return ret;
 }
 
-template <typename DstT, typename SrcT>
-inline DstT extend(SrcT in) noexcept
+/// The size of the immediates of a branch to a label, resolved by the parser:
+/// the target instruction offset, the target immediates offset, the label arity
+/// and the number of stack items to drop.
+constexpr auto BranchImmediateSize = 4 * sizeof(uint32_t);
+
+void branch(const Code& code, CachedStack& stack, const Instr*& pc,
+    const uint8_t*& immediates) noexcept
 {
-    if constexpr (std::is_signed<SrcT>::value)
+    const auto code_offset = read<uint32_t>(immediates);
+    const auto imm_offset = read<uint32_t>(immediates);
+    const auto arity = read<uint32_t>(immediates);
+    const auto stack_drop = read<uint32_t>(immediates);
+
+    pc = code.instructions.data() + code_offset;
+    immediates = code.immediates.data() + imm_offset;
+
+    // When branch is taken, additional stack items must be dropped.
+    assert(stack.size() + 1 >= stack_drop + arity);
+    if (arity != 0)
     {
-        using SignedDstT = typename std::make_signed<DstT>::type;
-        return static_cast<DstT>(SignedDstT{in});
+        // Drop the items below the result kept in the top item.
+        assert(arity == 1);
+        stack.drop_below_top(stack_drop);
     }
     else
-        return DstT{in};
+        stack.drop(stack_drop);
 }
 
-template <typename DstT, typename SrcT = DstT>
-inline bool load_from_memory(bytes_view memory, Stack<uint64_t>& stack, const uint8_t*& immediates)
+/// Loads from the memory, the Checked variant compares the address with the memory size.
+/// Otherwise the memory must be guarded, where the out-of-bounds accesses fault instead.
+template <bool Checked, typename DstT, typename SrcT = DstT>
+inline bool load_from_memory(
+    const LinearMemory& memory, CachedStack& stack, const uint8_t*& immediates)
 {
-    const auto address = static_cast<uint32_t>(stack.pop());
+    const auto address = static_cast<uint32_t>(stack.top());
     // NOTE: alignment is dropped by the parser
     const auto offset = read<uint32_t>(immediates);
     // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
-    if ((uint64_t{address} + offset + sizeof(SrcT)) > memory.size())
+    const auto effective_address = uint64_t{address} + offset;
+    if (Checked && (effective_address + sizeof(SrcT)) > memory.size())
         return false;
 
-    const auto ret = load<SrcT>(memory, address + offset);
-    stack.push(extend<DstT>(ret));
+    const auto ret = load<SrcT>(memory.data(), effective_address);
+    stack.top() = extend<DstT>(ret);
     return true;
 }
 
-template <typename DstT>
-inline bool store_into_memory(bytes& memory, Stack<uint64_t>& stack, const uint8_t*& immediates)
+/// Stores into the memory, see load_from_memory().
+template <bool Checked, typename DstT>
+inline bool store_into_memory(LinearMemory& memory, CachedStack& stack, const uint8_t*& immediates)
 {
     const auto value = static_cast<DstT>(stack.pop());
     const auto address = static_cast<uint32_t>(stack.pop());
     // NOTE: alignment is dropped by the parser
     const auto offset = read<uint32_t>(immediates);
     // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
-    if ((uint64_t{address} + offset + sizeof(DstT)) > memory.size())
+    const auto effective_address = uint64_t{address} + offset;
+    if (Checked && (effective_address + sizeof(DstT)) > memory.size())
         return false;
 
-    store<DstT>(memory, address + offset, value);
+    store<DstT>(memory.data(), effective_address, value);
     return true;
 }
 
 template <typename Op>
-inline void unary_op(Stack<uint64_t>& stack, Op op) noexcept
+inline void unary_op(CachedStack& stack, Op op) noexcept
 {
-    using T = decltype(op(stack.pop()));
-    const auto a = static_cast<T>(stack.pop());
-    stack.push(op(a));
+    using T = decltype(op(stack.top()));
+    const auto a = from_value<T>(stack.top());
+    stack.top() = to_value(op(a));
 }
 
 template <typename Op>
-inline void binary_op(Stack<uint64_t>& stack, Op op) noexcept
+inline void binary_op(CachedStack& stack, Op op) noexcept
 {
-    using T = decltype(op(stack.pop(), stack.pop()));
-    const auto val2 = static_cast<T>(stack.pop());
-    const auto val1 = static_cast<T>(stack.pop());
-    stack.push(static_cast<std::make_unsigned_t<T>>(op(val1, val2)));
+    using T = decltype(op(stack.top(), stack.top()));
+    const auto val2 = from_value<T>(stack.pop());
+    const auto val1 = from_value<T>(stack.top());
+    stack.top() = to_value(op(val1, val2));
 }
 
 template <typename T, template <typename> class Op>
-inline void comparison_op(Stack<uint64_t>& stack, Op<T> op) noexcept
+inline void comparison_op(CachedStack& stack, Op<T> op) noexcept
 {
-    const auto val2 = static_cast<T>(stack.pop());
-    const auto val1 = static_cast<T>(stack.pop());
-    stack.push(uint32_t{op(val1, val2)});
+    const auto val2 = from_value<T>(stack.pop());
+    const auto val1 = from_value<T>(stack.top());
+    stack.top() = uint32_t{op(val1, val2)};
 }
 
 template <typename T>
-inline T shift_left(T lhs, T rhs) noexcept
+inline void fabs_op(CachedStack& stack) noexcept
 {
-    constexpr T num_bits{sizeof(T) * 8};
-    const auto k = rhs & (num_bits - 1);
-    return lhs << k;
+    stack.top() &= ~uint64_t{SignMask<T>};
 }
 
 template <typename T>
-inline T shift_right(T lhs, T rhs) noexcept
+inline void fneg_op(CachedStack& stack) noexcept
 {
-    constexpr T num_bits{sizeof(T) * 8};
-    const auto k = rhs & (num_bits - 1);
-    return lhs >> k;
+    stack.top() ^= SignMask<T>;
 }
 
 template <typename T>
-inline T rotl(T lhs, T rhs) noexcept
+inline void fcopysign_op(CachedStack& stack) noexcept
 {
-    constexpr T num_bits{sizeof(T) * 8};
-    const auto k = rhs & (num_bits - 1);
-
-    if (k == 0)
-        return lhs;
-
-    return (lhs << k) | (lhs >> (num_bits - k));
+    const auto sign = stack.pop() & SignMask<T>;
+    stack.top() = (stack.top() & ~uint64_t{SignMask<T>}) | sign;
 }
 
-template <typename T>
-inline T rotr(T lhs, T rhs) noexcept
-{
-    constexpr T num_bits{sizeof(T) * 8};
-    const auto k = rhs & (num_bits - 1);
-
-    if (k == 0)
-        return lhs;
-
-    return (lhs >> k) | (lhs << (num_bits - k));
-}
-
-inline uint32_t clz32(uint32_t value) noexcept
+template <typename DstT, typename SrcT>
+inline bool trunc_op(CachedStack& stack) noexcept
 {
-    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
-    if (value == 0)
-        return 32;
-    return static_cast<uint32_t>(__builtin_clz(value));
+    const auto result = trunc<DstT>(from_value<SrcT>(stack.top()));
+    if (!result.has_value())
+        return false;
+    stack.top() = to_value(*result);
+    return true;
 }
 
-inline uint32_t ctz32(uint32_t value) noexcept
+template <typename DstT, typename SrcT>
+inline void convert_op(CachedStack& stack) noexcept
 {
-    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
-    if (value == 0)
-        return 32;
-    return static_cast<uint32_t>(__builtin_ctz(value));
+    stack.top() = to_value(static_cast<DstT>(from_value<SrcT>(stack.top())));
 }
 
-inline uint32_t popcnt32(uint32_t value) noexcept
+std::optional<uint32_t> find_export(const Module& module, ExternalKind kind, std::string_view name)
 {
-    return static_cast<uint32_t>(__builtin_popcount(value));
-}
+    const auto it = std::find_if(module.exportsec.begin(), module.exportsec.end(),
+        [kind, name](const auto& export_) { return export_.kind == kind && export_.name == name; });
 
-inline uint64_t clz64(uint64_t value) noexcept
-{
-    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
-    if (value == 0)
-        return 64;
-    return static_cast<uint64_t>(__builtin_clzll(value));
+    return (it != module.exportsec.end() ? std::make_optional(it->index) : std::nullopt);
 }
 
-inline uint64_t ctz64(uint64_t value) noexcept
-{
-    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
-    if (value == 0)
-        return 64;
-    return static_cast<uint64_t>(__builtin_ctzll(value));
-}
+}  // namespace
 
-inline uint64_t popcnt64(uint64_t value) noexcept
+CanonicalTypeId canonical_type_id(const FuncType& type)
 {
-    return static_cast<uint64_t>(__builtin_popcountll(value));
+    return type_registry().get(type);
 }
 
-std::optional<uint32_t> find_export(const Module& module, ExternalKind kind, std::string_view name)
+std::vector<CanonicalTypeId> canonical_type_ids(const std::vector<FuncType>& types)
 {
-    const auto it = std::find_if(module.exportsec.begin(), module.exportsec.end(),
-        [kind, name](const auto& export_) { return export_.kind == kind && export_.name == name; });
-
-    return (it != module.exportsec.end() ? std::make_optional(it->index) : std::nullopt);
+    return type_registry().get(types);
 }
 
-}  // namespace
-
-std::unique_ptr<Instance> instantiate(Module module,
+std::unique_ptr<Instance> instantiate(std::shared_ptr<const Module> module,
     std::vector<ExternalFunction> imported_functions, std::vector<ExternalTable> imported_tables,
-    std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals)
+    std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals,
+    MemoryMode memory_mode)
 {
-    assert(module.funcsec.size() == module.codesec.size());
+    assert(module != nullptr);
+    assert(module->lazy_code != nullptr || module->funcsec.size() == module->codesec.size());
 
-    match_imported_functions(module.imported_function_types, imported_functions);
-    match_imported_tables(module.imported_table_types, imported_tables);
-    match_imported_memories(module.imported_memory_types, imported_memories);
-    match_imported_globals(module.imported_globals_mutability, imported_globals);
+    match_imported_functions(module->imported_function_types, imported_functions);
+    match_imported_tables(module->imported_table_types, imported_tables);
+    match_imported_memories(module->imported_memory_types, imported_memories);
+    match_imported_globals(module->imported_globals_mutability, imported_globals);
 
     // Init globals
     std::vector<uint64_t> globals;
-    globals.reserve(module.globalsec.size());
-    for (auto const& global : module.globalsec)
+    globals.reserve(module->globalsec.size());
+    for (auto const& global : module->globalsec)
     {
         // Wasm spec section 3.3.7 constrains initialization by another global to const imports only
         // https://webassembly.github.io/spec/core/valid/instructions.html#expressions
@@ -528,23 +735,23 @@ std::unique_ptr<Instance> instantiate(Module module,
         }
 
         const auto value = eval_constant_expression(
-            global.expression, imported_globals, module.globalsec, globals);
+            global.expression, imported_globals, module->globalsec, globals);
         globals.emplace_back(value);
     }
 
-    auto table = allocate_table(module.tablesec, imported_tables);
+    auto table = allocate_table(module->tablesec, imported_tables);
 
     // Allocate memory
-    auto [memory, memory_max] = allocate_memory(module.memorysec, imported_memories);
+    auto [memory, memory_max] = allocate_memory(module->memorysec, imported_memories, memory_mode);
 
     // Before starting to fill memory and table,
     // check that data and element segments are within bounds.
     std::vector<uint64_t> datasec_offsets;
-    datasec_offsets.reserve(module.datasec.size());
-    for (const auto& data : module.datasec)
+    datasec_offsets.reserve(module->datasec.size());
+    for (const auto& data : module->datasec)
     {
         const uint64_t offset =
-            eval_constant_expression(data.offset, imported_globals, module.globalsec, globals);
+            eval_constant_expression(data.offset, imported_globals, module->globalsec, globals);
 
         if (offset + data.init.size() > memory->size())
             throw instantiate_error("Data segment is out of memory bounds");
@@ -552,13 +759,13 @@ std::unique_ptr<Instance> instantiate(Module module,
         datasec_offsets.emplace_back(offset);
     }
 
-    assert(module.elementsec.empty() || table != nullptr);
+    assert(module->elementsec.empty() || table != nullptr);
     std::vector<ptrdiff_t> elementsec_offsets;
-    elementsec_offsets.reserve(module.elementsec.size());
-    for (const auto& element : module.elementsec)
+    elementsec_offsets.reserve(module->elementsec.size());
+    for (const auto& element : module->elementsec)
     {
         const uint64_t offset =
-            eval_constant_expression(element.offset, imported_globals, module.globalsec, globals);
+            eval_constant_expression(element.offset, imported_globals, module->globalsec, globals);
 
         if (offset + element.init.size() > table->size())
             throw instantiate_error("Element segment is out of table bounds");
@@ -567,10 +774,10 @@ std::unique_ptr<Instance> instantiate(Module module,
     }
 
     // Fill out memory based on data segments
-    for (size_t i = 0; i < module.datasec.size(); ++i)
+    for (size_t i = 0; i < module->datasec.size(); ++i)
     {
         // NOTE: these instructions can overlap
-        std::copy(module.datasec[i].init.begin(), module.datasec[i].init.end(),
+        std::copy(module->datasec[i].init.begin(), module->datasec[i].init.end(),
             memory->data() + datasec_offsets[i]);
     }
 
@@ -583,51 +790,59 @@ std::unique_ptr<Instance> instantiate(Module module,
         std::move(table), std::move(globals), std::move(imported_functions),
         std::move(imported_globals));
 
+    // The types of the imported functions are equal to the module's imported function types.
+    auto& imported_funcs = instance->imported_functions;
+    const auto& module_imported_type_ids = instance->module->imported_function_type_ids;
+    const auto imported_type_ids =
+        module_imported_type_ids.size() == imported_funcs.size() ?
+            module_imported_type_ids :
+            canonical_type_ids(instance->module->imported_function_types);
+    for (size_t i = 0; i < imported_funcs.size(); ++i)
+        imported_funcs[i].type_id = imported_type_ids[i];
+
     // Fill the table based on elements segment
-    for (size_t i = 0; i < instance->module.elementsec.size(); ++i)
+    for (size_t i = 0; i < instance->module->elementsec.size(); ++i)
     {
         // Overwrite table[offset..] with element.init
         auto it_table = instance->table->begin() + elementsec_offsets[i];
-        for (const auto idx : instance->module.elementsec[i].init)
-        {
-            auto func = [idx, &instance_ref = *instance](
-                            fizzy::Instance&, std::vector<uint64_t> args, int depth) {
-                return execute(instance_ref, idx, std::move(args), depth);
-            };
-
-            *it_table++ = ExternalFunction{std::move(func), function_type(*instance, idx)};
-        }
+        for (const auto idx : instance->module->elementsec[i].init)
+            *it_table++ = table_function(*instance, idx);
     }
 
     // Run start function if present
-    if (instance->module.startfunc)
+    if (instance->module->startfunc)
     {
-        const auto funcidx = *instance->module.startfunc;
-        assert(funcidx < instance->imported_functions.size() + instance->module.funcsec.size());
+        const auto funcidx = *instance->module->startfunc;
+        assert(funcidx < instance->imported_functions.size() + instance->module->funcsec.size());
         if (execute(*instance, funcidx, {}).trapped)
         {
             // When element section modified imported table, and then start function trapped,
             // modifications to the table are not rolled back.
             // Instance in this case is not being returned to the user, so it needs to be kept alive
             // as long as functions using it are alive in the table.
-            if (!imported_tables.empty() && !instance->module.elementsec.empty())
+            if (!imported_tables.empty() && !instance->module->elementsec.empty())
             {
                 // Instance may be used by several functions added to the table,
                 // so we need a shared ownership here.
                 std::shared_ptr<Instance> shared_instance = std::move(instance);
 
-                for (size_t i = 0; i < shared_instance->module.elementsec.size(); ++i)
+                for (size_t i = 0; i < shared_instance->module->elementsec.size(); ++i)
                 {
                     auto it_table = shared_instance->table->begin() + elementsec_offsets[i];
-                    for ([[maybe_unused]] auto _ : shared_instance->module.elementsec[i].init)
+                    for ([[maybe_unused]] auto _ : shared_instance->module->elementsec[i].init)
                     {
-                        // Wrap the function with the lambda capturing shared instance
+                        // Wrap the function with the lambda capturing shared instance.
+                        // The low-level host functions do not use the instance.
                         auto& table_function = (*it_table)->function;
-                        table_function = [shared_instance, func = std::move(table_function)](
-                                             fizzy::Instance& _instance, std::vector<uint64_t> args,
-                                             int depth) {
-                            return func(_instance, std::move(args), depth);
-                        };
+                        if ((*it_table)->host_function == nullptr)
+                        {
+                            table_function = [shared_instance,
+                                                 func = std::move(table_function)](
+                                                 fizzy::Instance& _instance,
+                                                 std::vector<uint64_t> args, int depth) {
+                                return func(_instance, std::move(args), depth);
+                            };
+                        }
                         ++it_table;
                     }
                 }
@@ -639,169 +854,561 @@ std::unique_ptr<Instance> instantiate(Module module,
     return instance;
 }
 
-execution_result execute(
-    Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args, int depth)
+std::unique_ptr<Instance> instantiate(Module module,
+    std::vector<ExternalFunction> imported_functions, std::vector<ExternalTable> imported_tables,
+    std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals,
+    MemoryMode memory_mode)
 {
-    assert(depth >= 0);
-    if (depth > CallStackLimit)
-        return {true, {}};
+    return instantiate(std::make_shared<const Module>(std::move(module)),
+        std::move(imported_functions), std::move(imported_tables), std::move(imported_memories),
+        std::move(imported_globals), memory_mode);
+}
 
-    if (func_idx < instance.imported_functions.size())
-        return instance.imported_functions[func_idx].function(instance, std::move(args), depth);
+namespace
+{
+/// Binds the elements of the instance's own table placed by the element segments
+/// to the instance, e.g. after the table has been copied from another instance.
+/// The elements placed by other instances importing the table are kept.
+void bind_table_elements(Instance& instance)
+{
+    const auto& module = *instance.module;
+    for (const auto& element : module.elementsec)
+    {
+        const auto offset = eval_constant_expression(
+            element.offset, instance.imported_globals, module.globalsec, instance.globals);
+        auto it_table = instance.table->begin() + static_cast<ptrdiff_t>(offset);
+        for (const auto idx : element.init)
+            *it_table++ = table_function(instance, idx);
+    }
+}
+}  // namespace
 
+InstanceTemplate make_instance_template(std::unique_ptr<Instance> instance)
+{
+    std::shared_ptr<const MemoryImage> memory_image;
+    if (!instance->module->memorysec.empty())
+    {
+        memory_image = std::make_shared<const MemoryImage>(*instance->memory);
+        // The template's memory shares the pages of the image as well.
+        instance->memory.reset(new LinearMemory(*memory_image));
+    }
+    return {std::move(instance), std::move(memory_image)};
+}
+
+std::unique_ptr<Instance> fork_instance(const InstanceTemplate& instance_template)
+{
+    static const auto memory_delete = [](LinearMemory* m) noexcept { delete m; };
+    static const auto null_memory_delete = [](LinearMemory*) noexcept {};
+    static const auto table_delete = [](table_elements* t) noexcept { delete t; };
+    static const auto null_table_delete = [](table_elements*) noexcept {};
+
+    const auto& source = *instance_template.instance;
+    const auto& module = *source.module;
+
+    memory_ptr memory{source.memory.get(), null_memory_delete};
+    if (instance_template.memory_image != nullptr)
+        memory = {new LinearMemory(*instance_template.memory_image), memory_delete};
+
+    const bool owns_table = !module.tablesec.empty();
+    table_ptr table{source.table.get(), null_table_delete};
+    if (owns_table)
+        table = {new table_elements(*source.table), table_delete};
+
+    // The module is shared, not copied.
+    auto instance = std::make_unique<Instance>(source.module, std::move(memory),
+        // NOLINTNEXTLINE(clang-analyzer-cplusplus.NewDeleteLeaks)
+        source.memory_max_pages, std::move(table), source.globals, source.imported_functions,
+        source.imported_globals);
+    instance->jit_code = source.jit_code;
+    instance->aot_code = source.aot_code;
+
+    if (owns_table)
+        bind_table_elements(*instance);
+
+    return instance;
+}
+
+void reset_instance(Instance& instance, const InstanceTemplate& instance_template)
+{
+    const auto& source = *instance_template.instance;
+    assert(instance.module->funcsec.size() == source.module->funcsec.size());
+
+    if (instance_template.memory_image != nullptr)
+        instance.memory->reset(*instance_template.memory_image);
+
+    instance.globals = source.globals;
+
+    if (!instance.module->tablesec.empty())
+    {
+        *instance.table = *source.table;
+        bind_table_elements(instance);
+    }
+}
+
+namespace
+{
+/// Finds the code of the function defined in the module.
+///
+/// @return  The code or null if the function parsed lazily is invalid. Such a function traps
+///          when called, its error is reported by get_code() and validate_lazy_code().
+inline const Code* find_code(const Instance& instance, FuncIdx func_idx)
+{
+    assert(func_idx >= instance.imported_functions.size());
     const auto code_idx = func_idx - instance.imported_functions.size();
-    assert(code_idx < instance.module.codesec.size());
+    assert(code_idx < instance.module->funcsec.size());
+    if (instance.module->lazy_code == nullptr)
+        return &instance.module->codesec[code_idx];
+    return find_lazy_code(*instance.module, code_idx);
+}
 
-    const auto& code = instance.module.codesec[code_idx];
-    auto* const memory = instance.memory.get();
+/// Creates the frame of the function, taking the @a num_args arguments from the top of the value
+/// stack memory as the first locals and zero-initializing the rest of locals.
+///
+/// The value stack capacity is reserved for the frame's locals and the function's maximum
+/// operand stack height, so the frame's instructions can access the stack unchecked.
+Frame enter_frame(const Code& code, size_t num_args, ExecutionContext& context, CachedStack& stack)
+{
+    assert(stack.size() >= num_args);
+    const auto locals_base = stack.size() - num_args;
+    const auto num_locals = num_args + code.local_count;
+
+    // The operand stack items are preceded by the placeholder item (see execute_code()), but
+    // the top item is cached, so the stack memory needs as many items as the maximum height.
+    // One more is needed for the top item spilled by a call.
+    const auto required_size = locals_base + num_locals + code.max_stack_height + 1;
+    if (required_size > context.stack.size())
+    {
+        context.stack.resize(std::max(required_size, 2 * context.stack.size()));
+        stack.rebase(context.stack.data());
+    }
 
-    std::vector<uint64_t> locals = std::move(args);
-    locals.resize(locals.size() + code.local_count);
+    std::fill_n(context.stack.data() + stack.size(), code.local_count, uint64_t{0});
+    stack.resize(locals_base + num_locals);
 
-    // TODO: preallocate fixed stack depth properly
-    Stack<uint64_t> stack;
+    return {&code, code.instructions.data(), code.immediates.data(), locals_base, num_locals};
+}
 
-    LabelStack labels;
+#if FIZZY_COMPUTED_GOTO
+// With computed goto dispatch each instruction handler jumps directly to the handler of the next
+// instruction (looked up in the dispatch table) instead of going back to the single shared jump
+// of the switch statement. This gives the CPU's branch predictor a separate history per handler.
+// The switch is still used to dispatch the first instruction.
+#define CASE(NAME)    \
+    case Instr::NAME: \
+    instr_##NAME
+#define SUPERINSTR_CASE(NAME)  \
+    case superinstr::NAME: \
+    instr_##NAME
+#define NEXT() goto* dispatch_table[static_cast<uint8_t>(instruction = *pc++)]
+#else
+#define CASE(NAME) case Instr::NAME
+#define SUPERINSTR_CASE(NAME) case superinstr::NAME
+#define NEXT() break
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch"  // Superinstruction opcodes are not Instr enumerators.
+#if FIZZY_COMPUTED_GOTO
+#pragma GCC diagnostic ignored "-Wpedantic"  // Computed goto is a GNU extension.
+#endif
+
+/// Executes the function of the given index defined in the module (i.e. not imported).
+///
+/// The @a num_args function arguments are expected on the top of the context's value stack,
+/// and on successful return they are replaced with the function results.
+///
+/// Calls to other functions defined in the module do not recurse: the caller's frame is suspended
+/// on the context's frame stack and the callee continues in the same interpreter loop.
+///
+/// The Checked variant compares the memory access addresses with the memory size, otherwise
+/// the memory must be guarded and the execution must run in call_with_memory_guard().
+///
+/// @return  false if the execution trapped.
+template <bool Checked>
+bool execute_code(
+    Instance& instance, FuncIdx func_idx, size_t num_args, ExecutionContext& context, int depth)
+{
+    assert(depth >= 0);
+    if (depth > CallStackLimit)
+        return false;
+
+    auto* const memory = instance.memory.get();
+
+    // The operand stack of a frame starts with a placeholder item cached as the top item
+    // (its value is irrelevant), so the locals always stay in the stack memory.
+    auto& locals = context.stack;
+    CachedStack stack{context.stack.data(), context.stack.size()};
+    auto& frames = context.frames;
+    const auto frames_base = frames.size();
+
+    const auto* const code = find_code(instance, func_idx);
+    if (code == nullptr)
+        return false;
+    auto frame = enter_frame(*code, num_args, context, stack);
 
     bool trap = false;
 
-    const Instr* pc = code.instructions.data();
-    const uint8_t* immediates = code.immediates.data();
+    // The index of the function defined in the module to be called at enter_function.
+    FuncIdx called_func_idx = 0;
+
+    const Instr* pc = frame.pc;
+    const uint8_t* immediates = frame.immediates;
+
+    Instr instruction;
+
+#if FIZZY_COMPUTED_GOTO
+    // The table of the instruction handlers indexed by opcode.
+    static const void* const dispatch_table[256] = {
+        /* 0x00 */ &&instr_unreachable,
+        /* 0x01 */ &&instr_nop,
+        /* 0x02 */ &&instr_block,
+        /* 0x03 */ &&instr_loop,
+        /* 0x04 */ &&instr_if_,
+        /* 0x05 */ &&instr_else_,
+        /* 0x06 */ &&instr_undefined,
+        /* 0x07 */ &&instr_undefined,
+        /* 0x08 */ &&instr_undefined,
+        /* 0x09 */ &&instr_undefined,
+        /* 0x0a */ &&instr_undefined,
+        /* 0x0b */ &&instr_end,
+        /* 0x0c */ &&instr_br,
+        /* 0x0d */ &&instr_br_if,
+        /* 0x0e */ &&instr_br_table,
+        /* 0x0f */ &&instr_return_,
+        /* 0x10 */ &&instr_call,
+        /* 0x11 */ &&instr_call_indirect,
+        /* 0x12 */ &&instr_undefined,
+        /* 0x13 */ &&instr_undefined,
+        /* 0x14 */ &&instr_undefined,
+        /* 0x15 */ &&instr_undefined,
+        /* 0x16 */ &&instr_undefined,
+        /* 0x17 */ &&instr_undefined,
+        /* 0x18 */ &&instr_undefined,
+        /* 0x19 */ &&instr_undefined,
+        /* 0x1a */ &&instr_drop,
+        /* 0x1b */ &&instr_select,
+        /* 0x1c */ &&instr_undefined,
+        /* 0x1d */ &&instr_undefined,
+        /* 0x1e */ &&instr_undefined,
+        /* 0x1f */ &&instr_undefined,
+        /* 0x20 */ &&instr_local_get,
+        /* 0x21 */ &&instr_local_set,
+        /* 0x22 */ &&instr_local_tee,
+        /* 0x23 */ &&instr_global_get,
+        /* 0x24 */ &&instr_global_set,
+        /* 0x25 */ &&instr_undefined,
+        /* 0x26 */ &&instr_undefined,
+        /* 0x27 */ &&instr_undefined,
+        /* 0x28 */ &&instr_i32_load,
+        /* 0x29 */ &&instr_i64_load,
+        /* 0x2a */ &&instr_f32_load,
+        /* 0x2b */ &&instr_f64_load,
+        /* 0x2c */ &&instr_i32_load8_s,
+        /* 0x2d */ &&instr_i32_load8_u,
+        /* 0x2e */ &&instr_i32_load16_s,
+        /* 0x2f */ &&instr_i32_load16_u,
+        /* 0x30 */ &&instr_i64_load8_s,
+        /* 0x31 */ &&instr_i64_load8_u,
+        /* 0x32 */ &&instr_i64_load16_s,
+        /* 0x33 */ &&instr_i64_load16_u,
+        /* 0x34 */ &&instr_i64_load32_s,
+        /* 0x35 */ &&instr_i64_load32_u,
+        /* 0x36 */ &&instr_i32_store,
+        /* 0x37 */ &&instr_i64_store,
+        /* 0x38 */ &&instr_f32_store,
+        /* 0x39 */ &&instr_f64_store,
+        /* 0x3a */ &&instr_i32_store8,
+        /* 0x3b */ &&instr_i32_store16,
+        /* 0x3c */ &&instr_i64_store8,
+        /* 0x3d */ &&instr_i64_store16,
+        /* 0x3e */ &&instr_i64_store32,
+        /* 0x3f */ &&instr_memory_size,
+        /* 0x40 */ &&instr_memory_grow,
+        /* 0x41 */ &&instr_i32_const,
+        /* 0x42 */ &&instr_i64_const,
+        /* 0x43 */ &&instr_f32_const,
+        /* 0x44 */ &&instr_f64_const,
+        /* 0x45 */ &&instr_i32_eqz,
+        /* 0x46 */ &&instr_i32_eq,
+        /* 0x47 */ &&instr_i32_ne,
+        /* 0x48 */ &&instr_i32_lt_s,
+        /* 0x49 */ &&instr_i32_lt_u,
+        /* 0x4a */ &&instr_i32_gt_s,
+        /* 0x4b */ &&instr_i32_gt_u,
+        /* 0x4c */ &&instr_i32_le_s,
+        /* 0x4d */ &&instr_i32_le_u,
+        /* 0x4e */ &&instr_i32_ge_s,
+        /* 0x4f */ &&instr_i32_ge_u,
+        /* 0x50 */ &&instr_i64_eqz,
+        /* 0x51 */ &&instr_i64_eq,
+        /* 0x52 */ &&instr_i64_ne,
+        /* 0x53 */ &&instr_i64_lt_s,
+        /* 0x54 */ &&instr_i64_lt_u,
+        /* 0x55 */ &&instr_i64_gt_s,
+        /* 0x56 */ &&instr_i64_gt_u,
+        /* 0x57 */ &&instr_i64_le_s,
+        /* 0x58 */ &&instr_i64_le_u,
+        /* 0x59 */ &&instr_i64_ge_s,
+        /* 0x5a */ &&instr_i64_ge_u,
+        /* 0x5b */ &&instr_f32_eq,
+        /* 0x5c */ &&instr_f32_ne,
+        /* 0x5d */ &&instr_f32_lt,
+        /* 0x5e */ &&instr_f32_gt,
+        /* 0x5f */ &&instr_f32_le,
+        /* 0x60 */ &&instr_f32_ge,
+        /* 0x61 */ &&instr_f64_eq,
+        /* 0x62 */ &&instr_f64_ne,
+        /* 0x63 */ &&instr_f64_lt,
+        /* 0x64 */ &&instr_f64_gt,
+        /* 0x65 */ &&instr_f64_le,
+        /* 0x66 */ &&instr_f64_ge,
+        /* 0x67 */ &&instr_i32_clz,
+        /* 0x68 */ &&instr_i32_ctz,
+        /* 0x69 */ &&instr_i32_popcnt,
+        /* 0x6a */ &&instr_i32_add,
+        /* 0x6b */ &&instr_i32_sub,
+        /* 0x6c */ &&instr_i32_mul,
+        /* 0x6d */ &&instr_i32_div_s,
+        /* 0x6e */ &&instr_i32_div_u,
+        /* 0x6f */ &&instr_i32_rem_s,
+        /* 0x70 */ &&instr_i32_rem_u,
+        /* 0x71 */ &&instr_i32_and,
+        /* 0x72 */ &&instr_i32_or,
+        /* 0x73 */ &&instr_i32_xor,
+        /* 0x74 */ &&instr_i32_shl,
+        /* 0x75 */ &&instr_i32_shr_s,
+        /* 0x76 */ &&instr_i32_shr_u,
+        /* 0x77 */ &&instr_i32_rotl,
+        /* 0x78 */ &&instr_i32_rotr,
+        /* 0x79 */ &&instr_i64_clz,
+        /* 0x7a */ &&instr_i64_ctz,
+        /* 0x7b */ &&instr_i64_popcnt,
+        /* 0x7c */ &&instr_i64_add,
+        /* 0x7d */ &&instr_i64_sub,
+        /* 0x7e */ &&instr_i64_mul,
+        /* 0x7f */ &&instr_i64_div_s,
+        /* 0x80 */ &&instr_i64_div_u,
+        /* 0x81 */ &&instr_i64_rem_s,
+        /* 0x82 */ &&instr_i64_rem_u,
+        /* 0x83 */ &&instr_i64_and,
+        /* 0x84 */ &&instr_i64_or,
+        /* 0x85 */ &&instr_i64_xor,
+        /* 0x86 */ &&instr_i64_shl,
+        /* 0x87 */ &&instr_i64_shr_s,
+        /* 0x88 */ &&instr_i64_shr_u,
+        /* 0x89 */ &&instr_i64_rotl,
+        /* 0x8a */ &&instr_i64_rotr,
+        /* 0x8b */ &&instr_f32_abs,
+        /* 0x8c */ &&instr_f32_neg,
+        /* 0x8d */ &&instr_f32_ceil,
+        /* 0x8e */ &&instr_f32_floor,
+        /* 0x8f */ &&instr_f32_trunc,
+        /* 0x90 */ &&instr_f32_nearest,
+        /* 0x91 */ &&instr_f32_sqrt,
+        /* 0x92 */ &&instr_f32_add,
+        /* 0x93 */ &&instr_f32_sub,
+        /* 0x94 */ &&instr_f32_mul,
+        /* 0x95 */ &&instr_f32_div,
+        /* 0x96 */ &&instr_f32_min,
+        /* 0x97 */ &&instr_f32_max,
+        /* 0x98 */ &&instr_f32_copysign,
+        /* 0x99 */ &&instr_f64_abs,
+        /* 0x9a */ &&instr_f64_neg,
+        /* 0x9b */ &&instr_f64_ceil,
+        /* 0x9c */ &&instr_f64_floor,
+        /* 0x9d */ &&instr_f64_trunc,
+        /* 0x9e */ &&instr_f64_nearest,
+        /* 0x9f */ &&instr_f64_sqrt,
+        /* 0xa0 */ &&instr_f64_add,
+        /* 0xa1 */ &&instr_f64_sub,
+        /* 0xa2 */ &&instr_f64_mul,
+        /* 0xa3 */ &&instr_f64_div,
+        /* 0xa4 */ &&instr_f64_min,
+        /* 0xa5 */ &&instr_f64_max,
+        /* 0xa6 */ &&instr_f64_copysign,
+        /* 0xa7 */ &&instr_i32_wrap_i64,
+        /* 0xa8 */ &&instr_i32_trunc_f32_s,
+        /* 0xa9 */ &&instr_i32_trunc_f32_u,
+        /* 0xaa */ &&instr_i32_trunc_f64_s,
+        /* 0xab */ &&instr_i32_trunc_f64_u,
+        /* 0xac */ &&instr_i64_extend_i32_s,
+        /* 0xad */ &&instr_i64_extend_i32_u,
+        /* 0xae */ &&instr_i64_trunc_f32_s,
+        /* 0xaf */ &&instr_i64_trunc_f32_u,
+        /* 0xb0 */ &&instr_i64_trunc_f64_s,
+        /* 0xb1 */ &&instr_i64_trunc_f64_u,
+        /* 0xb2 */ &&instr_f32_convert_i32_s,
+        /* 0xb3 */ &&instr_f32_convert_i32_u,
+        /* 0xb4 */ &&instr_f32_convert_i64_s,
+        /* 0xb5 */ &&instr_f32_convert_i64_u,
+        /* 0xb6 */ &&instr_f32_demote_f64,
+        /* 0xb7 */ &&instr_f64_convert_i32_s,
+        /* 0xb8 */ &&instr_f64_convert_i32_u,
+        /* 0xb9 */ &&instr_f64_convert_i64_s,
+        /* 0xba */ &&instr_f64_convert_i64_u,
+        /* 0xbb */ &&instr_f64_promote_f32,
+        /* 0xbc */ &&instr_i32_reinterpret_f32,
+        /* 0xbd */ &&instr_i64_reinterpret_f64,
+        /* 0xbe */ &&instr_f32_reinterpret_i32,
+        /* 0xbf */ &&instr_f64_reinterpret_i64,
+        /* 0xc0 */ &&instr_undefined,
+        /* 0xc1 */ &&instr_undefined,
+        /* 0xc2 */ &&instr_undefined,
+        /* 0xc3 */ &&instr_undefined,
+        /* 0xc4 */ &&instr_undefined,
+        /* 0xc5 */ &&instr_undefined,
+        /* 0xc6 */ &&instr_undefined,
+        /* 0xc7 */ &&instr_undefined,
+        /* 0xc8 */ &&instr_undefined,
+        /* 0xc9 */ &&instr_undefined,
+        /* 0xca */ &&instr_undefined,
+        /* 0xcb */ &&instr_undefined,
+        /* 0xcc */ &&instr_undefined,
+        /* 0xcd */ &&instr_undefined,
+        /* 0xce */ &&instr_undefined,
+        /* 0xcf */ &&instr_undefined,
+        /* 0xd0 */ &&instr_undefined,
+        /* 0xd1 */ &&instr_undefined,
+        /* 0xd2 */ &&instr_undefined,
+        /* 0xd3 */ &&instr_undefined,
+        /* 0xd4 */ &&instr_undefined,
+        /* 0xd5 */ &&instr_undefined,
+        /* 0xd6 */ &&instr_undefined,
+        /* 0xd7 */ &&instr_undefined,
+        /* 0xd8 */ &&instr_undefined,
+        /* 0xd9 */ &&instr_undefined,
+        /* 0xda */ &&instr_undefined,
+        /* 0xdb */ &&instr_undefined,
+        /* 0xdc */ &&instr_undefined,
+        /* 0xdd */ &&instr_undefined,
+        /* 0xde */ &&instr_undefined,
+        /* 0xdf */ &&instr_undefined,
+        /* 0xe0 */ &&instr_local_get_local_get,
+        /* 0xe1 */ &&instr_local_tee_local_get,
+        /* 0xe2 */ &&instr_i32_add_imm,
+        /* 0xe3 */ &&instr_i64_and_imm,
+        /* 0xe4 */ &&instr_i64_shr_u_imm,
+        /* 0xe5 */ &&instr_local_get_i32_load,
+        /* 0xe6 */ &&instr_local_get_i64_load,
+        /* 0xe7 */ &&instr_local_get_i32_add_imm_local_set,
+        /* 0xe8 */ &&instr_undefined,
+        /* 0xe9 */ &&instr_undefined,
+        /* 0xea */ &&instr_undefined,
+        /* 0xeb */ &&instr_undefined,
+        /* 0xec */ &&instr_undefined,
+        /* 0xed */ &&instr_undefined,
+        /* 0xee */ &&instr_undefined,
+        /* 0xef */ &&instr_undefined,
+        /* 0xf0 */ &&instr_undefined,
+        /* 0xf1 */ &&instr_undefined,
+        /* 0xf2 */ &&instr_undefined,
+        /* 0xf3 */ &&instr_undefined,
+        /* 0xf4 */ &&instr_undefined,
+        /* 0xf5 */ &&instr_undefined,
+        /* 0xf6 */ &&instr_undefined,
+        /* 0xf7 */ &&instr_undefined,
+        /* 0xf8 */ &&instr_undefined,
+        /* 0xf9 */ &&instr_undefined,
+        /* 0xfa */ &&instr_undefined,
+        /* 0xfb */ &&instr_undefined,
+        /* 0xfc */ &&instr_undefined,
+        /* 0xfd */ &&instr_undefined,
+        /* 0xfe */ &&instr_undefined,
+        /* 0xff */ &&instr_undefined,
+    };
+#endif
 
     while (true)
     {
-        const auto instruction = *pc++;
-        switch (instruction)
+        switch (instruction = *pc++)
         {
-        case Instr::unreachable:
+        CASE(unreachable):
             trap = true;
             goto end;
-        case Instr::nop:
-            break;
-        case Instr::block:
-        {
-            const auto arity = read<uint8_t>(immediates);
-            const auto target_pc = read<uint32_t>(immediates);
-            const auto target_imm = read<uint32_t>(immediates);
-            LabelContext label{code.instructions.data() + target_pc,
-                code.immediates.data() + target_imm, arity, stack.size()};
-            labels.push(label);
-            break;
-        }
-        case Instr::loop:
-        {
-            LabelContext label{pc - 1, immediates, 0, stack.size()};  // Target this instruction.
-            labels.push(label);
-            break;
-        }
-        case Instr::if_:
+        CASE(nop):
+            NEXT();
+        CASE(block):
+        CASE(loop):
+            // The block and loop instructions are resolved by the parser and not emitted.
+            assert(false);
+            NEXT();
+        CASE(if_):
         {
-            const auto arity = read<uint8_t>(immediates);
-            const auto target_pc = read<uint32_t>(immediates);
-            const auto target_imm = read<uint32_t>(immediates);
-
-            if (static_cast<uint32_t>(stack.pop()) != 0)
+            // Jump to the else branch or to the end of the if block if the condition is false.
+            if (static_cast<uint32_t>(stack.pop()) == 0)
             {
-                immediates += 2 * sizeof(uint32_t);  // Skip the immediates for else instruction.
-
-                LabelContext label{code.instructions.data() + target_pc,
-                    code.immediates.data() + target_imm, arity, stack.size()};
-                labels.push(label);
+                const auto target_pc = read<uint32_t>(immediates);
+                const auto target_imm = read<uint32_t>(immediates);
+                pc = frame.code->instructions.data() + target_pc;
+                immediates = frame.code->immediates.data() + target_imm;
             }
             else
-            {
-                const auto target_else_pc = read<uint32_t>(immediates);
-                const auto target_else_imm = read<uint32_t>(immediates);
-
-                if (target_else_pc != 0)  // If else block defined.
-                {
-                    LabelContext label{code.instructions.data() + target_pc,
-                        code.immediates.data() + target_imm, arity, stack.size()};
-                    labels.push(label);
-                    pc = code.instructions.data() + target_else_pc;
-                    immediates = code.immediates.data() + target_else_imm;
-                }
-                else  // If else block not defined go to end of if.
-                {
-                    assert(arity == 0);  // if without else cannot have type signature.
-                    pc = code.instructions.data() + target_pc;
-                    immediates = code.immediates.data() + target_imm;
-                }
-            }
-            break;
+                immediates += 2 * sizeof(uint32_t);
+            NEXT();
         }
-        case Instr::else_:
+        CASE(else_):
         {
-            // We reach else only at the end of if block.
-            assert(!labels.empty());
-            const auto label = labels.top();
-            labels.pop();
-
-            pc = label.pc;
-            immediates = label.immediate;
-
-            break;
+            // We reach else only at the end of the then branch, jump to the end of if block.
+            const auto target_pc = read<uint32_t>(immediates);
+            const auto target_imm = read<uint32_t>(immediates);
+            pc = frame.code->instructions.data() + target_pc;
+            immediates = frame.code->immediates.data() + target_imm;
+            NEXT();
         }
-        case Instr::end:
+        CASE(end):
         {
-            if (!labels.empty())
-                labels.pop();
-            else
-                goto end;
-            break;
+            // Only the end of the function is emitted.
+            goto leave_frame;
         }
-        case Instr::br:
-        case Instr::br_if:
+        CASE(br):
+        CASE(br_if):
+        CASE(return_):
         {
-            const auto label_idx = read<uint32_t>(immediates);
-
             // Check condition for br_if.
             if (instruction == Instr::br_if && static_cast<uint32_t>(stack.pop()) == 0)
-                break;
-
-            if (label_idx == labels.size())
-                goto case_return;
+            {
+                immediates += BranchImmediateSize;
+                NEXT();
+            }
 
-            branch(label_idx, labels, stack, pc, immediates);
-            break;
+            branch(*frame.code, stack, pc, immediates);
+            NEXT();
         }
-        case Instr::br_table:
+        CASE(br_table):
         {
-            // immediates are: size of label vector, labels, default label
+            // immediates are: size of label vector, branches to labels, branch to default label
             const auto br_table_size = read<uint32_t>(immediates);
             const auto br_table_idx = stack.pop();
 
             const auto label_idx_offset = br_table_idx < br_table_size ?
-                                              br_table_idx * sizeof(uint32_t) :
-                                              br_table_size * sizeof(uint32_t);
+                                              br_table_idx * BranchImmediateSize :
+                                              br_table_size * BranchImmediateSize;
             immediates += label_idx_offset;
 
-            const auto label_idx = read<uint32_t>(immediates);
-
-            if (label_idx == labels.size())
-                goto case_return;
-
-            branch(label_idx, labels, stack, pc, immediates);
-            break;
+            branch(*frame.code, stack, pc, immediates);
+            NEXT();
         }
-        case Instr::call:
+        CASE(call):
         {
-            const auto called_func_idx = read<uint32_t>(immediates);
-            const auto& func_type = function_type(instance, called_func_idx);
+            called_func_idx = read<uint32_t>(immediates);
+
+            if (called_func_idx >= instance.imported_functions.size())
+                goto enter_function;
 
-            if (!invoke_function(func_type, called_func_idx, instance, stack, depth))
+            const auto& called_func = instance.imported_functions[called_func_idx];
+            if (!invoke_function(called_func, instance, stack, depth))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::call_indirect:
+        CASE(call_indirect):
         {
             assert(instance.table != nullptr);
 
             const auto expected_type_idx = read<uint32_t>(immediates);
-            assert(expected_type_idx < instance.module.typesec.size());
+            assert(expected_type_idx < instance.module->typesec.size());
 
             const auto elem_idx = stack.pop();
             if (elem_idx >= instance.table->size())
@@ -810,7 +1417,7 @@ execution_result execute(
                 goto end;
             }
 
-            const auto called_func = (*instance.table)[elem_idx];
+            const auto& called_func = (*instance.table)[elem_idx];
             if (!called_func.has_value())
             {
                 trap = true;
@@ -818,82 +1425,115 @@ execution_result execute(
             }
 
             // check actual type against expected type
-            const auto& actual_type = called_func->type;
-            const auto& expected_type = instance.module.typesec[expected_type_idx];
-            if (expected_type != actual_type)
+            if (called_func->type_id != instance.type_ids[expected_type_idx])
             {
                 trap = true;
                 goto end;
             }
 
-            if (!invoke_function(actual_type, called_func->function, instance, stack, depth))
+            // The function of this instance is called the same way as by the call instruction.
+            if (called_func->instance == &instance)
+            {
+                called_func_idx = called_func->func_idx;
+                goto enter_function;
+            }
+
+            if (!invoke_function(*called_func, instance, stack, depth))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::return_:
-        case_return:
+        enter_function:
         {
-            // TODO: Not needed, but satisfies the assert in the end of the main loop.
-            labels = {};
+            // Suspend the current frame and continue in the frame of the function
+            // of the called_func_idx defined in the module.
+            if (depth == CallStackLimit)
+            {
+                trap = true;
+                goto end;
+            }
+            const auto* const called_code = find_code(instance, called_func_idx);
+            if (called_code == nullptr)
+            {
+                trap = true;
+                goto end;
+            }
+            ++depth;
 
-            assert(code_idx < instance.module.funcsec.size());
-            const auto type_idx = instance.module.funcsec[code_idx];
-            assert(type_idx < instance.module.typesec.size());
-            const bool have_result = !instance.module.typesec[type_idx].outputs.empty();
+            frame.pc = pc;
+            frame.immediates = immediates;
+            frames.push(frame);
 
-            if (have_result)
+            const auto num_call_args = function_type(instance, called_func_idx).inputs.size();
+            stack.spill();
+            frame = enter_frame(*called_code, num_call_args, context, stack);
+            pc = frame.pc;
+            immediates = frame.immediates;
+            NEXT();
+        }
+        leave_frame:
+        {
+            // Replace the frame's locals with the function result, which is the top item
+            // if there is any besides the placeholder.
+            const auto operands_base = frame.locals_base + frame.num_locals;
+            const auto num_results = stack.size() - operands_base;
+            assert(num_results <= 1);
+            stack.resize(frame.locals_base);
+
+            if (frames.size() == frames_base)
             {
-                const auto result = stack.peek();
-                stack.clear();
-                stack.push(result);
+                if (num_results != 0)
+                    stack.spill();
+                goto end;
             }
-            else
-                stack.clear();
 
-            goto end;
+            // Resume the caller.
+            if (num_results == 0)
+                stack.fill();
+            frame = frames.pop();
+            --depth;
+            pc = frame.pc;
+            immediates = frame.immediates;
+            NEXT();
         }
-        case Instr::drop:
+        CASE(drop):
         {
             stack.pop();
-            break;
+            NEXT();
         }
-        case Instr::select:
+        CASE(select):
         {
             const auto condition = static_cast<uint32_t>(stack.pop());
             // NOTE: these two are the same type (ensured by validation)
             const auto val2 = stack.pop();
-            const auto val1 = stack.pop();
             if (condition == 0)
-                stack.push(val2);
-            else
-                stack.push(val1);
-            break;
+                stack.top() = val2;
+            NEXT();
         }
-        case Instr::local_get:
+        CASE(local_get):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
-            stack.push(locals[idx]);
-            break;
+            assert(idx < frame.num_locals);
+            stack.push(locals[frame.locals_base + idx]);
+            NEXT();
         }
-        case Instr::local_set:
+        CASE(local_set):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
-            locals[idx] = stack.pop();
-            break;
+            assert(idx < frame.num_locals);
+            locals[frame.locals_base + idx] = stack.pop();
+            NEXT();
         }
-        case Instr::local_tee:
+        CASE(local_tee):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
-            locals[idx] = stack.peek();
-            break;
+            assert(idx < frame.num_locals);
+            locals[frame.locals_base + idx] = stack.top();
+            NEXT();
         }
-        case Instr::global_get:
+        CASE(global_get):
         {
             const auto idx = read<uint32_t>(immediates);
             assert(idx < instance.imported_globals.size() + instance.globals.size());
@@ -904,12 +1544,12 @@ execution_result execute(
             else
             {
                 const auto module_global_idx = idx - instance.imported_globals.size();
-                assert(module_global_idx < instance.module.globalsec.size());
+                assert(module_global_idx < instance.module->globalsec.size());
                 stack.push(instance.globals[module_global_idx]);
             }
-            break;
+            NEXT();
         }
-        case Instr::global_set:
+        CASE(global_set):
         {
             const auto idx = read<uint32_t>(immediates);
             if (idx < instance.imported_globals.size())
@@ -920,347 +1560,337 @@ execution_result execute(
             else
             {
                 const auto module_global_idx = idx - instance.imported_globals.size();
-                assert(module_global_idx < instance.module.globalsec.size());
-                assert(instance.module.globalsec[module_global_idx].is_mutable);
+                assert(module_global_idx < instance.module->globalsec.size());
+                assert(instance.module->globalsec[module_global_idx].is_mutable);
                 instance.globals[module_global_idx] = stack.pop();
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_load:
+        CASE(i32_load):
+        CASE(f32_load):
         {
-            if (!load_from_memory<uint32_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load:
+        CASE(i64_load):
+        CASE(f64_load):
         {
-            if (!load_from_memory<uint64_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_load8_s:
+        CASE(i32_load8_s):
         {
-            if (!load_from_memory<uint32_t, int8_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint32_t, int8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_load8_u:
+        CASE(i32_load8_u):
         {
-            if (!load_from_memory<uint32_t, uint8_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint32_t, uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_load16_s:
+        CASE(i32_load16_s):
         {
-            if (!load_from_memory<uint32_t, int16_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint32_t, int16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_load16_u:
+        CASE(i32_load16_u):
         {
-            if (!load_from_memory<uint32_t, uint16_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint32_t, uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load8_s:
+        CASE(i64_load8_s):
         {
-            if (!load_from_memory<uint64_t, int8_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, int8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load8_u:
+        CASE(i64_load8_u):
         {
-            if (!load_from_memory<uint64_t, uint8_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load16_s:
+        CASE(i64_load16_s):
         {
-            if (!load_from_memory<uint64_t, int16_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, int16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load16_u:
+        CASE(i64_load16_u):
         {
-            if (!load_from_memory<uint64_t, uint16_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load32_s:
+        CASE(i64_load32_s):
         {
-            if (!load_from_memory<uint64_t, int32_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, int32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_load32_u:
+        CASE(i64_load32_u):
         {
-            if (!load_from_memory<uint64_t, uint32_t>(*memory, stack, immediates))
+            if (!load_from_memory<Checked, uint64_t, uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_store:
+        CASE(i32_store):
+        CASE(f32_store):
         {
-            if (!store_into_memory<uint32_t>(*memory, stack, immediates))
+            if (!store_into_memory<Checked, uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_store:
+        CASE(i64_store):
+        CASE(f64_store):
         {
-            if (!store_into_memory<uint64_t>(*memory, stack, immediates))
+            if (!store_into_memory<Checked, uint64_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_store8:
-        case Instr::i64_store8:
+        CASE(i32_store8):
+        CASE(i64_store8):
         {
-            if (!store_into_memory<uint8_t>(*memory, stack, immediates))
+            if (!store_into_memory<Checked, uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i32_store16:
-        case Instr::i64_store16:
+        CASE(i32_store16):
+        CASE(i64_store16):
         {
-            if (!store_into_memory<uint16_t>(*memory, stack, immediates))
+            if (!store_into_memory<Checked, uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::i64_store32:
+        CASE(i64_store32):
         {
-            if (!store_into_memory<uint32_t>(*memory, stack, immediates))
+            if (!store_into_memory<Checked, uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            NEXT();
         }
-        case Instr::memory_size:
+        CASE(memory_size):
         {
             stack.push(static_cast<uint32_t>(memory->size() / PageSize));
-            break;
+            NEXT();
         }
-        case Instr::memory_grow:
+        CASE(memory_grow):
         {
-            const auto delta = static_cast<uint32_t>(stack.pop());
-            const auto cur_pages = memory->size() / PageSize;
-            assert(cur_pages <= size_t(std::numeric_limits<int32_t>::max()));
-            const auto new_pages = cur_pages + delta;
-            assert(new_pages >= cur_pages);
-            uint32_t ret = static_cast<uint32_t>(cur_pages);
-            try
-            {
-                if (new_pages > instance.memory_max_pages)
-                    throw std::bad_alloc();
-                memory->resize(new_pages * PageSize);
-            }
-            catch (std::bad_alloc const&)
-            {
-                ret = static_cast<uint32_t>(-1);
-            }
-            stack.push(ret);
-            break;
+            const auto delta = static_cast<uint32_t>(stack.top());
+            stack.top() = memory->grow_pages(delta, instance.memory_max_pages);
+            NEXT();
         }
-        case Instr::i32_const:
+        CASE(i32_const):
+        CASE(f32_const):
         {
             const auto value = read<uint32_t>(immediates);
             stack.push(value);
-            break;
+            NEXT();
         }
-        case Instr::i64_const:
+        CASE(i64_const):
+        CASE(f64_const):
         {
             const auto value = read<uint64_t>(immediates);
             stack.push(value);
-            break;
+            NEXT();
         }
-        case Instr::i32_eqz:
+        CASE(i32_eqz):
         {
-            const auto value = static_cast<uint32_t>(stack.pop());
-            stack.push(value == 0);
-            break;
+            stack.top() = static_cast<uint32_t>(stack.top()) == 0;
+            NEXT();
         }
-        case Instr::i32_eq:
+        CASE(i32_eq):
         {
             comparison_op(stack, std::equal_to<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_ne:
+        CASE(i32_ne):
         {
             comparison_op(stack, std::not_equal_to<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_lt_s:
+        CASE(i32_lt_s):
         {
             comparison_op(stack, std::less<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_lt_u:
+        CASE(i32_lt_u):
         {
             comparison_op(stack, std::less<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_gt_s:
+        CASE(i32_gt_s):
         {
             comparison_op(stack, std::greater<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_gt_u:
+        CASE(i32_gt_u):
         {
             comparison_op(stack, std::greater<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_le_s:
+        CASE(i32_le_s):
         {
             comparison_op(stack, std::less_equal<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_le_u:
+        CASE(i32_le_u):
         {
             comparison_op(stack, std::less_equal<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_ge_s:
+        CASE(i32_ge_s):
         {
             comparison_op(stack, std::greater_equal<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_ge_u:
+        CASE(i32_ge_u):
         {
             comparison_op(stack, std::greater_equal<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_eqz:
+        CASE(i64_eqz):
         {
-            stack.push(stack.pop() == 0);
-            break;
+            stack.top() = stack.top() == 0;
+            NEXT();
         }
-        case Instr::i64_eq:
+        CASE(i64_eq):
         {
             comparison_op(stack, std::equal_to<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_ne:
+        CASE(i64_ne):
         {
             comparison_op(stack, std::not_equal_to<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_lt_s:
+        CASE(i64_lt_s):
         {
             comparison_op(stack, std::less<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_lt_u:
+        CASE(i64_lt_u):
         {
             comparison_op(stack, std::less<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_gt_s:
+        CASE(i64_gt_s):
         {
             comparison_op(stack, std::greater<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_gt_u:
+        CASE(i64_gt_u):
         {
             comparison_op(stack, std::greater<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_le_s:
+        CASE(i64_le_s):
         {
             comparison_op(stack, std::less_equal<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_le_u:
+        CASE(i64_le_u):
         {
             comparison_op(stack, std::less_equal<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_ge_s:
+        CASE(i64_ge_s):
         {
             comparison_op(stack, std::greater_equal<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_ge_u:
+        CASE(i64_ge_u):
         {
             comparison_op(stack, std::greater_equal<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_clz:
+        CASE(i32_clz):
         {
             unary_op(stack, clz32);
-            break;
+            NEXT();
         }
-        case Instr::i32_ctz:
+        CASE(i32_ctz):
         {
             unary_op(stack, ctz32);
-            break;
+            NEXT();
         }
-        case Instr::i32_popcnt:
+        CASE(i32_popcnt):
         {
             unary_op(stack, popcnt32);
-            break;
+            NEXT();
         }
-        case Instr::i32_add:
+        CASE(i32_add):
         {
             binary_op(stack, std::plus<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_sub:
+        CASE(i32_sub):
         {
             binary_op(stack, std::minus<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_mul:
+        CASE(i32_mul):
         {
             binary_op(stack, std::multiplies<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_div_s:
+        CASE(i32_div_s):
         {
             auto const rhs = static_cast<int32_t>(stack.peek(0));
             auto const lhs = static_cast<int32_t>(stack.peek(1));
@@ -1270,9 +1900,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_div_u:
+        CASE(i32_div_u):
         {
             auto const rhs = static_cast<uint32_t>(stack.peek());
             if (rhs == 0)
@@ -1281,9 +1911,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_rem_s:
+        CASE(i32_rem_s):
         {
             auto const rhs = static_cast<int32_t>(stack.peek());
             if (rhs == 0)
@@ -1294,14 +1924,14 @@ execution_result execute(
             auto const lhs = static_cast<int32_t>(stack.peek(1));
             if (lhs == std::numeric_limits<int32_t>::min() && rhs == -1)
             {
-                stack.drop(2);
-                stack.push(0);
+                stack.drop();
+                stack.top() = 0;
             }
             else
                 binary_op(stack, std::modulus<int32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_rem_u:
+        CASE(i32_rem_u):
         {
             auto const rhs = static_cast<uint32_t>(stack.peek());
             if (rhs == 0)
@@ -1310,79 +1940,79 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::modulus<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_and:
+        CASE(i32_and):
         {
             binary_op(stack, std::bit_and<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_or:
+        CASE(i32_or):
         {
             binary_op(stack, std::bit_or<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_xor:
+        CASE(i32_xor):
         {
             binary_op(stack, std::bit_xor<uint32_t>());
-            break;
+            NEXT();
         }
-        case Instr::i32_shl:
+        CASE(i32_shl):
         {
             binary_op(stack, shift_left<uint32_t>);
-            break;
+            NEXT();
         }
-        case Instr::i32_shr_s:
+        CASE(i32_shr_s):
         {
             binary_op(stack, shift_right<int32_t>);
-            break;
+            NEXT();
         }
-        case Instr::i32_shr_u:
+        CASE(i32_shr_u):
         {
             binary_op(stack, shift_right<uint32_t>);
-            break;
+            NEXT();
         }
-        case Instr::i32_rotl:
+        CASE(i32_rotl):
         {
             binary_op(stack, rotl<uint32_t>);
-            break;
+            NEXT();
         }
-        case Instr::i32_rotr:
+        CASE(i32_rotr):
         {
             binary_op(stack, rotr<uint32_t>);
-            break;
+            NEXT();
         }
-        case Instr::i64_clz:
+        CASE(i64_clz):
         {
             unary_op(stack, clz64);
-            break;
+            NEXT();
         }
-        case Instr::i64_ctz:
+        CASE(i64_ctz):
         {
             unary_op(stack, ctz64);
-            break;
+            NEXT();
         }
-        case Instr::i64_popcnt:
+        CASE(i64_popcnt):
         {
             unary_op(stack, popcnt64);
-            break;
+            NEXT();
         }
-        case Instr::i64_add:
+        CASE(i64_add):
         {
             binary_op(stack, std::plus<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_sub:
+        CASE(i64_sub):
         {
             binary_op(stack, std::minus<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_mul:
+        CASE(i64_mul):
         {
             binary_op(stack, std::multiplies<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_div_s:
+        CASE(i64_div_s):
         {
             auto const rhs = static_cast<int64_t>(stack.peek(0));
             auto const lhs = static_cast<int64_t>(stack.peek(1));
@@ -1392,9 +2022,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_div_u:
+        CASE(i64_div_u):
         {
             auto const rhs = static_cast<uint64_t>(stack.peek());
             if (rhs == 0)
@@ -1403,9 +2033,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_rem_s:
+        CASE(i64_rem_s):
         {
             auto const rhs = static_cast<int64_t>(stack.peek());
             if (rhs == 0)
@@ -1416,14 +2046,14 @@ execution_result execute(
             auto const lhs = static_cast<int64_t>(stack.peek(1));
             if (lhs == std::numeric_limits<int64_t>::min() && rhs == -1)
             {
-                stack.drop(2);
-                stack.push(0);
+                stack.drop();
+                stack.top() = 0;
             }
             else
                 binary_op(stack, std::modulus<int64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_rem_u:
+        CASE(i64_rem_u):
         {
             auto const rhs = static_cast<uint64_t>(stack.peek());
             if (rhs == 0)
@@ -1432,143 +2062,597 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::modulus<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_and:
+        CASE(i64_and):
         {
             binary_op(stack, std::bit_and<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_or:
+        CASE(i64_or):
         {
             binary_op(stack, std::bit_or<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_xor:
+        CASE(i64_xor):
         {
             binary_op(stack, std::bit_xor<uint64_t>());
-            break;
+            NEXT();
         }
-        case Instr::i64_shl:
+        CASE(i64_shl):
         {
             binary_op(stack, shift_left<uint64_t>);
-            break;
+            NEXT();
         }
-        case Instr::i64_shr_s:
+        CASE(i64_shr_s):
         {
             binary_op(stack, shift_right<int64_t>);
-            break;
+            NEXT();
         }
-        case Instr::i64_shr_u:
+        CASE(i64_shr_u):
         {
             binary_op(stack, shift_right<uint64_t>);
-            break;
+            NEXT();
         }
-        case Instr::i64_rotl:
+        CASE(i64_rotl):
         {
             binary_op(stack, rotl<uint64_t>);
-            break;
+            NEXT();
         }
-        case Instr::i64_rotr:
+        CASE(i64_rotr):
         {
             binary_op(stack, rotr<uint64_t>);
-            break;
-        }
-        case Instr::i32_wrap_i64:
-        {
-            stack.push(static_cast<uint32_t>(stack.pop()));
-            break;
-        }
-        case Instr::i64_extend_i32_s:
-        {
-            const auto value = static_cast<int32_t>(stack.pop());
-            stack.push(static_cast<uint64_t>(int64_t{value}));
-            break;
-        }
-        case Instr::i64_extend_i32_u:
-        {
-            // effectively no-op
-            break;
-        }
-        case Instr::f32_load:
-        case Instr::f64_load:
-        case Instr::f32_store:
-        case Instr::f64_store:
-        case Instr::f32_const:
-        case Instr::f64_const:
-        case Instr::f32_eq:
-        case Instr::f32_ne:
-        case Instr::f32_lt:
-        case Instr::f32_gt:
-        case Instr::f32_le:
-        case Instr::f32_ge:
-        case Instr::f64_eq:
-        case Instr::f64_ne:
-        case Instr::f64_lt:
-        case Instr::f64_gt:
-        case Instr::f64_le:
-        case Instr::f64_ge:
-        case Instr::f32_abs:
-        case Instr::f32_neg:
-        case Instr::f32_ceil:
-        case Instr::f32_floor:
-        case Instr::f32_trunc:
-        case Instr::f32_nearest:
-        case Instr::f32_sqrt:
-        case Instr::f32_add:
-        case Instr::f32_sub:
-        case Instr::f32_mul:
-        case Instr::f32_div:
-        case Instr::f32_min:
-        case Instr::f32_max:
-        case Instr::f32_copysign:
-        case Instr::f64_abs:
-        case Instr::f64_neg:
-        case Instr::f64_ceil:
-        case Instr::f64_floor:
-        case Instr::f64_trunc:
-        case Instr::f64_nearest:
-        case Instr::f64_sqrt:
-        case Instr::f64_add:
-        case Instr::f64_sub:
-        case Instr::f64_mul:
-        case Instr::f64_div:
-        case Instr::f64_min:
-        case Instr::f64_max:
-        case Instr::f64_copysign:
-        case Instr::i32_trunc_f32_s:
-        case Instr::i32_trunc_f32_u:
-        case Instr::i32_trunc_f64_s:
-        case Instr::i32_trunc_f64_u:
-        case Instr::i64_trunc_f32_s:
-        case Instr::i64_trunc_f32_u:
-        case Instr::i64_trunc_f64_s:
-        case Instr::i64_trunc_f64_u:
-        case Instr::f32_convert_i32_s:
-        case Instr::f32_convert_i32_u:
-        case Instr::f32_convert_i64_s:
-        case Instr::f32_convert_i64_u:
-        case Instr::f32_demote_f64:
-        case Instr::f64_convert_i32_s:
-        case Instr::f64_convert_i32_u:
-        case Instr::f64_convert_i64_s:
-        case Instr::f64_convert_i64_u:
-        case Instr::f64_promote_f32:
-        case Instr::i32_reinterpret_f32:
-        case Instr::i64_reinterpret_f64:
-        case Instr::f32_reinterpret_i32:
-        case Instr::f64_reinterpret_i64:
-            throw unsupported_feature("Floating point instruction.");
+            NEXT();
+        }
+        CASE(i32_wrap_i64):
+        {
+            stack.top() = static_cast<uint32_t>(stack.top());
+            NEXT();
+        }
+        CASE(i64_extend_i32_s):
+        {
+            const auto value = static_cast<int32_t>(stack.top());
+            stack.top() = static_cast<uint64_t>(int64_t{value});
+            NEXT();
+        }
+        CASE(i64_extend_i32_u):
+        CASE(i32_reinterpret_f32):
+        CASE(i64_reinterpret_f64):
+        CASE(f32_reinterpret_i32):
+        CASE(f64_reinterpret_i64):
+        {
+            // effectively no-op, the floating point values are kept as their bits
+            NEXT();
+        }
+        SUPERINSTR_CASE(local_get_local_get):
+        {
+            const auto idx1 = read<uint32_t>(immediates);
+            const auto idx2 = read<uint32_t>(immediates);
+            assert(idx1 < frame.num_locals && idx2 < frame.num_locals);
+            stack.push(locals[frame.locals_base + idx1]);
+            stack.push(locals[frame.locals_base + idx2]);
+            NEXT();
+        }
+        SUPERINSTR_CASE(local_tee_local_get):
+        {
+            const auto idx1 = read<uint32_t>(immediates);
+            const auto idx2 = read<uint32_t>(immediates);
+            assert(idx1 < frame.num_locals && idx2 < frame.num_locals);
+            locals[frame.locals_base + idx1] = stack.top();
+            stack.push(locals[frame.locals_base + idx2]);
+            NEXT();
+        }
+        SUPERINSTR_CASE(i32_add_imm):
+        {
+            const auto imm = read<uint32_t>(immediates);
+            stack.top() = static_cast<uint32_t>(stack.top()) + imm;
+            NEXT();
+        }
+        SUPERINSTR_CASE(i64_and_imm):
+        {
+            stack.top() &= read<uint64_t>(immediates);
+            NEXT();
+        }
+        SUPERINSTR_CASE(i64_shr_u_imm):
+        {
+            stack.top() = shift_right(stack.top(), read<uint64_t>(immediates));
+            NEXT();
+        }
+        SUPERINSTR_CASE(local_get_i32_load):
+        SUPERINSTR_CASE(local_get_i64_load):
+        {
+            const auto idx = read<uint32_t>(immediates);
+            assert(idx < frame.num_locals);
+            stack.push(locals[frame.locals_base + idx]);
+
+            const auto loaded =
+                instruction == superinstr::local_get_i32_load ?
+                    load_from_memory<Checked, uint32_t>(*memory, stack, immediates) :
+                    load_from_memory<Checked, uint64_t>(*memory, stack, immediates);
+            if (!loaded)
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        SUPERINSTR_CASE(local_get_i32_add_imm_local_set):
+        {
+            const auto src_idx = read<uint32_t>(immediates);
+            const auto imm = read<uint32_t>(immediates);
+            const auto dst_idx = read<uint32_t>(immediates);
+            assert(src_idx < frame.num_locals && dst_idx < frame.num_locals);
+            locals[frame.locals_base + dst_idx] =
+                static_cast<uint32_t>(locals[frame.locals_base + src_idx]) + imm;
+            NEXT();
+        }
+        CASE(f32_eq):
+        {
+            comparison_op(stack, std::equal_to<float>());
+            NEXT();
+        }
+        CASE(f32_ne):
+        {
+            comparison_op(stack, std::not_equal_to<float>());
+            NEXT();
+        }
+        CASE(f32_lt):
+        {
+            comparison_op(stack, std::less<float>());
+            NEXT();
+        }
+        CASE(f32_gt):
+        {
+            comparison_op(stack, std::greater<float>());
+            NEXT();
+        }
+        CASE(f32_le):
+        {
+            comparison_op(stack, std::less_equal<float>());
+            NEXT();
+        }
+        CASE(f32_ge):
+        {
+            comparison_op(stack, std::greater_equal<float>());
+            NEXT();
+        }
+        CASE(f64_eq):
+        {
+            comparison_op(stack, std::equal_to<double>());
+            NEXT();
+        }
+        CASE(f64_ne):
+        {
+            comparison_op(stack, std::not_equal_to<double>());
+            NEXT();
+        }
+        CASE(f64_lt):
+        {
+            comparison_op(stack, std::less<double>());
+            NEXT();
+        }
+        CASE(f64_gt):
+        {
+            comparison_op(stack, std::greater<double>());
+            NEXT();
+        }
+        CASE(f64_le):
+        {
+            comparison_op(stack, std::less_equal<double>());
+            NEXT();
+        }
+        CASE(f64_ge):
+        {
+            comparison_op(stack, std::greater_equal<double>());
+            NEXT();
+        }
+        CASE(f32_abs):
+        {
+            fabs_op<float>(stack);
+            NEXT();
+        }
+        CASE(f32_neg):
+        {
+            fneg_op<float>(stack);
+            NEXT();
+        }
+        CASE(f32_ceil):
+        {
+            unary_op(stack, [](float a) { return std::ceil(a); });
+            NEXT();
+        }
+        CASE(f32_floor):
+        {
+            unary_op(stack, [](float a) { return std::floor(a); });
+            NEXT();
+        }
+        CASE(f32_trunc):
+        {
+            unary_op(stack, [](float a) { return std::trunc(a); });
+            NEXT();
+        }
+        CASE(f32_nearest):
+        {
+            unary_op(stack, fnearest<float>);
+            NEXT();
+        }
+        CASE(f32_sqrt):
+        {
+            unary_op(stack, [](float a) { return std::sqrt(a); });
+            NEXT();
+        }
+        CASE(f32_add):
+        {
+            binary_op(stack, std::plus<float>());
+            NEXT();
+        }
+        CASE(f32_sub):
+        {
+            binary_op(stack, std::minus<float>());
+            NEXT();
+        }
+        CASE(f32_mul):
+        {
+            binary_op(stack, std::multiplies<float>());
+            NEXT();
+        }
+        CASE(f32_div):
+        {
+            binary_op(stack, std::divides<float>());
+            NEXT();
+        }
+        CASE(f32_min):
+        {
+            binary_op(stack, fmin<float>);
+            NEXT();
+        }
+        CASE(f32_max):
+        {
+            binary_op(stack, fmax<float>);
+            NEXT();
+        }
+        CASE(f32_copysign):
+        {
+            fcopysign_op<float>(stack);
+            NEXT();
+        }
+        CASE(f64_abs):
+        {
+            fabs_op<double>(stack);
+            NEXT();
+        }
+        CASE(f64_neg):
+        {
+            fneg_op<double>(stack);
+            NEXT();
+        }
+        CASE(f64_ceil):
+        {
+            unary_op(stack, [](double a) { return std::ceil(a); });
+            NEXT();
+        }
+        CASE(f64_floor):
+        {
+            unary_op(stack, [](double a) { return std::floor(a); });
+            NEXT();
+        }
+        CASE(f64_trunc):
+        {
+            unary_op(stack, [](double a) { return std::trunc(a); });
+            NEXT();
+        }
+        CASE(f64_nearest):
+        {
+            unary_op(stack, fnearest<double>);
+            NEXT();
+        }
+        CASE(f64_sqrt):
+        {
+            unary_op(stack, [](double a) { return std::sqrt(a); });
+            NEXT();
+        }
+        CASE(f64_add):
+        {
+            binary_op(stack, std::plus<double>());
+            NEXT();
+        }
+        CASE(f64_sub):
+        {
+            binary_op(stack, std::minus<double>());
+            NEXT();
+        }
+        CASE(f64_mul):
+        {
+            binary_op(stack, std::multiplies<double>());
+            NEXT();
+        }
+        CASE(f64_div):
+        {
+            binary_op(stack, std::divides<double>());
+            NEXT();
+        }
+        CASE(f64_min):
+        {
+            binary_op(stack, fmin<double>);
+            NEXT();
+        }
+        CASE(f64_max):
+        {
+            binary_op(stack, fmax<double>);
+            NEXT();
+        }
+        CASE(f64_copysign):
+        {
+            fcopysign_op<double>(stack);
+            NEXT();
+        }
+        CASE(i32_trunc_f32_s):
+        {
+            if (!trunc_op<int32_t, float>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i32_trunc_f32_u):
+        {
+            if (!trunc_op<uint32_t, float>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i32_trunc_f64_s):
+        {
+            if (!trunc_op<int32_t, double>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i32_trunc_f64_u):
+        {
+            if (!trunc_op<uint32_t, double>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i64_trunc_f32_s):
+        {
+            if (!trunc_op<int64_t, float>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i64_trunc_f32_u):
+        {
+            if (!trunc_op<uint64_t, float>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i64_trunc_f64_s):
+        {
+            if (!trunc_op<int64_t, double>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(i64_trunc_f64_u):
+        {
+            if (!trunc_op<uint64_t, double>(stack))
+            {
+                trap = true;
+                goto end;
+            }
+            NEXT();
+        }
+        CASE(f32_convert_i32_s):
+        {
+            convert_op<float, int32_t>(stack);
+            NEXT();
+        }
+        CASE(f32_convert_i32_u):
+        {
+            convert_op<float, uint32_t>(stack);
+            NEXT();
+        }
+        CASE(f32_convert_i64_s):
+        {
+            convert_op<float, int64_t>(stack);
+            NEXT();
+        }
+        CASE(f32_convert_i64_u):
+        {
+            convert_op<float, uint64_t>(stack);
+            NEXT();
+        }
+        CASE(f32_demote_f64):
+        {
+            convert_op<float, double>(stack);
+            NEXT();
+        }
+        CASE(f64_convert_i32_s):
+        {
+            convert_op<double, int32_t>(stack);
+            NEXT();
+        }
+        CASE(f64_convert_i32_u):
+        {
+            convert_op<double, uint32_t>(stack);
+            NEXT();
+        }
+        CASE(f64_convert_i64_s):
+        {
+            convert_op<double, int64_t>(stack);
+            NEXT();
+        }
+        CASE(f64_convert_i64_u):
+        {
+            convert_op<double, uint64_t>(stack);
+            NEXT();
+        }
+        CASE(f64_promote_f32):
+        {
+            convert_op<double, float>(stack);
+            NEXT();
+        }
         default:
+#if FIZZY_COMPUTED_GOTO
+        instr_undefined:
+#endif
             assert(false);
-            break;
+            NEXT();
         }
     }
 
 end:
-    assert(labels.empty() || trap);
-    // move allows to return derived Stack<uint64_t> instance into base vector<uint64_t> value
-    return {trap, std::move(stack)};
+    assert(frames.size() == frames_base || trap);
+    context.stack.resize(stack.size());
+    return !trap;
+}
+
+#pragma GCC diagnostic pop
+
+#undef CASE
+#undef SUPERINSTR_CASE
+#undef NEXT
+
+/// The execution context taken from the thread's pool of contexts for a single execution.
+///
+/// The contexts are returned to the pool with their stack memory, so the following executions
+/// in the thread do not allocate. Each of the nested executions (e.g. of the host functions
+/// calling back into wasm) takes a separate context.
+class PooledExecutionContext
+{
+    static thread_local std::vector<std::unique_ptr<ExecutionContext>> pool;
+
+    std::unique_ptr<ExecutionContext> m_context;
+
+public:
+    PooledExecutionContext()
+    {
+        if (pool.empty())
+            m_context = std::make_unique<ExecutionContext>();
+        else
+        {
+            m_context = std::move(pool.back());
+            pool.pop_back();
+        }
+    }
+
+    ~PooledExecutionContext()
+    {
+        m_context->stack.clear();
+        m_context->frames.clear();
+        pool.emplace_back(std::move(m_context));
+    }
+
+    PooledExecutionContext(const PooledExecutionContext&) = delete;
+    PooledExecutionContext& operator=(const PooledExecutionContext&) = delete;
+
+    ExecutionContext& operator*() const noexcept { return *m_context; }
+    ExecutionContext* operator->() const noexcept { return m_context.get(); }
+};
+
+thread_local std::vector<std::unique_ptr<ExecutionContext>> PooledExecutionContext::pool;
+}  // namespace
+
+ExecutionResult execute_span(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args, int depth)
+{
+    assert(depth >= 0);
+    if (depth > CallStackLimit)
+        return {true, {}};
+
+    if (func_idx < instance.imported_functions.size())
+    {
+        const auto& func = instance.imported_functions[func_idx];
+        if (func.instance != nullptr)
+            return execute_span(*func.instance, func.func_idx, args, depth);
+
+        if (func.host_function == nullptr)
+        {
+            const auto ret =
+                func.function(instance, std::vector<uint64_t>(args.begin(), args.end()), depth);
+            if (ret.trapped)
+                return {true, {}};
+            return {false, !ret.stack.empty() ? ret.stack[0] : std::optional<uint64_t>{}};
+        }
+
+        uint64_t result;
+        const auto num_outputs = func.type.outputs.size();
+        if (!func.host_function(func.host_context, instance, args, {&result, num_outputs}, depth))
+            return {true, {}};
+        return {false, num_outputs != 0 ? result : std::optional<uint64_t>{}};
+    }
+
+    if (instance.aot_code != nullptr)
+        return execute_aot(instance, *instance.aot_code, func_idx, args, depth);
+
+    if (instance.jit_code != nullptr)
+        return execute_jit(instance, *instance.jit_code, func_idx, args, depth);
+
+    const PooledExecutionContext context;
+    context->stack.assign(args.begin(), args.end());
+
+    const auto* const memory = instance.memory.get();
+    if (memory != nullptr && memory->mode() == MemoryMode::guarded)
+    {
+        // The fault jumps out of execute_code(), which keeps the entire state in the context.
+        struct Call
+        {
+            Instance& instance;
+            FuncIdx func_idx;
+            size_t num_args;
+            ExecutionContext& context;
+            int depth;
+        } call{instance, func_idx, args.size(), *context, depth};
+
+        const auto execute_guarded = [](void* argument) {
+            auto& c = *static_cast<Call*>(argument);
+            return execute_code<false>(c.instance, c.func_idx, c.num_args, c.context, c.depth);
+        };
+        if (!call_with_memory_guard(*memory, execute_guarded, &call))
+            return {true, {}};
+    }
+    else if (!execute_code<true>(instance, func_idx, args.size(), *context, depth))
+        return {true, {}};
+
+    assert(context->stack.size() <= 1);
+    return {false, !context->stack.empty() ? context->stack[0] : std::optional<uint64_t>{}};
+}
+
+execution_result execute(
+    Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args, int depth)
+{
+    if (func_idx < instance.imported_functions.size() &&
+        instance.imported_functions[func_idx].host_function == nullptr &&
+        instance.imported_functions[func_idx].instance == nullptr)
+    {
+        assert(depth >= 0);
+        if (depth > CallStackLimit)
+            return {true, {}};
+        return instance.imported_functions[func_idx].function(instance, std::move(args), depth);
+    }
+
+    const auto [trapped, value] = execute_span(instance, func_idx, args, depth);
+    if (trapped)
+        return {true, {}};
+    if (value.has_value())
+        return {false, {*value}};
+    return {false, {}};
 }
 
 execution_result execute(const Module& module, FuncIdx func_idx, std::vector<uint64_t> args)
@@ -1590,7 +2674,7 @@ std::optional<FuncIdx> find_exported_function(const Module& module, std::string_
 
 std::optional<ExternalFunction> find_exported_function(Instance& instance, std::string_view name)
 {
-    const auto opt_index = find_export(instance.module, ExternalKind::Function, name);
+    const auto opt_index = find_export(*instance.module, ExternalKind::Function, name);
     if (!opt_index.has_value())
         return std::nullopt;
 
@@ -1599,12 +2683,15 @@ std::optional<ExternalFunction> find_exported_function(Instance& instance, std::
         return execute(instance, idx, std::move(args), depth);
     };
 
-    return ExternalFunction{std::move(func), function_type(instance, idx)};
+    auto* const func_instance = idx >= instance.imported_functions.size() ? &instance : nullptr;
+
+    return ExternalFunction{std::move(func), function_type(instance, idx), nullptr, nullptr,
+        function_type_id(instance, idx), func_instance, idx};
 }
 
 std::optional<ExternalGlobal> find_exported_global(Instance& instance, std::string_view name)
 {
-    const auto opt_index = find_export(instance.module, ExternalKind::Global, name);
+    const auto opt_index = find_export(*instance.module, ExternalKind::Global, name);
     if (!opt_index.has_value())
         return std::nullopt;
 
@@ -1620,13 +2707,13 @@ std::optional<ExternalGlobal> find_exported_global(Instance& instance, std::stri
         // global owned by instance
         const auto module_global_idx = global_idx - instance.imported_globals.size();
         return ExternalGlobal{&instance.globals[module_global_idx],
-            instance.module.globalsec[module_global_idx].is_mutable};
+            instance.module->globalsec[module_global_idx].is_mutable};
     }
 }
 
 std::optional<ExternalTable> find_exported_table(Instance& instance, std::string_view name)
 {
-    const auto& module = instance.module;
+    const auto& module = *instance.module;
 
     // Index returned from find_export is discarded, because there's no more than 1 table
     if (!find_export(module, ExternalKind::Table, name))
@@ -1652,7 +2739,7 @@ std::optional<ExternalTable> find_exported_table(Instance& instance, std::string
 
 std::optional<ExternalMemory> find_exported_memory(Instance& instance, std::string_view name)
 {
-    const auto& module = instance.module;
+    const auto& module = *instance.module;
 
     // Index returned from find_export is discarded, because there's no more than 1 memory
     if (!find_export(module, ExternalKind::Memory, name))
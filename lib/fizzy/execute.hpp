@@ -5,10 +5,14 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include "memory.hpp"
+#include "span.hpp"
 #include "types.hpp"
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <type_traits>
 
 namespace fizzy
 {
@@ -22,12 +26,50 @@ struct execution_result
     std::vector<uint64_t> stack;
 };
 
+// The result of an execution, without memory allocation.
+struct ExecutionResult
+{
+    // true if execution resulted in a trap
+    bool trapped = false;
+    // the result value, if the function has any
+    std::optional<uint64_t> value;
+};
+static_assert(std::is_trivially_copyable_v<ExecutionResult>);
+
 struct Instance;
+class AotCode;
+class JitCode;
+
+/// The low-level host function.
+///
+/// The arguments are passed as the span over the interpreter's value stack and the results are
+/// written to the @a results span of the size of the function type's outputs, so the call
+/// does not allocate.
+///
+/// @param context  The context pointer of the ExternalFunction.
+/// @return         false if the execution trapped.
+using HostFunctionPtr = bool (*)(void* context, Instance& instance, span<const uint64_t> args,
+    span<uint64_t> results, int depth);
 
 struct ExternalFunction
 {
     std::function<execution_result(Instance&, std::vector<uint64_t>, int depth)> function;
     FuncType type;
+
+    // The low-level host function, called instead of the function above if not null.
+    HostFunctionPtr host_function = nullptr;
+    // The context pointer passed to the host_function.
+    void* host_context = nullptr;
+    // The canonical id of the type, so call_indirect checks the type with a single comparison.
+    // Set by instantiate() for the imported functions and the elements of the tables, and by
+    // find_exported_function(). The functions placed in a table after its instantiation must
+    // have it set to canonical_type_id(type), otherwise call_indirect traps on them.
+    CanonicalTypeId type_id = 0;
+    // The reference to the wasm function defined in the instance's module, if not null.
+    // The interpreter calls such function directly instead of the function above, which is
+    // still set for the other users.
+    Instance* instance = nullptr;
+    FuncIdx func_idx = 0;
 };
 
 using table_elements = std::vector<std::optional<ExternalFunction>>;
@@ -41,7 +83,7 @@ struct ExternalTable
 
 struct ExternalMemory
 {
-    bytes* data = nullptr;
+    LinearMemory* data = nullptr;
     Limits limits;
 };
 
@@ -51,16 +93,17 @@ struct ExternalGlobal
     bool is_mutable = false;
 };
 
-using bytes_ptr = std::unique_ptr<bytes, void (*)(bytes*)>;
+using memory_ptr = std::unique_ptr<LinearMemory, void (*)(LinearMemory*)>;
 
 // The module instance.
 struct Instance
 {
-    Module module;
-    // Memory is either allocated and owned by the instance or imported as already allocated bytes
-    // and owned externally.
+    // The module is immutable and shared by all the instances of it, also across threads.
+    std::shared_ptr<const Module> module;
+    // Memory is either allocated and owned by the instance or imported as already allocated
+    // memory and owned externally.
     // For these cases unique_ptr would either have a normal deleter or noop deleter respectively
-    bytes_ptr memory = {nullptr, [](bytes*) {}};
+    memory_ptr memory = {nullptr, [](LinearMemory*) {}};
     size_t memory_max_pages = 0;
     // Table is either allocated and owned by the instance or imported and owned externally.
     // For these cases unique_ptr would either have a normal deleter or noop deleter respectively.
@@ -68,9 +111,18 @@ struct Instance
     std::vector<uint64_t> globals;
     std::vector<ExternalFunction> imported_functions;
     std::vector<ExternalGlobal> imported_globals;
-
-    Instance(Module _module, bytes_ptr _memory, size_t _memory_max_pages, table_ptr _table,
-        std::vector<uint64_t> _globals, std::vector<ExternalFunction> _imported_functions,
+    // The canonical ids of the types of the module's type section.
+    std::vector<CanonicalTypeId> type_ids;
+    // The machine code of the module's functions, see compile_jit(). If set, execute() runs
+    // the module's functions in it instead of the interpreter.
+    std::shared_ptr<const JitCode> jit_code;
+    // The module's functions compiled ahead of time, see load_aot(). If set, execute() runs
+    // the module's functions in it instead of the interpreter or the JIT code.
+    std::shared_ptr<const AotCode> aot_code;
+
+    Instance(std::shared_ptr<const Module> _module, memory_ptr _memory, size_t _memory_max_pages,
+        table_ptr _table, std::vector<uint64_t> _globals,
+        std::vector<ExternalFunction> _imported_functions,
         std::vector<ExternalGlobal> _imported_globals)
       : module(std::move(_module)),
         memory(std::move(_memory)),
@@ -78,21 +130,72 @@ struct Instance
         table(std::move(_table)),
         globals(std::move(_globals)),
         imported_functions(std::move(_imported_functions)),
-        imported_globals(std::move(_imported_globals))
+        imported_globals(std::move(_imported_globals)),
+        type_ids(module->type_ids.size() == module->typesec.size() ?
+                     module->type_ids :
+                     canonical_type_ids(module->typesec))
     {}
 };
 
 // Instantiate a module.
+//
+// The module is shared with the instance, nothing is copied from it, so the module can be
+// instantiated many times (also concurrently) without duplicating its sections and code.
+//
+// The memory defined in the module is allocated in the given mode, see MemoryMode.
+// The interpreter executes the guarded memory accesses without the bounds checks, so the host
+// functions called from it must not access the guarded memory out of bounds either.
+std::unique_ptr<Instance> instantiate(std::shared_ptr<const Module> module,
+    std::vector<ExternalFunction> imported_functions = {},
+    std::vector<ExternalTable> imported_tables = {},
+    std::vector<ExternalMemory> imported_memories = {},
+    std::vector<ExternalGlobal> imported_globals = {},
+    MemoryMode memory_mode = MemoryMode::checked);
+
+// Instantiate a module, taking the ownership of it.
 std::unique_ptr<Instance> instantiate(Module module,
     std::vector<ExternalFunction> imported_functions = {},
     std::vector<ExternalTable> imported_tables = {},
     std::vector<ExternalMemory> imported_memories = {},
-    std::vector<ExternalGlobal> imported_globals = {});
+    std::vector<ExternalGlobal> imported_globals = {},
+    MemoryMode memory_mode = MemoryMode::checked);
+
+// The pre-initialized instance, from which the instances are created by fork_instance().
+struct InstanceTemplate
+{
+    // The instance in the state to be copied. Its memory is replaced with the memory
+    // created from the memory image.
+    std::unique_ptr<Instance> instance;
+    // The image of the memory owned by the instance, null if the memory is imported.
+    std::shared_ptr<const MemoryImage> memory_image;
+};
+
+// Make the template of the instance, usually just after instantiate().
+InstanceTemplate make_instance_template(std::unique_ptr<Instance> instance);
+
+// Create the instance in the state of the template instance, without instantiating the module.
+//
+// The memory pages are shared with the template until written (copy-on-write), the globals
+// and the table are copied. The imported memory, table and globals are shared with the template.
+std::unique_ptr<Instance> fork_instance(const InstanceTemplate& instance_template);
+
+// Reset the instance forked from the template to the state of the template instance.
+//
+// Only the memory pages written since the fork or the previous reset are restored. The globals
+// and the table are restored as well, the imported memory, table and globals are not.
+void reset_instance(Instance& instance, const InstanceTemplate& instance_template);
 
 // Execute a function on an instance.
 execution_result execute(
     Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args, int depth = 0);
 
+// Execute a function on an instance, the variant without memory allocations.
+//
+// The arguments are not copied to a vector and the result is returned by value. The value stack
+// memory is reused from the previous executions in the thread.
+ExecutionResult execute_span(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args, int depth = 0);
+
 // TODO: remove this helper
 execution_result execute(const Module& module, FuncIdx func_idx, std::vector<uint64_t> args);
 
@@ -0,0 +1,85 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "bytes.hpp"
+#include "numeric.hpp"
+#include <cstdint>
+#include <cstring>
+
+namespace fizzy
+{
+namespace xxhash
+{
+constexpr uint64_t Prime1 = 0x9e3779b185ebca87;
+constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t Prime3 = 0x165667b19e3779f9;
+constexpr uint64_t Prime4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t Prime5 = 0x27d4eb2f165667c5;
+
+template <typename T>
+inline uint64_t load(const uint8_t* p) noexcept
+{
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) noexcept
+{
+    return rotl(acc + input * Prime2, uint64_t{31}) * Prime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t lane) noexcept
+{
+    return (acc ^ round(0, lane)) * Prime1 + Prime4;
+}
+}  // namespace xxhash
+
+/// Computes the 64-bit xxHash (XXH64) of the data.
+///
+/// The hash is fast (several GB/s) and detects the accidental changes of the data, but it is not
+/// cryptographic: the data of the given hash can be constructed on purpose.
+inline uint64_t xxhash64(bytes_view data, uint64_t seed = 0) noexcept
+{
+    using namespace xxhash;
+
+    const auto* p = data.data();
+    const auto* const end = p + data.size();
+
+    uint64_t h;
+    if (data.size() >= 32)
+    {
+        uint64_t v[4]{seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1};
+        for (; end - p >= 32; p += 32)
+        {
+            for (size_t i = 0; i < 4; ++i)
+                v[i] = xxhash::round(v[i], load<uint64_t>(p + i * 8));
+        }
+        h = rotl(v[0], uint64_t{1}) + rotl(v[1], uint64_t{7}) + rotl(v[2], uint64_t{12}) +
+            rotl(v[3], uint64_t{18});
+        for (const auto lane : v)
+            h = merge_round(h, lane);
+    }
+    else
+        h = seed + Prime5;
+
+    h += data.size();
+
+    for (; end - p >= 8; p += 8)
+        h = rotl(h ^ xxhash::round(0, load<uint64_t>(p)), uint64_t{27}) * Prime1 + Prime4;
+    if (end - p >= 4)
+    {
+        h = rotl(h ^ (load<uint32_t>(p) * Prime1), uint64_t{23}) * Prime2 + Prime3;
+        p += 4;
+    }
+    for (; p != end; ++p)
+        h = rotl(h ^ (uint64_t{*p} * Prime5), uint64_t{11}) * Prime1;
+
+    h = (h ^ (h >> 33)) * Prime2;
+    h = (h ^ (h >> 29)) * Prime3;
+    return h ^ (h >> 32);
+}
+}  // namespace fizzy
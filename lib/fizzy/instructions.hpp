@@ -4,10 +4,45 @@
 
 #pragma once
 
+#include "types.hpp"
 #include <cstdint>
 
 namespace fizzy
 {
+/// The superinstructions: the internal instructions replacing frequent sequences of wasm
+/// instructions, chosen from the instruction pair statistics of the execution benchmarks.
+///
+/// They are emitted only by parse_expr() and use the opcodes 0xe0-0xe7, not assigned to any wasm
+/// instruction, also of the standardized extensions (e.g. 0xc0-0xc4 are the sign-extension
+/// instructions), so they are not part of the binary encoding (the parser rejects them in input).
+/// The immediates of a superinstruction are the immediates of the fused instructions in order.
+namespace superinstr
+{
+/// local.get a; local.get b
+constexpr auto local_get_local_get = static_cast<Instr>(0xe0);
+
+/// local.tee a; local.get b
+constexpr auto local_tee_local_get = static_cast<Instr>(0xe1);
+
+/// i32.const c; i32.add
+constexpr auto i32_add_imm = static_cast<Instr>(0xe2);
+
+/// i64.const c; i64.and
+constexpr auto i64_and_imm = static_cast<Instr>(0xe3);
+
+/// i64.const c; i64.shr_u
+constexpr auto i64_shr_u_imm = static_cast<Instr>(0xe4);
+
+/// local.get a; i32.load offset
+constexpr auto local_get_i32_load = static_cast<Instr>(0xe5);
+
+/// local.get a; i64.load offset
+constexpr auto local_get_i64_load = static_cast<Instr>(0xe6);
+
+/// local.get a; i32.const c; i32.add; local.set b
+constexpr auto local_get_i32_add_imm_local_set = static_cast<Instr>(0xe7);
+}  // namespace superinstr
+
 struct InstructionMetrics
 {
     /// The minimum number of the stack items required for the instruction.
@@ -0,0 +1,1419 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "jit.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+
+#include "instructions.hpp"
+#include "limits.hpp"
+#include "numeric.hpp"
+#include "register_ir.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <new>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch"  // Superinstruction opcodes are not Instr enumerators.
+
+namespace fizzy
+{
+namespace
+{
+/// The state of the execution shared by the compiled code and the runtime helpers.
+/// The compiled code keeps the pointer to it in r12 and accesses the fields by their offsets.
+struct JitContext
+{
+    uint8_t* memory_data = nullptr;
+    uint64_t memory_size = 0;
+    uint64_t* globals = nullptr;
+    ExternalGlobal* imported_globals = nullptr;
+    int32_t depth = 0;
+    Instance* instance = nullptr;
+    const JitCode* code = nullptr;
+    /// The exception thrown by a runtime helper, to be rethrown after the compiled code returns.
+    /// The exceptions must not be propagated through the frames of the compiled code.
+    std::exception_ptr exception;
+};
+
+/// The compiled function takes the pointer to its frame slots in rdi
+/// and returns non-zero in eax if the execution trapped.
+///
+/// The entry trampoline at the beginning of the code sets up the registers of the compiled code
+/// from the context and calls the function.
+using EntryFn = int (*)(JitContext* context, uint64_t* slots, const uint8_t* func);
+
+void update_memory(JitContext& context) noexcept
+{
+    auto* const memory = context.instance->memory.get();
+    context.memory_data = memory != nullptr ? memory->data() : nullptr;
+    context.memory_size = memory != nullptr ? memory->size() : 0;
+}
+
+/// The memory of the frame slots of the thread's executions in the compiled code.
+///
+/// The compiled code does not check the frame bounds: the calls place the callee's frame within
+/// the caller's, so an execution at the given depth reserves the address space of the deepest
+/// possible call stack, i.e. (CallStackLimit - depth + 1) * max_frame_size slots. The pages are
+/// committed by the OS on first use, so only the frames actually reached use the memory.
+/// E.g. the reservation of a function of 10000 slots at depth 0 is 160 MB of the address space,
+/// but a call stack of 10 frames commits only 800 KB of it.
+///
+/// The nested executions (e.g. started by host functions) take the space following the slots of
+/// the calling frame, which is within the outer reservation for the executions of the same code
+/// (see SlotRelease), so the reservations do not accumulate with the nesting.
+class SlotStack
+{
+    uint64_t* m_begin = nullptr;
+    size_t m_capacity = 0;
+    size_t m_top = 0;
+
+    static uint64_t* map(size_t size)
+    {
+        void* const ptr = mmap(nullptr, size * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+        return static_cast<uint64_t*>(ptr);
+    }
+
+    static void unmap(uint64_t* ptr, size_t size) noexcept
+    {
+        munmap(ptr, size * sizeof(uint64_t));
+    }
+
+public:
+    SlotStack() = default;
+    SlotStack(const SlotStack&) = delete;
+    SlotStack& operator=(const SlotStack&) = delete;
+
+    ~SlotStack()
+    {
+        if (m_begin != nullptr)
+            unmap(m_begin, m_capacity);
+    }
+
+    uint64_t* allocate(size_t size)
+    {
+        if (m_capacity - m_top >= size)
+        {
+            auto* const ptr = m_begin + m_top;
+            m_top += size;
+            return ptr;
+        }
+
+        if (m_top != 0)
+        {
+            // The space is in use by an outer execution, the separate mapping is used.
+            return map(size);
+        }
+
+        const auto new_capacity = std::max(size, 2 * m_capacity);
+        auto* const new_begin = map(new_capacity);
+        if (m_begin != nullptr)
+            unmap(m_begin, m_capacity);
+        m_begin = new_begin;
+        m_capacity = new_capacity;
+        m_top = size;
+        return m_begin;
+    }
+
+    /// Returns the space following @a end, which is in use by the current execution, to the
+    /// stack for the nested executions. Returns the previous top to be restored by restore().
+    size_t release_above(const uint64_t* end) noexcept
+    {
+        const auto top = m_top;
+        if (end > m_begin && end <= m_begin + m_top)
+            m_top = static_cast<size_t>(end - m_begin);
+        return top;
+    }
+
+    void restore(size_t top) noexcept { m_top = top; }
+
+    void deallocate(uint64_t* ptr, size_t size) noexcept
+    {
+        if (ptr >= m_begin && ptr < m_begin + m_capacity)
+        {
+            assert(ptr + size == m_begin + m_top);
+            m_top = static_cast<size_t>(ptr - m_begin);
+        }
+        else
+            unmap(ptr, size);
+    }
+};
+
+thread_local SlotStack slot_stack;
+
+/// The frame slots of an execution, allocated from the thread's SlotStack.
+class SlotLease
+{
+    uint64_t* m_slots = nullptr;
+    size_t m_size = 0;
+
+public:
+    explicit SlotLease(size_t size) : m_slots{slot_stack.allocate(size)}, m_size{size} {}
+    ~SlotLease() { slot_stack.deallocate(m_slots, m_size); }
+
+    SlotLease(const SlotLease&) = delete;
+    SlotLease& operator=(const SlotLease&) = delete;
+
+    uint64_t* data() const noexcept { return m_slots; }
+};
+
+/// Makes the slots following @a end available to the nested executions for the lifetime
+/// of the object, see SlotStack::release_above().
+class SlotRelease
+{
+    size_t m_top = 0;
+
+public:
+    explicit SlotRelease(const uint64_t* end) noexcept : m_top{slot_stack.release_above(end)} {}
+    ~SlotRelease() { slot_stack.restore(m_top); }
+
+    SlotRelease(const SlotRelease&) = delete;
+    SlotRelease& operator=(const SlotRelease&) = delete;
+};
+}  // namespace
+
+class JitCode
+{
+    uint8_t* m_code = nullptr;
+    size_t m_code_size = 0;
+
+    /// The offsets of the functions in the code, in the order of the module's code section.
+    std::vector<uint32_t> m_function_offsets;
+
+    /// The maximum frame size of all functions.
+    uint32_t m_max_frame_size = 0;
+
+public:
+    JitCode(const std::vector<uint8_t>& code, std::vector<uint32_t> function_offsets,
+        uint32_t max_frame_size)
+      : m_code_size{code.size()},
+        m_function_offsets{std::move(function_offsets)},
+        m_max_frame_size{max_frame_size}
+    {
+        // The code is written to the writable mapping, which is then made executable.
+        void* const ptr =
+            mmap(nullptr, m_code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+        m_code = static_cast<uint8_t*>(ptr);
+        std::memcpy(m_code, code.data(), m_code_size);
+        if (mprotect(m_code, m_code_size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(m_code, m_code_size);
+            throw std::bad_alloc();
+        }
+    }
+
+    ~JitCode() { munmap(m_code, m_code_size); }
+
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    EntryFn entry() const noexcept { return reinterpret_cast<EntryFn>(m_code); }
+
+    /// Returns the compiled function of the given index in the module's code section.
+    const uint8_t* function(size_t code_idx) const noexcept
+    {
+        assert(code_idx < m_function_offsets.size());
+        return m_code + m_function_offsets[code_idx];
+    }
+
+    uint32_t max_frame_size() const noexcept { return m_max_frame_size; }
+};
+
+namespace
+{
+/// Calls the function outside of the compiled code, see invoke_external_function().
+int call_external(JitContext& context, const ExternalFunction& func, uint64_t* args) noexcept
+{
+    // The slots following the arguments are not used by the caller until the function returns.
+    const SlotRelease release{args + func.type.inputs.size()};
+
+    bool ok = false;
+    try
+    {
+        ok = invoke_external_function(func, *context.instance, args, context.depth);
+    }
+    catch (...)
+    {
+        context.exception = std::current_exception();
+    }
+    // The memory may have been grown by the called function.
+    update_memory(context);
+    return ok ? 0 : 1;
+}
+
+int call_imported_helper(JitContext* context, uint64_t* args, uint32_t func_idx) noexcept
+{
+    return call_external(*context, context->instance->imported_functions[func_idx], args);
+}
+
+int call_indirect_helper(
+    JitContext* context, uint64_t* args, uint32_t elem_idx, uint32_t type_idx) noexcept
+{
+    auto& instance = *context->instance;
+    assert(instance.table != nullptr);
+
+    if (elem_idx >= instance.table->size())
+        return 1;
+
+    const auto& called_func = (*instance.table)[elem_idx];
+    if (!called_func.has_value())
+        return 1;
+
+    // check actual type against expected type
+    if (called_func->type_id != instance.type_ids[type_idx])
+        return 1;
+
+    // The function of this instance is called directly in the compiled code.
+    if (called_func->instance == &instance)
+    {
+        if (context->depth >= CallStackLimit)
+            return 1;
+
+        const auto& code = *context->code;
+        const auto code_idx = called_func->func_idx - instance.imported_functions.size();
+        ++context->depth;
+        const auto trapped = code.entry()(context, args, code.function(code_idx));
+        --context->depth;
+        return trapped;
+    }
+
+    return call_external(*context, *called_func, args);
+}
+
+uint64_t memory_grow_helper(JitContext* context, uint32_t delta) noexcept
+{
+    auto& instance = *context->instance;
+    const auto ret = instance.memory->grow_pages(delta, instance.memory_max_pages);
+    update_memory(*context);
+    return ret;
+}
+
+/// Executes the floating point instruction not compiled to the native code,
+/// see execute_float_instruction().
+int float_helper(uint64_t* slots, uint32_t op, uint32_t dst, uint32_t a, uint32_t b) noexcept
+{
+    const RegInstr instr{static_cast<Instr>(op), dst, a, b, 0};
+    return execute_float_instruction(instr, slots) ? 0 : 1;
+}
+
+uint64_t clz32_helper(uint64_t value) noexcept
+{
+    return clz32(static_cast<uint32_t>(value));
+}
+
+uint64_t ctz32_helper(uint64_t value) noexcept
+{
+    return ctz32(static_cast<uint32_t>(value));
+}
+
+uint64_t popcnt32_helper(uint64_t value) noexcept
+{
+    return popcnt32(static_cast<uint32_t>(value));
+}
+
+uint64_t clz64_helper(uint64_t value) noexcept
+{
+    return clz64(value);
+}
+
+uint64_t ctz64_helper(uint64_t value) noexcept
+{
+    return ctz64(value);
+}
+
+uint64_t popcnt64_helper(uint64_t value) noexcept
+{
+    return popcnt64(value);
+}
+
+enum Reg : uint8_t
+{
+    rax,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+    r14,
+    r15,
+    no_reg = 0xff,
+};
+
+/// The x86-64 condition codes.
+enum Cond : uint8_t
+{
+    cond_b = 0x2,
+    cond_ae = 0x3,
+    cond_e = 0x4,
+    cond_ne = 0x5,
+    cond_be = 0x6,
+    cond_a = 0x7,
+    cond_l = 0xc,
+    cond_ge = 0xd,
+    cond_le = 0xe,
+    cond_g = 0xf,
+};
+
+/// The encoder of the subset of x86-64 instructions used by the compiler.
+class Assembler
+{
+    std::vector<uint8_t> m_code;
+
+public:
+    std::vector<uint8_t>& code() noexcept { return m_code; }
+
+    size_t size() const noexcept { return m_code.size(); }
+
+    void emit(std::initializer_list<uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+
+    void emit_u32(uint32_t value)
+    {
+        uint8_t bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        m_code.insert(m_code.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    void emit_u64(uint64_t value)
+    {
+        uint8_t bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        m_code.insert(m_code.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    void patch_u32(size_t pos, uint32_t value) noexcept
+    {
+        std::memcpy(&m_code[pos], &value, sizeof(value));
+    }
+
+    /// Emits the instruction with the register operand @a reg (or the opcode extension)
+    /// and the memory operand [base + index * 2^scale + disp].
+    void op_mem(bool wide, std::initializer_list<uint8_t> opcode, unsigned reg, Reg base,
+        int32_t disp, Reg index = no_reg, unsigned scale = 0)
+    {
+        const unsigned index_bits = index != no_reg ? index : 0;
+        rex(wide, reg, index_bits, base);
+        emit(opcode);
+
+        const bool disp8 = disp >= -128 && disp <= 127;
+        // The displacement is always present, so the r13 and rbp base need no special handling.
+        const uint8_t mod = disp8 ? 0x40 : 0x80;
+        if (index != no_reg || (base & 7) == rsp)
+        {
+            // The SIB byte follows, the index 100b means no index.
+            const unsigned sib_index = index != no_reg ? (index & 7u) : 4u;
+            emit({static_cast<uint8_t>(mod | ((reg & 7) << 3) | 4),
+                static_cast<uint8_t>((scale << 6) | (sib_index << 3) | (base & 7))});
+        }
+        else
+            emit({static_cast<uint8_t>(mod | ((reg & 7) << 3) | (base & 7))});
+
+        if (disp8)
+            emit({static_cast<uint8_t>(disp)});
+        else
+            emit_u32(static_cast<uint32_t>(disp));
+    }
+
+    /// Emits the instruction with the register operands @a reg (or the opcode extension)
+    /// and @a rm.
+    void op_reg(bool wide, std::initializer_list<uint8_t> opcode, unsigned reg, Reg rm)
+    {
+        rex(wide, reg, 0, rm);
+        emit(opcode);
+        emit({static_cast<uint8_t>(0xc0 | ((reg & 7) << 3) | (rm & 7))});
+    }
+
+    void mov_imm64(Reg reg, uint64_t value)
+    {
+        rex(true, 0, 0, reg);
+        emit({static_cast<uint8_t>(0xb8 + (reg & 7))});
+        emit_u64(value);
+    }
+
+    void mov_imm32(Reg reg, uint32_t value)
+    {
+        rex(false, 0, 0, reg);
+        emit({static_cast<uint8_t>(0xb8 + (reg & 7))});
+        emit_u32(value);
+    }
+
+    void push(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        emit({static_cast<uint8_t>(0x50 + (reg & 7))});
+    }
+
+    void pop(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        emit({static_cast<uint8_t>(0x58 + (reg & 7))});
+    }
+
+    /// Calls the function at the absolute address.
+    void call_abs(const void* func)
+    {
+        mov_imm64(rax, reinterpret_cast<uint64_t>(func));
+        op_reg(false, {0xff}, 2, rax);
+    }
+
+    /// Emits the conditional short jump, to be bound with bind_short().
+    size_t jcc_short(Cond cond)
+    {
+        emit({static_cast<uint8_t>(0x70 + cond), 0});
+        return size();
+    }
+
+    /// Emits the unconditional short jump, to be bound with bind_short().
+    size_t jmp_short()
+    {
+        emit({0xeb, 0});
+        return size();
+    }
+
+    /// Sets the target of the short jump to the current position.
+    void bind_short(size_t jump_end) noexcept
+    {
+        const auto distance = size() - jump_end;
+        assert(distance <= 127);
+        m_code[jump_end - 1] = static_cast<uint8_t>(distance);
+    }
+
+private:
+    void rex(bool wide, unsigned reg, unsigned index, unsigned base)
+    {
+        const auto value = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1) |
+                                                ((index & 8) >> 2) | ((base & 8) >> 3));
+        if (value != 0x40)
+            emit({value});
+    }
+};
+
+/// The registers of the compiled code, preserved across the calls.
+constexpr auto slots_reg = rbx;    ///< The frame slots of the current function.
+constexpr auto context_reg = r12;  ///< The JitContext.
+constexpr auto memory_reg = r13;   ///< The memory data.
+constexpr auto mem_size_reg = r14;  ///< The memory size.
+
+constexpr int32_t slot_disp(uint32_t slot) noexcept
+{
+    return static_cast<int32_t>(slot * sizeof(uint64_t));
+}
+
+constexpr int32_t context_disp(size_t offset) noexcept
+{
+    return static_cast<int32_t>(offset);
+}
+
+/// The single-pass compiler of the register IR of the module's functions.
+class Compiler
+{
+    const Module& m_module;
+    Assembler m_asm;
+
+    /// The offsets of the compiled functions.
+    std::vector<uint32_t> m_function_offsets;
+
+    /// The calls to be resolved: the rel32 position and the called function's code index.
+    std::vector<std::pair<size_t, size_t>> m_calls;
+
+    /// The positions of the current function's instructions. The position following the
+    /// instructions is the trap exit of the function.
+    std::vector<size_t> m_labels;
+
+    /// The jumps of the current function to be resolved.
+    struct Jump
+    {
+        size_t pos;     ///< The position of the 32-bit offset.
+        size_t base;    ///< The position the offset is relative to.
+        size_t target;  ///< The target instruction index.
+    };
+    std::vector<Jump> m_jumps;
+
+    /// The index of the trap exit label of the current function.
+    size_t m_trap = 0;
+
+public:
+    explicit Compiler(const Module& module) : m_module{module} {}
+
+    std::shared_ptr<const JitCode> compile();
+
+private:
+    void emit_entry();
+    void compile_function(const RegCode& code);
+    void compile_instruction(const RegInstr* instructions, size_t index);
+
+    void load(Reg reg, uint32_t slot, bool wide = true)
+    {
+        m_asm.op_mem(wide, {0x8b}, reg, slots_reg, slot_disp(slot));
+    }
+
+    void store(uint32_t slot, Reg reg)
+    {
+        m_asm.op_mem(true, {0x89}, reg, slots_reg, slot_disp(slot));
+    }
+
+    void copy(uint32_t dst, uint32_t src)
+    {
+        if (dst == src)
+            return;
+        load(rax, src);
+        store(dst, rax);
+    }
+
+    /// Compares the 32-bit slot value with 0.
+    void test_slot(uint32_t slot)
+    {
+        m_asm.op_mem(false, {0x83}, 7, slots_reg, slot_disp(slot));  // cmp dword [slot], 0
+        m_asm.emit({0});
+    }
+
+    void jump(size_t target)
+    {
+        m_asm.emit({0xe9});
+        add_jump(target);
+    }
+
+    void jump_if(Cond cond, size_t target)
+    {
+        m_asm.emit({0x0f, static_cast<uint8_t>(0x80 + cond)});
+        add_jump(target);
+    }
+
+    void trap_if(Cond cond) { jump_if(cond, m_trap); }
+
+    void add_jump(size_t target)
+    {
+        m_jumps.push_back({m_asm.size(), m_asm.size() + 4, target});
+        m_asm.emit_u32(0);
+    }
+
+    void reload_memory()
+    {
+        m_asm.op_mem(true, {0x8b}, memory_reg, context_reg,
+            context_disp(offsetof(JitContext, memory_data)));
+        m_asm.op_mem(true, {0x8b}, mem_size_reg, context_reg,
+            context_disp(offsetof(JitContext, memory_size)));
+    }
+
+    /// Calls the helper returning non-zero on trap.
+    void call_helper(const void* helper)
+    {
+        m_asm.call_abs(helper);
+        m_asm.op_reg(false, {0x85}, rax, rax);  // test eax, eax
+        trap_if(cond_ne);
+    }
+
+    void call_function(const RegInstr& instr);
+    void binary(const RegInstr& instr, bool wide, std::initializer_list<uint8_t> opcode);
+    void shift(const RegInstr& instr, bool wide, unsigned ext);
+    void compare(const RegInstr& instr, bool wide, Cond cond);
+    void unary_helper(const RegInstr& instr, const void* helper);
+    void float_arithmetic(const RegInstr& instr, bool wide, uint8_t opcode, bool unary = false);
+    void float_instruction(const RegInstr& instr);
+    void divide(const RegInstr& instr, bool wide, bool is_signed, bool remainder);
+    void memory_address(const RegInstr& instr, uint32_t size);
+    void load_memory(
+        const RegInstr& instr, uint32_t size, bool wide, std::initializer_list<uint8_t> opcode);
+    void store_memory(const RegInstr& instr, uint32_t size);
+};
+
+std::shared_ptr<const JitCode> Compiler::compile()
+{
+    const auto code = translate_to_register_ir(m_module);
+
+    emit_entry();
+
+    uint32_t max_frame_size = 1;
+    for (const auto& func_code : code)
+    {
+        m_function_offsets.push_back(static_cast<uint32_t>(m_asm.size()));
+        compile_function(func_code);
+        max_frame_size = std::max(max_frame_size, func_code.frame_size);
+    }
+
+    for (const auto& [pos, code_idx] : m_calls)
+    {
+        const auto target = m_function_offsets[code_idx];
+        m_asm.patch_u32(pos, static_cast<uint32_t>(target - (pos + 4)));
+    }
+
+    return std::make_shared<JitCode>(
+        m_asm.code(), std::move(m_function_offsets), max_frame_size);
+}
+
+void Compiler::emit_entry()
+{
+    // The callee-saved registers used by the compiled code are saved. r15 keeps the stack aligned.
+    for (const auto reg : {rbx, r12, r13, r14, r15})
+        m_asm.push(reg);
+    m_asm.op_reg(true, {0x89}, rdi, context_reg);  // mov r12, rdi
+    reload_memory();
+    m_asm.op_reg(true, {0x89}, rsi, rdi);  // mov rdi, rsi
+    m_asm.op_reg(false, {0xff}, 2, rdx);   // call rdx
+    for (const auto reg : {r15, r14, r13, r12, rbx})
+        m_asm.pop(reg);
+    m_asm.emit({0xc3});  // ret
+}
+
+void Compiler::compile_function(const RegCode& code)
+{
+    const auto num_instructions = code.instructions.size();
+    m_labels.assign(num_instructions + 1, 0);
+    m_jumps.clear();
+    m_trap = num_instructions;
+
+    // Prologue.
+    m_asm.push(slots_reg);
+    m_asm.op_reg(true, {0x89}, rdi, slots_reg);  // mov rbx, rdi
+
+    // Zero the locals following the arguments.
+    const auto num_zeroed = code.num_locals - code.num_args;
+    if (num_zeroed <= 8)
+    {
+        for (auto i = code.num_args; i < code.num_locals; ++i)
+        {
+            m_asm.op_mem(true, {0xc7}, 0, slots_reg, slot_disp(i));  // mov qword [slot], 0
+            m_asm.emit_u32(0);
+        }
+    }
+    else
+    {
+        m_asm.op_mem(true, {0x8d}, rdi, slots_reg, slot_disp(code.num_args));  // lea rdi, [slot]
+        m_asm.op_reg(false, {0x31}, rax, rax);                                  // xor eax, eax
+        m_asm.mov_imm32(rcx, num_zeroed);
+        m_asm.emit({0xf3, 0x48, 0xab});  // rep stosq
+    }
+
+    for (size_t i = 0; i < num_instructions; ++i)
+    {
+        m_labels[i] = m_asm.size();
+        compile_instruction(code.instructions.data(), i);
+    }
+
+    // The trap exit.
+    m_labels[m_trap] = m_asm.size();
+    m_asm.mov_imm32(rax, 1);
+    m_asm.pop(slots_reg);
+    m_asm.emit({0xc3});  // ret
+
+    for (const auto& jump : m_jumps)
+        m_asm.patch_u32(jump.pos, static_cast<uint32_t>(m_labels[jump.target] - jump.base));
+}
+
+void Compiler::call_function(const RegInstr& instr)
+{
+    const auto func_idx = static_cast<FuncIdx>(instr.imm);
+    const auto num_imported_functions = m_module.imported_function_types.size();
+
+    if (func_idx < num_imported_functions)
+    {
+        m_asm.op_reg(true, {0x89}, context_reg, rdi);                           // mov rdi, r12
+        m_asm.op_mem(true, {0x8d}, rsi, slots_reg, slot_disp(instr.dst));  // lea rsi, [args]
+        m_asm.mov_imm32(rdx, func_idx);
+        call_helper(reinterpret_cast<const void*>(&call_imported_helper));
+        reload_memory();
+        return;
+    }
+
+    const auto depth_disp = context_disp(offsetof(JitContext, depth));
+    m_asm.op_mem(false, {0x81}, 7, context_reg, depth_disp);  // cmp dword [depth], limit
+    m_asm.emit_u32(CallStackLimit);
+    trap_if(cond_ge);
+    m_asm.op_mem(false, {0xff}, 0, context_reg, depth_disp);  // inc dword [depth]
+
+    m_asm.op_mem(true, {0x8d}, rdi, slots_reg, slot_disp(instr.dst));  // lea rdi, [args]
+    m_asm.emit({0xe8});                                                  // call rel32
+    m_calls.emplace_back(m_asm.size(), func_idx - num_imported_functions);
+    m_asm.emit_u32(0);
+
+    m_asm.op_mem(false, {0xff}, 1, context_reg, depth_disp);  // dec dword [depth]
+    m_asm.op_reg(false, {0x85}, rax, rax);                   // test eax, eax
+    trap_if(cond_ne);
+    reload_memory();
+}
+
+void Compiler::binary(const RegInstr& instr, bool wide, std::initializer_list<uint8_t> opcode)
+{
+    load(rax, instr.a, wide);
+    m_asm.op_mem(wide, opcode, rax, slots_reg, slot_disp(instr.b));
+    store(instr.dst, rax);
+}
+
+void Compiler::shift(const RegInstr& instr, bool wide, unsigned ext)
+{
+    // The shift count in cl is masked by the CPU the same way as wasm specifies.
+    load(rax, instr.a, wide);
+    load(rcx, instr.b, false);
+    m_asm.op_reg(wide, {0xd3}, ext, rax);
+    store(instr.dst, rax);
+}
+
+void Compiler::compare(const RegInstr& instr, bool wide, Cond cond)
+{
+    load(rax, instr.a, wide);
+    m_asm.op_mem(wide, {0x3b}, rax, slots_reg, slot_disp(instr.b));    // cmp rax, [b]
+    m_asm.op_reg(false, {0x0f, static_cast<uint8_t>(0x90 + cond)}, 0, rax);  // setcc al
+    m_asm.op_reg(false, {0x0f, 0xb6}, rax, rax);                         // movzx eax, al
+    store(instr.dst, rax);
+}
+
+void Compiler::unary_helper(const RegInstr& instr, const void* helper)
+{
+    load(rdi, instr.a);
+    m_asm.call_abs(helper);
+    store(instr.dst, rax);
+}
+
+void Compiler::float_arithmetic(const RegInstr& instr, bool wide, uint8_t opcode, bool unary)
+{
+    // The SSE scalar instructions round to nearest, ties to even and produce the NaNs
+    // allowed by wasm, so they match the interpreter.
+    const uint8_t prefix = wide ? 0xf2 : 0xf3;
+    if (!unary)
+    {
+        m_asm.emit({prefix});
+        m_asm.op_mem(false, {0x0f, 0x10}, 0, slots_reg, slot_disp(instr.a));  // movs[sd] xmm0, [a]
+    }
+    const auto src = unary ? instr.a : instr.b;
+    m_asm.emit({prefix});
+    m_asm.op_mem(false, {0x0f, opcode}, 0, slots_reg, slot_disp(src));  // op xmm0, [src]
+    if (wide)
+    {
+        m_asm.emit({prefix});
+        m_asm.op_mem(false, {0x0f, 0x11}, 0, slots_reg, slot_disp(instr.dst));  // movsd [dst], xmm0
+    }
+    else
+    {
+        // The f32 result is zero-extended in the slot.
+        m_asm.emit({0x66});
+        m_asm.op_reg(false, {0x0f, 0x7e}, 0, rax);  // movd eax, xmm0
+        store(instr.dst, rax);
+    }
+}
+
+void Compiler::float_instruction(const RegInstr& instr)
+{
+    m_asm.op_reg(true, {0x89}, slots_reg, rdi);  // mov rdi, rbx
+    m_asm.mov_imm32(rsi, static_cast<uint32_t>(instr.op));
+    m_asm.mov_imm32(rdx, instr.dst);
+    m_asm.mov_imm32(rcx, instr.a);
+    m_asm.mov_imm32(r8, instr.b);
+    call_helper(reinterpret_cast<const void*>(&float_helper));
+}
+
+void Compiler::divide(const RegInstr& instr, bool wide, bool is_signed, bool remainder)
+{
+    load(rax, instr.a, wide);
+    load(rcx, instr.b, wide);
+    m_asm.op_reg(wide, {0x85}, rcx, rcx);  // test rcx, rcx
+    trap_if(cond_e);
+
+    size_t done = 0;
+    if (is_signed)
+    {
+        // The division of the minimum value by -1 overflows: it traps for div
+        // and the result of rem is 0.
+        m_asm.op_reg(wide, {0x83}, 7, rcx);  // cmp rcx, -1
+        m_asm.emit({0xff});
+        const auto not_minus_one = m_asm.jcc_short(cond_ne);
+        if (remainder)
+        {
+            m_asm.op_reg(false, {0x31}, rax, rax);  // xor eax, eax
+            done = m_asm.jmp_short();
+        }
+        else
+        {
+            if (wide)
+            {
+                m_asm.mov_imm64(rdx, uint64_t{1} << 63);
+                m_asm.op_reg(true, {0x3b}, rax, rdx);  // cmp rax, rdx
+            }
+            else
+            {
+                m_asm.op_reg(false, {0x81}, 7, rax);  // cmp eax, imm32
+                m_asm.emit_u32(uint32_t{1} << 31);
+            }
+            trap_if(cond_e);
+        }
+        m_asm.bind_short(not_minus_one);
+        if (wide)
+            m_asm.emit({0x48, 0x99});  // cqo
+        else
+            m_asm.emit({0x99});  // cdq
+        m_asm.op_reg(wide, {0xf7}, 7, rcx);  // idiv rcx
+    }
+    else
+    {
+        m_asm.op_reg(false, {0x31}, rdx, rdx);  // xor edx, edx
+        m_asm.op_reg(wide, {0xf7}, 6, rcx);     // div rcx
+    }
+
+    if (remainder)
+        m_asm.op_reg(true, {0x89}, rdx, rax);  // mov rax, rdx
+
+    if (done != 0)
+        m_asm.bind_short(done);
+    store(instr.dst, rax);
+}
+
+void Compiler::memory_address(const RegInstr& instr, uint32_t size)
+{
+    // rdx = address + offset + size, checked against the memory size. The address is 32-bit,
+    // but the sum is 64-bit, so it does not overflow.
+    load(rax, instr.a, false);
+    const auto end = instr.imm + size;
+    if (end <= uint64_t{std::numeric_limits<int32_t>::max()})
+        m_asm.op_mem(true, {0x8d}, rdx, rax, static_cast<int32_t>(end));  // lea rdx, [rax + end]
+    else
+    {
+        m_asm.mov_imm64(rdx, end);
+        m_asm.op_reg(true, {0x03}, rdx, rax);  // add rdx, rax
+    }
+    m_asm.op_reg(true, {0x3b}, rdx, mem_size_reg);  // cmp rdx, r14
+    trap_if(cond_a);
+}
+
+void Compiler::load_memory(
+    const RegInstr& instr, uint32_t size, bool wide, std::initializer_list<uint8_t> opcode)
+{
+    memory_address(instr, size);
+    m_asm.op_mem(wide, opcode, rax, memory_reg, -static_cast<int32_t>(size), rdx);
+    store(instr.dst, rax);
+}
+
+void Compiler::store_memory(const RegInstr& instr, uint32_t size)
+{
+    memory_address(instr, size);
+    load(rcx, instr.b);
+    const auto disp = -static_cast<int32_t>(size);
+    switch (size)
+    {
+    case 1:
+        m_asm.op_mem(false, {0x88}, rcx, memory_reg, disp, rdx);
+        break;
+    case 2:
+        m_asm.emit({0x66});
+        m_asm.op_mem(false, {0x89}, rcx, memory_reg, disp, rdx);
+        break;
+    default:
+        m_asm.op_mem(size == 8, {0x89}, rcx, memory_reg, disp, rdx);
+        break;
+    }
+}
+
+void Compiler::compile_instruction(const RegInstr* instructions, size_t index)
+{
+    const auto& instr = instructions[index];
+    switch (instr.op)
+    {
+    case Instr::unreachable:
+        jump(m_trap);
+        break;
+    case Instr::if_:
+        test_slot(instr.a);
+        jump_if(cond_e, instr.imm);
+        break;
+    case Instr::br:
+        copy(instr.dst, instr.a);
+        jump(instr.imm);
+        break;
+    case Instr::br_if:
+        test_slot(instr.b);
+        if (instr.dst == instr.a)
+            jump_if(cond_ne, instr.imm);
+        else
+        {
+            const auto skip = m_asm.jcc_short(cond_e);
+            copy(instr.dst, instr.a);
+            jump(instr.imm);
+            m_asm.bind_short(skip);
+        }
+        break;
+    case Instr::br_table:
+    {
+        // The br instructions of the labels follow, the last one is for the default label.
+        // The jump table holds their offsets relative to the table.
+        load(rax, instr.a, false);
+        m_asm.mov_imm32(rcx, instr.b);
+        m_asm.op_reg(false, {0x3b}, rax, rcx);        // cmp eax, ecx
+        m_asm.op_reg(false, {0x0f, 0x47}, rax, rcx);  // cmova eax, ecx
+        m_asm.emit({0x48, 0x8d, 0x0d});               // lea rcx, [rip + table]
+        const auto table_disp_pos = m_asm.size();
+        m_asm.emit_u32(0);
+        m_asm.op_mem(true, {0x63}, rax, rcx, 0, rax, 2);  // movsxd rax, [rcx + rax * 4]
+        m_asm.op_reg(true, {0x01}, rcx, rax);             // add rax, rcx
+        m_asm.op_reg(false, {0xff}, 4, rax);              // jmp rax
+
+        const auto table_pos = m_asm.size();
+        m_asm.patch_u32(table_disp_pos, static_cast<uint32_t>(table_pos - (table_disp_pos + 4)));
+        for (size_t i = 0; i <= instr.b; ++i)
+        {
+            m_jumps.push_back({m_asm.size(), table_pos, index + 1 + i});
+            m_asm.emit_u32(0);
+        }
+        break;
+    }
+    case Instr::return_:
+        if (instr.b != 0)
+            copy(0, instr.a);
+        m_asm.op_reg(false, {0x31}, rax, rax);  // xor eax, eax
+        m_asm.pop(slots_reg);
+        m_asm.emit({0xc3});  // ret
+        break;
+    case Instr::call:
+        call_function(instr);
+        break;
+    case Instr::call_indirect:
+        m_asm.op_reg(true, {0x89}, context_reg, rdi);                      // mov rdi, r12
+        m_asm.op_mem(true, {0x8d}, rsi, slots_reg, slot_disp(instr.dst));  // lea rsi, [args]
+        load(rdx, instr.a, false);
+        m_asm.mov_imm32(rcx, static_cast<uint32_t>(instr.imm));
+        call_helper(reinterpret_cast<const void*>(&call_indirect_helper));
+        reload_memory();
+        break;
+    case Instr::select:
+        load(rax, instr.b);
+        test_slot(static_cast<uint32_t>(instr.imm));
+        m_asm.op_mem(true, {0x0f, 0x45}, rax, slots_reg, slot_disp(instr.a));  // cmovne rax, [a]
+        store(instr.dst, rax);
+        break;
+    case Instr::local_get:
+        copy(instr.dst, instr.a);
+        break;
+    case Instr::global_get:
+    case Instr::global_set:
+    {
+        // rcx = the address of the global's value.
+        const auto num_imported_globals = m_module.imported_globals_mutability.size();
+        if (instr.imm < num_imported_globals)
+        {
+            m_asm.op_mem(true, {0x8b}, rcx, context_reg,
+                context_disp(offsetof(JitContext, imported_globals)));
+            m_asm.op_mem(true, {0x8b}, rcx, rcx,
+                static_cast<int32_t>(
+                    instr.imm * sizeof(ExternalGlobal) + offsetof(ExternalGlobal, value)));
+        }
+        else
+        {
+            m_asm.op_mem(
+                true, {0x8b}, rcx, context_reg, context_disp(offsetof(JitContext, globals)));
+            m_asm.op_mem(true, {0x8d}, rcx, rcx,
+                static_cast<int32_t>((instr.imm - num_imported_globals) * sizeof(uint64_t)));
+        }
+
+        if (instr.op == Instr::global_get)
+        {
+            m_asm.op_mem(true, {0x8b}, rax, rcx, 0);
+            store(instr.dst, rax);
+        }
+        else
+        {
+            load(rax, instr.a);
+            m_asm.op_mem(true, {0x89}, rax, rcx, 0);
+        }
+        break;
+    }
+    case Instr::i32_load:
+        load_memory(instr, 4, false, {0x8b});
+        break;
+    case Instr::i64_load:
+        load_memory(instr, 8, true, {0x8b});
+        break;
+    case Instr::i32_load8_s:
+        load_memory(instr, 1, false, {0x0f, 0xbe});
+        break;
+    case Instr::i32_load8_u:
+    case Instr::i64_load8_u:
+        load_memory(instr, 1, false, {0x0f, 0xb6});
+        break;
+    case Instr::i32_load16_s:
+        load_memory(instr, 2, false, {0x0f, 0xbf});
+        break;
+    case Instr::i32_load16_u:
+    case Instr::i64_load16_u:
+        load_memory(instr, 2, false, {0x0f, 0xb7});
+        break;
+    case Instr::i64_load8_s:
+        load_memory(instr, 1, true, {0x0f, 0xbe});
+        break;
+    case Instr::i64_load16_s:
+        load_memory(instr, 2, true, {0x0f, 0xbf});
+        break;
+    case Instr::i64_load32_s:
+        load_memory(instr, 4, true, {0x63});
+        break;
+    case Instr::i64_load32_u:
+        load_memory(instr, 4, false, {0x8b});
+        break;
+    case Instr::i32_store:
+    case Instr::i64_store32:
+        store_memory(instr, 4);
+        break;
+    case Instr::i64_store:
+        store_memory(instr, 8);
+        break;
+    case Instr::i32_store8:
+    case Instr::i64_store8:
+        store_memory(instr, 1);
+        break;
+    case Instr::i32_store16:
+    case Instr::i64_store16:
+        store_memory(instr, 2);
+        break;
+    case Instr::memory_size:
+        m_asm.op_reg(true, {0x89}, mem_size_reg, rax);  // mov rax, r14
+        m_asm.op_reg(true, {0xc1}, 5, rax);             // shr rax, 16
+        m_asm.emit({16});
+        store(instr.dst, rax);
+        break;
+    case Instr::memory_grow:
+        m_asm.op_reg(true, {0x89}, context_reg, rdi);  // mov rdi, r12
+        load(rsi, instr.a, false);
+        m_asm.call_abs(reinterpret_cast<const void*>(&memory_grow_helper));
+        store(instr.dst, rax);
+        reload_memory();
+        break;
+    case Instr::i32_const:
+    case Instr::i64_const:
+        if (static_cast<int64_t>(instr.imm) >= std::numeric_limits<int32_t>::min() &&
+            static_cast<int64_t>(instr.imm) <= std::numeric_limits<int32_t>::max())
+        {
+            // mov qword [dst], imm32 (sign-extended)
+            m_asm.op_mem(true, {0xc7}, 0, slots_reg, slot_disp(instr.dst));
+            m_asm.emit_u32(static_cast<uint32_t>(instr.imm));
+        }
+        else
+        {
+            m_asm.mov_imm64(rax, instr.imm);
+            store(instr.dst, rax);
+        }
+        break;
+    case Instr::i32_eqz:
+    case Instr::i64_eqz:
+        m_asm.op_mem(instr.op == Instr::i64_eqz, {0x83}, 7, slots_reg, slot_disp(instr.a));
+        m_asm.emit({0});                                                // cmp [a], 0
+        m_asm.op_reg(false, {0x0f, static_cast<uint8_t>(0x90 + cond_e)}, 0, rax);  // sete al
+        m_asm.op_reg(false, {0x0f, 0xb6}, rax, rax);                               // movzx eax, al
+        store(instr.dst, rax);
+        break;
+    case Instr::i32_eq:
+        compare(instr, false, cond_e);
+        break;
+    case Instr::i32_ne:
+        compare(instr, false, cond_ne);
+        break;
+    case Instr::i32_lt_s:
+        compare(instr, false, cond_l);
+        break;
+    case Instr::i32_lt_u:
+        compare(instr, false, cond_b);
+        break;
+    case Instr::i32_gt_s:
+        compare(instr, false, cond_g);
+        break;
+    case Instr::i32_gt_u:
+        compare(instr, false, cond_a);
+        break;
+    case Instr::i32_le_s:
+        compare(instr, false, cond_le);
+        break;
+    case Instr::i32_le_u:
+        compare(instr, false, cond_be);
+        break;
+    case Instr::i32_ge_s:
+        compare(instr, false, cond_ge);
+        break;
+    case Instr::i32_ge_u:
+        compare(instr, false, cond_ae);
+        break;
+    case Instr::i64_eq:
+        compare(instr, true, cond_e);
+        break;
+    case Instr::i64_ne:
+        compare(instr, true, cond_ne);
+        break;
+    case Instr::i64_lt_s:
+        compare(instr, true, cond_l);
+        break;
+    case Instr::i64_lt_u:
+        compare(instr, true, cond_b);
+        break;
+    case Instr::i64_gt_s:
+        compare(instr, true, cond_g);
+        break;
+    case Instr::i64_gt_u:
+        compare(instr, true, cond_a);
+        break;
+    case Instr::i64_le_s:
+        compare(instr, true, cond_le);
+        break;
+    case Instr::i64_le_u:
+        compare(instr, true, cond_be);
+        break;
+    case Instr::i64_ge_s:
+        compare(instr, true, cond_ge);
+        break;
+    case Instr::i64_ge_u:
+        compare(instr, true, cond_ae);
+        break;
+    case Instr::i32_clz:
+        unary_helper(instr, reinterpret_cast<const void*>(&clz32_helper));
+        break;
+    case Instr::i32_ctz:
+        unary_helper(instr, reinterpret_cast<const void*>(&ctz32_helper));
+        break;
+    case Instr::i32_popcnt:
+        unary_helper(instr, reinterpret_cast<const void*>(&popcnt32_helper));
+        break;
+    case Instr::i64_clz:
+        unary_helper(instr, reinterpret_cast<const void*>(&clz64_helper));
+        break;
+    case Instr::i64_ctz:
+        unary_helper(instr, reinterpret_cast<const void*>(&ctz64_helper));
+        break;
+    case Instr::i64_popcnt:
+        unary_helper(instr, reinterpret_cast<const void*>(&popcnt64_helper));
+        break;
+    case Instr::i32_add:
+        binary(instr, false, {0x03});
+        break;
+    case Instr::i32_sub:
+        binary(instr, false, {0x2b});
+        break;
+    case Instr::i32_mul:
+        binary(instr, false, {0x0f, 0xaf});
+        break;
+    case Instr::i32_and:
+        binary(instr, false, {0x23});
+        break;
+    case Instr::i32_or:
+        binary(instr, false, {0x0b});
+        break;
+    case Instr::i32_xor:
+        binary(instr, false, {0x33});
+        break;
+    case Instr::i64_add:
+        binary(instr, true, {0x03});
+        break;
+    case Instr::i64_sub:
+        binary(instr, true, {0x2b});
+        break;
+    case Instr::i64_mul:
+        binary(instr, true, {0x0f, 0xaf});
+        break;
+    case Instr::i64_and:
+        binary(instr, true, {0x23});
+        break;
+    case Instr::i64_or:
+        binary(instr, true, {0x0b});
+        break;
+    case Instr::i64_xor:
+        binary(instr, true, {0x33});
+        break;
+    case Instr::i32_div_s:
+        divide(instr, false, true, false);
+        break;
+    case Instr::i32_div_u:
+        divide(instr, false, false, false);
+        break;
+    case Instr::i32_rem_s:
+        divide(instr, false, true, true);
+        break;
+    case Instr::i32_rem_u:
+        divide(instr, false, false, true);
+        break;
+    case Instr::i64_div_s:
+        divide(instr, true, true, false);
+        break;
+    case Instr::i64_div_u:
+        divide(instr, true, false, false);
+        break;
+    case Instr::i64_rem_s:
+        divide(instr, true, true, true);
+        break;
+    case Instr::i64_rem_u:
+        divide(instr, true, false, true);
+        break;
+    case Instr::i32_shl:
+        shift(instr, false, 4);
+        break;
+    case Instr::i32_shr_s:
+        shift(instr, false, 7);
+        break;
+    case Instr::i32_shr_u:
+        shift(instr, false, 5);
+        break;
+    case Instr::i32_rotl:
+        shift(instr, false, 0);
+        break;
+    case Instr::i32_rotr:
+        shift(instr, false, 1);
+        break;
+    case Instr::i64_shl:
+        shift(instr, true, 4);
+        break;
+    case Instr::i64_shr_s:
+        shift(instr, true, 7);
+        break;
+    case Instr::i64_shr_u:
+        shift(instr, true, 5);
+        break;
+    case Instr::i64_rotl:
+        shift(instr, true, 0);
+        break;
+    case Instr::i64_rotr:
+        shift(instr, true, 1);
+        break;
+    case Instr::i32_wrap_i64:
+        load(rax, instr.a, false);
+        store(instr.dst, rax);
+        break;
+    case Instr::i64_extend_i32_s:
+        m_asm.op_mem(true, {0x63}, rax, slots_reg, slot_disp(instr.a));  // movsxd rax, [a]
+        store(instr.dst, rax);
+        break;
+    case superinstr::i32_add_imm:
+        load(rax, instr.a, false);
+        m_asm.op_reg(false, {0x81}, 0, rax);  // add eax, imm32
+        m_asm.emit_u32(static_cast<uint32_t>(instr.imm));
+        store(instr.dst, rax);
+        break;
+    case superinstr::i64_and_imm:
+        load(rax, instr.a);
+        if (static_cast<int64_t>(instr.imm) >= std::numeric_limits<int32_t>::min() &&
+            static_cast<int64_t>(instr.imm) <= std::numeric_limits<int32_t>::max())
+        {
+            m_asm.op_reg(true, {0x81}, 4, rax);  // and rax, imm32 (sign-extended)
+            m_asm.emit_u32(static_cast<uint32_t>(instr.imm));
+        }
+        else
+        {
+            m_asm.mov_imm64(rcx, instr.imm);
+            m_asm.op_reg(true, {0x23}, rax, rcx);  // and rax, rcx
+        }
+        store(instr.dst, rax);
+        break;
+    case superinstr::i64_shr_u_imm:
+        load(rax, instr.a);
+        m_asm.op_reg(true, {0xc1}, 5, rax);  // shr rax, imm8
+        m_asm.emit({static_cast<uint8_t>(instr.imm & 63)});
+        store(instr.dst, rax);
+        break;
+    case Instr::f32_add:
+        float_arithmetic(instr, false, 0x58);
+        break;
+    case Instr::f32_sub:
+        float_arithmetic(instr, false, 0x5c);
+        break;
+    case Instr::f32_mul:
+        float_arithmetic(instr, false, 0x59);
+        break;
+    case Instr::f32_div:
+        float_arithmetic(instr, false, 0x5e);
+        break;
+    case Instr::f32_sqrt:
+        float_arithmetic(instr, false, 0x51, true);
+        break;
+    case Instr::f64_add:
+        float_arithmetic(instr, true, 0x58);
+        break;
+    case Instr::f64_sub:
+        float_arithmetic(instr, true, 0x5c);
+        break;
+    case Instr::f64_mul:
+        float_arithmetic(instr, true, 0x59);
+        break;
+    case Instr::f64_div:
+        float_arithmetic(instr, true, 0x5e);
+        break;
+    case Instr::f64_sqrt:
+        float_arithmetic(instr, true, 0x51, true);
+        break;
+    default:
+        // The other floating point instructions are executed by the helper.
+        float_instruction(instr);
+        break;
+    }
+}
+
+}  // namespace
+
+std::shared_ptr<const JitCode> compile_jit(const Module& module)
+{
+    return Compiler{module}.compile();
+}
+
+ExecutionResult execute_jit(Instance& instance, const JitCode& code, FuncIdx func_idx,
+    span<const uint64_t> args, int depth)
+{
+    assert(depth >= 0 && depth <= CallStackLimit);
+    const auto num_imported_functions = instance.imported_functions.size();
+    assert(func_idx >= num_imported_functions);
+    const auto code_idx = func_idx - num_imported_functions;
+    const auto type_idx = instance.module->funcsec[code_idx];
+    const auto has_result = !instance.module->typesec[type_idx].outputs.empty();
+
+    // The frames of the nested calls may follow each other up to the call stack limit,
+    // see SlotStack.
+    const SlotLease slots{size_t(CallStackLimit - depth + 1) * code.max_frame_size()};
+    std::copy(args.begin(), args.end(), slots.data());
+
+    JitContext context;
+    context.globals = instance.globals.data();
+    context.imported_globals = instance.imported_globals.data();
+    context.depth = depth;
+    context.instance = &instance;
+    context.code = &code;
+    update_memory(context);
+
+    const auto trapped = code.entry()(&context, slots.data(), code.function(code_idx)) != 0;
+
+    if (context.exception)
+        std::rethrow_exception(context.exception);
+
+    if (trapped)
+        return {true, {}};
+    return {false, has_result ? slots.data()[0] : std::optional<uint64_t>{}};
+}
+}  // namespace fizzy
+
+#pragma GCC diagnostic pop
+
+#else
+
+namespace fizzy
+{
+class JitCode
+{
+};
+
+std::shared_ptr<const JitCode> compile_jit(const Module&)
+{
+    return nullptr;
+}
+
+ExecutionResult execute_jit(Instance&, const JitCode&, FuncIdx, span<const uint64_t>, int)
+{
+    throw unsupported_feature("The JIT compiler is not supported on this platform.");
+}
+}  // namespace fizzy
+
+#endif
@@ -0,0 +1,48 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "execute.hpp"
+#include "types.hpp"
+#include <memory>
+
+namespace fizzy
+{
+/// The machine code of the functions defined in a module, compiled by the baseline JIT compiler.
+///
+/// The compiler is single-pass: each instruction of the function's register IR
+/// (see translate_to_register_ir()) is translated to a fixed sequence of x86-64 instructions
+/// operating on the frame slots in memory. Only the slots base, the execution context and
+/// the memory data and size are kept in registers.
+///
+/// The compiled code keeps the trap semantics of the interpreter. The floating point arithmetic
+/// is compiled to the SSE instructions, the other floating point instructions call
+/// execute_float_instruction() of the register IR tier.
+class JitCode;
+
+/// Compiles the functions defined in the module to the machine code.
+///
+/// The module is expected to be validated, i.e. to come from parse().
+/// The returned code is to be set as the jit_code of the module's instances, so that execute()
+/// dispatches the calls of the module's functions into it.
+///
+/// @return  The compiled code or nullptr if the JIT compiler is not supported on the platform.
+std::shared_ptr<const JitCode> compile_jit(const Module& module);
+
+/// Executes the function defined in the instance's module in the compiled code.
+///
+/// This is used by execute() for the instances having the jit_code set.
+///
+/// The calls of the module's functions are native calls, so the native stack of the thread must
+/// have room for CallStackLimit of their frames: 16 bytes for a call and up to a few hundred
+/// bytes for a call_indirect going through the runtime helper.
+/// The frame slots take (CallStackLimit - depth + 1) times the largest frame of the module in
+/// the address space, but only the pages of the frames actually reached are committed.
+///
+/// @param code      The code compiled from the instance's module by compile_jit().
+/// @param func_idx  The index of the function defined in the module, not imported.
+ExecutionResult execute_jit(Instance& instance, const JitCode& code, FuncIdx func_idx,
+    span<const uint64_t> args, int depth);
+}  // namespace fizzy
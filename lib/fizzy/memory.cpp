@@ -0,0 +1,330 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "memory.hpp"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <new>
+
+#if (defined(__unix__) || defined(__APPLE__)) && UINTPTR_MAX > 0xffffffff
+#define FIZZY_VIRTUAL_MEMORY 1
+#include <sys/mman.h>
+#include <csetjmp>
+#include <csignal>
+#include <mutex>
+#endif
+
+#if FIZZY_VIRTUAL_MEMORY && defined(__linux__)
+#define FIZZY_MEMORY_IMAGE 1
+#include <unistd.h>
+#endif
+
+namespace fizzy
+{
+#if FIZZY_VIRTUAL_MEMORY
+namespace
+{
+constexpr auto GuardedReservationSize = static_cast<size_t>(LinearMemory::GuardedReservationSize);
+
+/// The guarded memory of the thread's innermost call_with_memory_guard().
+struct MemoryGuard
+{
+    const uint8_t* begin = nullptr;
+    const uint8_t* end = nullptr;
+    sigjmp_buf jump_buffer;
+};
+
+/// The guard is read by the signal handler, so it is a constant-initialized pointer of the
+/// initial-exec TLS model: the access is a plain load from the thread pointer, which never
+/// allocates the thread's storage lazily and so is async-signal-safe.
+#if defined(__GNUC__)
+__attribute__((tls_model("initial-exec")))
+#endif
+thread_local MemoryGuard* current_guard = nullptr;
+
+struct sigaction previous_segv_action;
+struct sigaction previous_bus_action;
+
+void handle_fault(int sig, siginfo_t* info, void* ucontext)
+{
+    const auto* const guard = current_guard;
+    const auto* const address = static_cast<const uint8_t*>(info->si_addr);
+    if (guard != nullptr && address >= guard->begin && address < guard->end)
+        siglongjmp(const_cast<MemoryGuard*>(guard)->jump_buffer, 1);
+
+    // Not a fault of the guarded memory access, so it is passed to the previous handler.
+    const auto& previous = sig == SIGSEGV ? previous_segv_action : previous_bus_action;
+    if ((previous.sa_flags & SA_SIGINFO) != 0)
+        previous.sa_sigaction(sig, info, ucontext);
+    else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN)
+        previous.sa_handler(sig);
+    else
+    {
+        // The faulting instruction is executed again, now with the default action.
+        signal(sig, SIG_DFL);
+    }
+}
+
+void install_fault_handlers()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        struct sigaction action = {};
+        action.sa_sigaction = handle_fault;
+        // The signal is not blocked in the handler, because the handler does not return
+        // to restore the signal mask when it jumps out of the faulting code.
+        action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_segv_action);
+        sigaction(SIGBUS, &action, &previous_bus_action);
+    });
+}
+
+/// Replaces the pages with the new inaccessible ones, which are zeros when made accessible.
+void decommit(uint8_t* data, size_t size) noexcept
+{
+    [[maybe_unused]] const auto ptr = mmap(data, size, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    assert(ptr == data);
+}
+}  // namespace
+#endif
+
+LinearMemory::LinearMemory(size_t size, MemoryMode mode, size_t max_size)
+  : m_max_size{max_size}, m_mode{mode}
+{
+    assert(size % PageSize == 0);
+    assert(max_size % PageSize == 0);
+    if (size > max_size)
+        throw std::bad_alloc();
+
+    reserve();
+
+    if (!grow(size))
+    {
+#if FIZZY_VIRTUAL_MEMORY
+        munmap(m_data, m_reservation_size);
+#endif
+        throw std::bad_alloc();
+    }
+}
+
+LinearMemory::LinearMemory(const MemoryImage& image)
+  : m_max_size{image.m_max_size}, m_mode{image.m_mode}
+{
+    reserve();
+
+#if FIZZY_MEMORY_IMAGE
+    // The private mapping of the file shares the pages until they are written.
+    if (image.m_size != 0 && mmap(m_data, image.m_size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_FIXED, image.m_fd, 0) == MAP_FAILED)
+    {
+        munmap(m_data, m_reservation_size);
+        throw std::bad_alloc();
+    }
+    m_size = image.m_size;
+#else
+    // The images are not created on the other platforms.
+    assert(false);
+#endif
+}
+
+void LinearMemory::reserve()
+{
+#if FIZZY_VIRTUAL_MEMORY
+    if (m_mode == MemoryMode::guarded)
+    {
+        // The reservation covers the accesses of the 32-bit addresses only.
+        m_max_size = std::min(m_max_size, size_t{1} << 32);
+        m_reservation_size = GuardedReservationSize;
+        install_fault_handlers();
+    }
+    else
+    {
+        // The empty mapping is not allowed.
+        m_reservation_size = std::max(m_max_size, size_t{PageSize});
+    }
+
+    void* const ptr = mmap(nullptr, m_reservation_size, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+        throw std::bad_alloc();
+    m_data = static_cast<uint8_t*>(ptr);
+#else
+    if (m_mode == MemoryMode::guarded)
+        throw unsupported_feature("Guarded memory is not supported on this platform.");
+    m_data = m_storage.data();
+#endif
+}
+
+LinearMemory::~LinearMemory()
+{
+#if FIZZY_VIRTUAL_MEMORY
+    if (m_reservation_size != 0)
+        munmap(m_data, m_reservation_size);
+#endif
+}
+
+bool LinearMemory::grow(size_t new_size) noexcept
+{
+    assert(new_size >= m_size);
+    assert(new_size % PageSize == 0);
+    if (new_size > m_max_size)
+        return false;
+
+    if (m_reservation_size == 0)
+    {
+        try
+        {
+            m_storage.resize(new_size);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        m_data = m_storage.data();
+    }
+#if FIZZY_VIRTUAL_MEMORY
+    else if (new_size > m_size &&
+             mprotect(m_data + m_size, new_size - m_size, PROT_READ | PROT_WRITE) != 0)
+        return false;
+#endif
+
+    m_size = new_size;
+    return true;
+}
+
+uint32_t LinearMemory::grow_pages(uint32_t delta, size_t max_pages) noexcept
+{
+    const auto cur_pages = m_size / PageSize;
+    assert(cur_pages <= size_t(std::numeric_limits<int32_t>::max()));
+    const auto new_pages = cur_pages + delta;
+    if (new_pages > max_pages || !grow(new_pages * PageSize))
+        return static_cast<uint32_t>(-1);
+    return static_cast<uint32_t>(cur_pages);
+}
+
+void LinearMemory::resize(size_t new_size)
+{
+    if (new_size >= m_size)
+    {
+        if (!grow(new_size))
+            throw std::bad_alloc();
+        return;
+    }
+
+    if (m_reservation_size == 0)
+        m_storage.resize(new_size);
+#if FIZZY_VIRTUAL_MEMORY
+    else
+        decommit(m_data + new_size, m_size - new_size);
+#endif
+    m_size = new_size;
+}
+
+void LinearMemory::reset(const MemoryImage& image)
+{
+    assert(m_mode == image.m_mode);
+    assert(m_max_size == image.m_max_size);
+
+#if FIZZY_MEMORY_IMAGE
+    if (m_size > image.m_size)
+        decommit(m_data + image.m_size, m_size - image.m_size);
+
+    // Mapping the image again drops the private copies of the written pages, the kernel
+    // only visits the pages which have been accessed.
+    if (image.m_size != 0 && mmap(m_data, image.m_size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_FIXED, image.m_fd, 0) == MAP_FAILED)
+        throw std::bad_alloc();
+    m_size = image.m_size;
+#else
+    // The images are not created on the other platforms.
+    (void)image;
+    assert(false);
+#endif
+}
+
+MemoryImage::MemoryImage(const LinearMemory& memory)
+  : m_size{memory.size()}, m_max_size{memory.max_size()}, m_mode{memory.mode()}
+{
+#if FIZZY_MEMORY_IMAGE
+    m_fd = memfd_create("fizzy-memory", MFD_CLOEXEC);
+    if (m_fd == -1)
+        throw std::bad_alloc();
+
+    if (ftruncate(m_fd, static_cast<off_t>(m_size)) != 0)
+    {
+        close(m_fd);
+        throw std::bad_alloc();
+    }
+
+    // Only the pages with non-zero bytes are written, the rest of the file stays sparse.
+    const auto* const data = memory.data();
+    for (size_t offset = 0; offset < m_size; offset += PageSize)
+    {
+        const auto* const page = data + offset;
+        if (std::all_of(page, page + PageSize, [](uint8_t b) { return b == 0; }))
+            continue;
+
+        if (pwrite(m_fd, page, PageSize, static_cast<off_t>(offset)) != ssize_t{PageSize})
+        {
+            close(m_fd);
+            throw std::bad_alloc();
+        }
+    }
+#else
+    throw unsupported_feature("Memory images are not supported on this platform.");
+#endif
+}
+
+MemoryImage::~MemoryImage()
+{
+#if FIZZY_MEMORY_IMAGE
+    close(m_fd);
+#endif
+}
+
+bool call_with_memory_guard(const LinearMemory& memory, bool (*function)(void*), void* argument)
+{
+    assert(memory.mode() == MemoryMode::guarded);
+#if FIZZY_VIRTUAL_MEMORY
+    MemoryGuard guard;
+    guard.begin = memory.data();
+    guard.end = memory.data() + GuardedReservationSize;
+
+    // The previous guard is restored also when the function throws or the fault jumps back.
+    struct RestoreGuard
+    {
+        MemoryGuard* previous;
+        ~RestoreGuard() { current_guard = previous; }
+    } const restore{current_guard};
+
+    if (sigsetjmp(guard.jump_buffer, 0) != 0)
+        return false;
+
+    current_guard = &guard;
+    return function(argument);
+#else
+    (void)memory;
+    return function(argument);
+#endif
+}
+
+MemoryGuardSuspension::MemoryGuardSuspension() noexcept
+{
+#if FIZZY_VIRTUAL_MEMORY
+    m_suspended_guard = current_guard;
+    current_guard = nullptr;
+#endif
+}
+
+MemoryGuardSuspension::~MemoryGuardSuspension()
+{
+#if FIZZY_VIRTUAL_MEMORY
+    current_guard = static_cast<MemoryGuard*>(m_suspended_guard);
+#endif
+}
+}  // namespace fizzy
@@ -0,0 +1,178 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "bytes.hpp"
+#include "limits.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace fizzy
+{
+/// The way the out-of-bounds accesses of the linear memory are detected.
+enum class MemoryMode
+{
+    /// The interpreter compares each accessed address with the memory size.
+    checked,
+
+    /// The memory is placed at the beginning of the address space reservation covering any
+    /// 32-bit address with any 32-bit offset, and the pages beyond the memory size are
+    /// inaccessible. The out-of-bounds accesses fault and the fault is turned into the trap,
+    /// so the interpreter accesses the memory without comparisons.
+    ///
+    /// The faults are handled with the SIGSEGV and SIGBUS handlers, installed when the first
+    /// guarded memory is created. The handlers of the application are called for other faults.
+    guarded,
+};
+
+class MemoryImage;
+
+/// The linear memory of an instance.
+///
+/// The address space for the maximum size of the memory is reserved up front and the pages
+/// are committed as the memory grows, so growing does not copy the memory and the memory
+/// stays at the same address.
+///
+/// The memory is an anonymous mapping, so the committed pages are zeroed by the kernel on first
+/// access: the cost of creating the memory does not depend on its size.
+class LinearMemory
+{
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_max_size = 0;
+    MemoryMode m_mode = MemoryMode::checked;
+
+    /// The size of the reserved address space, 0 if the memory is kept in m_storage instead.
+    size_t m_reservation_size = 0;
+
+    /// The storage of the checked memory where the address space cannot be reserved.
+    bytes m_storage;
+
+    /// Reserves the address space for the memory of m_mode and m_max_size.
+    void reserve();
+
+public:
+    /// The size of the address space reserved for the guarded memory: the 32-bit address and
+    /// offset, and the largest access size, rounded up to the page.
+    static constexpr uint64_t GuardedReservationSize = (uint64_t{1} << 33) + PageSize;
+
+    /// Creates the memory of the given size in bytes, filled with zeros, which can grow up to
+    /// the maximum size.
+    ///
+    /// The sizes must be multiples of PageSize.
+    ///
+    /// @throws std::bad_alloc              if the memory cannot be allocated.
+    /// @throws fizzy::unsupported_feature  if the guarded memory is not supported on the platform.
+    explicit LinearMemory(size_t size = 0, MemoryMode mode = MemoryMode::checked,
+        size_t max_size = size_t{MemoryPagesLimit} * PageSize);
+
+    /// Creates the memory with the contents, the mode and the maximum size of the image.
+    ///
+    /// The pages of the image are shared with the other memories created from it until written.
+    ///
+    /// @throws std::bad_alloc  if the memory cannot be allocated.
+    explicit LinearMemory(const MemoryImage& image);
+
+    ~LinearMemory();
+
+    LinearMemory(const LinearMemory&) = delete;
+    LinearMemory& operator=(const LinearMemory&) = delete;
+
+    MemoryMode mode() const noexcept { return m_mode; }
+
+    uint8_t* data() noexcept { return m_data; }
+    const uint8_t* data() const noexcept { return m_data; }
+
+    size_t size() const noexcept { return m_size; }
+
+    size_t max_size() const noexcept { return m_max_size; }
+
+    uint8_t* begin() noexcept { return m_data; }
+    uint8_t* end() noexcept { return m_data + m_size; }
+
+    uint8_t& operator[](size_t index) noexcept { return m_data[index]; }
+    const uint8_t& operator[](size_t index) const noexcept { return m_data[index]; }
+
+    operator bytes_view() const noexcept { return {m_data, m_size}; }
+
+    /// Grows the memory to the new size, the added bytes are zeros.
+    ///
+    /// Only the added pages are committed, the memory stays at the same address.
+    ///
+    /// @return  false if the new size exceeds the maximum size or cannot be committed.
+    bool grow(size_t new_size) noexcept;
+
+    /// Grows the memory by the number of pages up to @a max_pages, as the memory.grow
+    /// instruction does.
+    ///
+    /// @return  The previous number of pages or -1 if the memory cannot grow.
+    uint32_t grow_pages(uint32_t delta, size_t max_pages) noexcept;
+
+    /// Changes the size of the memory, the added bytes are zeros.
+    ///
+    /// @throws std::bad_alloc  if the memory cannot grow, see grow().
+    void resize(size_t new_size);
+
+    /// Restores the contents and the size of the memory created from the image.
+    ///
+    /// Only the pages written since are restored: their private copies are discarded, so they
+    /// are shared with the image again. The pages grown beyond the image are released.
+    ///
+    /// @throws std::bad_alloc  if the image cannot be mapped again.
+    void reset(const MemoryImage& image);
+};
+
+/// The snapshot of the memory contents, from which the memories are created with the pages
+/// shared until written (copy-on-write).
+class MemoryImage
+{
+    friend class LinearMemory;
+
+    /// The file of the memory contents.
+    int m_fd = -1;
+    size_t m_size = 0;
+    size_t m_max_size = 0;
+    MemoryMode m_mode = MemoryMode::checked;
+
+public:
+    /// Creates the image of the current contents of the memory.
+    ///
+    /// @throws std::bad_alloc              if the image cannot be allocated.
+    /// @throws fizzy::unsupported_feature  if the images are not supported on the platform.
+    explicit MemoryImage(const LinearMemory& memory);
+
+    ~MemoryImage();
+
+    MemoryImage(const MemoryImage&) = delete;
+    MemoryImage& operator=(const MemoryImage&) = delete;
+
+    size_t size() const noexcept { return m_size; }
+};
+
+/// Calls the function with the faults of the accesses to the guarded memory turned into
+/// the return of false, as if the function trapped.
+///
+/// The fault unwinds the stack to this call without running the destructors, so the function
+/// must not keep objects with non-trivial destructors alive while accessing the memory.
+/// The code which does (e.g. the host functions) must run in the MemoryGuardSuspension.
+/// The nested calls are allowed and each guards only its own memory.
+bool call_with_memory_guard(const LinearMemory& memory, bool (*function)(void*), void* argument);
+
+/// Suspends the thread's innermost call_with_memory_guard() for the lifetime of the object.
+///
+/// The faults in the meantime are not turned into traps, but handled as if there were no guard,
+/// so the code may keep any objects alive, e.g. the host functions called from the guarded code.
+class MemoryGuardSuspension
+{
+    void* m_suspended_guard = nullptr;
+
+public:
+    MemoryGuardSuspension() noexcept;
+    ~MemoryGuardSuspension();
+
+    MemoryGuardSuspension(const MemoryGuardSuspension&) = delete;
+    MemoryGuardSuspension& operator=(const MemoryGuardSuspension&) = delete;
+};
+}  // namespace fizzy
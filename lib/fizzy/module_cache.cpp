@@ -0,0 +1,106 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "module_cache.hpp"
+#include "hash.hpp"
+#include "parser.hpp"
+#include "serialize.hpp"
+#include <cstdio>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FIZZY_MODULE_CACHE 1
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+
+// The version of the library, set by the build.
+#ifndef FIZZY_VERSION
+#define FIZZY_VERSION "unknown"
+#endif
+
+namespace fizzy
+{
+namespace
+{
+std::string cache_path(bytes_view input, const std::string& cache_directory)
+{
+    return cache_directory + "/" + module_digest(input) + ".fizzy-" + FIZZY_VERSION + ".v" +
+           std::to_string(SerializedModuleVersion) + ".fzm";
+}
+
+/// Checks if the directory can be written only by the current user, so no other user can place
+/// the modules in the cache.
+bool is_private_directory(const std::string& path) noexcept
+{
+#if FIZZY_MODULE_CACHE
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::geteuid() &&
+           (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+/// Stores the module in the cache, ignoring the failures.
+void store(const Module& module, bytes_view input, const std::string& path) noexcept
+{
+#if FIZZY_MODULE_CACHE
+    auto tmp_path = path + ".XXXXXX";
+    const int fd = mkstemp(tmp_path.data());
+    if (fd == -1)
+        return;
+    // Readable by the other processes, as if created by save_module() directly.
+    (void)fchmod(fd, 0644);
+    close(fd);
+
+    try
+    {
+        save_module(tmp_path, module, input);
+        if (std::rename(tmp_path.c_str(), path.c_str()) == 0)
+            return;
+    }
+    catch (...)
+    {}
+    unlink(tmp_path.c_str());
+#else
+    (void)module;
+    (void)input;
+    (void)path;
+#endif
+}
+}  // namespace
+
+std::string module_digest(bytes_view input)
+{
+    char hex[33];
+    std::snprintf(hex, sizeof(hex), "%016llx%016llx",
+        static_cast<unsigned long long>(xxhash64(input)),
+        static_cast<unsigned long long>(xxhash64(input, xxhash::Prime1)));
+    return hex;
+}
+
+std::shared_ptr<const Module> parse_cached(bytes_view input, const std::string& cache_directory)
+{
+    if (!is_private_directory(cache_directory))
+        return std::make_shared<const Module>(parse(input));
+
+    const auto path = cache_path(input, cache_directory);
+    try
+    {
+        return load_module(path, input);
+    }
+    catch (const std::runtime_error&)
+    {
+        // Not cached yet, the cached file is not usable or it is of another binary of the same
+        // digest: parse and store it again.
+    }
+
+    auto module = std::make_shared<const Module>(parse(input));
+    store(*module, input, path);
+    return module;
+}
+}  // namespace fizzy
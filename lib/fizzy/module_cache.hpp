@@ -0,0 +1,44 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "bytes.hpp"
+#include "types.hpp"
+#include <memory>
+#include <string>
+
+namespace fizzy
+{
+/// Computes the 128-bit digest of the wasm binary, as the string of 32 hex digits.
+///
+/// The digest is fast to compute (many times faster than parsing) but it is not cryptographic:
+/// the colliding binaries can be constructed on purpose. It only names the cached modules,
+/// see parse_cached().
+std::string module_digest(bytes_view input);
+
+/// Parses the module using the cache directory shared by the processes on the machine.
+///
+/// The module is stored in the directory by its digest (see module_digest()), the version of
+/// fizzy and the version of the format (SerializedModuleVersion), in the format of save_module(). If the module is
+/// already there, it is loaded with load_module() instead of being parsed. Otherwise the module is
+/// parsed and stored: it is written to a temporary file which is then renamed, so the readers see
+/// either the complete file or none, without any locking.
+///
+/// The whole wasm binary is stored with the module and compared when it is loaded, so the binary
+/// colliding with the digest of another one gets its own module parsed, never the cached module
+/// of the other binary.
+///
+/// Only the parsed module is cached. The register IR, the JIT code and the AOT code are not: they
+/// are produced from the module by their own tiers, e.g. load_aot() loads the AOT code.
+///
+/// The code of the cached functions is not validated again when loaded, so the directory must be
+/// writable only by the current user: otherwise the cache is not used and the module is parsed.
+/// The cache is best-effort: the missing directory, the failure to store the module and the
+/// cached file of another version of fizzy only cause the module to be parsed. The invalid
+/// modules are not cached.
+///
+/// @throws parser_error, validation_error  as parse().
+std::shared_ptr<const Module> parse_cached(bytes_view input, const std::string& cache_directory);
+}  // namespace fizzy
@@ -0,0 +1,205 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <type_traits>
+
+/// The implementations of the numeric instructions shared by the execution tiers.
+namespace fizzy
+{
+template <typename DstT, typename SrcT>
+inline DstT extend(SrcT in) noexcept
+{
+    if constexpr (std::is_signed<SrcT>::value)
+    {
+        using SignedDstT = typename std::make_signed<DstT>::type;
+        return static_cast<DstT>(SignedDstT{in});
+    }
+    else
+        return DstT{in};
+}
+
+template <typename T>
+inline T shift_left(T lhs, T rhs) noexcept
+{
+    constexpr T num_bits{sizeof(T) * 8};
+    const auto k = rhs & (num_bits - 1);
+    return lhs << k;
+}
+
+template <typename T>
+inline T shift_right(T lhs, T rhs) noexcept
+{
+    constexpr T num_bits{sizeof(T) * 8};
+    const auto k = rhs & (num_bits - 1);
+    return lhs >> k;
+}
+
+template <typename T>
+inline T rotl(T lhs, T rhs) noexcept
+{
+    constexpr T num_bits{sizeof(T) * 8};
+    const auto k = rhs & (num_bits - 1);
+
+    if (k == 0)
+        return lhs;
+
+    return (lhs << k) | (lhs >> (num_bits - k));
+}
+
+template <typename T>
+inline T rotr(T lhs, T rhs) noexcept
+{
+    constexpr T num_bits{sizeof(T) * 8};
+    const auto k = rhs & (num_bits - 1);
+
+    if (k == 0)
+        return lhs;
+
+    return (lhs >> k) | (lhs << (num_bits - k));
+}
+
+inline uint32_t clz32(uint32_t value) noexcept
+{
+    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
+    if (value == 0)
+        return 32;
+    return static_cast<uint32_t>(__builtin_clz(value));
+}
+
+inline uint32_t ctz32(uint32_t value) noexcept
+{
+    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
+    if (value == 0)
+        return 32;
+    return static_cast<uint32_t>(__builtin_ctz(value));
+}
+
+inline uint32_t popcnt32(uint32_t value) noexcept
+{
+    return static_cast<uint32_t>(__builtin_popcount(value));
+}
+
+inline uint64_t clz64(uint64_t value) noexcept
+{
+    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
+    if (value == 0)
+        return 64;
+    return static_cast<uint64_t>(__builtin_clzll(value));
+}
+
+inline uint64_t ctz64(uint64_t value) noexcept
+{
+    // NOTE: Wasm specifies this case, but C/C++ intrinsic leaves it as undefined.
+    if (value == 0)
+        return 64;
+    return static_cast<uint64_t>(__builtin_ctzll(value));
+}
+
+inline uint64_t popcnt64(uint64_t value) noexcept
+{
+    return static_cast<uint64_t>(__builtin_popcountll(value));
+}
+
+/// The unsigned integer type of the same size as the floating point type T.
+template <typename T>
+using FloatBits = std::conditional_t<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>;
+
+/// Returns the value of type T kept in the value stack item.
+/// The floating point values are kept as their bits, f32 zero-extended like i32.
+template <typename T>
+inline T from_value(uint64_t value) noexcept
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        const auto bits = static_cast<FloatBits<T>>(value);
+        T ret;
+        __builtin_memcpy(&ret, &bits, sizeof(ret));
+        return ret;
+    }
+    else
+        return static_cast<T>(value);
+}
+
+/// Returns the value stack item of the value, the reverse of from_value().
+template <typename T>
+inline uint64_t to_value(T value) noexcept
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        FloatBits<T> bits;
+        __builtin_memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    else
+        return static_cast<std::make_unsigned_t<T>>(value);
+}
+
+/// The sign bit of the floating point type T.
+/// The abs, neg and copysign instructions operate on the bits only, so they never alter NaNs.
+template <typename T>
+constexpr FloatBits<T> SignMask = FloatBits<T>{1} << (sizeof(T) * 8 - 1);
+
+template <typename T>
+inline T fmin(T a, T b) noexcept
+{
+    if (std::isnan(a) || std::isnan(b))
+        return std::numeric_limits<T>::quiet_NaN();
+
+    // The -0 is less than +0 here, unlike in the IEEE comparison.
+    if (a == 0 && b == 0)
+        return std::signbit(a) ? a : b;
+
+    return a < b ? a : b;
+}
+
+template <typename T>
+inline T fmax(T a, T b) noexcept
+{
+    if (std::isnan(a) || std::isnan(b))
+        return std::numeric_limits<T>::quiet_NaN();
+
+    if (a == 0 && b == 0)
+        return std::signbit(a) ? b : a;
+
+    return a < b ? b : a;
+}
+
+/// Rounds to the nearest integer, ties to even.
+template <typename T>
+inline T fnearest(T value) noexcept
+{
+    // The default floating point environment rounds to nearest, ties to even.
+    return std::nearbyint(value);
+}
+
+/// Truncates the floating point value to the integer of type DstT.
+///
+/// @return  The result or std::nullopt if the value is NaN or the result is out of range of DstT,
+///          in which case the wasm instruction traps.
+template <typename DstT, typename SrcT>
+inline std::optional<DstT> trunc(SrcT value) noexcept
+{
+    static_assert(std::is_floating_point_v<SrcT> && std::is_integral_v<DstT>);
+
+    // The bounds of DstT are powers of 2, so they are represented exactly in SrcT.
+    constexpr auto signed_min =
+        static_cast<SrcT>(std::numeric_limits<std::make_signed_t<DstT>>::min());
+    constexpr auto lower = std::is_signed_v<DstT> ? signed_min : SrcT{0};
+    constexpr auto upper = std::is_signed_v<DstT> ? -signed_min : -2 * signed_min;
+
+    // The fractional part is discarded first, e.g. -0.5 truncates to -0 which is in range
+    // of the unsigned types. The NaN fails the comparisons.
+    const auto truncated = std::trunc(value);
+    if (!(truncated >= lower && truncated < upper))
+        return std::nullopt;
+
+    return static_cast<DstT>(truncated);
+}
+}  // namespace fizzy
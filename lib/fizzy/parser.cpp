@@ -6,7 +6,14 @@
 #include "leb128.hpp"
 #include "types.hpp"
 #include "utf8.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 namespace fizzy
 {
@@ -144,18 +151,21 @@ inline parser_result<ConstantExpression> parse_constant_expression(
             break;
         }
         case Instr::f32_const:
-            // FIXME: support this once floating points are implemented
+        {
+            // The floating point values are kept as their bits, f32 zero-extended.
             result.kind = ConstantExpression::Kind::Constant;
-            result.value.constant = 0;
-            pos = skip(4, pos, end);
+            uint32_t value;
+            std::tie(value, pos) = parse_value<uint32_t>(pos, end);
+            result.value.constant = value;
             break;
+        }
         case Instr::f64_const:
-            // FIXME: support this once floating points are implemented
+        {
             result.kind = ConstantExpression::Kind::Constant;
-            result.value.constant = 0;
-            pos = skip(8, pos, end);
+            std::tie(result.value.constant, pos) = parse_value<uint64_t>(pos, end);
             break;
         }
+        }
     } while (instr != Instr::end);
 
     return {result, pos};
@@ -335,13 +345,13 @@ inline parser_result<code_view> parse(const uint8_t* pos, const uint8_t* end)
     return {{code_begin, code_size}, code_end};
 }
 
-inline Code parse_code(code_view code_binary, bool have_memory)
+inline Code parse_code(code_view code_binary, FuncIdx func_idx, const Module& module)
 {
     const auto begin = code_binary.begin();
     const auto end = code_binary.end();
     const auto [locals_vec, pos1] = parse_vec<Locals>(begin, end);
 
-    auto [code, pos2] = parse_expr(pos1, end, have_memory);
+    auto [code, pos2] = parse_expr(pos1, end, func_idx, module);
 
     // Size is the total bytes of locals and expressions.
     if (pos2 != end)
@@ -382,7 +392,169 @@ inline parser_result<Data> parse(const uint8_t* pos, const uint8_t* end)
     return {{offset, std::move(init)}, pos};
 }
 
-Module parse(bytes_view input)
+class LazyCode
+{
+    /// The copy of the code section, the function bodies are the slices of it.
+    bytes m_binary;
+
+    std::vector<code_view> m_code_binaries;
+
+    enum State : uint8_t
+    {
+        NotParsed,
+        Parsed,
+        Invalid,
+    };
+
+    /// The code of the functions, valid where the state is Parsed.
+    std::vector<Code> m_codes;
+
+    /// The errors of the functions, set where the state is Invalid.
+    std::vector<std::exception_ptr> m_errors;
+
+    std::unique_ptr<std::atomic<State>[]> m_states;
+
+    /// Guards the parsing, so that each function is parsed once.
+    std::mutex m_mutex;
+
+public:
+    explicit LazyCode(const std::vector<code_view>& code_binaries)
+      : m_codes(code_binaries.size()),
+        m_errors(code_binaries.size()),
+        m_states{new std::atomic<State>[code_binaries.size()]()}
+    {
+        if (code_binaries.empty())
+            return;
+
+        const auto* const begin = code_binaries.front().data();
+        const auto* const end = code_binaries.back().data() + code_binaries.back().size();
+        m_binary.assign(begin, end);
+        m_code_binaries.reserve(code_binaries.size());
+        for (const auto& code_binary : code_binaries)
+        {
+            m_code_binaries.emplace_back(
+                m_binary.data() + (code_binary.data() - begin), code_binary.size());
+        }
+    }
+
+    /// Returns the code of the function, parsing it on first use, or null if it is invalid.
+    /// The error of the invalid function is kept, so the function is not parsed again.
+    const Code* find(const Module& module, size_t code_idx)
+    {
+        assert(code_idx < m_codes.size());
+        auto state = m_states[code_idx].load(std::memory_order_acquire);
+        if (state == NotParsed)
+        {
+            const std::lock_guard lock{m_mutex};
+            state = m_states[code_idx].load(std::memory_order_relaxed);
+            if (state == NotParsed)
+            {
+                const auto func_idx =
+                    static_cast<FuncIdx>(module.imported_function_types.size() + code_idx);
+                try
+                {
+                    m_codes[code_idx] = parse_code(m_code_binaries[code_idx], func_idx, module);
+                    state = Parsed;
+                }
+                catch (const parser_error&)
+                {
+                    m_errors[code_idx] = std::current_exception();
+                    state = Invalid;
+                }
+                catch (const validation_error&)
+                {
+                    m_errors[code_idx] = std::current_exception();
+                    state = Invalid;
+                }
+                m_states[code_idx].store(state, std::memory_order_release);
+            }
+        }
+        return state == Parsed ? &m_codes[code_idx] : nullptr;
+    }
+
+    const Code& get(const Module& module, size_t code_idx)
+    {
+        if (const auto* const code = find(module, code_idx); code != nullptr)
+            return *code;
+        std::rethrow_exception(m_errors[code_idx]);
+    }
+};
+
+const Code& parse_lazy_code(const Module& module, size_t code_idx)
+{
+    assert(module.lazy_code != nullptr);
+    return module.lazy_code->get(module, code_idx);
+}
+
+const Code* find_lazy_code(const Module& module, size_t code_idx)
+{
+    assert(module.lazy_code != nullptr);
+    return module.lazy_code->find(module, code_idx);
+}
+
+void validate_lazy_code(const Module& module)
+{
+    if (module.lazy_code == nullptr)
+        return;
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+        module.lazy_code->get(module, i);
+}
+
+/// Parses the code of the functions defined in the module on the given number of threads.
+///
+/// The threads take the functions in the order of their indexes and none takes the functions
+/// after the one which failed, so all the functions before it are parsed. The error of the first
+/// failed function is rethrown, the one the sequential parsing would throw.
+inline std::vector<Code> parse_code_parallel(
+    const std::vector<code_view>& code_binaries, const Module& module, unsigned num_threads)
+{
+    const auto num_codes = code_binaries.size();
+    std::vector<Code> codes(num_codes);
+    std::vector<std::exception_ptr> errors(num_codes);
+    std::atomic<size_t> next_code_idx{0};
+    std::atomic<size_t> first_error_idx{num_codes};
+
+    const auto parse_codes = [&]() noexcept {
+        for (auto i = next_code_idx++; i < num_codes && i < first_error_idx; i = next_code_idx++)
+        {
+            try
+            {
+                const auto func_idx =
+                    static_cast<FuncIdx>(module.imported_function_types.size() + i);
+                codes[i] = parse_code(code_binaries[i], func_idx, module);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+                auto error_idx = first_error_idx.load();
+                while (i < error_idx && !first_error_idx.compare_exchange_weak(error_idx, i))
+                {
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    try
+    {
+        while (threads.size() < num_threads - 1)
+            threads.emplace_back(parse_codes);
+    }
+    catch (const std::system_error&)
+    {
+        // Continue with the threads started so far.
+    }
+    parse_codes();
+    for (auto& thread : threads)
+        thread.join();
+
+    if (const auto error_idx = first_error_idx.load(); error_idx != num_codes)
+        std::rethrow_exception(errors[error_idx]);
+    return codes;
+}
+
+Module parse(bytes_view input, const ParseOptions& options)
 {
     if (input.substr(0, wasm_prefix.size()) != wasm_prefix)
         throw parser_error{"invalid wasm module prefix"};
@@ -525,15 +697,35 @@ Module parse(bytes_view input)
     if (module.startfunc && *module.startfunc >= total_func_count)
         throw parser_error{"invalid start function index"};
 
-    const auto have_memory = !module.memorysec.empty() || !module.imported_memory_types.empty();
-    // Process code. TODO: This can be done lazily.
-    module.codesec.reserve(code_binaries.size());
-    for (size_t i = 0; i < code_binaries.size(); ++i)
+    for (const auto type_idx : module.funcsec)
     {
-        const auto type_idx = module.funcsec[i];
         if (type_idx >= module.typesec.size())
             throw validation_error{"invalid function type index"};
-        module.codesec.emplace_back(parse_code(code_binaries[i], have_memory));
+    }
+
+    module.type_ids = canonical_type_ids(module.typesec);
+    module.imported_function_type_ids = canonical_type_ids(module.imported_function_types);
+
+    // Process code.
+    if (options.lazy)
+    {
+        module.lazy_code = std::make_shared<LazyCode>(code_binaries);
+        return module;
+    }
+
+    auto num_threads = options.num_threads != 0 ? options.num_threads :
+                                                  std::max(std::thread::hardware_concurrency(), 1u);
+    num_threads = static_cast<unsigned>(std::min(size_t{num_threads}, code_binaries.size()));
+    if (num_threads > 1)
+        module.codesec = parse_code_parallel(code_binaries, module, num_threads);
+    else
+    {
+        module.codesec.reserve(code_binaries.size());
+        for (size_t i = 0; i < code_binaries.size(); ++i)
+        {
+            const auto func_idx = static_cast<FuncIdx>(module.imported_function_types.size() + i);
+            module.codesec.emplace_back(parse_code(code_binaries[i], func_idx, module));
+        }
     }
 
     return module;
@@ -17,7 +17,55 @@ constexpr bytes_view wasm_prefix{wasm_prefix_data, sizeof(wasm_prefix_data)};
 template <typename T>
 using parser_result = std::tuple<T, const uint8_t*>;
 
-Module parse(bytes_view input);
+/// The options of parse().
+struct ParseOptions
+{
+    /// The number of threads validating and translating the function bodies in parallel,
+    /// 0 for std::thread::hardware_concurrency(). With 1 the bodies are parsed in the calling
+    /// thread. The threads are started for each parse, so it pays off for large modules only.
+    unsigned num_threads = 1;
+
+    /// Whether the function bodies are parsed and validated on first use instead of by parse().
+    /// Only the sizes of the bodies are checked up front and the bodies are kept as the slices of
+    /// the copy of the code section until then, see get_code().
+    bool lazy = false;
+};
+
+/// Parses and validates the module.
+///
+/// When the function bodies are parsed in parallel, the error of the invalid function of
+/// the lowest index is reported, the same as when they are parsed sequentially.
+Module parse(bytes_view input, const ParseOptions& options = {});
+
+/// Parses the code of the function deferred by the lazy parse(), see get_code().
+const Code& parse_lazy_code(const Module& module, size_t code_idx);
+
+/// Parses the code of the function deferred by the lazy parse(), as parse_lazy_code() does.
+///
+/// @return  The code or null if the function is invalid. The error is kept and reported by
+///          get_code(), the function is not parsed again.
+const Code* find_lazy_code(const Module& module, size_t code_idx);
+
+/// Parses and validates all the functions deferred by the lazy parse(), e.g. to report the error
+/// of the invalid function before the module is executed. Does nothing for the module not parsed
+/// lazily.
+///
+/// @throws parser_error, validation_error  of the invalid function of the lowest index.
+void validate_lazy_code(const Module& module);
+
+/// Returns the code of the function defined in the module.
+///
+/// If the module was parsed lazily, the function is parsed and validated on the first call.
+/// This is safe to be done concurrently by the threads sharing the module.
+///
+/// @throws parser_error, validation_error  if the function parsed lazily is invalid. The error is
+///                                         kept, so each call throws it without parsing again.
+inline const Code& get_code(const Module& module, size_t code_idx)
+{
+    if (module.lazy_code == nullptr)
+        return module.codesec[code_idx];
+    return parse_lazy_code(module, code_idx);
+}
 
 inline const uint8_t* skip(size_t num_bytes, const uint8_t* input, const uint8_t* end)
 {
@@ -27,6 +75,18 @@ inline const uint8_t* skip(size_t num_bytes, const uint8_t* input, const uint8_t
     return ret;
 }
 
+/// Parses the fixed-size little-endian value, e.g. the f32.const and f64.const immediates.
+template <typename T>
+inline parser_result<T> parse_value(const uint8_t* pos, const uint8_t* end)
+{
+    if (static_cast<size_t>(end - pos) < sizeof(T))
+        throw parser_error{"Unexpected EOF"};
+
+    T value;
+    __builtin_memcpy(&value, pos, sizeof(value));
+    return {value, pos + sizeof(value)};
+}
+
 inline parser_result<uint8_t> parse_byte(const uint8_t* pos, const uint8_t* end)
 {
     if (pos == end)
@@ -38,10 +98,17 @@ inline parser_result<uint8_t> parse_byte(const uint8_t* pos, const uint8_t* end)
 /// Parse `expr`, i.e. a function's instructions residing in the code section.
 /// https://webassembly.github.io/spec/core/binary/instructions.html#binary-expr
 ///
-/// @param input        The beginning of the expr binary input.
-/// @param end          The end of the binary input.
-/// @param have_memory  If the module (the context) contains imported or defined memory.
-parser_result<Code> parse_expr(const uint8_t* input, const uint8_t* end, bool have_memory);
+/// The branch targets are resolved while parsing: the block, loop and inner end instructions are
+/// not emitted, and the branch instructions carry the target offsets and the numbers of stack
+/// items to keep and to drop.
+///
+/// @param input     The beginning of the expr binary input.
+/// @param end       The end of the binary input.
+/// @param func_idx  The index of the parsed function in the module's function index space.
+/// @param module    The module (the context) with type, import, function and memory sections
+///                  already parsed.
+parser_result<Code> parse_expr(
+    const uint8_t* input, const uint8_t* end, FuncIdx func_idx, const Module& module);
 
 parser_result<std::string> parse_string(const uint8_t* pos, const uint8_t* end);
 
@@ -4,8 +4,9 @@
 
 #include "instructions.hpp"
 #include "parser.hpp"
+#include "stack.hpp"
+#include <algorithm>
 #include <cassert>
-#include <stack>
 
 namespace fizzy
 {
@@ -29,11 +30,23 @@ inline void push(bytes& b, T value)
 /// Wasm Validation Algorithm https://webassembly.github.io/spec/core/appendix/algorithm.html.
 struct ControlFrame
 {
-    /// The instruction that created the label.
-    const Instr instruction{Instr::unreachable};
+    /// The instruction that created the label. For an if instruction it is changed to else
+    /// at the else instruction.
+    Instr instruction{Instr::unreachable};
 
-    /// The immediates offset for block instructions.
-    const size_t immediates_offset{0};
+    /// The type arity of the block (can be 0 or 1).
+    uint8_t arity{0};
+
+    /// The operand stack height of the function at the frame start (in the parent frame). This is
+    /// the height the operand stack is reset to when branching to the frame's label.
+    int parent_stack_height{0};
+
+    /// The offset of the instruction following the loop instruction (the loop label target).
+    size_t code_offset{0};
+
+    /// The immediates offset following the loop instruction (the loop label target)
+    /// or the offset of the if instruction's immediates.
+    size_t immediates_offset{0};
 
     /// The frame stack height.
     int stack_height{0};
@@ -41,8 +54,146 @@ struct ControlFrame
     /// Whether the remainder of the block is unreachable (used to handle stack-polymorphic typing
     /// after branches).
     bool unreachable{false};
+
+    /// The offsets of the immediates of the jumps to the end of the block (the branches and
+    /// the else instruction), to be filled in at the block's end instruction.
+    std::vector<size_t> end_jump_immediates_offsets{};
 };
 
+/// Returns the type of the function of the given index in the module's function index space.
+inline const FuncType& get_function_type(const Module& module, FuncIdx idx) noexcept
+{
+    assert(idx < module.imported_function_types.size() + module.funcsec.size());
+
+    if (idx < module.imported_function_types.size())
+        return module.imported_function_types[idx];
+
+    const auto type_idx = module.funcsec[idx - module.imported_function_types.size()];
+    assert(type_idx < module.typesec.size());
+    return module.typesec[type_idx];
+}
+
+/// Validates the operand stack height required by an instruction and applies the change of
+/// the height caused by the instruction execution.
+inline void update_operand_stack(ControlFrame& frame, int stack_height_required,
+    int stack_height_change)
+{
+    if (frame.stack_height < stack_height_required && !frame.unreachable)
+        throw validation_error{"stack underflow"};
+
+    frame.stack_height += stack_height_change;
+}
+
+/// Stores the target of a jump: the instruction offset and the immediates offset.
+inline void store_jump_target(bytes& immediates, size_t immediates_offset, size_t target_pc,
+    size_t target_imm) noexcept
+{
+    auto* imm = immediates.data() + immediates_offset;
+    store(imm, static_cast<uint32_t>(target_pc));
+    imm += sizeof(uint32_t);
+    store(imm, static_cast<uint32_t>(target_imm));
+}
+
+/// Appends the immediates of a branch to the label of the given index: the target instruction
+/// and immediates offsets, the number of the label's values to keep on the top of the stack and
+/// the number of stack items to drop below them.
+///
+/// The target of a forward branch is not known yet. It is filled in at the end of the block.
+void push_branch_immediates(Code& code, Stack<ControlFrame>& control_stack, uint32_t label_idx)
+{
+    auto& frame = control_stack.back();
+    auto& label_frame = control_stack[control_stack.size() - label_idx - 1];
+
+    // The loop label has no values (the MVP loop has no parameters).
+    const int arity = label_frame.instruction != Instr::loop ? label_frame.arity : 0;
+    if (frame.stack_height < arity && !frame.unreachable)
+        throw validation_error{"stack underflow"};
+
+    // In the unreachable code the stack height is not known, but the branch is never taken.
+    const auto stack_height = frame.parent_stack_height + frame.stack_height;
+    const auto stack_drop =
+        !frame.unreachable ? stack_height - arity - label_frame.parent_stack_height : 0;
+
+    if (label_frame.instruction == Instr::loop)
+    {
+        push(code.immediates, static_cast<uint32_t>(label_frame.code_offset));
+        push(code.immediates, static_cast<uint32_t>(label_frame.immediates_offset));
+    }
+    else
+    {
+        label_frame.end_jump_immediates_offsets.push_back(code.immediates.size());
+        push(code.immediates, uint32_t{0});  // Offset of the target instruction.
+        push(code.immediates, uint32_t{0});  // Offset of the target immediates.
+    }
+    push(code.immediates, static_cast<uint32_t>(arity));
+    push(code.immediates, static_cast<uint32_t>(stack_drop));
+}
+
+/// Appends the instruction to the code, fusing it with the preceding instructions into
+/// a superinstruction when possible.
+///
+/// The instructions before @a fusion_barrier are never fused with the following ones, because
+/// the instruction at the barrier is a jump target.
+void emit_instruction(Code& code, Instr instr, size_t fusion_barrier)
+{
+    auto& instructions = code.instructions;
+    // For the else instruction the barrier is already set past it, to the else branch.
+    const auto num_fusable =
+        instructions.size() > fusion_barrier ? instructions.size() - fusion_barrier : 0;
+
+    // Checks if the preceding instructions match the given ones.
+    const auto preceded_by = [&](std::initializer_list<Instr> sequence) noexcept {
+        return num_fusable >= sequence.size() &&
+               std::equal(sequence.begin(), sequence.end(),
+                   instructions.end() - static_cast<std::ptrdiff_t>(sequence.size()));
+    };
+
+    // Replaces the given number of the preceding instructions and the current instruction with
+    // the superinstruction. The immediates need no changes, they are already in order.
+    const auto fuse = [&](size_t num_preceding, Instr fused) {
+        instructions.resize(instructions.size() - num_preceding);
+        instructions.emplace_back(fused);
+    };
+
+    switch (instr)
+    {
+    default:
+        break;
+    case Instr::local_get:
+        if (preceded_by({Instr::local_get}))
+            return fuse(1, superinstr::local_get_local_get);
+        if (preceded_by({Instr::local_tee}))
+            return fuse(1, superinstr::local_tee_local_get);
+        break;
+    case Instr::local_set:
+        if (preceded_by({Instr::local_get, superinstr::i32_add_imm}))
+            return fuse(2, superinstr::local_get_i32_add_imm_local_set);
+        break;
+    case Instr::i32_add:
+        if (preceded_by({Instr::i32_const}))
+            return fuse(1, superinstr::i32_add_imm);
+        break;
+    case Instr::i64_and:
+        if (preceded_by({Instr::i64_const}))
+            return fuse(1, superinstr::i64_and_imm);
+        break;
+    case Instr::i64_shr_u:
+        if (preceded_by({Instr::i64_const}))
+            return fuse(1, superinstr::i64_shr_u_imm);
+        break;
+    case Instr::i32_load:
+        if (preceded_by({Instr::local_get}))
+            return fuse(1, superinstr::local_get_i32_load);
+        break;
+    case Instr::i64_load:
+        if (preceded_by({Instr::local_get}))
+            return fuse(1, superinstr::local_get_i64_load);
+        break;
+    }
+
+    instructions.emplace_back(instr);
+}
+
 /// Parses blocktype.
 ///
 /// Spec: https://webassembly.github.io/spec/core/binary/types.html#binary-blocktype.
@@ -64,32 +215,42 @@ parser_result<uint8_t> parse_blocktype(const uint8_t* pos, const uint8_t* end)
 }
 }  // namespace
 
-parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have_memory)
+parser_result<Code> parse_expr(
+    const uint8_t* pos, const uint8_t* end, FuncIdx func_idx, const Module& module)
 {
     Code code;
 
+    const auto have_memory = !module.memorysec.empty() || !module.imported_memory_types.empty();
+    const auto& func_type = get_function_type(module, func_idx);
+
     // The stack of control frames allowing to distinguish between block/if/else and label
     // instructions as defined in Wasm Validation Algorithm.
-    // For a block/if/else instruction the value is the block/if/else's immediate offset.
-    std::stack<ControlFrame> control_stack;
+    Stack<ControlFrame> control_stack;
+
+    // The function's implicit block.
+    control_stack.emplace_back(
+        ControlFrame{Instr::block, static_cast<uint8_t>(func_type.outputs.size())});
 
-    control_stack.push({Instr::block});  // The function's implicit block.
+    // The index of the latest jump target instruction, the superinstructions cannot span it.
+    size_t fusion_barrier = 0;
 
     const auto metrics_table = get_instruction_metrics_table();
 
+    // The maximum operand stack height of the function. The heights of the unreachable code
+    // are included, so it may be overestimated, but never underestimated.
+    int max_stack_height = 0;
+
     bool continue_parsing = true;
     while (continue_parsing)
     {
         uint8_t opcode;
         std::tie(opcode, pos) = parse_byte(pos, end);
 
-        auto& frame = control_stack.top();
+        auto& frame = control_stack.back();
         const auto& metrics = metrics_table[opcode];
-
-        if (frame.stack_height < metrics.stack_height_required && !frame.unreachable)
-            throw validation_error{"stack underflow"};
-
-        frame.stack_height += metrics.stack_height_change;
+        update_operand_stack(frame, metrics.stack_height_required, metrics.stack_height_change);
+        max_stack_height =
+            std::max(max_stack_height, frame.parent_stack_height + frame.stack_height);
 
         const auto instr = static_cast<Instr>(opcode);
         switch (instr)
@@ -97,89 +258,14 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         default:
             throw parser_error{"invalid instruction " + std::to_string(*(pos - 1))};
 
-        // Floating point instructions are unsupported
-        case Instr::f32_load:
-        case Instr::f64_load:
-        case Instr::f32_store:
-        case Instr::f64_store:
-            if (!have_memory)
-                throw validation_error{"memory instructions require imported or defined memory"};
-            // alignment
-            std::tie(std::ignore, pos) = leb128u_decode<uint32_t>(pos, end);
-            // offset
-            std::tie(std::ignore, pos) = leb128u_decode<uint32_t>(pos, end);
-            break;
-        case Instr::f32_const:
-            pos = skip(4, pos, end);
-            break;
-        case Instr::f64_const:
-            pos = skip(8, pos, end);
+        case Instr::unreachable:
+            frame.unreachable = true;
             break;
-        case Instr::f32_eq:
-        case Instr::f32_ne:
-        case Instr::f32_lt:
-        case Instr::f32_gt:
-        case Instr::f32_le:
-        case Instr::f32_ge:
-        case Instr::f64_eq:
-        case Instr::f64_ne:
-        case Instr::f64_lt:
-        case Instr::f64_gt:
-        case Instr::f64_le:
-        case Instr::f64_ge:
-        case Instr::f32_abs:
-        case Instr::f32_neg:
-        case Instr::f32_ceil:
-        case Instr::f32_floor:
-        case Instr::f32_trunc:
-        case Instr::f32_nearest:
-        case Instr::f32_sqrt:
-        case Instr::f32_add:
-        case Instr::f32_sub:
-        case Instr::f32_mul:
-        case Instr::f32_div:
-        case Instr::f32_min:
-        case Instr::f32_max:
-        case Instr::f32_copysign:
-        case Instr::f64_abs:
-        case Instr::f64_neg:
-        case Instr::f64_ceil:
-        case Instr::f64_floor:
-        case Instr::f64_trunc:
-        case Instr::f64_nearest:
-        case Instr::f64_sqrt:
-        case Instr::f64_add:
-        case Instr::f64_sub:
-        case Instr::f64_mul:
-        case Instr::f64_div:
-        case Instr::f64_min:
-        case Instr::f64_max:
-        case Instr::f64_copysign:
-        case Instr::i32_trunc_f32_s:
-        case Instr::i32_trunc_f32_u:
-        case Instr::i32_trunc_f64_s:
-        case Instr::i32_trunc_f64_u:
-        case Instr::i64_trunc_f32_s:
-        case Instr::i64_trunc_f32_u:
-        case Instr::i64_trunc_f64_s:
-        case Instr::i64_trunc_f64_u:
-        case Instr::f32_convert_i32_s:
-        case Instr::f32_convert_i32_u:
-        case Instr::f32_convert_i64_s:
-        case Instr::f32_convert_i64_u:
-        case Instr::f32_demote_f64:
-        case Instr::f64_convert_i32_s:
-        case Instr::f64_convert_i32_u:
-        case Instr::f64_convert_i64_s:
-        case Instr::f64_convert_i64_u:
-        case Instr::f64_promote_f32:
-        case Instr::i32_reinterpret_f32:
-        case Instr::i64_reinterpret_f64:
-        case Instr::f32_reinterpret_i32:
-        case Instr::f64_reinterpret_i64:
 
-        case Instr::unreachable:
         case Instr::return_:
+            // The return is the branch to the function's label.
+            push_branch_immediates(
+                code, control_stack, static_cast<uint32_t>(control_stack.size() - 1));
             frame.unreachable = true;
             break;
 
@@ -247,78 +333,135 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         case Instr::i32_wrap_i64:
         case Instr::i64_extend_i32_s:
         case Instr::i64_extend_i32_u:
+        case Instr::f32_eq:
+        case Instr::f32_ne:
+        case Instr::f32_lt:
+        case Instr::f32_gt:
+        case Instr::f32_le:
+        case Instr::f32_ge:
+        case Instr::f64_eq:
+        case Instr::f64_ne:
+        case Instr::f64_lt:
+        case Instr::f64_gt:
+        case Instr::f64_le:
+        case Instr::f64_ge:
+        case Instr::f32_abs:
+        case Instr::f32_neg:
+        case Instr::f32_ceil:
+        case Instr::f32_floor:
+        case Instr::f32_trunc:
+        case Instr::f32_nearest:
+        case Instr::f32_sqrt:
+        case Instr::f32_add:
+        case Instr::f32_sub:
+        case Instr::f32_mul:
+        case Instr::f32_div:
+        case Instr::f32_min:
+        case Instr::f32_max:
+        case Instr::f32_copysign:
+        case Instr::f64_abs:
+        case Instr::f64_neg:
+        case Instr::f64_ceil:
+        case Instr::f64_floor:
+        case Instr::f64_trunc:
+        case Instr::f64_nearest:
+        case Instr::f64_sqrt:
+        case Instr::f64_add:
+        case Instr::f64_sub:
+        case Instr::f64_mul:
+        case Instr::f64_div:
+        case Instr::f64_min:
+        case Instr::f64_max:
+        case Instr::f64_copysign:
+        case Instr::i32_trunc_f32_s:
+        case Instr::i32_trunc_f32_u:
+        case Instr::i32_trunc_f64_s:
+        case Instr::i32_trunc_f64_u:
+        case Instr::i64_trunc_f32_s:
+        case Instr::i64_trunc_f32_u:
+        case Instr::i64_trunc_f64_s:
+        case Instr::i64_trunc_f64_u:
+        case Instr::f32_convert_i32_s:
+        case Instr::f32_convert_i32_u:
+        case Instr::f32_convert_i64_s:
+        case Instr::f32_convert_i64_u:
+        case Instr::f32_demote_f64:
+        case Instr::f64_convert_i32_s:
+        case Instr::f64_convert_i32_u:
+        case Instr::f64_convert_i64_s:
+        case Instr::f64_convert_i64_u:
+        case Instr::f64_promote_f32:
+        case Instr::i32_reinterpret_f32:
+        case Instr::i64_reinterpret_f64:
+        case Instr::f32_reinterpret_i32:
+        case Instr::f64_reinterpret_i64:
             break;
 
         case Instr::end:
         {
-            if (control_stack.size() > 1)
-            {
-                if (frame.instruction != Instr::loop)  // If end of block/if/else instruction.
-                {
-                    const auto target_pc = static_cast<uint32_t>(code.instructions.size() + 1);
-                    const auto target_imm = static_cast<uint32_t>(code.immediates.size());
-
-                    // Set the imm values for block instruction.
-                    auto* block_imm = code.immediates.data() + frame.immediates_offset;
-                    store(block_imm, target_pc);
-                    block_imm += sizeof(target_pc);
-                    store(block_imm, target_imm);
-                }
-                control_stack.pop();  // Pop the current frame.
-            }
-            else
-                continue_parsing = false;
-            break;
-        }
+            if (frame.instruction == Instr::if_ && frame.arity != 0)
+                throw validation_error{"if without else must not return a value"};
 
-        case Instr::block:
-        {
-            uint8_t arity;
-            std::tie(arity, pos) = parse_blocktype(pos, end);
-            code.immediates.push_back(arity);
+            // The end instruction of a block is not emitted, the jumps target the next
+            // instruction. The end of the function is emitted and it is the target of the branches
+            // to the function's label.
+            const auto target_pc = code.instructions.size();
+            const auto target_imm = code.immediates.size();
 
-            // Parent frame gets additional items on stack after this block exit.
-            frame.stack_height += arity;
+            if (frame.instruction == Instr::if_)
+                store_jump_target(code.immediates, frame.immediates_offset, target_pc, target_imm);
 
-            // Push label with immediates offset after arity.
-            control_stack.push({Instr::block, code.immediates.size()});
+            for (const auto offset : frame.end_jump_immediates_offsets)
+                store_jump_target(code.immediates, offset, target_pc, target_imm);
 
-            // Placeholders for immediate values, filled at the matching end instruction.
-            push(code.immediates, uint32_t{0});  // Diff to the end instruction.
-            push(code.immediates, uint32_t{0});  // Diff for the immediates.
+            if (control_stack.size() > 1)
+            {
+                control_stack.pop_back();  // Pop the current frame.
+                fusion_barrier = target_pc;
+                continue;
+            }
+
+            continue_parsing = false;
             break;
         }
 
+        case Instr::block:
         case Instr::loop:
         {
             uint8_t arity;
             std::tie(arity, pos) = parse_blocktype(pos, end);
 
+            const auto parent_stack_height = frame.parent_stack_height + frame.stack_height;
+
             // Parent frame gets additional items on stack after this block exit.
             frame.stack_height += arity;
 
-            control_stack.push({Instr::loop});
-            break;
+            // The block and loop instructions are not emitted. The loop label targets
+            // the instruction following the loop.
+            control_stack.emplace_back(ControlFrame{instr, arity, parent_stack_height,
+                code.instructions.size(), code.immediates.size()});
+            if (instr == Instr::loop)
+                fusion_barrier = code.instructions.size();
+            continue;
         }
 
         case Instr::if_:
         {
             uint8_t arity;
             std::tie(arity, pos) = parse_blocktype(pos, end);
-            code.immediates.push_back(arity);
+
+            const auto parent_stack_height = frame.parent_stack_height + frame.stack_height;
 
             // Parent frame gets additional items on stack after this block exit.
             frame.stack_height += arity;
 
-            control_stack.push({Instr::if_, code.immediates.size()});
-
-            // Placeholders for immediate values, filled at the matching end and else instructions.
-            push(code.immediates, uint32_t{0});  // Diff to the end instruction.
-            push(code.immediates, uint32_t{0});  // Diff for the immediates
-
-            push(code.immediates, uint32_t{0});  // Diff to the else instruction
-            push(code.immediates, uint32_t{0});  // Diff for the immediates.
+            control_stack.emplace_back(ControlFrame{
+                Instr::if_, arity, parent_stack_height, 0, code.immediates.size()});
 
+            // Placeholders for the jump target taken when the condition is false (the else branch
+            // or the end of the block), filled at the matching else or end instruction.
+            push(code.immediates, uint32_t{0});  // Offset of the target instruction.
+            push(code.immediates, uint32_t{0});  // Offset of the target immediates.
             break;
         }
 
@@ -327,20 +470,22 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             if (frame.instruction != Instr::if_)
                 throw parser_error{"unexpected else instruction (if instruction missing)"};
 
-            // Reset frame after if. The if result type validation not implemented yet.
-            frame.stack_height = 0;
-            frame.unreachable = false;
+            // The else instruction is the jump from the end of the then branch to the end of
+            // the block. The if instruction jumps to the else branch following it.
+            store_jump_target(code.immediates, frame.immediates_offset,
+                code.instructions.size() + 1, code.immediates.size() + 2 * sizeof(uint32_t));
 
-            const auto target_pc = static_cast<uint32_t>(code.instructions.size() + 1);
-            const auto target_imm = static_cast<uint32_t>(code.immediates.size());
+            frame.end_jump_immediates_offsets.push_back(code.immediates.size());
+            push(code.immediates, uint32_t{0});  // Offset of the end instruction.
+            push(code.immediates, uint32_t{0});  // Offset of the end immediates.
 
-            // Set the imm values for else instruction.
-            auto* block_imm = code.immediates.data() + frame.immediates_offset + sizeof(target_pc) +
-                              sizeof(target_imm);
-            store(block_imm, target_pc);
-            block_imm += sizeof(target_pc);
-            store(block_imm, target_imm);
+            // The else branch is the jump target of the if instruction.
+            fusion_barrier = code.instructions.size() + 1;
 
+            // Reset frame after if.
+            frame.instruction = Instr::else_;
+            frame.stack_height = 0;
+            frame.unreachable = false;
             break;
         }
 
@@ -353,7 +498,7 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             if (label_idx >= control_stack.size())
                 throw validation_error{"invalid label index"};
 
-            push(code.immediates, label_idx);
+            push_branch_immediates(code, control_stack, label_idx);
 
             if (instr == Instr::br)
                 frame.unreachable = true;
@@ -361,12 +506,30 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             break;
         }
 
+        case Instr::call:
+        {
+            uint32_t callee_func_idx;
+            std::tie(callee_func_idx, pos) = leb128u_decode<uint32_t>(pos, end);
+
+            if (callee_func_idx >= module.imported_function_types.size() + module.funcsec.size())
+                throw validation_error{"invalid funcidx encountered with call"};
+
+            const auto& callee_type = get_function_type(module, callee_func_idx);
+            update_operand_stack(frame, static_cast<int>(callee_type.inputs.size()),
+                static_cast<int>(callee_type.outputs.size()) -
+                    static_cast<int>(callee_type.inputs.size()));
+            max_stack_height =
+                std::max(max_stack_height, frame.parent_stack_height + frame.stack_height);
+
+            push(code.immediates, callee_func_idx);
+            break;
+        }
+
         case Instr::local_get:
         case Instr::local_set:
         case Instr::local_tee:
         case Instr::global_get:
         case Instr::global_set:
-        case Instr::call:
         {
             uint32_t imm;
             std::tie(imm, pos) = leb128u_decode<uint32_t>(pos, end);
@@ -392,8 +555,8 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
 
             push(code.immediates, static_cast<uint32_t>(label_indices.size()));
             for (const auto idx : label_indices)
-                push(code.immediates, idx);
-            push(code.immediates, default_label_idx);
+                push_branch_immediates(code, control_stack, idx);
+            push_branch_immediates(code, control_stack, default_label_idx);
 
             frame.unreachable = true;
 
@@ -402,9 +565,20 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
 
         case Instr::call_indirect:
         {
-            uint32_t imm;
-            std::tie(imm, pos) = leb128u_decode<uint32_t>(pos, end);
-            push(code.immediates, imm);
+            uint32_t type_idx;
+            std::tie(type_idx, pos) = leb128u_decode<uint32_t>(pos, end);
+
+            if (type_idx >= module.typesec.size())
+                throw validation_error{"invalid type index encountered with call_indirect"};
+
+            const auto& callee_type = module.typesec[type_idx];
+            update_operand_stack(frame, static_cast<int>(callee_type.inputs.size()),
+                static_cast<int>(callee_type.outputs.size()) -
+                    static_cast<int>(callee_type.inputs.size()));
+            max_stack_height =
+                std::max(max_stack_height, frame.parent_stack_height + frame.stack_height);
+
+            push(code.immediates, type_idx);
 
             if (pos == end)
                 throw parser_error{"Unexpected EOF"};
@@ -431,6 +605,22 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             break;
         }
 
+        case Instr::f32_const:
+        {
+            uint32_t value;
+            std::tie(value, pos) = parse_value<uint32_t>(pos, end);
+            push(code.immediates, value);
+            break;
+        }
+
+        case Instr::f64_const:
+        {
+            uint64_t value;
+            std::tie(value, pos) = parse_value<uint64_t>(pos, end);
+            push(code.immediates, value);
+            break;
+        }
+
         case Instr::i32_load:
         case Instr::i64_load:
         case Instr::i32_load8_s:
@@ -443,6 +633,8 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         case Instr::i64_load16_u:
         case Instr::i64_load32_s:
         case Instr::i64_load32_u:
+        case Instr::f32_load:
+        case Instr::f64_load:
         case Instr::i32_store:
         case Instr::i64_store:
         case Instr::i32_store8:
@@ -450,6 +642,8 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         case Instr::i64_store8:
         case Instr::i64_store16:
         case Instr::i64_store32:
+        case Instr::f32_store:
+        case Instr::f64_store:
         {
             // alignment
             std::tie(std::ignore, pos) = leb128u_decode<uint32_t>(pos, end);
@@ -478,9 +672,10 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             break;
         }
         }
-        code.instructions.emplace_back(instr);
+        emit_instruction(code, instr, fusion_barrier);
     }
     assert(control_stack.size() == 1);
+    code.max_stack_height = static_cast<uint32_t>(max_stack_height);
     return {code, pos};
 }
 }  // namespace fizzy
@@ -0,0 +1,1624 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "register_ir.hpp"
+#include "instructions.hpp"
+#include "limits.hpp"
+#include "numeric.hpp"
+#include "parser.hpp"
+#include "stack.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch"  // Superinstruction opcodes are not Instr enumerators.
+
+namespace fizzy
+{
+namespace
+{
+template <typename T>
+inline T read(const uint8_t*& input) noexcept
+{
+    T ret;
+    __builtin_memcpy(&ret, input, sizeof(ret));
+    input += sizeof(ret);
+    return ret;
+}
+
+/// The size of the immediates of a branch, see push_branch_immediates() in the parser.
+constexpr auto BranchImmediateSize = 4 * sizeof(uint32_t);
+
+/// The unknown operand stack height of a jump target.
+constexpr auto UnknownHeight = std::numeric_limits<uint32_t>::max();
+
+/// Returns the size of the immediates of the instruction in the stack bytecode.
+size_t immediates_size(Instr instr, const uint8_t* immediates) noexcept
+{
+    switch (instr)
+    {
+    case Instr::br:
+    case Instr::br_if:
+    case Instr::return_:
+        return BranchImmediateSize;
+    case Instr::br_table:
+        return sizeof(uint32_t) + (read<uint32_t>(immediates) + 1) * BranchImmediateSize;
+    case Instr::if_:
+    case Instr::else_:
+    case Instr::i64_const:
+    case Instr::f64_const:
+    case superinstr::local_get_local_get:
+    case superinstr::local_tee_local_get:
+    case superinstr::i64_and_imm:
+    case superinstr::i64_shr_u_imm:
+    case superinstr::local_get_i32_load:
+    case superinstr::local_get_i64_load:
+        return 2 * sizeof(uint32_t);
+    case superinstr::local_get_i32_add_imm_local_set:
+        return 3 * sizeof(uint32_t);
+    case Instr::call:
+    case Instr::call_indirect:
+    case Instr::local_get:
+    case Instr::local_set:
+    case Instr::local_tee:
+    case Instr::global_get:
+    case Instr::global_set:
+    case Instr::i32_const:
+    case Instr::f32_const:
+    case Instr::i32_load:
+    case Instr::i64_load:
+    case Instr::f32_load:
+    case Instr::f64_load:
+    case Instr::i32_load8_s:
+    case Instr::i32_load8_u:
+    case Instr::i32_load16_s:
+    case Instr::i32_load16_u:
+    case Instr::i64_load8_s:
+    case Instr::i64_load8_u:
+    case Instr::i64_load16_s:
+    case Instr::i64_load16_u:
+    case Instr::i64_load32_s:
+    case Instr::i64_load32_u:
+    case Instr::i32_store:
+    case Instr::i64_store:
+    case Instr::i32_store8:
+    case Instr::i32_store16:
+    case Instr::i64_store8:
+    case Instr::i64_store16:
+    case Instr::i64_store32:
+    case Instr::f32_store:
+    case Instr::f64_store:
+    case superinstr::i32_add_imm:
+        return sizeof(uint32_t);
+    default:
+        return 0;
+    }
+}
+
+const FuncType& function_type(const Module& module, FuncIdx idx)
+{
+    if (idx < module.imported_function_types.size())
+        return module.imported_function_types[idx];
+
+    const auto type_idx = module.funcsec[idx - module.imported_function_types.size()];
+    assert(type_idx < module.typesec.size());
+    return module.typesec[type_idx];
+}
+
+/// Translates the stack bytecode of a single function to the register IR.
+///
+/// The translation keeps a virtual operand stack, where each item is the slot holding the value.
+/// The item of height h is kept in its own stack slot (num_locals + h) or, if it is a result of
+/// local.get not yet overwritten, it refers to the local's slot directly. Such references are
+/// copied to their stack slots (materialized) only when required: before the local is modified
+/// and when the control flow joins, where all the items must be in their own stack slots.
+class Translator
+{
+    const Module& m_module;
+    const Code& m_code;
+    RegCode m_result;
+
+    /// The number of the function results.
+    uint32_t m_arity = 0;
+
+    /// The slots of the operand stack items.
+    std::vector<uint32_t> m_stack;
+
+    /// Whether the current instruction is reachable from the function entry.
+    bool m_reachable = true;
+
+    /// Whether the last emitted instruction only stores its result to the dst slot,
+    /// so the dst can be replaced by a local in the following local.set or local.tee.
+    bool m_last_defines_dst = false;
+
+    /// The index of the first emitted instruction after the last jump target.
+    /// The instructions before it cannot have their dst replaced.
+    size_t m_barrier = 0;
+
+    /// Whether the stack bytecode instruction of the given index is a jump target.
+    std::vector<bool> m_is_target;
+
+    /// The operand stack height at the jump target, recorded by the branches to it.
+    std::vector<uint32_t> m_target_height;
+
+    /// The index of the register IR instruction translated from the stack bytecode instruction.
+    std::vector<size_t> m_new_index;
+
+    /// The register IR jumps to be resolved: the instruction index and the stack bytecode target.
+    std::vector<std::pair<size_t, uint32_t>> m_jumps;
+
+public:
+    Translator(const Module& module, const FuncType& type, const Code& code)
+      : m_module{module}, m_code{code}, m_arity{static_cast<uint32_t>(type.outputs.size())}
+    {
+        m_result.num_args = static_cast<uint32_t>(type.inputs.size());
+        m_result.num_locals = m_result.num_args + code.local_count;
+        m_result.frame_size = m_result.num_locals;
+    }
+
+    RegCode translate();
+
+private:
+    uint32_t stack_slot(size_t height) const noexcept
+    {
+        return m_result.num_locals + static_cast<uint32_t>(height);
+    }
+
+    void push_slot(uint32_t slot)
+    {
+        m_stack.push_back(slot);
+        m_result.frame_size = std::max(m_result.frame_size, stack_slot(m_stack.size()));
+    }
+
+    /// Pushes the new item kept in its own stack slot.
+    uint32_t push()
+    {
+        const auto slot = stack_slot(m_stack.size());
+        push_slot(slot);
+        return slot;
+    }
+
+    uint32_t pop() noexcept
+    {
+        assert(!m_stack.empty());
+        const auto slot = m_stack.back();
+        m_stack.pop_back();
+        return slot;
+    }
+
+    void emit(const RegInstr& instr, bool defines_dst = false)
+    {
+        m_result.instructions.push_back(instr);
+        m_last_defines_dst = defines_dst;
+    }
+
+    void emit_copy(uint32_t dst, uint32_t src)
+    {
+        if (dst != src)
+            emit({Instr::local_get, dst, src, 0, 0}, true);
+    }
+
+    void emit_jump(Instr op, uint32_t target, uint32_t dst = 0, uint32_t a = 0, uint32_t b = 0)
+    {
+        m_jumps.emplace_back(m_result.instructions.size(), target);
+        emit({op, dst, a, b, 0});
+    }
+
+    /// Copies the items in range [begin, end) of the stack to their own stack slots.
+    void materialize(size_t begin, size_t end)
+    {
+        for (auto h = begin; h < end; ++h)
+        {
+            if (m_stack[h] != stack_slot(h))
+            {
+                emit_copy(stack_slot(h), m_stack[h]);
+                m_stack[h] = stack_slot(h);
+            }
+        }
+    }
+
+    void materialize_all() { materialize(0, m_stack.size()); }
+
+    /// Copies the items referring to the local to their own stack slots.
+    void materialize_local(uint32_t local_idx)
+    {
+        for (size_t h = 0; h < m_stack.size(); ++h)
+        {
+            if (m_stack[h] == local_idx)
+            {
+                emit_copy(stack_slot(h), local_idx);
+                m_stack[h] = stack_slot(h);
+            }
+        }
+    }
+
+    void record_target_height(uint32_t target, size_t height)
+    {
+        assert(m_target_height[target] == UnknownHeight || m_target_height[target] == height);
+        m_target_height[target] = static_cast<uint32_t>(height);
+    }
+
+    /// Stores the value of the slot to the local.
+    void set_local(uint32_t local_idx, uint32_t src)
+    {
+        materialize_local(local_idx);
+
+        // Store the result of the last instruction directly to the local if the value was computed
+        // to the temporary stack slot by the instruction, no jump lands in between.
+        auto& instructions = m_result.instructions;
+        if (src >= m_result.num_locals && m_last_defines_dst && instructions.size() > m_barrier &&
+            instructions.back().dst == src)
+        {
+            instructions.back().dst = local_idx;
+        }
+        else
+            emit_copy(local_idx, src);
+    }
+
+    void local_set(uint32_t local_idx) { set_local(local_idx, pop()); }
+
+    void local_tee(uint32_t local_idx)
+    {
+        const auto src = pop();
+        set_local(local_idx, src);
+        push_slot(local_idx);
+    }
+
+    void unary(Instr op, uint64_t imm = 0)
+    {
+        const auto a = pop();
+        emit({op, push(), a, 0, imm}, true);
+    }
+
+    void binary(Instr op)
+    {
+        const auto b = pop();
+        const auto a = pop();
+        emit({op, push(), a, b, 0}, true);
+    }
+
+    void load(Instr op, uint32_t offset)
+    {
+        const auto address = pop();
+        emit({op, push(), address, 0, offset}, true);
+    }
+
+    /// Emits the branch of the stack bytecode. The items of the current stack are put to their own
+    /// slots, except the branch result which is moved to the target's stack slot by the branch.
+    void branch(Instr op, const uint8_t*& immediates, uint32_t condition = 0)
+    {
+        const auto target = read<uint32_t>(immediates);
+        immediates += sizeof(uint32_t);  // The target immediates offset.
+        const auto arity = read<uint32_t>(immediates);
+        const auto drop = read<uint32_t>(immediates);
+
+        const auto height = m_stack.size();
+        assert(height >= arity + drop);
+        materialize(0, height - arity);
+
+        if (arity != 0)
+            emit_jump(op, target, stack_slot(height - drop - 1), m_stack.back(), condition);
+        else
+            emit_jump(op, target, 0, 0, condition);
+        record_target_height(target, height - drop);
+    }
+
+    void translate_call(Instr op, const FuncType& callee_type, uint64_t imm, uint32_t elem_slot = 0)
+    {
+        // The arguments must be in the consecutive stack slots where the callee frame starts.
+        const auto num_args = callee_type.inputs.size();
+        assert(m_stack.size() >= num_args);
+        const auto args_height = m_stack.size() - num_args;
+        materialize(args_height, m_stack.size());
+        m_stack.resize(args_height);
+
+        emit({op, stack_slot(args_height), elem_slot, 0, imm});
+        if (!callee_type.outputs.empty())
+            push();
+    }
+
+    void translate_instruction(Instr instr, const uint8_t* immediates);
+};
+
+RegCode Translator::translate()
+{
+    const auto num_instructions = m_code.instructions.size();
+    m_is_target.resize(num_instructions, false);
+    m_target_height.resize(num_instructions, UnknownHeight);
+    m_new_index.resize(num_instructions, 0);
+
+    // Find the jump targets.
+    const auto* immediates = m_code.immediates.data();
+    for (const auto instr : m_code.instructions)
+    {
+        const auto* imm = immediates;
+        switch (instr)
+        {
+        case Instr::br:
+        case Instr::br_if:
+        case Instr::if_:
+        case Instr::else_:
+            m_is_target[read<uint32_t>(imm)] = true;
+            break;
+        case Instr::br_table:
+        {
+            const auto size = read<uint32_t>(imm);
+            for (size_t i = 0; i <= size; ++i)
+            {
+                const auto* br_imm = imm + i * BranchImmediateSize;
+                m_is_target[read<uint32_t>(br_imm)] = true;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        immediates += immediates_size(instr, immediates);
+    }
+
+    immediates = m_code.immediates.data();
+    for (size_t i = 0; i < num_instructions; ++i)
+    {
+        const auto instr = m_code.instructions[i];
+
+        if (m_is_target[i])
+        {
+            if (m_reachable)
+                materialize_all();
+            else if (m_target_height[i] != UnknownHeight)
+            {
+                m_stack.clear();
+                for (size_t h = 0; h < m_target_height[i]; ++h)
+                    push();
+                m_reachable = true;
+            }
+            m_barrier = m_result.instructions.size();
+        }
+        m_new_index[i] = m_result.instructions.size();
+
+        if (m_reachable)
+        {
+            if (instr == Instr::end)
+            {
+                // The end of the function.
+                emit({Instr::return_, 0, m_arity != 0 ? m_stack.back() : 0, m_arity, 0});
+                m_reachable = false;
+            }
+            else
+                translate_instruction(instr, immediates);
+        }
+        immediates += immediates_size(instr, immediates);
+    }
+
+    for (const auto& [index, target] : m_jumps)
+        m_result.instructions[index].imm = m_new_index[target];
+
+    return std::move(m_result);
+}
+
+void Translator::translate_instruction(Instr instr, const uint8_t* immediates)
+{
+    switch (instr)
+    {
+    case Instr::unreachable:
+        emit({Instr::unreachable, 0, 0, 0, 0});
+        m_reachable = false;
+        break;
+    case Instr::nop:
+        break;
+    case Instr::block:
+    case Instr::loop:
+    case Instr::end:
+        // The block and loop instructions and the ends of blocks are not emitted by the parser.
+        assert(false);
+        break;
+    case Instr::if_:
+    {
+        const auto target = read<uint32_t>(immediates);
+        const auto condition = pop();
+        materialize_all();
+        emit_jump(Instr::if_, target, 0, condition);
+        record_target_height(target, m_stack.size());
+        break;
+    }
+    case Instr::else_:
+    {
+        // The end of the then branch, jump to the end of the if block.
+        const auto target = read<uint32_t>(immediates);
+        materialize_all();
+        emit_jump(Instr::br, target);
+        record_target_height(target, m_stack.size());
+        m_reachable = false;
+        break;
+    }
+    case Instr::br:
+    {
+        const auto* target_imm = immediates;
+        if (read<uint32_t>(target_imm) == m_code.instructions.size() - 1)
+        {
+            // The branch to the function's label is the return.
+            translate_instruction(Instr::return_, immediates);
+            break;
+        }
+        branch(Instr::br, immediates);
+        m_reachable = false;
+        break;
+    }
+    case Instr::return_:
+    {
+        immediates += 2 * sizeof(uint32_t);  // The target offsets.
+        const auto arity = read<uint32_t>(immediates);
+        emit({Instr::return_, 0, arity != 0 ? m_stack.back() : 0, arity, 0});
+        m_reachable = false;
+        break;
+    }
+    case Instr::br_if:
+    {
+        const auto condition = pop();
+        branch(Instr::br_if, immediates, condition);
+        break;
+    }
+    case Instr::br_table:
+    {
+        const auto size = read<uint32_t>(immediates);
+        const auto idx = pop();
+
+        // All the labels have the same arity. The stack items below the branch result are put
+        // to their own slots before the jump table.
+        const auto* arity_imm = immediates + 2 * sizeof(uint32_t);
+        const auto arity = read<uint32_t>(arity_imm);
+        materialize(0, m_stack.size() - arity);
+        emit({Instr::br_table, 0, idx, size, 0});
+        for (size_t i = 0; i <= size; ++i)
+            branch(Instr::br, immediates);
+        m_reachable = false;
+        break;
+    }
+    case Instr::call:
+    {
+        const auto func_idx = read<uint32_t>(immediates);
+        translate_call(Instr::call, function_type(m_module, func_idx), func_idx);
+        break;
+    }
+    case Instr::call_indirect:
+    {
+        const auto type_idx = read<uint32_t>(immediates);
+        const auto elem_slot = pop();
+        translate_call(Instr::call_indirect, m_module.typesec[type_idx], type_idx, elem_slot);
+        break;
+    }
+    case Instr::drop:
+        pop();
+        break;
+    case Instr::select:
+    {
+        const auto condition = pop();
+        const auto b = pop();
+        const auto a = pop();
+        emit({Instr::select, push(), a, b, condition}, true);
+        break;
+    }
+    case Instr::local_get:
+        push_slot(read<uint32_t>(immediates));
+        break;
+    case Instr::local_set:
+        local_set(read<uint32_t>(immediates));
+        break;
+    case Instr::local_tee:
+        local_tee(read<uint32_t>(immediates));
+        break;
+    case Instr::global_get:
+        emit({Instr::global_get, push(), 0, 0, read<uint32_t>(immediates)}, true);
+        break;
+    case Instr::global_set:
+        emit({Instr::global_set, 0, pop(), 0, read<uint32_t>(immediates)});
+        break;
+    case Instr::i32_load:
+    case Instr::i64_load:
+    case Instr::i32_load8_s:
+    case Instr::i32_load8_u:
+    case Instr::i32_load16_s:
+    case Instr::i32_load16_u:
+    case Instr::i64_load8_s:
+    case Instr::i64_load8_u:
+    case Instr::i64_load16_s:
+    case Instr::i64_load16_u:
+    case Instr::i64_load32_s:
+    case Instr::i64_load32_u:
+        load(instr, read<uint32_t>(immediates));
+        break;
+    case Instr::f32_load:
+        // The floating point values are kept as their bits, so the integer loads and stores
+        // of the same size are used.
+        load(Instr::i32_load, read<uint32_t>(immediates));
+        break;
+    case Instr::f64_load:
+        load(Instr::i64_load, read<uint32_t>(immediates));
+        break;
+    case Instr::i32_store:
+    case Instr::i64_store:
+    case Instr::i32_store8:
+    case Instr::i32_store16:
+    case Instr::i64_store8:
+    case Instr::i64_store16:
+    case Instr::i64_store32:
+    case Instr::f32_store:
+    case Instr::f64_store:
+    {
+        const auto op = instr == Instr::f32_store ? Instr::i32_store :
+                        instr == Instr::f64_store ? Instr::i64_store :
+                                                    instr;
+        const auto value = pop();
+        const auto address = pop();
+        emit({op, 0, address, value, read<uint32_t>(immediates)});
+        break;
+    }
+    case Instr::memory_size:
+        emit({Instr::memory_size, push(), 0, 0, 0}, true);
+        break;
+    case Instr::memory_grow:
+        unary(Instr::memory_grow);
+        break;
+    case Instr::i32_const:
+    case Instr::f32_const:
+        emit({Instr::i32_const, push(), 0, 0, read<uint32_t>(immediates)}, true);
+        break;
+    case Instr::i64_const:
+    case Instr::f64_const:
+        emit({Instr::i64_const, push(), 0, 0, read<uint64_t>(immediates)}, true);
+        break;
+    case Instr::i32_eqz:
+    case Instr::i64_eqz:
+    case Instr::i32_clz:
+    case Instr::i32_ctz:
+    case Instr::i32_popcnt:
+    case Instr::i64_clz:
+    case Instr::i64_ctz:
+    case Instr::i64_popcnt:
+    case Instr::i32_wrap_i64:
+    case Instr::i64_extend_i32_s:
+    case Instr::f32_abs:
+    case Instr::f32_neg:
+    case Instr::f32_ceil:
+    case Instr::f32_floor:
+    case Instr::f32_trunc:
+    case Instr::f32_nearest:
+    case Instr::f32_sqrt:
+    case Instr::f64_abs:
+    case Instr::f64_neg:
+    case Instr::f64_ceil:
+    case Instr::f64_floor:
+    case Instr::f64_trunc:
+    case Instr::f64_nearest:
+    case Instr::f64_sqrt:
+    case Instr::i32_trunc_f32_s:
+    case Instr::i32_trunc_f32_u:
+    case Instr::i32_trunc_f64_s:
+    case Instr::i32_trunc_f64_u:
+    case Instr::i64_trunc_f32_s:
+    case Instr::i64_trunc_f32_u:
+    case Instr::i64_trunc_f64_s:
+    case Instr::i64_trunc_f64_u:
+    case Instr::f32_convert_i32_s:
+    case Instr::f32_convert_i32_u:
+    case Instr::f32_convert_i64_s:
+    case Instr::f32_convert_i64_u:
+    case Instr::f32_demote_f64:
+    case Instr::f64_convert_i32_s:
+    case Instr::f64_convert_i32_u:
+    case Instr::f64_convert_i64_s:
+    case Instr::f64_convert_i64_u:
+    case Instr::f64_promote_f32:
+        unary(instr);
+        break;
+    case Instr::i64_extend_i32_u:
+    case Instr::i32_reinterpret_f32:
+    case Instr::i64_reinterpret_f64:
+    case Instr::f32_reinterpret_i32:
+    case Instr::f64_reinterpret_i64:
+        // The i32 values are kept zero-extended and the floating point values as their bits,
+        // so the slot already holds the result.
+        break;
+    case Instr::i32_eq:
+    case Instr::i32_ne:
+    case Instr::i32_lt_s:
+    case Instr::i32_lt_u:
+    case Instr::i32_gt_s:
+    case Instr::i32_gt_u:
+    case Instr::i32_le_s:
+    case Instr::i32_le_u:
+    case Instr::i32_ge_s:
+    case Instr::i32_ge_u:
+    case Instr::i64_eq:
+    case Instr::i64_ne:
+    case Instr::i64_lt_s:
+    case Instr::i64_lt_u:
+    case Instr::i64_gt_s:
+    case Instr::i64_gt_u:
+    case Instr::i64_le_s:
+    case Instr::i64_le_u:
+    case Instr::i64_ge_s:
+    case Instr::i64_ge_u:
+    case Instr::i32_add:
+    case Instr::i32_sub:
+    case Instr::i32_mul:
+    case Instr::i32_div_s:
+    case Instr::i32_div_u:
+    case Instr::i32_rem_s:
+    case Instr::i32_rem_u:
+    case Instr::i32_and:
+    case Instr::i32_or:
+    case Instr::i32_xor:
+    case Instr::i32_shl:
+    case Instr::i32_shr_s:
+    case Instr::i32_shr_u:
+    case Instr::i32_rotl:
+    case Instr::i32_rotr:
+    case Instr::i64_add:
+    case Instr::i64_sub:
+    case Instr::i64_mul:
+    case Instr::i64_div_s:
+    case Instr::i64_div_u:
+    case Instr::i64_rem_s:
+    case Instr::i64_rem_u:
+    case Instr::i64_and:
+    case Instr::i64_or:
+    case Instr::i64_xor:
+    case Instr::i64_shl:
+    case Instr::i64_shr_s:
+    case Instr::i64_shr_u:
+    case Instr::i64_rotl:
+    case Instr::i64_rotr:
+    case Instr::f32_eq:
+    case Instr::f32_ne:
+    case Instr::f32_lt:
+    case Instr::f32_gt:
+    case Instr::f32_le:
+    case Instr::f32_ge:
+    case Instr::f64_eq:
+    case Instr::f64_ne:
+    case Instr::f64_lt:
+    case Instr::f64_gt:
+    case Instr::f64_le:
+    case Instr::f64_ge:
+    case Instr::f32_add:
+    case Instr::f32_sub:
+    case Instr::f32_mul:
+    case Instr::f32_div:
+    case Instr::f32_min:
+    case Instr::f32_max:
+    case Instr::f32_copysign:
+    case Instr::f64_add:
+    case Instr::f64_sub:
+    case Instr::f64_mul:
+    case Instr::f64_div:
+    case Instr::f64_min:
+    case Instr::f64_max:
+    case Instr::f64_copysign:
+        binary(instr);
+        break;
+    case superinstr::local_get_local_get:
+        push_slot(read<uint32_t>(immediates));
+        push_slot(read<uint32_t>(immediates));
+        break;
+    case superinstr::local_tee_local_get:
+        local_tee(read<uint32_t>(immediates));
+        push_slot(read<uint32_t>(immediates));
+        break;
+    case superinstr::i32_add_imm:
+        unary(instr, read<uint32_t>(immediates));
+        break;
+    case superinstr::i64_and_imm:
+    case superinstr::i64_shr_u_imm:
+        unary(instr, read<uint64_t>(immediates));
+        break;
+    case superinstr::local_get_i32_load:
+        push_slot(read<uint32_t>(immediates));
+        load(Instr::i32_load, read<uint32_t>(immediates));
+        break;
+    case superinstr::local_get_i64_load:
+        push_slot(read<uint32_t>(immediates));
+        load(Instr::i64_load, read<uint32_t>(immediates));
+        break;
+    case superinstr::local_get_i32_add_imm_local_set:
+        push_slot(read<uint32_t>(immediates));
+        unary(superinstr::i32_add_imm, read<uint32_t>(immediates));
+        local_set(read<uint32_t>(immediates));
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+template <typename DstT, typename SrcT = DstT>
+inline bool load_from_memory(
+    const LinearMemory& memory, uint64_t* slots, const RegInstr& instr) noexcept
+{
+    const auto address = static_cast<uint32_t>(slots[instr.a]);
+    // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
+    if ((uint64_t{address} + instr.imm + sizeof(SrcT)) > memory.size())
+        return false;
+
+    SrcT value;
+    __builtin_memcpy(&value, memory.data() + address + instr.imm, sizeof(value));
+    slots[instr.dst] = extend<DstT>(value);
+    return true;
+}
+
+template <typename DstT>
+inline bool store_into_memory(
+    LinearMemory& memory, const uint64_t* slots, const RegInstr& instr) noexcept
+{
+    const auto address = static_cast<uint32_t>(slots[instr.a]);
+    // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
+    if ((uint64_t{address} + instr.imm + sizeof(DstT)) > memory.size())
+        return false;
+
+    const auto value = static_cast<DstT>(slots[instr.b]);
+    __builtin_memcpy(memory.data() + address + instr.imm, &value, sizeof(value));
+    return true;
+}
+
+template <typename Op>
+inline void unary_op(uint64_t* slots, const RegInstr& instr, Op op) noexcept
+{
+    using T = decltype(op(slots[instr.a]));
+    slots[instr.dst] = to_value(op(from_value<T>(slots[instr.a])));
+}
+
+template <typename Op>
+inline void binary_op(uint64_t* slots, const RegInstr& instr, Op op) noexcept
+{
+    using T = decltype(op(slots[instr.a], slots[instr.b]));
+    const auto val1 = from_value<T>(slots[instr.a]);
+    const auto val2 = from_value<T>(slots[instr.b]);
+    slots[instr.dst] = to_value(op(val1, val2));
+}
+
+template <typename T, template <typename> class Op>
+inline void comparison_op(uint64_t* slots, const RegInstr& instr, Op<T> op) noexcept
+{
+    const auto val1 = from_value<T>(slots[instr.a]);
+    const auto val2 = from_value<T>(slots[instr.b]);
+    slots[instr.dst] = uint32_t{op(val1, val2)};
+}
+
+template <typename T>
+inline void fcopysign_op(uint64_t* slots, const RegInstr& instr) noexcept
+{
+    const auto sign = slots[instr.b] & SignMask<T>;
+    slots[instr.dst] = (slots[instr.a] & ~uint64_t{SignMask<T>}) | sign;
+}
+
+template <typename DstT, typename SrcT>
+inline bool trunc_op(uint64_t* slots, const RegInstr& instr) noexcept
+{
+    const auto result = trunc<DstT>(from_value<SrcT>(slots[instr.a]));
+    if (!result.has_value())
+        return false;
+    slots[instr.dst] = to_value(*result);
+    return true;
+}
+
+template <typename DstT, typename SrcT>
+inline void convert_op(uint64_t* slots, const RegInstr& instr) noexcept
+{
+    slots[instr.dst] = to_value(static_cast<DstT>(from_value<SrcT>(slots[instr.a])));
+}
+
+/// The call frame of the register IR tier. The frame's slots are placed in the slots vector
+/// of the execution at the given offset, overlapping the caller's call argument slots.
+struct RegFrame
+{
+    const RegCode* code = nullptr;
+    const RegInstr* pc = nullptr;  ///< The instruction to resume from after a call.
+    size_t base = 0;               ///< The offset of the frame's first slot.
+};
+}  // namespace
+
+std::vector<RegCode> translate_to_register_ir(const Module& module)
+{
+    std::vector<RegCode> result;
+    result.reserve(module.funcsec.size());
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+    {
+        const auto& type = module.typesec[module.funcsec[i]];
+        result.emplace_back(Translator{module, type, get_code(module, i)}.translate());
+    }
+    return result;
+}
+
+bool invoke_external_function(
+    const ExternalFunction& func, Instance& instance, uint64_t* args, int depth)
+{
+    const auto num_args = func.type.inputs.size();
+    const auto num_outputs = func.type.outputs.size();
+
+    if (func.host_function != nullptr)
+    {
+        uint64_t result;
+        if (!func.host_function(
+                func.host_context, instance, {args, num_args}, {&result, num_outputs}, depth + 1))
+            return false;
+        if (num_outputs != 0)
+            args[0] = result;
+        return true;
+    }
+
+    if (func.instance != nullptr)
+    {
+        const auto ret = execute_span(*func.instance, func.func_idx, {args, num_args}, depth + 1);
+        if (ret.trapped)
+            return false;
+        if (ret.value.has_value())
+            args[0] = *ret.value;
+        return true;
+    }
+
+    std::vector<uint64_t> call_args(args, args + num_args);
+    const auto ret = func.function(instance, std::move(call_args), depth + 1);
+    // Bubble up traps
+    if (ret.trapped)
+        return false;
+
+    assert(ret.stack.size() == num_outputs);
+    if (num_outputs != 0)
+        args[0] = ret.stack[0];
+    return true;
+}
+
+bool execute_float_instruction(const RegInstr& instr, uint64_t* slots) noexcept
+{
+    switch (instr.op)
+    {
+    case Instr::f32_eq:
+        comparison_op(slots, instr, std::equal_to<float>());
+        break;
+    case Instr::f32_ne:
+        comparison_op(slots, instr, std::not_equal_to<float>());
+        break;
+    case Instr::f32_lt:
+        comparison_op(slots, instr, std::less<float>());
+        break;
+    case Instr::f32_gt:
+        comparison_op(slots, instr, std::greater<float>());
+        break;
+    case Instr::f32_le:
+        comparison_op(slots, instr, std::less_equal<float>());
+        break;
+    case Instr::f32_ge:
+        comparison_op(slots, instr, std::greater_equal<float>());
+        break;
+    case Instr::f64_eq:
+        comparison_op(slots, instr, std::equal_to<double>());
+        break;
+    case Instr::f64_ne:
+        comparison_op(slots, instr, std::not_equal_to<double>());
+        break;
+    case Instr::f64_lt:
+        comparison_op(slots, instr, std::less<double>());
+        break;
+    case Instr::f64_gt:
+        comparison_op(slots, instr, std::greater<double>());
+        break;
+    case Instr::f64_le:
+        comparison_op(slots, instr, std::less_equal<double>());
+        break;
+    case Instr::f64_ge:
+        comparison_op(slots, instr, std::greater_equal<double>());
+        break;
+    case Instr::f32_abs:
+        slots[instr.dst] = slots[instr.a] & ~uint64_t{SignMask<float>};
+        break;
+    case Instr::f32_neg:
+        slots[instr.dst] = slots[instr.a] ^ SignMask<float>;
+        break;
+    case Instr::f32_ceil:
+        unary_op(slots, instr, [](float a) { return std::ceil(a); });
+        break;
+    case Instr::f32_floor:
+        unary_op(slots, instr, [](float a) { return std::floor(a); });
+        break;
+    case Instr::f32_trunc:
+        unary_op(slots, instr, [](float a) { return std::trunc(a); });
+        break;
+    case Instr::f32_nearest:
+        unary_op(slots, instr, fnearest<float>);
+        break;
+    case Instr::f32_sqrt:
+        unary_op(slots, instr, [](float a) { return std::sqrt(a); });
+        break;
+    case Instr::f32_add:
+        binary_op(slots, instr, std::plus<float>());
+        break;
+    case Instr::f32_sub:
+        binary_op(slots, instr, std::minus<float>());
+        break;
+    case Instr::f32_mul:
+        binary_op(slots, instr, std::multiplies<float>());
+        break;
+    case Instr::f32_div:
+        binary_op(slots, instr, std::divides<float>());
+        break;
+    case Instr::f32_min:
+        binary_op(slots, instr, fmin<float>);
+        break;
+    case Instr::f32_max:
+        binary_op(slots, instr, fmax<float>);
+        break;
+    case Instr::f32_copysign:
+        fcopysign_op<float>(slots, instr);
+        break;
+    case Instr::f64_abs:
+        slots[instr.dst] = slots[instr.a] & ~uint64_t{SignMask<double>};
+        break;
+    case Instr::f64_neg:
+        slots[instr.dst] = slots[instr.a] ^ SignMask<double>;
+        break;
+    case Instr::f64_ceil:
+        unary_op(slots, instr, [](double a) { return std::ceil(a); });
+        break;
+    case Instr::f64_floor:
+        unary_op(slots, instr, [](double a) { return std::floor(a); });
+        break;
+    case Instr::f64_trunc:
+        unary_op(slots, instr, [](double a) { return std::trunc(a); });
+        break;
+    case Instr::f64_nearest:
+        unary_op(slots, instr, fnearest<double>);
+        break;
+    case Instr::f64_sqrt:
+        unary_op(slots, instr, [](double a) { return std::sqrt(a); });
+        break;
+    case Instr::f64_add:
+        binary_op(slots, instr, std::plus<double>());
+        break;
+    case Instr::f64_sub:
+        binary_op(slots, instr, std::minus<double>());
+        break;
+    case Instr::f64_mul:
+        binary_op(slots, instr, std::multiplies<double>());
+        break;
+    case Instr::f64_div:
+        binary_op(slots, instr, std::divides<double>());
+        break;
+    case Instr::f64_min:
+        binary_op(slots, instr, fmin<double>);
+        break;
+    case Instr::f64_max:
+        binary_op(slots, instr, fmax<double>);
+        break;
+    case Instr::f64_copysign:
+        fcopysign_op<double>(slots, instr);
+        break;
+    case Instr::i32_trunc_f32_s:
+        return trunc_op<int32_t, float>(slots, instr);
+    case Instr::i32_trunc_f32_u:
+        return trunc_op<uint32_t, float>(slots, instr);
+    case Instr::i32_trunc_f64_s:
+        return trunc_op<int32_t, double>(slots, instr);
+    case Instr::i32_trunc_f64_u:
+        return trunc_op<uint32_t, double>(slots, instr);
+    case Instr::i64_trunc_f32_s:
+        return trunc_op<int64_t, float>(slots, instr);
+    case Instr::i64_trunc_f32_u:
+        return trunc_op<uint64_t, float>(slots, instr);
+    case Instr::i64_trunc_f64_s:
+        return trunc_op<int64_t, double>(slots, instr);
+    case Instr::i64_trunc_f64_u:
+        return trunc_op<uint64_t, double>(slots, instr);
+    case Instr::f32_convert_i32_s:
+        convert_op<float, int32_t>(slots, instr);
+        break;
+    case Instr::f32_convert_i32_u:
+        convert_op<float, uint32_t>(slots, instr);
+        break;
+    case Instr::f32_convert_i64_s:
+        convert_op<float, int64_t>(slots, instr);
+        break;
+    case Instr::f32_convert_i64_u:
+        convert_op<float, uint64_t>(slots, instr);
+        break;
+    case Instr::f32_demote_f64:
+        convert_op<float, double>(slots, instr);
+        break;
+    case Instr::f64_convert_i32_s:
+        convert_op<double, int32_t>(slots, instr);
+        break;
+    case Instr::f64_convert_i32_u:
+        convert_op<double, uint32_t>(slots, instr);
+        break;
+    case Instr::f64_convert_i64_s:
+        convert_op<double, int64_t>(slots, instr);
+        break;
+    case Instr::f64_convert_i64_u:
+        convert_op<double, uint64_t>(slots, instr);
+        break;
+    case Instr::f64_promote_f32:
+        convert_op<double, float>(slots, instr);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+    return true;
+}
+
+execution_result execute_register_ir(Instance& instance, const std::vector<RegCode>& code,
+    FuncIdx func_idx, std::vector<uint64_t> args, int depth)
+{
+    assert(depth >= 0);
+    if (depth > CallStackLimit)
+        return {true, {}};
+
+    const auto num_imported_functions = instance.imported_functions.size();
+    if (func_idx < num_imported_functions)
+        return execute(instance, func_idx, std::move(args), depth);
+
+    assert(code.size() == instance.module->codesec.size());
+    const auto* func_code = &code[func_idx - num_imported_functions];
+    assert(args.size() == func_code->num_args);
+    const auto has_result = !function_type(*instance.module, func_idx).outputs.empty();
+
+    auto* const memory = instance.memory.get();
+
+    std::vector<uint64_t> slots_storage(func_code->frame_size);
+    std::copy(args.begin(), args.end(), slots_storage.begin());
+
+    Stack<RegFrame> frames;
+    size_t base = 0;
+    uint64_t* slots = slots_storage.data();
+    const RegInstr* pc = func_code->instructions.data();
+
+    bool trap = false;
+
+    // The index of the function defined in the module to be called at enter_function.
+    FuncIdx called_func_idx = 0;
+
+    while (true)
+    {
+        const auto& instr = *pc++;
+        switch (instr.op)
+        {
+        case Instr::unreachable:
+            trap = true;
+            goto end;
+        case Instr::if_:
+            if (static_cast<uint32_t>(slots[instr.a]) == 0)
+                pc = func_code->instructions.data() + instr.imm;
+            break;
+        case Instr::br:
+            slots[instr.dst] = slots[instr.a];
+            pc = func_code->instructions.data() + instr.imm;
+            break;
+        case Instr::br_if:
+            if (static_cast<uint32_t>(slots[instr.b]) != 0)
+            {
+                slots[instr.dst] = slots[instr.a];
+                pc = func_code->instructions.data() + instr.imm;
+            }
+            break;
+        case Instr::br_table:
+            // The br instructions of the labels follow, the last one is for the default label.
+            pc += std::min(static_cast<uint32_t>(slots[instr.a]), instr.b);
+            break;
+        case Instr::return_:
+        {
+            if (instr.b != 0)
+                slots[0] = slots[instr.a];
+
+            if (frames.empty())
+                goto end;
+
+            // Resume the caller.
+            const auto frame = frames.pop();
+            --depth;
+            func_code = frame.code;
+            pc = frame.pc;
+            base = frame.base;
+            slots = slots_storage.data() + base;
+            break;
+        }
+        case Instr::call:
+        {
+            called_func_idx = static_cast<FuncIdx>(instr.imm);
+
+            if (called_func_idx < num_imported_functions)
+            {
+                const auto& called_func = instance.imported_functions[called_func_idx];
+                if (!invoke_external_function(called_func, instance, slots + instr.dst, depth))
+                {
+                    trap = true;
+                    goto end;
+                }
+                break;
+            }
+
+        enter_function:
+            if (depth == CallStackLimit)
+            {
+                trap = true;
+                goto end;
+            }
+            ++depth;
+
+            frames.push({func_code, pc, base});
+
+            func_code = &code[called_func_idx - num_imported_functions];
+            base += instr.dst;
+            if (slots_storage.size() < base + func_code->frame_size)
+                slots_storage.resize(base + func_code->frame_size);
+            slots = slots_storage.data() + base;
+            std::fill(slots + func_code->num_args, slots + func_code->num_locals, 0);
+            pc = func_code->instructions.data();
+            break;
+        }
+        case Instr::call_indirect:
+        {
+            assert(instance.table != nullptr);
+
+            const auto elem_idx = static_cast<uint32_t>(slots[instr.a]);
+            if (elem_idx >= instance.table->size())
+            {
+                trap = true;
+                goto end;
+            }
+
+            const auto& called_func = (*instance.table)[elem_idx];
+            if (!called_func.has_value())
+            {
+                trap = true;
+                goto end;
+            }
+
+            // check actual type against expected type
+            if (called_func->type_id != instance.type_ids[instr.imm])
+            {
+                trap = true;
+                goto end;
+            }
+
+            // The function of this instance is called the same way as by the call instruction.
+            if (called_func->instance == &instance)
+            {
+                called_func_idx = called_func->func_idx;
+                goto enter_function;
+            }
+
+            if (!invoke_external_function(*called_func, instance, slots + instr.dst, depth))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        }
+        case Instr::select:
+            slots[instr.dst] =
+                static_cast<uint32_t>(slots[instr.imm]) != 0 ? slots[instr.a] : slots[instr.b];
+            break;
+        case Instr::local_get:
+            slots[instr.dst] = slots[instr.a];
+            break;
+        case Instr::global_get:
+        {
+            const auto idx = instr.imm;
+            if (idx < instance.imported_globals.size())
+                slots[instr.dst] = *instance.imported_globals[idx].value;
+            else
+                slots[instr.dst] = instance.globals[idx - instance.imported_globals.size()];
+            break;
+        }
+        case Instr::global_set:
+        {
+            const auto idx = instr.imm;
+            if (idx < instance.imported_globals.size())
+                *instance.imported_globals[idx].value = slots[instr.a];
+            else
+                instance.globals[idx - instance.imported_globals.size()] = slots[instr.a];
+            break;
+        }
+        case Instr::i32_load:
+            if (!load_from_memory<uint32_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load:
+            if (!load_from_memory<uint64_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_load8_s:
+            if (!load_from_memory<uint32_t, int8_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_load8_u:
+            if (!load_from_memory<uint32_t, uint8_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_load16_s:
+            if (!load_from_memory<uint32_t, int16_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_load16_u:
+            if (!load_from_memory<uint32_t, uint16_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load8_s:
+            if (!load_from_memory<uint64_t, int8_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load8_u:
+            if (!load_from_memory<uint64_t, uint8_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load16_s:
+            if (!load_from_memory<uint64_t, int16_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load16_u:
+            if (!load_from_memory<uint64_t, uint16_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load32_s:
+            if (!load_from_memory<uint64_t, int32_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_load32_u:
+            if (!load_from_memory<uint64_t, uint32_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_store:
+        case Instr::i64_store32:
+            if (!store_into_memory<uint32_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i64_store:
+            if (!store_into_memory<uint64_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_store8:
+        case Instr::i64_store8:
+            if (!store_into_memory<uint8_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::i32_store16:
+        case Instr::i64_store16:
+            if (!store_into_memory<uint16_t>(*memory, slots, instr))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        case Instr::memory_size:
+            slots[instr.dst] = static_cast<uint32_t>(memory->size() / PageSize);
+            break;
+        case Instr::memory_grow:
+        {
+            const auto delta = static_cast<uint32_t>(slots[instr.a]);
+            slots[instr.dst] = memory->grow_pages(delta, instance.memory_max_pages);
+            break;
+        }
+        case Instr::i32_const:
+        case Instr::i64_const:
+            slots[instr.dst] = instr.imm;
+            break;
+        case Instr::i32_eqz:
+            slots[instr.dst] = uint32_t{static_cast<uint32_t>(slots[instr.a]) == 0};
+            break;
+        case Instr::i32_eq:
+            comparison_op(slots, instr, std::equal_to<uint32_t>());
+            break;
+        case Instr::i32_ne:
+            comparison_op(slots, instr, std::not_equal_to<uint32_t>());
+            break;
+        case Instr::i32_lt_s:
+            comparison_op(slots, instr, std::less<int32_t>());
+            break;
+        case Instr::i32_lt_u:
+            comparison_op(slots, instr, std::less<uint32_t>());
+            break;
+        case Instr::i32_gt_s:
+            comparison_op(slots, instr, std::greater<int32_t>());
+            break;
+        case Instr::i32_gt_u:
+            comparison_op(slots, instr, std::greater<uint32_t>());
+            break;
+        case Instr::i32_le_s:
+            comparison_op(slots, instr, std::less_equal<int32_t>());
+            break;
+        case Instr::i32_le_u:
+            comparison_op(slots, instr, std::less_equal<uint32_t>());
+            break;
+        case Instr::i32_ge_s:
+            comparison_op(slots, instr, std::greater_equal<int32_t>());
+            break;
+        case Instr::i32_ge_u:
+            comparison_op(slots, instr, std::greater_equal<uint32_t>());
+            break;
+        case Instr::i64_eqz:
+            slots[instr.dst] = uint32_t{slots[instr.a] == 0};
+            break;
+        case Instr::i64_eq:
+            comparison_op(slots, instr, std::equal_to<uint64_t>());
+            break;
+        case Instr::i64_ne:
+            comparison_op(slots, instr, std::not_equal_to<uint64_t>());
+            break;
+        case Instr::i64_lt_s:
+            comparison_op(slots, instr, std::less<int64_t>());
+            break;
+        case Instr::i64_lt_u:
+            comparison_op(slots, instr, std::less<uint64_t>());
+            break;
+        case Instr::i64_gt_s:
+            comparison_op(slots, instr, std::greater<int64_t>());
+            break;
+        case Instr::i64_gt_u:
+            comparison_op(slots, instr, std::greater<uint64_t>());
+            break;
+        case Instr::i64_le_s:
+            comparison_op(slots, instr, std::less_equal<int64_t>());
+            break;
+        case Instr::i64_le_u:
+            comparison_op(slots, instr, std::less_equal<uint64_t>());
+            break;
+        case Instr::i64_ge_s:
+            comparison_op(slots, instr, std::greater_equal<int64_t>());
+            break;
+        case Instr::i64_ge_u:
+            comparison_op(slots, instr, std::greater_equal<uint64_t>());
+            break;
+        case Instr::i32_clz:
+            unary_op(slots, instr, clz32);
+            break;
+        case Instr::i32_ctz:
+            unary_op(slots, instr, ctz32);
+            break;
+        case Instr::i32_popcnt:
+            unary_op(slots, instr, popcnt32);
+            break;
+        case Instr::i32_add:
+            binary_op(slots, instr, std::plus<uint32_t>());
+            break;
+        case Instr::i32_sub:
+            binary_op(slots, instr, std::minus<uint32_t>());
+            break;
+        case Instr::i32_mul:
+            binary_op(slots, instr, std::multiplies<uint32_t>());
+            break;
+        case Instr::i32_div_s:
+        {
+            const auto lhs = static_cast<int32_t>(slots[instr.a]);
+            const auto rhs = static_cast<int32_t>(slots[instr.b]);
+            if (rhs == 0 || (lhs == std::numeric_limits<int32_t>::min() && rhs == -1))
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::divides<int32_t>());
+            break;
+        }
+        case Instr::i32_div_u:
+            if (static_cast<uint32_t>(slots[instr.b]) == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::divides<uint32_t>());
+            break;
+        case Instr::i32_rem_s:
+        {
+            const auto lhs = static_cast<int32_t>(slots[instr.a]);
+            const auto rhs = static_cast<int32_t>(slots[instr.b]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            if (lhs == std::numeric_limits<int32_t>::min() && rhs == -1)
+                slots[instr.dst] = 0;
+            else
+                binary_op(slots, instr, std::modulus<int32_t>());
+            break;
+        }
+        case Instr::i32_rem_u:
+            if (static_cast<uint32_t>(slots[instr.b]) == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::modulus<uint32_t>());
+            break;
+        case Instr::i32_and:
+            binary_op(slots, instr, std::bit_and<uint32_t>());
+            break;
+        case Instr::i32_or:
+            binary_op(slots, instr, std::bit_or<uint32_t>());
+            break;
+        case Instr::i32_xor:
+            binary_op(slots, instr, std::bit_xor<uint32_t>());
+            break;
+        case Instr::i32_shl:
+            binary_op(slots, instr, shift_left<uint32_t>);
+            break;
+        case Instr::i32_shr_s:
+            binary_op(slots, instr, shift_right<int32_t>);
+            break;
+        case Instr::i32_shr_u:
+            binary_op(slots, instr, shift_right<uint32_t>);
+            break;
+        case Instr::i32_rotl:
+            binary_op(slots, instr, rotl<uint32_t>);
+            break;
+        case Instr::i32_rotr:
+            binary_op(slots, instr, rotr<uint32_t>);
+            break;
+        case Instr::i64_clz:
+            unary_op(slots, instr, clz64);
+            break;
+        case Instr::i64_ctz:
+            unary_op(slots, instr, ctz64);
+            break;
+        case Instr::i64_popcnt:
+            unary_op(slots, instr, popcnt64);
+            break;
+        case Instr::i64_add:
+            binary_op(slots, instr, std::plus<uint64_t>());
+            break;
+        case Instr::i64_sub:
+            binary_op(slots, instr, std::minus<uint64_t>());
+            break;
+        case Instr::i64_mul:
+            binary_op(slots, instr, std::multiplies<uint64_t>());
+            break;
+        case Instr::i64_div_s:
+        {
+            const auto lhs = static_cast<int64_t>(slots[instr.a]);
+            const auto rhs = static_cast<int64_t>(slots[instr.b]);
+            if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1))
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::divides<int64_t>());
+            break;
+        }
+        case Instr::i64_div_u:
+            if (slots[instr.b] == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::divides<uint64_t>());
+            break;
+        case Instr::i64_rem_s:
+        {
+            const auto lhs = static_cast<int64_t>(slots[instr.a]);
+            const auto rhs = static_cast<int64_t>(slots[instr.b]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            if (lhs == std::numeric_limits<int64_t>::min() && rhs == -1)
+                slots[instr.dst] = 0;
+            else
+                binary_op(slots, instr, std::modulus<int64_t>());
+            break;
+        }
+        case Instr::i64_rem_u:
+            if (slots[instr.b] == 0)
+            {
+                trap = true;
+                goto end;
+            }
+            binary_op(slots, instr, std::modulus<uint64_t>());
+            break;
+        case Instr::i64_and:
+            binary_op(slots, instr, std::bit_and<uint64_t>());
+            break;
+        case Instr::i64_or:
+            binary_op(slots, instr, std::bit_or<uint64_t>());
+            break;
+        case Instr::i64_xor:
+            binary_op(slots, instr, std::bit_xor<uint64_t>());
+            break;
+        case Instr::i64_shl:
+            binary_op(slots, instr, shift_left<uint64_t>);
+            break;
+        case Instr::i64_shr_s:
+            binary_op(slots, instr, shift_right<int64_t>);
+            break;
+        case Instr::i64_shr_u:
+            binary_op(slots, instr, shift_right<uint64_t>);
+            break;
+        case Instr::i64_rotl:
+            binary_op(slots, instr, rotl<uint64_t>);
+            break;
+        case Instr::i64_rotr:
+            binary_op(slots, instr, rotr<uint64_t>);
+            break;
+        case Instr::i32_wrap_i64:
+            slots[instr.dst] = static_cast<uint32_t>(slots[instr.a]);
+            break;
+        case Instr::i64_extend_i32_s:
+            slots[instr.dst] = static_cast<uint64_t>(int64_t{static_cast<int32_t>(slots[instr.a])});
+            break;
+        case superinstr::i32_add_imm:
+            slots[instr.dst] = static_cast<uint32_t>(slots[instr.a] + instr.imm);
+            break;
+        case superinstr::i64_and_imm:
+            slots[instr.dst] = slots[instr.a] & instr.imm;
+            break;
+        case superinstr::i64_shr_u_imm:
+            slots[instr.dst] = shift_right(slots[instr.a], instr.imm);
+            break;
+        default:
+            // The floating point instructions.
+            if (!execute_float_instruction(instr, slots))
+            {
+                trap = true;
+                goto end;
+            }
+            break;
+        }
+    }
+
+end:
+    if (trap)
+        return {true, {}};
+
+    if (!has_result)
+        return {false, {}};
+
+    return {false, {slots_storage[0]}};
+}
+}  // namespace fizzy
+
+#pragma GCC diagnostic pop
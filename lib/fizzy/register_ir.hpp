@@ -0,0 +1,86 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "execute.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace fizzy
+{
+/// The instruction of the register IR.
+///
+/// The register IR is the alternative execution tier translated from the validated stack bytecode
+/// of functions. The operand stack height is known at every instruction, so each operand stack
+/// item gets a fixed slot in the function's frame, following the function's locals. The
+/// instructions address their operands and result directly as frame slots, which makes most of
+/// local.get and local.set instructions disappear.
+///
+/// The op is a wasm instruction (or superinstruction) taking the operands from slots @a a and @a b
+/// and storing the result to slot @a dst. The exceptions are:
+/// - local_get: copies slot a to slot dst,
+/// - i32_const, i64_const: store imm to slot dst,
+/// - br: copies slot a to slot dst (the branch result) and jumps to instruction imm,
+/// - br_if: does br if slot b is not zero,
+/// - br_table: jumps to the br instruction min(slot a, b) following it,
+/// - if_: jumps to instruction imm if slot a is zero,
+/// - return_: copies slot a to slot 0 if b is not zero and leaves the frame,
+/// - select: dst = slot imm ? slot a : slot b,
+/// - call: calls function imm, the arguments are in the slots starting at dst,
+///   the result replaces the first argument,
+/// - call_indirect: as call, but the function of type imm is taken from the table at slot a,
+/// - global_get, global_set: imm is the global index, the value slot is dst or a respectively,
+/// - loads and stores: imm is the memory offset, the address is in slot a, the stored value
+///   in slot b.
+struct RegInstr
+{
+    Instr op = Instr::unreachable;
+    uint32_t dst = 0;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint64_t imm = 0;
+};
+
+/// The register IR of a function.
+struct RegCode
+{
+    /// The number of function arguments.
+    uint32_t num_args = 0;
+
+    /// The number of locals, arguments included.
+    uint32_t num_locals = 0;
+
+    /// The number of frame slots: the locals followed by the operand stack slots.
+    uint32_t frame_size = 0;
+
+    std::vector<RegInstr> instructions;
+};
+
+/// Translates the code of all functions defined in the module to the register IR.
+///
+/// The module is expected to be validated, i.e. to come from parse().
+std::vector<RegCode> translate_to_register_ir(const Module& module);
+
+/// Calls the function outside of the register IR tier, with the arguments taken from the slots
+/// starting at @a args. The result is stored to the first of these slots.
+///
+/// @return  false if the execution trapped.
+bool invoke_external_function(
+    const ExternalFunction& func, Instance& instance, uint64_t* args, int depth);
+
+/// Executes the floating point instruction of the register IR on the frame slots.
+/// This is shared by the register IR tier and the JIT compiler.
+///
+/// @return  false if the instruction trapped.
+bool execute_float_instruction(const RegInstr& instr, uint64_t* slots) noexcept;
+
+/// Executes the function in the register IR tier.
+///
+/// @param code  The register IR of the functions of instance's module,
+///              see translate_to_register_ir().
+execution_result execute_register_ir(Instance& instance, const std::vector<RegCode>& code,
+    FuncIdx func_idx, std::vector<uint64_t> args, int depth = 0);
+}  // namespace fizzy
@@ -0,0 +1,575 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "serialize.hpp"
+#include "hash.hpp"
+#include "parser.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FIZZY_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fizzy
+{
+namespace
+{
+constexpr uint8_t serialized_module_magic[]{0x00, 'f', 'z', 'm'};
+
+/// Computes the checksum of the serialized module, detecting the corrupted, truncated or
+/// partially written files.
+inline uint64_t checksum(bytes_view data) noexcept
+{
+    return xxhash64(data);
+}
+
+/// Writes the values of the serialized module.
+class Writer
+{
+    bytes m_out;
+
+public:
+    template <typename T>
+    void value(T v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint8_t buf[sizeof(T)];
+        std::memcpy(buf, &v, sizeof(v));
+        m_out.append(buf, sizeof(buf));
+    }
+
+    void size(size_t n) { value(static_cast<uint32_t>(n)); }
+
+    /// Writes the array of the trivially copyable values as a single block, prefixed by its size.
+    template <typename T>
+    void array(const T* data, size_t n)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        size(n);
+        if (n != 0)
+            m_out.append(reinterpret_cast<const uint8_t*>(data), n * sizeof(T));
+    }
+
+    template <typename T>
+    void array(const std::vector<T>& v)
+    {
+        array(v.data(), v.size());
+    }
+
+    void array(bytes_view v) { array(v.data(), v.size()); }
+
+    void string(const std::string& s) { array(s.data(), s.size()); }
+
+    void limits(const Limits& l)
+    {
+        value(l.min);
+        value(static_cast<uint8_t>(l.max.has_value()));
+        value(l.max.value_or(0));
+    }
+
+    void expression(const ConstantExpression& e)
+    {
+        value(e.kind);
+        value(e.kind == ConstantExpression::Kind::Constant ? e.value.constant :
+                                                             uint64_t{e.value.global_index});
+    }
+
+    void types(const std::vector<FuncType>& v)
+    {
+        size(v.size());
+        for (const auto& type : v)
+        {
+            array(type.inputs);
+            array(type.outputs);
+        }
+    }
+
+    /// Returns the output with the checksum of it appended.
+    bytes finish()
+    {
+        value(checksum(m_out));
+        return std::move(m_out);
+    }
+};
+
+/// Reads the values of the serialized module, checking the bounds of the input.
+class Reader
+{
+    const uint8_t* m_pos;
+    const uint8_t* const m_end;
+
+public:
+    explicit Reader(bytes_view input) noexcept : m_pos{input.data()}, m_end{m_pos + input.size()}
+    {}
+
+    bool at_end() const noexcept { return m_pos == m_end; }
+
+    size_t remaining() const noexcept { return static_cast<size_t>(m_end - m_pos); }
+
+    template <typename T>
+    T value()
+    {
+        T v;
+        std::tie(v, m_pos) = parse_value<T>(m_pos, m_end);
+        return v;
+    }
+
+    size_t size() { return value<uint32_t>(); }
+
+    /// Reads the bytes written by Writer::array() without copying them.
+    bytes_view bytes_array()
+    {
+        const auto n = size();
+        if (remaining() < n)
+            throw parser_error{"Unexpected EOF"};
+        const bytes_view v{m_pos, n};
+        m_pos += n;
+        return v;
+    }
+
+    /// Reads the array written by Writer::array() to the container of the values.
+    template <typename Container>
+    Container array()
+    {
+        using T = typename Container::value_type;
+        const auto n = size();
+        if (static_cast<size_t>(m_end - m_pos) / sizeof(T) < n)
+            throw parser_error{"Unexpected EOF"};
+        Container c(n, T{});
+        if (n != 0)
+            std::memcpy(&c[0], m_pos, n * sizeof(T));
+        m_pos += n * sizeof(T);
+        return c;
+    }
+
+    Limits limits()
+    {
+        Limits l;
+        l.min = value<uint32_t>();
+        const auto has_max = value<uint8_t>();
+        const auto max = value<uint32_t>();
+        if (has_max != 0)
+        {
+            if (l.min > max)
+                throw parser_error{"malformed limits (minimum is larger than maximum)"};
+            l.max = max;
+        }
+        return l;
+    }
+
+    ConstantExpression expression()
+    {
+        ConstantExpression e;
+        e.kind = value<ConstantExpression::Kind>();
+        const auto v = value<uint64_t>();
+        if (e.kind == ConstantExpression::Kind::Constant)
+            e.value.constant = v;
+        else if (e.kind == ConstantExpression::Kind::GlobalGet)
+            e.value.global_index = static_cast<uint32_t>(v);
+        else
+            throw parser_error{"invalid serialized constant expression"};
+        return e;
+    }
+
+    std::vector<FuncType> types()
+    {
+        std::vector<FuncType> v(count());
+        for (auto& type : v)
+        {
+            type.inputs = valtypes();
+            type.outputs = valtypes();
+        }
+        return v;
+    }
+
+    std::vector<ValType> valtypes()
+    {
+        auto v = array<std::vector<ValType>>();
+        for (const auto type : v)
+        {
+            if (type != ValType::i32 && type != ValType::i64 && type != ValType::f32 &&
+                type != ValType::f64)
+                throw parser_error{"invalid valtype " + std::to_string(static_cast<int>(type))};
+        }
+        return v;
+    }
+
+    /// Reads the count of the elements, bounded by the remaining input so that the corrupted
+    /// count cannot cause a huge allocation.
+    size_t count()
+    {
+        const auto n = size();
+        if (n > static_cast<size_t>(m_end - m_pos))
+            throw parser_error{"Unexpected EOF"};
+        return n;
+    }
+};
+
+void check_global_index(const ConstantExpression& expression, const Module& module)
+{
+    if (expression.kind == ConstantExpression::Kind::GlobalGet &&
+        expression.value.global_index >= module.imported_globals_mutability.size())
+        throw parser_error{"invalid global index in constant expression"};
+}
+
+/// Checks the indexes between the sections of the deserialized module, as parse() does,
+/// so that the corrupted module cannot make the execution access out of bounds.
+void validate(const Module& module)
+{
+    const auto total_func_count = module.imported_function_types.size() + module.funcsec.size();
+    const auto total_global_count =
+        module.imported_globals_mutability.size() + module.globalsec.size();
+    const auto total_table_count = module.imported_table_types.size() + module.tablesec.size();
+    const auto total_memory_count = module.imported_memory_types.size() + module.memorysec.size();
+
+    for (const auto type_idx : module.funcsec)
+    {
+        if (type_idx >= module.typesec.size())
+            throw parser_error{"invalid function type index"};
+    }
+
+    if (total_table_count > 1)
+        throw parser_error{"too many tables (at most one is allowed)"};
+    if (total_memory_count > 1)
+        throw parser_error{"too many memories (at most one is allowed)"};
+
+    for (const auto& global : module.globalsec)
+        check_global_index(global.expression, module);
+
+    for (const auto& export_ : module.exportsec)
+    {
+        size_t count = 0;
+        switch (export_.kind)
+        {
+        case ExternalKind::Function:
+            count = total_func_count;
+            break;
+        case ExternalKind::Table:
+            count = total_table_count;
+            break;
+        case ExternalKind::Memory:
+            count = total_memory_count;
+            break;
+        case ExternalKind::Global:
+            count = total_global_count;
+            break;
+        default:
+            throw parser_error{"invalid serialized export kind"};
+        }
+        if (export_.index >= count)
+            throw parser_error{"invalid export index"};
+    }
+
+    if (module.startfunc && *module.startfunc >= total_func_count)
+        throw parser_error{"invalid start function index"};
+
+    if (!module.elementsec.empty() && total_table_count == 0)
+        throw parser_error{"element section encountered without a table section"};
+    for (const auto& element : module.elementsec)
+    {
+        check_global_index(element.offset, module);
+        for (const auto func_idx : element.init)
+        {
+            if (func_idx >= total_func_count)
+                throw parser_error{"invalid function index in element section"};
+        }
+    }
+
+    if (!module.datasec.empty() && total_memory_count == 0)
+        throw parser_error{"data section encountered without a memory section"};
+    for (const auto& data : module.datasec)
+        check_global_index(data.offset, module);
+
+    if (module.funcsec.size() != module.codesec.size())
+        throw parser_error{"function and code section have inconsistent lengths"};
+    // The function's end instruction terminates the execution of the code, the instructions
+    // and the immediates are checked by the checksum only.
+    for (const auto& code : module.codesec)
+    {
+        if (code.instructions.empty() || code.instructions.back() != Instr::end)
+            throw parser_error{"invalid serialized code"};
+    }
+}
+}  // namespace
+
+bytes serialize_module(const Module& module, bytes_view source)
+{
+    Writer w;
+    w.array(serialized_module_magic, sizeof(serialized_module_magic));
+    w.value(SerializedModuleVersion);
+    w.array(source);
+
+    w.types(module.typesec);
+
+    w.size(module.importsec.size());
+    for (const auto& import : module.importsec)
+    {
+        w.string(import.module);
+        w.string(import.name);
+        w.value(import.kind);
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            w.value(import.desc.function_type_index);
+            break;
+        case ExternalKind::Table:
+            w.limits(import.desc.table.limits);
+            break;
+        case ExternalKind::Memory:
+            w.limits(import.desc.memory.limits);
+            break;
+        case ExternalKind::Global:
+            w.value(static_cast<uint8_t>(import.desc.global_mutable));
+            break;
+        }
+    }
+
+    w.array(module.funcsec);
+
+    w.size(module.tablesec.size());
+    for (const auto& table : module.tablesec)
+        w.limits(table.limits);
+
+    w.size(module.memorysec.size());
+    for (const auto& memory : module.memorysec)
+        w.limits(memory.limits);
+
+    w.size(module.globalsec.size());
+    for (const auto& global : module.globalsec)
+    {
+        w.value(static_cast<uint8_t>(global.is_mutable));
+        w.expression(global.expression);
+    }
+
+    w.size(module.exportsec.size());
+    for (const auto& export_ : module.exportsec)
+    {
+        w.string(export_.name);
+        w.value(export_.kind);
+        w.value(export_.index);
+    }
+
+    w.value(static_cast<uint8_t>(module.startfunc.has_value()));
+    w.value(module.startfunc.value_or(0));
+
+    w.size(module.elementsec.size());
+    for (const auto& element : module.elementsec)
+    {
+        w.expression(element.offset);
+        w.array(element.init);
+    }
+
+    w.size(module.funcsec.size());
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+    {
+        const auto& code = get_code(module, i);
+        w.value(code.local_count);
+        w.value(code.max_stack_height);
+        w.array(code.instructions);
+        w.array(code.immediates);
+    }
+
+    w.size(module.datasec.size());
+    for (const auto& data : module.datasec)
+    {
+        w.expression(data.offset);
+        w.array(data.init);
+    }
+
+    // The types of the imports by kind are not stored, they are restored from the imports.
+    return w.finish();
+}
+
+Module deserialize_module(bytes_view data, bytes_view source)
+{
+    Reader header{data};
+    if (header.array<bytes>() !=
+        bytes_view{serialized_module_magic, sizeof(serialized_module_magic)})
+        throw parser_error{"invalid serialized module magic"};
+    if (header.value<uint32_t>() != SerializedModuleVersion)
+        throw parser_error{"unsupported serialized module version"};
+
+    if (header.remaining() < sizeof(uint64_t))
+        throw parser_error{"Unexpected EOF"};
+    const auto payload_end = data.size() - sizeof(uint64_t);
+    if (checksum(data.substr(0, payload_end)) != xxhash::load<uint64_t>(&data[payload_end]))
+        throw parser_error{"serialized module checksum mismatch"};
+
+    const auto header_size = data.size() - header.remaining();
+    Reader r{data.substr(header_size, payload_end - header_size)};
+    if (r.bytes_array() != source)
+        throw parser_error{"serialized module source mismatch"};
+
+    Module module;
+    module.typesec = r.types();
+
+    const auto num_imports = r.count();
+    module.importsec.reserve(num_imports);
+    for (size_t i = 0; i < num_imports; ++i)
+    {
+        Import import{};
+        import.module = r.array<std::string>();
+        import.name = r.array<std::string>();
+        import.kind = r.value<ExternalKind>();
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            import.desc.function_type_index = r.value<TypeIdx>();
+            break;
+        case ExternalKind::Table:
+            import.desc.table.limits = r.limits();
+            break;
+        case ExternalKind::Memory:
+            import.desc.memory.limits = r.limits();
+            break;
+        case ExternalKind::Global:
+            import.desc.global_mutable = r.value<uint8_t>() != 0;
+            break;
+        default:
+            throw parser_error{"invalid serialized import kind"};
+        }
+        module.importsec.emplace_back(std::move(import));
+    }
+
+    for (const auto& import : module.importsec)
+    {
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            if (import.desc.function_type_index >= module.typesec.size())
+                throw parser_error{"invalid type index of an imported function"};
+            module.imported_function_types.emplace_back(
+                module.typesec[import.desc.function_type_index]);
+            break;
+        case ExternalKind::Table:
+            module.imported_table_types.emplace_back(import.desc.table);
+            break;
+        case ExternalKind::Memory:
+            module.imported_memory_types.emplace_back(import.desc.memory);
+            break;
+        case ExternalKind::Global:
+            module.imported_globals_mutability.emplace_back(import.desc.global_mutable);
+            break;
+        }
+    }
+
+    module.funcsec = r.array<std::vector<TypeIdx>>();
+
+    module.tablesec.resize(r.count());
+    for (auto& table : module.tablesec)
+        table.limits = r.limits();
+
+    module.memorysec.resize(r.count());
+    for (auto& memory : module.memorysec)
+        memory.limits = r.limits();
+
+    module.globalsec.resize(r.count());
+    for (auto& global : module.globalsec)
+    {
+        global.is_mutable = r.value<uint8_t>() != 0;
+        global.expression = r.expression();
+    }
+
+    module.exportsec.resize(r.count());
+    for (auto& export_ : module.exportsec)
+    {
+        export_.name = r.array<std::string>();
+        export_.kind = r.value<ExternalKind>();
+        export_.index = r.value<uint32_t>();
+    }
+
+    const auto has_startfunc = r.value<uint8_t>();
+    const auto startfunc = r.value<FuncIdx>();
+    if (has_startfunc != 0)
+        module.startfunc = startfunc;
+
+    module.elementsec.resize(r.count());
+    for (auto& element : module.elementsec)
+    {
+        element.offset = r.expression();
+        element.init = r.array<std::vector<FuncIdx>>();
+    }
+
+    module.codesec.resize(r.count());
+    for (auto& code : module.codesec)
+    {
+        code.local_count = r.value<uint32_t>();
+        code.max_stack_height = r.value<uint32_t>();
+        code.instructions = r.array<std::vector<Instr>>();
+        code.immediates = r.array<bytes>();
+    }
+
+    module.datasec.resize(r.count());
+    for (auto& data_segment : module.datasec)
+    {
+        data_segment.offset = r.expression();
+        data_segment.init = r.array<bytes>();
+    }
+
+    if (!r.at_end())
+        throw parser_error{"unexpected data at the end of serialized module"};
+    validate(module);
+
+    // The canonical type ids are specific to the process, so they are not serialized.
+    module.type_ids = canonical_type_ids(module.typesec);
+    module.imported_function_type_ids = canonical_type_ids(module.imported_function_types);
+
+    return module;
+}
+
+void save_module(const std::string& path, const Module& module, bytes_view source)
+{
+    const auto data = serialize_module(module, source);
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file.write(
+        reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    file.close();
+    if (!file)
+        throw std::runtime_error{"cannot write serialized module to " + path};
+}
+
+std::shared_ptr<const Module> load_module(const std::string& path, bytes_view source)
+{
+#if FIZZY_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::runtime_error{"cannot open serialized module " + path};
+
+    struct stat st;
+    const auto size = ::fstat(fd, &st) == 0 ? static_cast<size_t>(st.st_size) : size_t{0};
+    void* const mapping =
+        size != 0 ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (mapping == nullptr || mapping == MAP_FAILED)
+        throw std::runtime_error{"cannot map serialized module " + path};
+
+    try
+    {
+        auto module = std::make_shared<const Module>(
+            deserialize_module({static_cast<const uint8_t*>(mapping), size}, source));
+        ::munmap(mapping, size);
+        return module;
+    }
+    catch (...)
+    {
+        ::munmap(mapping, size);
+        throw;
+    }
+#else
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        throw std::runtime_error{"cannot open serialized module " + path};
+    const bytes data{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    return std::make_shared<const Module>(deserialize_module(data, source));
+#endif
+}
+}  // namespace fizzy
@@ -0,0 +1,55 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "bytes.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace fizzy
+{
+/// The version of the serialized module format.
+///
+/// The format stores the module as produced by parse(), including the decoded instructions and
+/// immediates of the functions, so the version must be changed with every change of the Module
+/// or of the representation of the code produced by the parser.
+constexpr uint32_t SerializedModuleVersion = 4;
+
+/// Serializes the module produced by parse() to the binary format loaded by deserialize_module().
+///
+/// The values are stored in the byte order of the host, so the serialized module is to be loaded
+/// on the same kind of machine.
+///
+/// The @a source bytes, e.g. the wasm binary the module was parsed from, are stored with the module
+/// to be compared when it is loaded.
+bytes serialize_module(const Module& module, bytes_view source = {});
+
+/// Deserializes the module serialized by serialize_module().
+///
+/// The checksum stored with the module is verified first, so the corrupted or truncated data is
+/// rejected. The indexes between the sections are checked as by parse(). The code of the functions
+/// is not validated again: the instructions and the immediates are copied as they are, so the data
+/// must come from serialize_module() of a trusted source.
+///
+/// @throws parser_error  if the data is not a valid serialized module of this version or it was
+///                       not serialized with the same @a source bytes.
+Module deserialize_module(bytes_view data, bytes_view source = {});
+
+/// Saves the module serialized by serialize_module() to the file.
+///
+/// @throws std::runtime_error  if the file cannot be written.
+void save_module(const std::string& path, const Module& module, bytes_view source = {});
+
+/// Loads the module saved by save_module(), see deserialize_module().
+///
+/// The file is mapped into memory, so the module is copied from the page cache directly.
+///
+/// @throws std::runtime_error  if the file cannot be read.
+/// @throws parser_error        if the file is not a serialized module of this version or it was
+///                             not saved with the same @a source bytes.
+std::shared_ptr<const Module> load_module(const std::string& path, bytes_view source = {});
+}  // namespace fizzy
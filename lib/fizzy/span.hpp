@@ -0,0 +1,52 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace fizzy
+{
+/// The non-owning view of contiguous elements, the minimal subset of C++20 std::span.
+template <typename T>
+class span
+{
+    T* m_begin = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    using value_type = std::remove_cv_t<T>;
+    using iterator = T*;
+
+    constexpr span() noexcept = default;
+
+    constexpr span(T* begin, std::size_t size) noexcept : m_begin{begin}, m_size{size} {}
+
+    /// The span of the vector's elements.
+    constexpr span(std::vector<value_type>& container) noexcept
+      : m_begin{container.data()}, m_size{container.size()}
+    {}
+
+    /// The span of the const vector's elements, only for the span of const elements.
+    template <typename U = T, typename = std::enable_if_t<std::is_const_v<U>>>
+    constexpr span(const std::vector<value_type>& container) noexcept
+      : m_begin{container.data()}, m_size{container.size()}
+    {}
+
+    /// The conversion from the span of non-const elements to the span of const elements.
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    constexpr span(span<U> other) noexcept : m_begin{other.data()}, m_size{other.size()} {}
+
+    constexpr T& operator[](std::size_t index) const noexcept { return m_begin[index]; }
+
+    constexpr T* data() const noexcept { return m_begin; }
+    constexpr std::size_t size() const noexcept { return m_size; }
+    constexpr bool empty() const noexcept { return m_size == 0; }
+
+    constexpr iterator begin() const noexcept { return m_begin; }
+    constexpr iterator end() const noexcept { return m_begin + m_size; }
+};
+}  // namespace fizzy
@@ -6,6 +6,7 @@
 
 #include "bytes.hpp"
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -32,6 +33,18 @@ struct FuncType
     std::vector<ValType> outputs;
 };
 
+// The canonical id of a function type, equal for all equal function types in the process.
+// The ids start from 1, the value 0 means the id is not known.
+using CanonicalTypeId = uint32_t;
+
+// Returns the canonical id of the function type, assigning a new one for a type not seen before.
+// The process keeps each distinct type once, so the registry grows only with the new types.
+// This is thread-safe.
+CanonicalTypeId canonical_type_id(const FuncType& type);
+
+// Returns the canonical ids of the function types, see canonical_type_id().
+std::vector<CanonicalTypeId> canonical_type_ids(const std::vector<FuncType>& types);
+
 // https://webassembly.github.io/spec/core/binary/types.html#binary-limits
 struct Limits
 {
@@ -341,6 +354,11 @@ struct Code
     // The decoded instructions' immediate values.
     // These are instruction-type dependent fixed size value in the order of instructions.
     bytes immediates;
+
+    /// The maximum height of the operand stack during the function execution, computed by
+    /// the parser. Together with the number of locals it bounds the value stack space needed
+    /// by a call of the function.
+    uint32_t max_stack_height = 0;
 };
 
 /// The reference to the `code` in the wasm binary.
@@ -375,6 +393,9 @@ enum class SectionId : uint8_t
     data = 11
 };
 
+/// The code of the functions parsed on first use, see ParseOptions::lazy.
+class LazyCode;
+
 struct Module
 {
     // https://webassembly.github.io/spec/core/binary/modules.html#type-section
@@ -396,6 +417,7 @@ struct Module
     // https://webassembly.github.io/spec/core/binary/modules.html#element-section
     std::vector<Element> elementsec;
     // https://webassembly.github.io/spec/core/binary/modules.html#code-section
+    // Empty if parsed lazily, see get_code().
     std::vector<Code> codesec;
     // https://webassembly.github.io/spec/core/binary/modules.html#data-section
     std::vector<Data> datasec;
@@ -408,6 +430,16 @@ struct Module
     std::vector<Memory> imported_memory_types;
     // Mutability of globals defined in import section
     std::vector<bool> imported_globals_mutability;
+
+    // The canonical ids of the types of the type section and of the imported functions,
+    // computed once by parse() so that the instances only copy them. Empty if the module is
+    // constructed otherwise, then the instances compute them.
+    std::vector<CanonicalTypeId> type_ids;
+    std::vector<CanonicalTypeId> imported_function_type_ids;
+
+    // The code of the functions to be parsed on first use if parsed lazily, null otherwise.
+    // It is shared by the copies of the module.
+    std::shared_ptr<LazyCode> lazy_code;
 };
 
 }  // namespace fizzy
@@ -2,6 +2,8 @@
 // Copyright 2019-2020 The Fizzy Authors.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "parser.hpp"
+#include "serialize.hpp"
 #include <benchmark/benchmark.h>
 #include <test/utils/hex.hpp>
 #include <test/utils/wasm_engine.hpp>
@@ -29,6 +31,13 @@ struct EngineRegistryEntry
 
 constexpr EngineRegistryEntry engine_registry[] = {
     {"fizzy", fizzy::test::create_fizzy_engine},
+    {"fizzy-guard", fizzy::test::create_fizzy_guarded_engine},
+    {"fizzy-fork", fizzy::test::create_fizzy_fork_engine},
+    {"fizzy-reset", fizzy::test::create_fizzy_reset_engine},
+    {"fizzy-lazy", fizzy::test::create_fizzy_lazy_engine},
+    {"fizzy-reg", fizzy::test::create_fizzy_register_engine},
+    {"fizzy-jit", fizzy::test::create_fizzy_jit_engine},
+    {"fizzy-aot", fizzy::test::create_fizzy_aot_engine},
     {" wabt", fizzy::test::create_wabt_engine},
     {"wasm3", fizzy::test::create_wasm3_engine},
 };
@@ -62,6 +71,33 @@ void benchmark_parse(
         benchmark::Counter(static_cast<double>(num_bytes_parsed), benchmark::Counter::kIsRate);
 }
 
+/// The cold start from the serialized module: the module saved by fizzy::save_module() is loaded
+/// instead of being parsed, to be compared with the fizzy/parse benchmark.
+void benchmark_load_module(benchmark::State& state, const fizzy::bytes& wasm_binary)
+{
+    const auto module_path = fs::temp_directory_path() / "fizzy-bench-module.fzm";
+    try
+    {
+        fizzy::save_module(module_path.string(), fizzy::parse(wasm_binary));
+    }
+    catch (const fizzy::parser_error&)
+    {
+        return state.SkipWithError("Parsing failed");
+    }
+
+    const auto input_size = wasm_binary.size();
+    auto num_bytes_loaded = uint64_t{0};
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(fizzy::load_module(module_path.string()));
+        num_bytes_loaded += input_size;
+    }
+    state.counters["size"] = benchmark::Counter(static_cast<double>(input_size));
+    state.counters["rate"] =
+        benchmark::Counter(static_cast<double>(num_bytes_loaded), benchmark::Counter::kIsRate);
+    fs::remove(module_path);
+}
+
 void benchmark_instantiate(
     benchmark::State& state, EngineCreateFn create_fn, const fizzy::bytes& wasm_binary)
 {
@@ -191,6 +227,10 @@ void load_benchmark(const fs::path& path, const std::string& name_prefix)
                 benchmark::State& state) { benchmark_parse(state, create_fn, *wasm_binary); });
     }
 
+    register_benchmark("fizzy/load_module/" + base_name, [wasm_binary](benchmark::State& state) {
+        benchmark_load_module(state, *wasm_binary);
+    });
+
     for (const auto& entry : engine_registry)  // Register instantiate benchmark.
     {
         register_benchmark(std::string{entry.name} + "/instantiate/" + base_name,
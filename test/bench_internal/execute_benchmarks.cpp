@@ -0,0 +1,246 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "execute.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "register_ir.hpp"
+#include <benchmark/benchmark.h>
+#include <test/utils/hex.hpp>
+
+namespace
+{
+/// The loop of numeric instructions on locals, without memory access and calls,
+/// so the execution time is dominated by the instruction dispatch and the operand stack traffic.
+/* wat2wasm
+(func (param $n i32) (result i32) (local $x i32)
+  (loop
+    ;; The chain of binary instructions, the result stays on the top of the stack.
+    local.get $x
+    local.get $n
+    i32.add
+    local.get $n
+    i32.xor
+    local.get $n
+    i32.mul
+    local.get $n
+    i32.sub
+    local.get $n
+    i32.or
+    local.set $x
+    ;; The stack of 4 items reduced by binary instructions.
+    local.get $x
+    local.get $n
+    local.get $x
+    local.get $n
+    i32.add
+    i32.xor
+    i32.add
+    local.set $x
+    ;; The loop counter.
+    local.get $n
+    i32.const -1
+    i32.add
+    local.tee $n
+    br_if 0
+  )
+  local.get $x
+)
+*/
+const auto stack_traffic_wasm = fizzy::from_hex(
+    "0061736d0100000001060160017f017f030201000a34013201017f0340200120006a20007320006c20006b2000"
+    "72210120012000200120006a736a21012000417f6a22000d000b20010b");
+
+/// The loop calling the imported function.
+/* wat2wasm
+(import "env" "f" (func $f (param i32) (result i32)))
+(func (param $n i32) (result i32) (local $x i32)
+  (loop
+    local.get $x
+    call $f
+    local.set $x
+    local.get $n
+    i32.const -1
+    i32.add
+    local.tee $n
+    br_if 0
+  )
+  local.get $x
+)
+*/
+const auto host_calls_wasm = fizzy::from_hex(
+    "0061736d0100000001060160017f017f02090103656e7601660000030201000a1a011801017f0340200110002101"
+    "2000417f6a22000d000b20010b");
+
+/// The loop calling the function through the table.
+/* wat2wasm
+(type $t (func (param i32) (result i32)))
+(table 1 funcref)
+(elem (i32.const 0) $g)
+(func $g (type $t)
+  local.get 0
+  i32.const 1
+  i32.add
+)
+(func (param $n i32) (result i32) (local $x i32)
+  (loop
+    local.get $x
+    i32.const 0
+    call_indirect (type $t)
+    local.set $x
+    local.get $n
+    i32.const -1
+    i32.add
+    local.tee $n
+    br_if 0
+  )
+  local.get $x
+)
+*/
+const auto call_indirect_wasm = fizzy::from_hex(
+    "0061736d0100000001060160017f017f03030200000404017000010907010041000b01000a25020700200041016a"
+    "0b1b01017f03402001410011000021012000417f6a22000d000b20010b");
+
+/// The function small enough for the execution time to be dominated by the call overhead.
+/* wat2wasm
+(func (param i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  i32.add
+)
+*/
+const auto add_wasm =
+    fizzy::from_hex("0061736d0100000001070160027f7f017f030201000a09010700200020016a0b");
+
+void execute_host_calls(benchmark::State& state, fizzy::ExternalFunction host_function)
+{
+    const auto num_iterations = static_cast<uint64_t>(state.range(0));
+    auto module = fizzy::parse(host_calls_wasm);
+    host_function.type = module.typesec[0];
+    const auto instance = fizzy::instantiate(std::move(module), {std::move(host_function)});
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute(*instance, 1, {num_iterations});
+        if (result.trapped)
+            state.SkipWithError("Trapped");
+        benchmark::DoNotOptimize(result.stack);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_iterations));
+}
+}  // namespace
+
+static void execute_stack_traffic(benchmark::State& state)
+{
+    const auto num_iterations = static_cast<uint64_t>(state.range(0));
+    const auto instance = fizzy::instantiate(fizzy::parse(stack_traffic_wasm));
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute(*instance, 0, {num_iterations});
+        if (result.trapped)
+            state.SkipWithError("Trapped");
+        benchmark::DoNotOptimize(result.stack);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_iterations));
+}
+BENCHMARK(execute_stack_traffic)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_register_ir_stack_traffic(benchmark::State& state)
+{
+    const auto num_iterations = static_cast<uint64_t>(state.range(0));
+    const auto instance = fizzy::instantiate(fizzy::parse(stack_traffic_wasm));
+    const auto code = fizzy::translate_to_register_ir(*instance->module);
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute_register_ir(*instance, code, 0, {num_iterations});
+        if (result.trapped)
+            state.SkipWithError("Trapped");
+        benchmark::DoNotOptimize(result.stack);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_iterations));
+}
+BENCHMARK(execute_register_ir_stack_traffic)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_jit_stack_traffic(benchmark::State& state)
+{
+    const auto num_iterations = static_cast<uint64_t>(state.range(0));
+    const auto instance = fizzy::instantiate(fizzy::parse(stack_traffic_wasm));
+    instance->jit_code = fizzy::compile_jit(*instance->module);
+    if (instance->jit_code == nullptr)
+        state.SkipWithError("JIT not supported");
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute(*instance, 0, {num_iterations});
+        if (result.trapped)
+            state.SkipWithError("Trapped");
+        benchmark::DoNotOptimize(result.stack);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_iterations));
+}
+BENCHMARK(execute_jit_stack_traffic)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_host_calls_std_function(benchmark::State& state)
+{
+    execute_host_calls(state, {[](fizzy::Instance&, std::vector<uint64_t> args, int) {
+                                   return fizzy::execution_result{false, {args[0] + 1}};
+                               },
+                                  {}});
+}
+BENCHMARK(execute_host_calls_std_function)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_host_calls_host_function_ptr(benchmark::State& state)
+{
+    constexpr fizzy::HostFunctionPtr host_function =
+        [](void*, fizzy::Instance&, fizzy::span<const uint64_t> args,
+            fizzy::span<uint64_t> results, int) {
+            results[0] = args[0] + 1;
+            return true;
+        };
+    execute_host_calls(state, {{}, {}, host_function, nullptr});
+}
+BENCHMARK(execute_host_calls_host_function_ptr)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_call_indirect(benchmark::State& state)
+{
+    const auto num_iterations = static_cast<uint64_t>(state.range(0));
+    const auto instance = fizzy::instantiate(fizzy::parse(call_indirect_wasm));
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute(*instance, 1, {num_iterations});
+        if (result.trapped)
+            state.SkipWithError("Trapped");
+        benchmark::DoNotOptimize(result.stack);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_iterations));
+}
+BENCHMARK(execute_call_indirect)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+static void execute_small_function(benchmark::State& state)
+{
+    const auto instance = fizzy::instantiate(fizzy::parse(add_wasm));
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute(*instance, 0, {1, 2});
+        benchmark::DoNotOptimize(result.stack);
+    }
+}
+BENCHMARK(execute_small_function);
+
+static void execute_span_small_function(benchmark::State& state)
+{
+    const auto instance = fizzy::instantiate(fizzy::parse(add_wasm));
+    const uint64_t args[]{1, 2};
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto result = fizzy::execute_span(*instance, 0, {args, 2});
+        benchmark::DoNotOptimize(result.value);
+    }
+}
+BENCHMARK(execute_span_small_function);
@@ -0,0 +1,35 @@
+// The matmul.wasm is the hand-written translation of this code,
+// with the matrices placed in the memory at the addresses 0, 32768 and 65536.
+
+#define WASM_EXPORT __attribute__((visibility("default")))
+
+#define N_MAX 64
+
+static double a[N_MAX * N_MAX];
+static double b[N_MAX * N_MAX];
+static double c[N_MAX * N_MAX];
+
+WASM_EXPORT int matmul_bench(unsigned n)
+{
+    for (unsigned i = 0; i < n * n; i++)
+    {
+        a[i] = (double)(i % 7) * 0.5;
+        b[i] = 1.0 / (double)(i + 1);
+    }
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        for (unsigned j = 0; j < n; j++)
+        {
+            double sum = 0.0;
+            for (unsigned k = 0; k < n; k++)
+                sum += a[i * n + k] * b[k * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+
+    double checksum = 0.0;
+    for (unsigned i = 0; i < n * n; i++)
+        checksum += c[i];
+    return (int)(checksum * 1000.0);
+}
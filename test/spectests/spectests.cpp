@@ -5,6 +5,7 @@
 #include "execute.hpp"
 #include "parser.hpp"
 #include <nlohmann/json.hpp>
+#include <test/utils/aot_compiler.hpp>
 #include <test/utils/hex.hpp>
 #include <filesystem>
 #include <fstream>
@@ -67,6 +68,8 @@ fizzy::bytes load_wasm_file(const fs::path& json_file_path, std::string_view fil
 struct test_settings
 {
     bool skip_validation = false;
+    /// Execute the modules compiled ahead of time with the system C compiler.
+    bool aot = false;
 };
 
 struct test_results
@@ -132,6 +135,18 @@ public:
                         std::move(imports.functions), std::move(imports.tables),
                         std::move(imports.memories), std::move(imports.globals));
 
+                    if (m_settings.aot)
+                    {
+                        auto& instance = *m_instances[name];
+                        instance.aot_code = fizzy::test::compile_aot(*instance.module);
+                        if (instance.aot_code == nullptr)
+                        {
+                            fail("AOT compilation failed");
+                            m_instances.erase(name);
+                            continue;
+                        }
+                    }
+
                     m_last_module_name = name;
                 }
                 catch (const fizzy::parser_error& ex)
@@ -415,7 +430,7 @@ private:
             return std::nullopt;
 
         const auto func_name = action.at("field").get<std::string>();
-        const auto func_idx = fizzy::find_exported_function(instance->module, func_name);
+        const auto func_idx = fizzy::find_exported_function(*instance->module, func_name);
         if (!func_idx.has_value())
         {
             skip("Function '" + func_name + "' not found.");
@@ -427,9 +442,10 @@ private:
         {
             const auto arg_type = arg.at("type").get<std::string>();
             uint64_t arg_value;
-            if (arg_type == "i32")
+            // The floating point values are given as their bits.
+            if (arg_type == "i32" || arg_type == "f32")
                 arg_value = json_to_value<int32_t>(arg.at("value"));
-            else if (arg_type == "i64")
+            else if (arg_type == "i64" || arg_type == "f64")
                 arg_value = json_to_value<int64_t>(arg.at("value"));
             else
             {
@@ -453,10 +469,14 @@ private:
     bool check_result(uint64_t actual_value, const json& expected)
     {
         const auto expected_type = expected.at("type").get<std::string>();
+        const auto expected_string = expected.at("value").get<std::string>();
+        if (expected_string == "nan:canonical" || expected_string == "nan:arithmetic")
+            return check_nan_result(actual_value, expected_type, expected_string);
+
         uint64_t expected_value;
-        if (expected_type == "i32")
+        if (expected_type == "i32" || expected_type == "f32")
             expected_value = json_to_value<int32_t>(expected.at("value"));
-        else if (expected_type == "i64")
+        else if (expected_type == "i64" || expected_type == "f64")
             expected_value = json_to_value<int64_t>(expected.at("value"));
         else
         {
@@ -476,6 +496,38 @@ private:
         return true;
     }
 
+    bool check_nan_result(
+        uint64_t actual_value, const std::string& expected_type, const std::string& expected_nan)
+    {
+        // The canonical NaN has only the most significant bit of the payload set,
+        // the arithmetic NaN has at least this bit set. The sign is not specified.
+        uint64_t canonical_nan;
+        if (expected_type == "f32")
+            canonical_nan = 0x7fc00000;
+        else if (expected_type == "f64")
+            canonical_nan = 0x7ff8000000000000;
+        else
+        {
+            skip("Unsupported expected type '" + expected_type + "'.");
+            return false;
+        }
+
+        const auto sign_mask = expected_type == "f32" ? uint64_t{0x80000000} : uint64_t{1} << 63;
+        const auto magnitude = actual_value & ~sign_mask;
+        const bool matches = expected_nan == "nan:canonical" ?
+                                 magnitude == canonical_nan :
+                                 (magnitude & canonical_nan) == canonical_nan;
+        if (!matches)
+        {
+            std::stringstream message;
+            message << "Incorrect returned value. Expected: " << expected_nan << " Actual: 0x"
+                    << std::hex << actual_value << std::dec;
+            fail(message.str());
+            return false;
+        }
+        return true;
+    }
+
     std::pair<imports, std::string> create_imports(const fizzy::Module& module)
     {
         imports result;
@@ -622,6 +674,8 @@ int main(int argc, char** argv)
             {
                 if (argv[i] == std::string{"--skip-validation"})
                     settings.skip_validation = true;
+                else if (argv[i] == std::string{"--aot"})
+                    settings.aot = true;
                 else
                 {
                     std::cerr << "Unknown argument: " << argv[i] << "\n";
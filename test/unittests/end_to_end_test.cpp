@@ -81,7 +81,7 @@ TEST(end_to_end, milestone2)
     memory[63] = 0xc0;
     // TODO: use find_exported_function
     EXPECT_THAT(execute(*instance, 0, {64, 0, 32}), Result());
-    EXPECT_EQ(hex(memory.substr(64, 64)),
+    EXPECT_EQ(hex(bytes_view{memory}.substr(64, 64)),
         "ff00000000000000000000000000000000000000000000000000000000000040"
         "8000000000000000000000000000000000000000000000000000000000000060");
 }
@@ -170,5 +170,5 @@ TEST(end_to_end, memset)
 
     auto instance = instantiate(module);
     EXPECT_THAT(execute(*instance, *func_idx, {0, 2}), Result());
-    EXPECT_EQ(hex(instance->memory->substr(0, 2 * sizeof(int))), "d2040000d2040000");
+    EXPECT_EQ(hex(bytes_view{*instance->memory}.substr(0, 2 * sizeof(int))), "d2040000d2040000");
 }
@@ -0,0 +1,102 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "aot.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/aot_compiler.hpp>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+
+using namespace fizzy;
+
+namespace
+{
+execution_result execute_compiled(const Module& module,
+    const std::shared_ptr<const AotCode>& code, FuncIdx func_idx, std::vector<uint64_t> args)
+{
+    auto instance = instantiate(module);
+    instance->aot_code = code;
+    return execute(*instance, func_idx, std::move(args));
+}
+
+/// The tests of the compiled code, skipped if the C compiler is not available.
+class execute_aot : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        static const bool compiler_available = test::compile_aot(parse(wasm_prefix)) != nullptr;
+        if (!compiler_available)
+            GTEST_SKIP() << "The C compiler is not available.";
+    }
+
+    static std::shared_ptr<const AotCode> compile(const Module& module)
+    {
+        auto code = test::compile_aot(module);
+        EXPECT_NE(code, nullptr);
+        return code;
+    }
+};
+}  // namespace
+
+TEST_F(execute_aot, memory_grow)
+{
+    /* wat2wasm
+    (memory 1 2)
+    (func (result i32)
+      i32.const 1
+      memory.grow
+      drop
+      i32.const 65536
+      i32.const 42
+      i32.store
+      i32.const 65536
+      i32.load
+      memory.size
+      i32.add
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d010000000105016000017f030201000504010101020a1c011a00410140001a41808004412a360200"
+        "418080042802003f006a0b");
+    const auto module = parse(wasm);
+    const auto code = compile(module);
+
+    // The grown memory must be visible to the code after memory.grow.
+    EXPECT_THAT(execute_compiled(module, code, 0, {}), Result(44));
+}
+
+TEST(aot, translate_to_c)
+{
+    /* wat2wasm
+    (func $f (param i32) (result i32)
+      local.get 0
+    )
+    (func (export "g") (result i32)
+      i32.const 1
+      call $f
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d01000000010a0260017f017f6000017f0303020001070501016700010a0d02040020000b06004101"
+        "10000b");
+    const auto module = parse(wasm);
+
+    const auto source = translate_to_c(module);
+    EXPECT_NE(
+        source.find("static int f0(FizzyAotContext* ctx, uint64_t* args)"), std::string::npos);
+    EXPECT_NE(source.find("fizzy_call(ctx, f0, a)"), std::string::npos);
+    EXPECT_NE(source.find("const FizzyAotFunction fizzy_aot_functions[] = {f0, f1};"),
+        std::string::npos);
+}
+
+TEST(aot, load_aot_mismatch)
+{
+    /* wat2wasm
+    (func)
+    */
+    const auto wasm = from_hex("0061736d01000000010401600000030201000a040102000b");
+    EXPECT_THROW(load_aot("/nonexistent/module.so", parse(wasm)), std::runtime_error);
+}
@@ -56,6 +56,37 @@ TEST(execute_call, call_with_arguments)
     EXPECT_THAT(execute(parse(wasm), 1, {}), Result(4));
 }
 
+TEST(execute_call, call_preserves_caller_locals_and_operands)
+{
+    /* wat2wasm
+    (module
+      (func $inc (param i32) (result i32) (local i32)
+        local.get 0
+        i32.const 1
+        i32.add
+        local.set 1
+        local.get 1
+      )
+      (func (result i32) (local i32)
+        i32.const 7
+        local.set 0
+        i32.const 100
+        i32.const 1
+        call $inc
+        i32.add      ;; 100 + 2
+        local.get 0
+        call $inc
+        i32.add      ;; 102 + 8
+      )
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d01000000010a0260017f017f6000017f03030200010a25020d01017f200041016a210120010b1501"
+        "017f4107210041e400410110006a200010006a0b");
+
+    EXPECT_THAT(execute(parse(wasm), 1, {}), Result(110));
+}
+
 TEST(execute_call, call_indirect)
 {
     /* wat2wasm
@@ -300,6 +331,92 @@ TEST(execute_call, imported_functions_call_indirect)
     EXPECT_THAT(execute(*instance, 3, {2, 50}), Result(7));   // isqrt(50)
 }
 
+TEST(execute_call, imported_host_function_call)
+{
+    /* wat2wasm
+    (import "mod" "foo" (func (param i32) (result i32)))
+    (func (param i32) (result i32)
+      get_local 0
+      call 0
+      i32.const 2
+      i32.add
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020b01036d6f6403666f6f0000030201000a0b0109002000100041026a"
+        "0b");
+
+    const auto module = parse(wasm);
+
+    constexpr HostFunctionPtr host_foo = [](void* context, Instance&, span<const uint64_t> args,
+                                             span<uint64_t> results, int) {
+        const auto factor = *static_cast<const uint64_t*>(context);
+        if (factor == 0)
+            return false;
+        results[0] = args[0] * factor;
+        return true;
+    };
+    uint64_t factor = 2;
+
+    auto instance = instantiate(module, {{{}, module.typesec[0], host_foo, &factor}});
+
+    EXPECT_THAT(execute(*instance, 1, {20}), Result(42));
+    EXPECT_THAT(execute(*instance, 0, {20}), Result(40));
+
+    factor = 0;
+    EXPECT_THAT(execute(*instance, 1, {20}), Traps());
+    EXPECT_THAT(execute(*instance, 0, {20}), Traps());
+}
+
+TEST(execute_call, imported_host_functions_call_indirect)
+{
+    /* wat2wasm
+    (module
+      (type $ft (func (param i32) (result i64)))
+      (func $sqr    (import "env" "sqr") (param i32) (result i64))
+      (func $isqrt  (import "env" "isqrt") (param i32) (result i64))
+      (func $double (param i32) (result i64)
+        get_local 0
+        i64.extend_u/i32
+        get_local 0
+        i64.extend_u/i32
+        i64.add
+      )
+
+      (func $main (param i32) (param i32) (result i64)
+        get_local 1
+        get_local 0
+        call_indirect (type $ft)
+      )
+
+      (table anyfunc (elem $double $sqr $isqrt))
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d01000000010c0260017f017e60027f7f017e02170203656e7603737172000003656e76056973717274"
+        "00000303020001040501700103030909010041000b030200010a150209002000ad2000ad7c0b09002001200011"
+        "00000b");
+
+    const auto module = parse(wasm);
+
+    constexpr HostFunctionPtr sqr = [](void*, Instance&, span<const uint64_t> args,
+                                        span<uint64_t> results, int) {
+        results[0] = args[0] * args[0];
+        return true;
+    };
+    constexpr HostFunctionPtr isqrt = [](void*, Instance&, span<const uint64_t> args,
+                                          span<uint64_t> results, int) {
+        results[0] = (11 + args[0] / 11) / 2;
+        return true;
+    };
+
+    auto instance = instantiate(
+        module, {{{}, module.typesec[0], sqr, nullptr}, {{}, module.typesec[0], isqrt, nullptr}});
+    EXPECT_THAT(execute(*instance, 3, {0, 10}), Result(20));  // double(10)
+    EXPECT_THAT(execute(*instance, 3, {1, 9}), Result(81));   // sqr(9)
+    EXPECT_THAT(execute(*instance, 3, {2, 50}), Result(7));   // isqrt(50)
+}
+
 TEST(execute_call, imported_function_from_another_module)
 {
     /* wat2wasm
@@ -479,6 +596,35 @@ TEST(execute_call, call_max_depth)
     EXPECT_THAT(execute(*instance, 1, {}, 2048), Traps());
 }
 
+TEST(execute_call, call_deep_recursion)
+{
+    /* wat2wasm
+    (func $count (param i32) (result i32)
+      local.get 0
+      i32.eqz
+      if (result i32)
+        i32.const 0
+      else
+        local.get 0
+        i32.const 1
+        i32.sub
+        call $count
+        i32.const 1
+        i32.add
+      end
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000a17011500200045047f410005200041016b100041016a0b"
+        "0b");
+
+    auto instance = instantiate(parse(wasm));
+
+    EXPECT_THAT(execute(*instance, 0, {1000}), Result(1000));
+    EXPECT_THAT(execute(*instance, 0, {CallStackLimit}), Result(CallStackLimit));
+    EXPECT_THAT(execute(*instance, 0, {CallStackLimit + 1}), Traps());
+}
+
 // A regression test for incorrect number of arguments passed to a call.
 TEST(execute_call, call_nonempty_stack)
 {
@@ -564,3 +710,31 @@ TEST(execute_call, call_indirect_imported_table_infinite_recursion)
 
     EXPECT_THAT(execute(*instance1, 0, {}), Traps());
 }
+
+TEST(execute_call, call_lazily_parsed_invalid_function)
+{
+    /* wat2wasm --no-check
+    (func (result i32) (call 2))
+    (func (result i32) (i32.const 1))
+    (func (result i32) drop)
+    */
+    const auto wasm =
+        from_hex("0061736d010000000105016000017f0304030000000a0f03040010020b040041010b03001a0b");
+    EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
+
+    ParseOptions options;
+    options.lazy = true;
+    auto instance = instantiate(parse(wasm, options));
+
+    // The invalid function traps each time it is called, the other functions are not affected.
+    EXPECT_THAT(execute(*instance, 1, {}), Result(1));
+    EXPECT_THAT(execute(*instance, 2, {}), Traps());
+    EXPECT_THAT(execute(*instance, 2, {}), Traps());
+    EXPECT_THAT(execute(*instance, 0, {}), Traps());
+    EXPECT_THAT(execute(*instance, 1, {}), Result(1));
+
+    // The error of the invalid function is kept.
+    EXPECT_THROW_MESSAGE(get_code(*instance->module, 2), validation_error, "stack underflow");
+    EXPECT_THROW_MESSAGE(
+        validate_lazy_code(*instance->module), validation_error, "stack underflow");
+}
@@ -0,0 +1,301 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "execute.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "register_ir.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/wasm_binary.hpp>
+#include <cmath>
+#include <limits>
+
+using namespace fizzy;
+using namespace fizzy::test;
+
+namespace
+{
+template <typename T>
+constexpr ValType valtype() noexcept
+{
+    if constexpr (std::is_same_v<T, float>)
+        return ValType::f32;
+    else if constexpr (std::is_same_v<T, double>)
+        return ValType::f64;
+    else if constexpr (sizeof(T) == sizeof(uint32_t))
+        return ValType::i32;
+    else
+        return ValType::i64;
+}
+
+/// Executes the single instruction taking the arguments of types Args and returning R.
+/// The register IR and JIT tiers are expected to give the same result as the interpreter.
+template <typename R, typename... Args>
+execution_result execute_instruction(Instr instr, Args... args)
+{
+    const bytes func_type{0x60, uint8_t{sizeof...(Args)}, static_cast<uint8_t>(valtype<Args>())...,
+        0x01, static_cast<uint8_t>(valtype<R>())};
+    bytes body{0x00};
+    for (uint8_t i = 0; i < sizeof...(Args); ++i)
+        body += bytes{0x20, i};
+    body += bytes{static_cast<uint8_t>(instr), 0x0b};
+    const auto wasm = bytes{0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00} +
+                      make_section(1, make_vec({func_type})) +
+                      make_section(3, make_vec({bytes{0x00}})) +
+                      make_section(10, make_vec({add_size_prefix(body)}));
+    const auto module = parse(wasm);
+    const std::vector<uint64_t> values{to_value(args)...};
+
+    const auto result = execute(module, 0, values);
+
+    auto instance = instantiate(module);
+    const auto register_ir_result =
+        execute_register_ir(*instance, translate_to_register_ir(module), 0, values);
+    EXPECT_EQ(register_ir_result.trapped, result.trapped);
+    EXPECT_EQ(register_ir_result.stack, result.stack);
+
+    instance->jit_code = compile_jit(module);
+    if (instance->jit_code != nullptr)
+    {
+        const auto jit_result = execute(*instance, 0, values);
+        EXPECT_EQ(jit_result.trapped, result.trapped);
+        EXPECT_EQ(jit_result.stack, result.stack);
+    }
+
+    return result;
+}
+
+/// Matches any NaN result of type T.
+template <typename T>
+auto ResultNaN()
+{
+    return testing::Truly([](const execution_result& result) {
+        return !result.trapped && result.stack.size() == 1 &&
+               std::isnan(from_value<T>(result.stack[0]));
+    });
+}
+
+template <typename T>
+constexpr T QNaN = std::numeric_limits<T>::quiet_NaN();
+
+template <typename T>
+constexpr T Inf = std::numeric_limits<T>::infinity();
+}  // namespace
+
+TEST(execute_floating_point, f32_arithmetic)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_add, 1.5f, 2.25f), Result(3.75f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_sub, 1.5f, 2.25f), Result(-0.75f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_mul, 1.5f, -2.0f), Result(-3.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_div, 1.0f, 4.0f), Result(0.25f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_div, 1.0f, -0.0f), Result(-Inf<float>));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_sqrt, 2.25f), Result(1.5f));
+    // Rounded to nearest, ties to even.
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_add, 16777216.0f, 1.0f), Result(16777216.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_add, 16777218.0f, 1.0f), Result(16777220.0f));
+}
+
+TEST(execute_floating_point, f64_arithmetic)
+{
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_add, 0.1, 0.2), Result(0.1 + 0.2));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_sub, 1.5, 2.25), Result(-0.75));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_mul, 1.5, -2.0), Result(-3.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_div, 1.0, 3.0), Result(1.0 / 3.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_div, -1.0, 0.0), Result(-Inf<double>));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_sqrt, 2.0), Result(std::sqrt(2.0)));
+}
+
+TEST(execute_floating_point, nan_results)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_div, 0.0f, 0.0f), ResultNaN<float>());
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_sqrt, -1.0f), ResultNaN<float>());
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_add, QNaN<float>, 1.0f), ResultNaN<float>());
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_sub, Inf<double>, Inf<double>),
+        ResultNaN<double>());
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_mul, 0.0, Inf<double>), ResultNaN<double>());
+}
+
+TEST(execute_floating_point, min_max)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_min, 1.0f, -2.0f), Result(-2.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_max, 1.0f, -2.0f), Result(1.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_min, 1.0, -2.0), Result(-2.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_max, 1.0, -2.0), Result(1.0));
+
+    // The -0 is less than +0.
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_min, 0.0f, -0.0f), Result(-0.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_min, -0.0f, 0.0f), Result(-0.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_max, 0.0f, -0.0f), Result(0.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_max, -0.0f, 0.0f), Result(0.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_min, 0.0, -0.0), Result(-0.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_max, -0.0, 0.0), Result(0.0));
+
+    // The NaN operand gives the canonical NaN.
+    const auto snan = from_value<float>(0x7f800001);
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_min, 1.0f, snan), Result(QNaN<float>));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_max, snan, 1.0f), Result(QNaN<float>));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_min, QNaN<double>, -Inf<double>),
+        Result(QNaN<double>));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_max, Inf<double>, QNaN<double>),
+        Result(QNaN<double>));
+}
+
+TEST(execute_floating_point, rounding)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_ceil, -1.5f), Result(-1.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_ceil, -0.5f), Result(-0.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_floor, -1.5f), Result(-2.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_trunc, -1.5f), Result(-1.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_ceil, 1.25), Result(2.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_floor, 1.75), Result(1.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_trunc, -0.75), Result(-0.0));
+
+    // The ties are rounded to even.
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_nearest, 2.5f), Result(2.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_nearest, 3.5f), Result(4.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_nearest, -0.5f), Result(-0.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_nearest, -2.5), Result(-2.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_nearest, 4503599627370497.0),
+        Result(4503599627370497.0));
+}
+
+TEST(execute_floating_point, sign_operations)
+{
+    // The sign operations do not alter the NaN payload.
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_neg, from_value<float>(0x7fc00001)),
+        Result(0xffc00001));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_abs, from_value<float>(0xff800001)),
+        Result(0x7f800001));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_neg, from_value<double>(0x7ff0000000000001)),
+        Result(0xfff0000000000001));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_abs, -0.0), Result(0.0));
+
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_copysign, 1.5f, -0.0f), Result(-1.5f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_copysign, -1.5f, QNaN<float>), Result(1.5f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_copysign, Inf<double>, -1.0),
+        Result(-Inf<double>));
+}
+
+TEST(execute_floating_point, comparison)
+{
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_eq, 1.0f, 1.0f), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_eq, 0.0f, -0.0f), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_eq, QNaN<float>, QNaN<float>), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_ne, QNaN<float>, QNaN<float>), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_lt, -1.0f, 1.0f), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_gt, -1.0f, 1.0f), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_le, 1.0f, QNaN<float>), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f32_ge, 1.0f, 1.0f), Result(1));
+
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f64_eq, -0.0, 0.0), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f64_ne, 1.0, 1.0), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f64_lt, QNaN<double>, 1.0), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f64_gt, Inf<double>, 1.0), Result(1));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::f64_le, -Inf<double>, -1.0), Result(1));
+    EXPECT_THAT(
+        execute_instruction<uint32_t>(Instr::f64_ge, QNaN<double>, QNaN<double>), Result(0));
+}
+
+TEST(execute_floating_point, trunc_i32)
+{
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, -7.9f), Result(uint32_t(-7)));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, 2147483520.0f),
+        Result(2147483520));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, -2147483648.0f),
+        Result(0x80000000));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, 2147483648.0f), Traps());
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, -2147483904.0f), Traps());
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_s, QNaN<float>), Traps());
+
+    // The values in (-1, 0) truncate to 0.
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_u, -0.9f), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_u, -1.0f), Traps());
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_u, 4294967040.0f),
+        Result(4294967040));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f32_u, 4294967296.0f), Traps());
+
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_s, 2147483647.9),
+        Result(2147483647));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_s, -2147483648.9),
+        Result(0x80000000));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_s, 2147483648.0), Traps());
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_s, -2147483649.0), Traps());
+
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_u, 4294967295.9),
+        Result(4294967295));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_u, -0.9), Result(0));
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_u, 4294967296.0), Traps());
+    EXPECT_THAT(execute_instruction<uint32_t>(Instr::i32_trunc_f64_u, Inf<double>), Traps());
+}
+
+TEST(execute_floating_point, trunc_i64)
+{
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f32_s, -9223372036854775808.0f),
+        Result(0x8000000000000000));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f32_s, 9223372036854775808.0f),
+        Traps());
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f32_u, 18446742974197923840.0f),
+        Result(18446742974197923840u));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f32_u, 18446744073709551616.0f),
+        Traps());
+
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_s, -1.5), Result(uint64_t(-1)));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_s, 9223372036854774784.0),
+        Result(9223372036854774784));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_s, 9223372036854775808.0),
+        Traps());
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_u, 18446744073709549568.0),
+        Result(18446744073709549568u));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_u, 18446744073709551616.0),
+        Traps());
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_trunc_f64_u, -QNaN<double>), Traps());
+}
+
+TEST(execute_floating_point, convert)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_convert_i32_s, uint32_t(-1)), Result(-1.0f));
+    EXPECT_THAT(
+        execute_instruction<float>(Instr::f32_convert_i32_u, uint32_t(-1)), Result(4294967296.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_convert_i64_s, uint64_t(-2)), Result(-2.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_convert_i32_s, uint32_t(-1)), Result(-1.0));
+    EXPECT_THAT(
+        execute_instruction<double>(Instr::f64_convert_i32_u, uint32_t(-1)), Result(4294967295.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_convert_i64_s, uint64_t(-3)), Result(-3.0));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_convert_i64_u, uint64_t(-1)),
+        Result(18446744073709551616.0));
+
+    // The conversion is rounded once, the value above the midpoint is rounded up.
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_convert_i64_u, uint64_t{0x8000008000000001}),
+        Result(9223373136366403584.0f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_convert_i64_s, uint64_t{0x0020000020000001}),
+        Result(9007200328482816.0f));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_convert_i64_u, uint64_t{0x8000000000000401}),
+        Result(9223372036854777856.0));
+}
+
+TEST(execute_floating_point, demote_promote)
+{
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_demote_f64, 1.5), Result(1.5f));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_demote_f64, 1e300), Result(Inf<float>));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_demote_f64, -1e-300), Result(-0.0f));
+    EXPECT_THAT(
+        execute_instruction<float>(Instr::f32_demote_f64, QNaN<double>), ResultNaN<float>());
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_promote_f32, 0.1f), Result(double{0.1f}));
+    EXPECT_THAT(execute_instruction<double>(Instr::f64_promote_f32, -Inf<float>),
+        Result(-Inf<double>));
+}
+
+TEST(execute_floating_point, reinterpret)
+{
+    EXPECT_THAT(
+        execute_instruction<uint32_t>(Instr::i32_reinterpret_f32, 1.0f), Result(0x3f800000));
+    EXPECT_THAT(execute_instruction<uint64_t>(Instr::i64_reinterpret_f64, -2.0),
+        Result(0xc000000000000000));
+    EXPECT_THAT(execute_instruction<float>(Instr::f32_reinterpret_i32, uint32_t{0x7fc00001}),
+        Result(from_value<float>(0x7fc00001)));
+    EXPECT_THAT(
+        execute_instruction<double>(Instr::f64_reinterpret_i64, uint64_t{0x3ff0000000000000}),
+        Result(1.0));
+}
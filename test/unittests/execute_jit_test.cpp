@@ -0,0 +1,115 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "jit.hpp"
+#include "limits.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+
+using namespace fizzy;
+
+namespace
+{
+execution_result execute_jit(const Module& module, FuncIdx func_idx, std::vector<uint64_t> args)
+{
+    auto instance = instantiate(module);
+    instance->jit_code = compile_jit(module);
+    return execute(*instance, func_idx, std::move(args));
+}
+}  // namespace
+
+TEST(execute_jit, memory_grow)
+{
+    /* wat2wasm
+    (memory 1 2)
+    (func (result i32)
+      i32.const 1
+      memory.grow
+      drop
+      i32.const 65536
+      i32.const 42
+      i32.store
+      i32.const 65536
+      i32.load
+      memory.size
+      i32.add
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d010000000105016000017f030201000504010101020a1c011a00410140001a41808004412a360200"
+        "418080042802003f006a0b");
+    const auto module = parse(wasm);
+
+    // The grown memory must be visible to the code after memory.grow.
+    EXPECT_THAT(execute_jit(module, 0, {}), Result(44));
+}
+
+TEST(execute_jit, large_frames_call_stack_limit)
+{
+    /* wat2wasm
+    (func $f (param i32) (result i32) (local i64 x1000)
+      local.get 0
+      i32.eqz
+      (if (result i32)
+        (then i32.const 0)
+        (else
+          local.get 0
+          i32.const 1
+          i32.sub
+          call $f
+          i32.const 1
+          i32.add
+        )
+      )
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000a1a011801e8077e200045047f410005200041016b100041"
+        "016a0b0b");
+    const auto module = parse(wasm);
+
+    // The deepest call stack commits the slots of all frames: about 16 MB.
+    EXPECT_THAT(execute_jit(module, 0, {CallStackLimit}), Result(CallStackLimit));
+    EXPECT_THAT(execute_jit(module, 0, {CallStackLimit + 1}), Traps());
+}
+
+TEST(execute_jit, large_frames_nested_executions)
+{
+    /* wat2wasm
+    (func $h (import "m" "h") (param i32) (result i32))
+    (func (param i32) (result i32) (local i64 x1000)
+      local.get 0
+      i32.eqz
+      (if (result i32)
+        (then i32.const 0)
+        (else
+          local.get 0
+          i32.const 1
+          i32.sub
+          call $h
+          i32.const 1
+          i32.add
+        )
+      )
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020701016d01680000030201000a1a011801e8077e200045047f4100"
+        "05200041016b100041016a0b0b");
+    const auto module = parse(wasm);
+
+    // The host function executes the function again, so each level of the recursion is
+    // a nested execution in the slots following the arguments of the calling frame.
+    std::unique_ptr<Instance> instance;
+    const auto host = [&instance](Instance&, std::vector<uint64_t> args, int depth) {
+        return execute(*instance, 1, {args[0]}, depth + 1);
+    };
+    instance = instantiate(module, {{host, module.typesec[0]}});
+    instance->jit_code = compile_jit(module);
+
+    EXPECT_THAT(execute(*instance, 1, {CallStackLimit / 2 - 1}), Result(CallStackLimit / 2 - 1));
+    EXPECT_THAT(execute(*instance, 1, {CallStackLimit / 2 + 1}), Traps());
+}
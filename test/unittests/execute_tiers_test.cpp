@@ -0,0 +1,488 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "aot.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "register_ir.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/aot_compiler.hpp>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <limits>
+
+using namespace fizzy;
+
+namespace
+{
+/// The execution tiers other than the interpreter.
+enum class Tier
+{
+    register_ir,
+    jit,
+    aot,
+};
+
+/// The tests executing the modules in each of the tiers, skipped for the tiers not available
+/// on the platform.
+class execute_tiers : public testing::TestWithParam<Tier>
+{
+    const Module* m_aot_module = nullptr;
+    std::shared_ptr<const AotCode> m_aot_code;
+
+protected:
+    void SetUp() override
+    {
+        switch (GetParam())
+        {
+        case Tier::register_ir:
+            break;
+        case Tier::jit:
+        {
+            static const bool jit_available = compile_jit(parse(wasm_prefix)) != nullptr;
+            if (!jit_available)
+                GTEST_SKIP() << "The JIT compiler is not supported on this platform.";
+            break;
+        }
+        case Tier::aot:
+        {
+            static const bool compiler_available =
+                test::compile_aot(parse(wasm_prefix)) != nullptr;
+            if (!compiler_available)
+                GTEST_SKIP() << "The C compiler is not available.";
+            break;
+        }
+        }
+    }
+
+    /// Executes the function of the module in the tier of the test.
+    ///
+    /// The AOT code is compiled once for the consecutive executions of the same module.
+    execution_result execute_tier(const Module& module, FuncIdx func_idx,
+        std::vector<uint64_t> args, std::vector<ExternalFunction> imported_functions = {})
+    {
+        auto instance = instantiate(module, std::move(imported_functions));
+        switch (GetParam())
+        {
+        case Tier::register_ir:
+            return execute_register_ir(
+                *instance, translate_to_register_ir(module), func_idx, std::move(args));
+        case Tier::jit:
+            instance->jit_code = compile_jit(module);
+            break;
+        case Tier::aot:
+            if (m_aot_module != &module)
+            {
+                m_aot_module = &module;
+                m_aot_code = test::compile_aot(module);
+                EXPECT_NE(m_aot_code, nullptr);
+            }
+            instance->aot_code = m_aot_code;
+            break;
+        }
+        return execute(*instance, func_idx, std::move(args));
+    }
+};
+
+std::string tier_name(const testing::TestParamInfo<Tier>& info)
+{
+    switch (info.param)
+    {
+    case Tier::register_ir:
+        return "register_ir";
+    case Tier::jit:
+        return "jit";
+    case Tier::aot:
+        return "aot";
+    }
+    return {};
+}
+}  // namespace
+
+INSTANTIATE_TEST_SUITE_P(
+    tiers, execute_tiers, testing::Values(Tier::register_ir, Tier::jit, Tier::aot), tier_name);
+
+TEST_P(execute_tiers, local_set_after_local_get)
+{
+    // The local.get result on the stack must not change when the local is modified.
+    /* wat2wasm
+    (func (param i32) (result i32)
+      local.get 0
+      local.get 0
+      i32.const 5
+      i32.add
+      local.set 0
+      local.get 0
+      i32.sub
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000a10010e002000200041056a210020006b0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {10}), Result(uint32_t(-5)));
+}
+
+TEST_P(execute_tiers, loop_sum)
+{
+    /* wat2wasm
+    (func (param i32) (result i32) (local i32)
+      (loop
+        local.get 1
+        local.get 0
+        i32.add
+        local.set 1
+        local.get 0
+        i32.const -1
+        i32.add
+        local.tee 0
+        br_if 0
+      )
+      local.get 1
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000a1b011901017f0340200120006a21012000417f6a22000d"
+        "000b20010b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {1}), Result(1));
+    EXPECT_THAT(execute_tier(module, 0, {10}), Result(55));
+    EXPECT_THAT(execute_tier(module, 0, {1000}), Result(500500));
+}
+
+TEST_P(execute_tiers, br_table_drop)
+{
+    /* wat2wasm
+    (func (param i32) (result i32)
+      (block (result i32)
+        (block (result i32)
+          i32.const 1
+          i32.const 2
+          local.get 0
+          br_table 0 1
+        )
+        i32.const 100
+        i32.add
+      )
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000a18011600027f027f4101410220000e0100010b41e4006a"
+        "0b0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0}), Result(102));
+    EXPECT_THAT(execute_tier(module, 0, {1}), Result(2));
+    EXPECT_THAT(execute_tier(module, 0, {5}), Result(2));
+}
+
+TEST_P(execute_tiers, if_else)
+{
+    /* wat2wasm
+    (func (param i32 i32) (result i32)
+      local.get 0
+      (if (result i32)
+        (then local.get 1)
+        (else i32.const 5)
+      )
+      local.get 1
+      i32.add
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001070160027f7f017f030201000a11010f002000047f20010541050b20016a0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {1, 3}), Result(6));
+    EXPECT_THAT(execute_tier(module, 0, {0, 3}), Result(8));
+}
+
+TEST_P(execute_tiers, select)
+{
+    /* wat2wasm
+    (func (param i64 i64 i32) (result i64)
+      local.get 0
+      local.get 1
+      local.get 2
+      select
+    )
+    */
+    const auto wasm =
+        from_hex("0061736d0100000001080160037e7e7f017e030201000a0b0109002000200120021b0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {3, 6, 0}), Result(6));
+    EXPECT_THAT(execute_tier(module, 0, {3, 6, 1}), Result(3));
+}
+
+TEST_P(execute_tiers, factorial_recursive)
+{
+    /* wat2wasm
+    (func $fac (param i64) (result i64)
+      local.get 0
+      i64.eqz
+      (if (result i64)
+        (then i64.const 1)
+        (else
+          local.get 0
+          local.get 0
+          i64.const 1
+          i64.sub
+          call $fac
+          i64.mul
+        )
+      )
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017e017e030201000a17011500200050047e4201052000200042017d10007e0b"
+        "0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0}), Result(1));
+    EXPECT_THAT(execute_tier(module, 0, {20}), Result(2432902008176640000));
+}
+
+TEST_P(execute_tiers, call_stack_limit)
+{
+    /* wat2wasm
+    (func $f call $f)
+    */
+    const auto wasm = from_hex("0061736d01000000010401600000030201000a0601040010000b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {}), Traps());
+}
+
+TEST_P(execute_tiers, call_imported_and_indirect)
+{
+    /* wat2wasm
+    (type $t (func (param i32) (result i32)))
+    (import "m" "f" (func $f (type $t)))
+    (table 1 funcref)
+    (elem (i32.const 0) $g)
+    (func $g (type $t)
+      local.get 0
+      i32.const 1
+      i32.add
+    )
+    (func (type $t)
+      local.get 0
+      call $f
+      i32.const 0
+      call_indirect (type $t)
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020701016d0166000003030200000404017000010907010041000b01"
+        "010a15020700200041016a0b0b002000100041001100000b");
+    const auto module = parse(wasm);
+
+    auto double_fn = [](Instance&, std::vector<uint64_t> args, int) {
+        return execution_result{false, {args[0] * 2}};
+    };
+    const auto func_type = module.typesec[0];
+
+    EXPECT_THAT(execute_tier(module, 2, {20}, {{double_fn, func_type}}), Result(41));
+
+    auto trap_fn = [](Instance&, std::vector<uint64_t>, int) {
+        return execution_result{true, {}};
+    };
+    EXPECT_THAT(execute_tier(module, 2, {20}, {{trap_fn, func_type}}), Traps());
+}
+
+TEST_P(execute_tiers, memory)
+{
+    /* wat2wasm
+    (memory 1)
+    (func (param i32) (result i64)
+      local.get 0
+      i64.const 0x0102030405060708
+      i64.store offset=1
+      local.get 0
+      i64.load32_u offset=1
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017e0302010005030100010a18011600200042888e98a8c0e08081013703"
+        "0120003502010b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0}), Result(0x05060708));
+    EXPECT_THAT(execute_tier(module, 0, {65527}), Result(0x05060708));
+    EXPECT_THAT(execute_tier(module, 0, {65528}), Traps());
+}
+
+TEST_P(execute_tiers, globals)
+{
+    /* wat2wasm
+    (global $g (mut i32) (i32.const 40))
+    (func (param i32) (result i32)
+      global.get $g
+      local.get 0
+      i32.add
+      global.set $g
+      global.get $g
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f030201000606017f0141280b0a0d010b00230020006a240023000b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {2}), Result(42));
+}
+
+TEST_P(execute_tiers, div_by_zero_traps)
+{
+    /* wat2wasm
+    (func (param i32 i32) (result i32)
+      local.get 0
+      local.get 1
+      i32.div_s
+    )
+    */
+    const auto wasm = from_hex("0061736d0100000001070160027f7f017f030201000a09010700200020016d0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {uint32_t(-6), 2}), Result(uint32_t(-3)));
+    EXPECT_THAT(execute_tier(module, 0, {6, 0}), Traps());
+    EXPECT_THAT(execute_tier(module, 0, {0x80000000, uint32_t(-1)}), Traps());
+}
+
+TEST_P(execute_tiers, floating_point)
+{
+    /* wat2wasm
+    (memory 1)
+    (func (param f64 f64) (result f64)
+      i32.const 8
+      local.get 0
+      f64.store
+      i32.const 8
+      f64.load
+      local.get 1
+      f64.mul
+      f64.sqrt
+    )
+    (func (param f32) (result i32)
+      local.get 0
+      i32.trunc_f32_s
+    )
+    (func (param f32 f32) (result f32)
+      local.get 0
+      local.get 1
+      f32.min
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001120360027c7c017c60017d017f60027d7d017d03040300010205030100010a22031200"
+        "4108200039030041082b03002001a29f0b05002000a80b070020002001960b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {to_value(2.0), to_value(8.0)}), Result(4.0));
+    EXPECT_THAT(execute_tier(module, 1, {to_value(-7.9f)}), Result(uint32_t(-7)));
+    EXPECT_THAT(execute_tier(module, 1, {to_value(2147483648.0f)}), Traps());
+    EXPECT_THAT(execute_tier(module, 2, {to_value(0.0f), to_value(-0.0f)}), Result(-0.0f));
+    const auto nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_THAT(execute_tier(module, 2, {to_value(1.0f), to_value(nan)}), Result(nan));
+}
+
+TEST_P(execute_tiers, load_offset_overflow)
+{
+    /* wat2wasm
+    (memory 1)
+    (func (param i32) (result i32)
+      local.get 0
+      i32.load offset=0xffffffff
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f0302010005030100010a0d010b0020002802ffffffff0f0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0}), Traps());
+    EXPECT_THAT(execute_tier(module, 0, {0xffffffff}), Traps());
+}
+
+
+TEST_P(execute_tiers, store16_load16_s)
+{
+    /* wat2wasm
+    (memory 1)
+    (func (param i32) (result i64)
+      i32.const 0
+      local.get 0
+      i32.store16
+      i32.const 0
+      i64.load16_s
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017e0302010005030100010a10010e00410020003b010041003201000b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0x17fff}), Result(0x7fff));
+    EXPECT_THAT(execute_tier(module, 0, {0x18000}), Result(uint64_t(-0x8000)));
+}
+
+
+TEST_P(execute_tiers, i64_rem_s)
+{
+    /* wat2wasm
+    (func (param i64 i64) (result i64)
+      local.get 0
+      local.get 1
+      i64.rem_s
+    )
+    */
+    const auto wasm = from_hex("0061736d0100000001070160027e7e017e030201000a0901070020002001810b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {uint64_t(-7), 2}), Result(uint64_t(-1)));
+    EXPECT_THAT(execute_tier(module, 0, {7, uint64_t(-1)}), Result(0));
+    EXPECT_THAT(execute_tier(module, 0, {0x8000000000000000, uint64_t(-1)}), Result(0));
+    EXPECT_THAT(execute_tier(module, 0, {7, 0}), Traps());
+}
+
+
+TEST_P(execute_tiers, i64_rotl_clz)
+{
+    /* wat2wasm
+    (func (param i64 i64) (result i64)
+      local.get 0
+      local.get 1
+      i64.rotl
+      local.get 0
+      i64.clz
+      i64.add
+    )
+    */
+    const auto wasm =
+        from_hex("0061736d0100000001070160027e7e017e030201000a0d010b0020002001892000797c0b");
+    const auto module = parse(wasm);
+
+    EXPECT_THAT(execute_tier(module, 0, {0x8000000000000001, 1}), Result(3));
+    EXPECT_THAT(execute_tier(module, 0, {1, 65}), Result(65));
+}
+
+
+TEST_P(execute_tiers, host_function_exception)
+{
+    /* wat2wasm
+    (import "m" "f" (func $f))
+    (func
+      call $f
+    )
+    */
+    const auto wasm =
+        from_hex("0061736d01000000010401600000020701016d01660000030201000a0601040010000b");
+    const auto module = parse(wasm);
+
+    // The exception is propagated through the compiled code.
+    auto throw_fn = [](Instance&, std::vector<uint64_t>, int) -> execution_result {
+        throw std::runtime_error{"host error"};
+    };
+    EXPECT_THROW_MESSAGE(execute_tier(module, 1, {}, {{throw_fn, module.typesec[0]}}),
+        std::runtime_error, "host error");
+}
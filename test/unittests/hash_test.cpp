@@ -0,0 +1,26 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hash.hpp"
+#include <gtest/gtest.h>
+
+using namespace fizzy;
+
+namespace
+{
+bytes_view to_bytes(std::string_view s)
+{
+    return {reinterpret_cast<const uint8_t*>(s.data()), s.size()};
+}
+}  // namespace
+
+TEST(hash, xxhash64)
+{
+    // The test vectors of the reference implementation.
+    EXPECT_EQ(xxhash64({}), 0xef46db3751d8e999);
+    EXPECT_EQ(xxhash64(to_bytes("a")), 0xd24ec4f1a98c6e5b);
+    EXPECT_EQ(xxhash64(to_bytes("abc")), 0x44bc2cf5ad770999);
+    EXPECT_EQ(xxhash64(to_bytes("Nobody inspects the spammish repetition")), 0xfbcea83c8a378bf1);
+    EXPECT_EQ(xxhash64(to_bytes("xxhash"), 20141025), 0xb559b98d844e0635);
+}
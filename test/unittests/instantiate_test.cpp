@@ -195,7 +195,7 @@ TEST(instantiate, imported_memory)
     const auto bin = from_hex("0061736d01000000020b01036d6f64016d02010103");
     const auto module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
     auto instance = instantiate(module, {}, {}, {{&memory, {1, 3}}});
 
     ASSERT_TRUE(instance->memory);
@@ -212,7 +212,7 @@ TEST(instantiate, imported_memory_unlimited)
     const auto bin = from_hex("0061736d01000000020a01036d6f64016d020001");
     const auto module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
     auto instance = instantiate(module, {}, {}, {{&memory, {1, std::nullopt}}});
 
     ASSERT_TRUE(instance->memory);
@@ -229,7 +229,7 @@ TEST(instantiate, imported_memory_stricter_limits)
     const auto bin = from_hex("0061736d01000000020b01036d6f64016d02010103");
     const auto module = parse(bin);
 
-    bytes memory(PageSize * 2, 0);
+    LinearMemory memory(PageSize * 2);
     auto instance = instantiate(module, {}, {}, {{&memory, {2, 2}}});
 
     ASSERT_TRUE(instance->memory);
@@ -246,7 +246,7 @@ TEST(instantiate, imported_memory_invalid)
     const auto bin = from_hex("0061736d01000000020b01036d6f64016d02010103");
     const auto module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
 
     // Providing more than 1 memory
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory, {1, 3}}, {&memory, {1, 1}}}),
@@ -267,7 +267,7 @@ TEST(instantiate, imported_memory_invalid)
         "Module defines an imported memory but none was provided.");
 
     // Provided min too low
-    bytes memory_empty;
+    LinearMemory memory_empty;
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory_empty, {0, 3}}}), instantiate_error,
         "Provided import's min is below import's min defined in module.");
 
@@ -288,7 +288,7 @@ TEST(instantiate, imported_memory_invalid)
         "Provided imported memory doesn't fit provided limits");
 
     // Allocated more than max
-    bytes memory_big(PageSize * 4, 0);
+    LinearMemory memory_big(PageSize * 4);
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory_big, {1, 3}}}), instantiate_error,
         "Provided imported memory doesn't fit provided limits");
 
@@ -465,6 +465,78 @@ TEST(instantiate, element_section)
     EXPECT_EQ(call_table_func(*instance, 3), 3);
 }
 
+TEST(instantiate, type_ids)
+{
+    /* wat2wasm
+    (module
+      (type $t0 (func (param i32) (result i32)))
+      (type $t1 (func))
+      (type $t2 (func (param i32) (result i32)))
+      (table 1 funcref)
+      (elem (i32.const 0) $f)
+      (func $f (type $t2) (local.get 0))
+    )
+    */
+    const auto bin = from_hex(
+        "0061736d01000000010e0360017f017f60000060017f017f030201020404017000010907010041000b01000a"
+        "0601040020000b");
+    const auto module = parse(bin);
+
+    auto instance1 = instantiate(module);
+    ASSERT_EQ(instance1->type_ids.size(), 3);
+    EXPECT_NE(instance1->type_ids[0], 0);
+    EXPECT_NE(instance1->type_ids[1], 0);
+    EXPECT_EQ(instance1->type_ids[0], instance1->type_ids[2]);
+    EXPECT_NE(instance1->type_ids[0], instance1->type_ids[1]);
+    EXPECT_EQ(instance1->type_ids[0], canonical_type_id({{ValType::i32}, {ValType::i32}}));
+    EXPECT_EQ(instance1->type_ids[1], canonical_type_id({}));
+    EXPECT_NE(instance1->type_ids[0], canonical_type_id({{ValType::i64}, {ValType::i32}}));
+    EXPECT_NE(instance1->type_ids[0], canonical_type_id({{ValType::i32, ValType::i32}, {}}));
+    EXPECT_EQ((*instance1->table)[0]->type_id, instance1->type_ids[0]);
+
+    auto instance2 = instantiate(module);
+    EXPECT_EQ(instance2->type_ids, instance1->type_ids);
+
+    // The ids are computed by the parser, the instances copy them.
+    EXPECT_EQ(module.type_ids, instance1->type_ids);
+
+    // The module not created by the parser has no ids, the instance computes them.
+    Module module_without_ids;
+    module_without_ids.typesec = module.typesec;
+    EXPECT_EQ(instantiate(std::move(module_without_ids))->type_ids, instance1->type_ids);
+}
+
+TEST(instantiate, element_section_function_references)
+{
+    /* wat2wasm
+    (module
+      (func $foo (import "mod" "foo") (result i32))
+      (table 2 funcref)
+      (elem (i32.const 0) $foo $f)
+      (func $f (result i32) (i32.const 1))
+    )
+    */
+    const auto bin = from_hex(
+        "0061736d010000000105016000017f020b01036d6f6403666f6f0000030201000404017000020908010041000b"
+        "0200010a0601040041010b");
+    const auto module = parse(bin);
+
+    auto host_foo = [](Instance&, std::vector<uint64_t>, int) -> execution_result {
+        return {false, {2}};
+    };
+    auto instance = instantiate(module, {{host_foo, module.typesec[0]}});
+
+    // The imported function is not referenced directly.
+    ASSERT_TRUE((*instance->table)[0].has_value());
+    EXPECT_EQ((*instance->table)[0]->instance, nullptr);
+    EXPECT_EQ(call_table_func(*instance, 0), 2);
+
+    ASSERT_TRUE((*instance->table)[1].has_value());
+    EXPECT_EQ((*instance->table)[1]->instance, instance.get());
+    EXPECT_EQ((*instance->table)[1]->func_idx, 1);
+    EXPECT_EQ(call_table_func(*instance, 1), 1);
+}
+
 TEST(instantiate, element_section_offset_from_global)
 {
     // Manually generated binary,
@@ -569,6 +641,9 @@ TEST(instantiate, element_section_fills_imported_table)
     EXPECT_EQ(call_table_func(*instance, 1), 1);
     EXPECT_EQ(call_table_func(*instance, 2), 3);
     EXPECT_EQ(call_table_func(*instance, 3), 4);
+
+    // The element placed by the host gets its type id.
+    EXPECT_EQ(table[0]->type_id, canonical_type_id(table[0]->type));
 }
 
 TEST(instantiate, element_section_out_of_bounds_doesnt_change_imported_table)
@@ -611,7 +686,7 @@ TEST(instantiate, data_section)
 
     auto instance = instantiate(module);
 
-    EXPECT_EQ(instance->memory->substr(0, 6), from_hex("00aa55550000"));
+    EXPECT_EQ(bytes_view{*instance->memory}.substr(0, 6), from_hex("00aa55550000"));
 }
 
 TEST(instantiate, data_section_offset_from_global)
@@ -624,7 +699,7 @@ TEST(instantiate, data_section_offset_from_global)
 
     auto instance = instantiate(module);
 
-    EXPECT_EQ(instance->memory->substr(42, 2), "aaff"_bytes);
+    EXPECT_EQ(bytes_view{*instance->memory}.substr(42, 2), "aaff"_bytes);
 }
 
 TEST(instantiate, data_section_offset_from_imported_global)
@@ -643,7 +718,7 @@ TEST(instantiate, data_section_offset_from_imported_global)
 
     auto instance = instantiate(module, {}, {}, {}, {g});
 
-    EXPECT_EQ(instance->memory->substr(42, 2), "aaff"_bytes);
+    EXPECT_EQ(bytes_view{*instance->memory}.substr(42, 2), "aaff"_bytes);
 }
 
 TEST(instantiate, data_section_offset_from_mutable_global)
@@ -680,10 +755,10 @@ TEST(instantiate, data_section_fills_imported_memory)
         from_hex("0061736d01000000020b01036d6f64016d020101010b0f020041010b02aaff0041020b025555");
     const auto module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
     auto instance = instantiate(module, {}, {}, {{&memory, {1, 1}}});
 
-    EXPECT_EQ(memory.substr(0, 6), from_hex("00aa55550000"));
+    EXPECT_EQ(bytes_view{memory}.substr(0, 6), from_hex("00aa55550000"));
 }
 
 TEST(instantiate, data_section_out_of_bounds_doesnt_change_imported_memory)
@@ -699,7 +774,7 @@ TEST(instantiate, data_section_out_of_bounds_doesnt_change_imported_memory)
         from_hex("0061736d01000000020a01016d036d656d0200010b0f020041000b016100418080040b0161");
     Module module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory, {1, 1}}}), instantiate_error,
         "Data segment is out of memory bounds");
 
@@ -724,7 +799,7 @@ TEST(instantiate, data_elem_section_errors_dont_change_imports)
     Module module_data_error = parse(bin_data_error);
 
     table_elements table(3);
-    bytes memory(PageSize, 0);
+    LinearMemory memory(PageSize);
     EXPECT_THROW_MESSAGE(
         instantiate(module_data_error, {}, {{&table, {3, std::nullopt}}}, {{&memory, {1, 1}}}),
         instantiate_error, "Data segment is out of memory bounds");
@@ -860,3 +935,162 @@ TEST(instantiate, start_unreachable)
     EXPECT_THROW_MESSAGE(
         instantiate(parse(wasm)), instantiate_error, "Start function failed to execute");
 }
+
+TEST(instantiate, shared_module)
+{
+    /* wat2wasm
+    (memory 1)
+    (data (i32.const 0) "\2a")
+    (func (param i32) (i32.store8 (i32.const 0) (local.get 0)))
+    (func (result i32) (i32.load8_u (i32.const 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001090260017f006000017f030302000105030100010a13020900410020003a00000b0700"
+        "41002d00000b0b07010041000b012a");
+
+    const std::shared_ptr<const Module> module = std::make_shared<Module>(parse(wasm));
+    auto instance1 = instantiate(module);
+    auto instance2 = instantiate(module);
+    EXPECT_EQ(instance1->module, module);
+    EXPECT_EQ(instance2->module, module);
+    EXPECT_EQ(module.use_count(), 3);
+
+    EXPECT_THAT(execute(*instance1, 0, {0x55}), Result());
+    EXPECT_THAT(execute(*instance1, 1, {}), Result(0x55));
+    EXPECT_THAT(execute(*instance2, 1, {}), Result(0x2a));
+
+    instance1.reset();
+    EXPECT_EQ(module.use_count(), 2);
+}
+
+TEST(instantiate, fork)
+{
+    /* wat2wasm
+    (memory 1 2)
+    (data (i32.const 16) "\2a")
+    (global (mut i32) (i32.const 7))
+    (table 2 funcref)
+    (elem (i32.const 1) $load)
+    (type $load_type (func (param i32) (result i32)))
+    (func $load (param i32) (result i32) (i32.load8_u (local.get 0)))
+    (func $store (param i32 i32) (i32.store8 (local.get 0) (local.get 1)))
+    (func $get_global (result i32) (global.get 0))
+    (func $set_global (param i32) (global.set 0 (local.get 0)))
+    (func $call (param i32) (result i32)
+      (call_indirect (type $load_type) (i32.const 16) (local.get 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001130460017f017f60027f7f006000017f60017f00030605000102030004040170000205"
+        "04010101020606017f0141070b0907010041010b01000a2905070020002d00000b0900200020013a00000b04"
+        "0023000b0600200024000b0900411020001100000b0b07010041100b012a");
+
+    auto instance_template = make_instance_template(instantiate(parse(wasm)));
+    ASSERT_NE(instance_template.memory_image, nullptr);
+    auto& source = *instance_template.instance;
+
+    auto instance1 = fork_instance(instance_template);
+    auto instance2 = fork_instance(instance_template);
+    EXPECT_EQ(instance1->module, source.module);
+    EXPECT_EQ(instance2->module, source.module);
+
+    EXPECT_THAT(execute(*instance1, 0, {16}), Result(0x2a));
+    EXPECT_THAT(execute(*instance1, 1, {16, 0x55}), Result());
+    EXPECT_THAT(execute(*instance1, 3, {8}), Result());
+    EXPECT_THAT(execute(*instance1, 0, {16}), Result(0x55));
+    EXPECT_THAT(execute(*instance1, 2, {}), Result(8));
+
+    // The memory and the globals of the other instances are not affected.
+    EXPECT_THAT(execute(*instance2, 0, {16}), Result(0x2a));
+    EXPECT_THAT(execute(*instance2, 2, {}), Result(7));
+    EXPECT_THAT(execute(source, 0, {16}), Result(0x2a));
+    EXPECT_THAT(execute(source, 2, {}), Result(7));
+
+    // The table elements refer to the functions of the forked instance.
+    ASSERT_NE(instance1->table, nullptr);
+    EXPECT_NE(instance1->table.get(), source.table.get());
+    EXPECT_EQ((*instance1->table)[1]->instance, instance1.get());
+    EXPECT_THAT(execute(*instance1, 4, {1}), Result(0x55));
+    EXPECT_THAT(execute(*instance2, 4, {1}), Result(0x2a));
+    EXPECT_THAT(execute(*instance1, 4, {0}), Traps());
+
+    // The forked instances do not depend on the template.
+    instance_template = {};
+    auto& memory = *instance2->memory;
+    EXPECT_EQ(memory.max_size(), 2 * PageSize);
+    EXPECT_THAT(execute(*instance2, 1, {PageSize - 1, 0xff}), Result());
+    EXPECT_EQ(memory[PageSize - 1], 0xff);
+    EXPECT_EQ(memory.grow_pages(1, instance2->memory_max_pages), 1);
+    EXPECT_THAT(execute(*instance2, 0, {PageSize}), Result(0));
+    EXPECT_THAT(execute(*instance2, 0, {16}), Result(0x2a));
+}
+
+TEST(instantiate, fork_imported_memory)
+{
+    /* wat2wasm
+    (memory (import "m" "m") 1)
+    (func (param i32) (result i32) (i32.load (local.get 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020801016d016d020001030201000a0901070020002802000b");
+
+    LinearMemory memory(PageSize);
+    auto instance_template = make_instance_template(
+        instantiate(parse(wasm), {}, {}, {{&memory, {1, std::nullopt}}}));
+    EXPECT_EQ(instance_template.memory_image, nullptr);
+
+    // The imported memory is shared.
+    auto instance = fork_instance(instance_template);
+    EXPECT_EQ(instance->memory.get(), &memory);
+    memory[0] = 0x2a;
+    EXPECT_THAT(execute(*instance, 0, {0}), Result(0x2a));
+}
+
+TEST(instantiate, reset)
+{
+    /* wat2wasm
+    (memory 1 2)
+    (data (i32.const 16) "\2a")
+    (global (mut i32) (i32.const 7))
+    (table 2 funcref)
+    (elem (i32.const 1) $load)
+    (type $load_type (func (param i32) (result i32)))
+    (func $load (param i32) (result i32) (i32.load8_u (local.get 0)))
+    (func $store (param i32 i32) (i32.store8 (local.get 0) (local.get 1)))
+    (func $get_global (result i32) (global.get 0))
+    (func $set_global (param i32) (global.set 0 (local.get 0)))
+    (func $call (param i32) (result i32)
+      (call_indirect (type $load_type) (i32.const 16) (local.get 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001130460017f017f60027f7f006000017f60017f00030605000102030004040170000205"
+        "04010101020606017f0141070b0907010041010b01000a2905070020002d00000b0900200020013a00000b04"
+        "0023000b0600200024000b0900411020001100000b0b07010041100b012a");
+
+    const auto instance_template = make_instance_template(instantiate(parse(wasm)));
+    auto instance = fork_instance(instance_template);
+    auto& memory = *instance->memory;
+    const auto* const memory_data = memory.data();
+
+    for (int i = 0; i < 2; ++i)
+    {
+        EXPECT_THAT(execute(*instance, 1, {16, 0x55}), Result());
+        EXPECT_THAT(execute(*instance, 1, {PageSize - 1, 0xff}), Result());
+        EXPECT_EQ(memory.grow_pages(1, instance->memory_max_pages), 1);
+        EXPECT_THAT(execute(*instance, 1, {PageSize, 0xff}), Result());
+        EXPECT_THAT(execute(*instance, 3, {8}), Result());
+        (*instance->table)[0] = (*instance->table)[1];
+        EXPECT_THAT(execute(*instance, 4, {0}), Result(0x55));
+
+        reset_instance(*instance, instance_template);
+
+        EXPECT_EQ(memory.data(), memory_data);
+        EXPECT_EQ(memory.size(), PageSize);
+        EXPECT_THAT(execute(*instance, 0, {16}), Result(0x2a));
+        EXPECT_THAT(execute(*instance, 0, {PageSize - 1}), Result(0));
+        EXPECT_THAT(execute(*instance, 0, {PageSize}), Traps());
+        EXPECT_THAT(execute(*instance, 2, {}), Result(7));
+        EXPECT_THAT(execute(*instance, 4, {0}), Traps());
+        EXPECT_THAT(execute(*instance, 4, {1}), Result(0x2a));
+        EXPECT_EQ((*instance->table)[1]->instance, instance.get());
+    }
+}
@@ -0,0 +1,366 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "execute.hpp"
+#include "limits.hpp"
+#include "memory.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <algorithm>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(memory 1 2)
+(func (param i32) (result i32) (i32.load (local.get 0)))
+(func (param i32 i32) (i32.store (local.get 0) (local.get 1)))
+(func (param i32) (result i32) (i32.load offset=0xffffffff (local.get 0)))
+(func (param i32) (result i32) (memory.grow (local.get 0)))
+*/
+const auto wasm_memory_access = from_hex(
+    "0061736d01000000010b0260017f017f60027f7f00030504000100000504010101020a2604070020002802000b09"
+    "00200020013602000b0b0020002802ffffffff0f0b0600200040000b");
+
+bool is_zero(bytes_view memory)
+{
+    return std::all_of(memory.begin(), memory.end(), [](uint8_t b) { return b == 0; });
+}
+}  // namespace
+
+TEST(memory, checked)
+{
+    LinearMemory memory(PageSize);
+    EXPECT_EQ(memory.mode(), MemoryMode::checked);
+    EXPECT_EQ(memory.size(), PageSize);
+    EXPECT_TRUE(is_zero(memory));
+
+    memory[PageSize - 1] = 0xff;
+    memory.resize(2 * PageSize);
+    EXPECT_EQ(memory.size(), 2 * PageSize);
+    EXPECT_EQ(memory[PageSize - 1], 0xff);
+    EXPECT_TRUE(is_zero(bytes_view{memory}.substr(PageSize)));
+
+    memory.resize(0);
+    EXPECT_EQ(memory.size(), 0);
+}
+
+TEST(memory, grow_in_place)
+{
+    for (const auto mode : {MemoryMode::checked, MemoryMode::guarded})
+    {
+        LinearMemory memory(PageSize, mode, 4 * PageSize);
+        EXPECT_EQ(memory.max_size(), 4 * PageSize);
+
+        const auto* const data = memory.data();
+        memory[PageSize - 1] = 0xff;
+        EXPECT_TRUE(memory.grow(3 * PageSize));
+        EXPECT_EQ(memory.data(), data);
+        EXPECT_EQ(memory.size(), 3 * PageSize);
+        EXPECT_EQ(memory[PageSize - 1], 0xff);
+        EXPECT_TRUE(is_zero(bytes_view{memory}.substr(PageSize)));
+
+        EXPECT_FALSE(memory.grow(5 * PageSize));
+        EXPECT_EQ(memory.size(), 3 * PageSize);
+        EXPECT_THROW(memory.resize(5 * PageSize), std::bad_alloc);
+
+        EXPECT_EQ(memory.grow_pages(1, 4), 3);
+        EXPECT_EQ(memory.grow_pages(1, 4), uint32_t(-1));
+        EXPECT_EQ(memory.grow_pages(0, 4), 4);
+        EXPECT_EQ(memory.data(), data);
+        EXPECT_EQ(memory.size(), 4 * PageSize);
+    }
+}
+
+TEST(memory, max_size)
+{
+    EXPECT_EQ(LinearMemory{}.max_size(), size_t{MemoryPagesLimit} * PageSize);
+    EXPECT_EQ(LinearMemory(0, MemoryMode::guarded, 0).max_size(), 0);
+    EXPECT_THROW(LinearMemory(2 * PageSize, MemoryMode::checked, PageSize), std::bad_alloc);
+}
+
+TEST(memory, guarded)
+{
+    LinearMemory memory(PageSize, MemoryMode::guarded);
+    EXPECT_EQ(memory.mode(), MemoryMode::guarded);
+    EXPECT_EQ(memory.size(), PageSize);
+    EXPECT_TRUE(is_zero(memory));
+
+    const auto* const data = memory.data();
+    memory[0] = 0xaa;
+    memory[PageSize - 1] = 0xff;
+    memory.resize(3 * PageSize);
+    EXPECT_EQ(memory.data(), data);
+    EXPECT_EQ(memory.size(), 3 * PageSize);
+    EXPECT_EQ(memory[0], 0xaa);
+    EXPECT_EQ(memory[PageSize - 1], 0xff);
+    EXPECT_TRUE(is_zero(bytes_view{memory}.substr(PageSize)));
+
+    // The pages released by shrinking are zeros when the memory grows again.
+    memory[2 * PageSize] = 0x55;
+    memory.resize(PageSize);
+    memory.resize(3 * PageSize);
+    EXPECT_EQ(memory.data(), data);
+    EXPECT_EQ(memory[0], 0xaa);
+    EXPECT_TRUE(is_zero(bytes_view{memory}.substr(PageSize)));
+}
+
+TEST(memory, image)
+{
+    for (const auto mode : {MemoryMode::checked, MemoryMode::guarded})
+    {
+        LinearMemory memory(3 * PageSize, mode, 4 * PageSize);
+        memory[1] = 0x2a;
+        memory[2 * PageSize] = 0x55;
+
+        const MemoryImage image{memory};
+        EXPECT_EQ(image.size(), 3 * PageSize);
+
+        // The image is the snapshot, not affected by the following changes.
+        memory[1] = 0xff;
+
+        LinearMemory copy1{image};
+        LinearMemory copy2{image};
+        EXPECT_EQ(copy1.mode(), mode);
+        EXPECT_EQ(copy1.size(), 3 * PageSize);
+        EXPECT_EQ(copy1.max_size(), 4 * PageSize);
+        EXPECT_EQ(copy1[1], 0x2a);
+        EXPECT_EQ(copy1[2 * PageSize], 0x55);
+        EXPECT_TRUE(is_zero(bytes_view{copy1}.substr(PageSize, PageSize)));
+
+        copy1[1] = 0x11;
+        EXPECT_EQ(copy2[1], 0x2a);
+        EXPECT_EQ(memory[1], 0xff);
+
+        EXPECT_TRUE(copy1.grow(4 * PageSize));
+        EXPECT_TRUE(is_zero(bytes_view{copy1}.substr(3 * PageSize)));
+        copy1.resize(PageSize);
+        EXPECT_TRUE(copy1.grow(3 * PageSize));
+        EXPECT_TRUE(is_zero(bytes_view{copy1}.substr(PageSize)));
+        EXPECT_EQ(copy2[2 * PageSize], 0x55);
+    }
+}
+
+TEST(memory, image_reset)
+{
+    for (const auto mode : {MemoryMode::checked, MemoryMode::guarded})
+    {
+        LinearMemory source(2 * PageSize, mode);
+        source[1] = 0x2a;
+        const MemoryImage image{source};
+
+        LinearMemory memory{image};
+        const auto* const data = memory.data();
+        memory[1] = 0x11;
+        memory[PageSize] = 0x22;
+        memory.resize(3 * PageSize);
+        memory[2 * PageSize] = 0x33;
+
+        memory.reset(image);
+        EXPECT_EQ(memory.data(), data);
+        EXPECT_EQ(memory.size(), 2 * PageSize);
+        EXPECT_EQ(memory[1], 0x2a);
+        EXPECT_EQ(memory[PageSize], 0);
+
+        // The pages grown after the reset are zeros.
+        memory.resize(3 * PageSize);
+        EXPECT_TRUE(is_zero(bytes_view{memory}.substr(2 * PageSize)));
+
+        // The shrunk memory is restored as well.
+        memory.resize(0);
+        memory.reset(image);
+        EXPECT_EQ(memory.size(), 2 * PageSize);
+        EXPECT_EQ(memory[1], 0x2a);
+    }
+}
+
+TEST(memory, guarded_empty)
+{
+    LinearMemory memory(0, MemoryMode::guarded);
+    EXPECT_EQ(memory.size(), 0);
+    EXPECT_NE(memory.data(), nullptr);
+}
+
+TEST(memory, guarded_execute)
+{
+    auto instance = instantiate(parse(wasm_memory_access), {}, {}, {}, {}, MemoryMode::guarded);
+    ASSERT_EQ(instance->memory->mode(), MemoryMode::guarded);
+
+    EXPECT_THAT(execute(*instance, 1, {PageSize - 4, 0x2a}), Result());
+    EXPECT_THAT(execute(*instance, 0, {PageSize - 4}), Result(0x2a));
+    EXPECT_EQ((*instance->memory)[PageSize - 4], 0x2a);
+
+    EXPECT_THAT(execute(*instance, 0, {PageSize - 3}), Traps());
+    EXPECT_THAT(execute(*instance, 0, {PageSize}), Traps());
+    EXPECT_THAT(execute(*instance, 0, {0xffffffff}), Traps());
+    EXPECT_THAT(execute(*instance, 1, {PageSize - 1, 0x2a}), Traps());
+    EXPECT_THAT(execute(*instance, 1, {0xfffffffd, 0x2a}), Traps());
+    EXPECT_THAT(execute(*instance, 2, {0}), Traps());
+    EXPECT_THAT(execute(*instance, 2, {0xffffffff}), Traps());
+
+    // The trapped executions do not affect the following ones.
+    EXPECT_THAT(execute(*instance, 0, {PageSize - 4}), Result(0x2a));
+
+    EXPECT_THAT(execute(*instance, 3, {1}), Result(1));
+    EXPECT_THAT(execute(*instance, 3, {1}), Result(uint32_t(-1)));
+    EXPECT_THAT(execute(*instance, 0, {PageSize}), Result(0));
+    EXPECT_THAT(execute(*instance, 1, {2 * PageSize - 4, 0x2a}), Result());
+    EXPECT_THAT(execute(*instance, 0, {2 * PageSize - 4}), Result(0x2a));
+    EXPECT_THAT(execute(*instance, 0, {2 * PageSize - 3}), Traps());
+}
+
+TEST(memory, guarded_nested_execute)
+{
+    /* wat2wasm
+    (func $host (import "m" "h") (param i32) (result i32))
+    (memory 1)
+    (func (param i32) (result i32)
+      (drop (call $host (local.get 0)))
+      (i32.load (local.get 0))
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020701016d016800000302010005030100010a0e010c00200010001a"
+        "20002802000b");
+
+    auto inner = instantiate(parse(wasm_memory_access), {}, {}, {}, {}, MemoryMode::guarded);
+
+    // The host function executes the load in the inner instance, which traps for the addresses
+    // out of its bounds, and returns whether it trapped.
+    const auto host = [&inner](Instance&, std::vector<uint64_t> args, int depth) {
+        const auto trapped = execute(*inner, 0, {args[0]}, depth + 1).trapped;
+        return execution_result{false, {uint64_t{trapped}}};
+    };
+    const auto host_type = FuncType{{ValType::i32}, {ValType::i32}};
+
+    auto instance =
+        instantiate(parse(wasm), {{host, host_type}}, {}, {}, {}, MemoryMode::guarded);
+    (*instance->memory)[0] = 0x2a;
+
+    EXPECT_THAT(execute(*instance, 1, {0}), Result(0x2a));
+    EXPECT_THAT(execute(*instance, 1, {PageSize}), Traps());
+
+    // The memory of the instance executing the host function stays guarded
+    // after the inner instance trapped.
+    EXPECT_THAT(execute(*inner, 3, {1}), Result(1));
+    EXPECT_THAT(execute(*instance, 1, {PageSize}), Traps());
+    EXPECT_THAT(execute(*instance, 1, {0}), Result(0x2a));
+}
+
+TEST(memory, guarded_reentrant_execute)
+{
+    /* wat2wasm
+    (func $host (import "m" "h") (param i32) (result i32))
+    (memory 1)
+    (func (param i32) (result i32)
+      (drop (call $host (local.get 0)))
+      (i32.load (local.get 0))
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020701016d016800000302010005030100010a0e010c00200010001a"
+        "20002802000b");
+
+    // Counts the live host function calls, decremented by the destructor.
+    int num_host_calls = 0;
+    struct HostCall
+    {
+        int& count;
+        explicit HostCall(int& c) : count{c} { ++count; }
+        ~HostCall() { --count; }
+    };
+
+    // The host function, while keeping the object with the destructor alive, calls back into
+    // the guarded instance, which faults out of its memory.
+    std::unique_ptr<Instance> instance;
+    bool callback_trapped = false;
+    const auto host = [&](Instance&, std::vector<uint64_t>, int depth) {
+        const HostCall call{num_host_calls};
+        if (num_host_calls == 1)
+            callback_trapped = execute(*instance, 1, {PageSize}, depth + 1).trapped;
+        return execution_result{false, {0}};
+    };
+    const auto host_type = FuncType{{ValType::i32}, {ValType::i32}};
+
+    instance = instantiate(parse(wasm), {{host, host_type}}, {}, {}, {}, MemoryMode::guarded);
+    (*instance->memory)[0] = 0x2a;
+
+    // The fault of the callback traps only the callback: the host function returns normally and
+    // the outer execution continues.
+    EXPECT_THAT(execute(*instance, 1, {0}), Result(0x2a));
+    EXPECT_TRUE(callback_trapped);
+    EXPECT_EQ(num_host_calls, 0);
+
+    // The outer execution is guarded again after the host function returned.
+    callback_trapped = false;
+    EXPECT_THAT(execute(*instance, 1, {PageSize}), Traps());
+    EXPECT_TRUE(callback_trapped);
+    EXPECT_EQ(num_host_calls, 0);
+}
+
+TEST(memory, guarded_fault_in_host_function)
+{
+    /* wat2wasm
+    (func $host (import "m" "h") (param i32) (result i32))
+    (memory 1)
+    (func (param i32) (result i32)
+      (drop (call $host (local.get 0)))
+      (i32.load (local.get 0))
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020701016d016800000302010005030100010a0e010c00200010001a"
+        "20002802000b");
+
+    // The fault of the host function is not a trap of the guarded caller (which would skip
+    // the destructors of the host function), but a crash as without the guard.
+    const auto host = [](Instance& instance, std::vector<uint64_t>, int) {
+        const std::vector<uint64_t> result{*(instance.memory->data() + PageSize)};
+        return execution_result{false, result};
+    };
+    const auto host_type = FuncType{{ValType::i32}, {ValType::i32}};
+
+    auto instance =
+        instantiate(parse(wasm), {{host, host_type}}, {}, {}, {}, MemoryMode::guarded);
+    EXPECT_DEATH(execute(*instance, 1, {0}), "");
+}
+
+TEST(memory, guarded_imported)
+{
+    LinearMemory memory(PageSize, MemoryMode::guarded);
+
+    /* wat2wasm
+    (memory (import "m" "m") 1)
+    (func (param i32) (result i32) (i32.load (local.get 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020801016d016d020001030201000a0901070020002802000b");
+
+    memory[8] = 0x2a;
+    auto instance = instantiate(parse(wasm), {}, {}, {{&memory, {1, std::nullopt}}});
+    EXPECT_THAT(execute(*instance, 0, {8}), Result(0x2a));
+    EXPECT_THAT(execute(*instance, 0, {PageSize}), Traps());
+}
+
+TEST(memory, imported_max_size)
+{
+    LinearMemory memory(PageSize, MemoryMode::checked, 2 * PageSize);
+
+    /* wat2wasm
+    (memory (import "m" "m") 1)
+    (func (param i32) (result i32) (memory.grow (local.get 0)))
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020801016d016d020001030201000a08010600200040000b");
+
+    // The memory cannot grow beyond its maximum size, even if the imported limits allow that.
+    auto instance = instantiate(parse(wasm), {}, {}, {{&memory, {1, std::nullopt}}});
+    EXPECT_EQ(instance->memory_max_pages, 2);
+    EXPECT_THAT(execute(*instance, 0, {2}), Result(uint32_t(-1)));
+    EXPECT_THAT(execute(*instance, 0, {1}), Result(1));
+    EXPECT_EQ(memory.size(), 2 * PageSize);
+}
@@ -0,0 +1,143 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "module_cache.hpp"
+#include "parser.hpp"
+#include "serialize.hpp"
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(func (export "f") (result i32) (i32.const 42))
+*/
+const auto wasm =
+    from_hex("0061736d010000000105016000017f03020100070501016600000a06010400412a0b");
+
+/// The temporary directory, removed with its files.
+class TempDirectory
+{
+    std::string m_path;
+
+public:
+    TempDirectory()
+    {
+        const auto* const tmpdir_env = std::getenv("TMPDIR");
+        m_path = std::string{tmpdir_env != nullptr ? tmpdir_env : "/tmp"} + "/fizzy-cache-XXXXXX";
+        if (mkdtemp(m_path.data()) == nullptr)
+            throw std::runtime_error{"cannot create temporary directory"};
+    }
+
+    ~TempDirectory()
+    {
+        for (const auto& file : files())
+            unlink((m_path + "/" + file).c_str());
+        rmdir(m_path.c_str());
+    }
+
+    const std::string& path() const noexcept { return m_path; }
+
+    std::set<std::string> files() const
+    {
+        std::set<std::string> names;
+        auto* const dir = opendir(m_path.c_str());
+        while (const auto* const entry = readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                names.insert(name);
+        }
+        closedir(dir);
+        return names;
+    }
+};
+}  // namespace
+
+TEST(module_cache, digest)
+{
+    const auto digest = module_digest(wasm);
+    EXPECT_EQ(digest.size(), 32);
+    EXPECT_EQ(digest.find_first_not_of("0123456789abcdef"), std::string::npos);
+    EXPECT_EQ(module_digest(wasm), digest);
+
+    EXPECT_NE(module_digest({}), module_digest(bytes(1, 0)));
+    EXPECT_NE(module_digest(bytes(8, 0)), module_digest(bytes(9, 0)));
+
+    // Every single-bit change gives a different digest, in all the parts of the input.
+    const bytes input(100, 0);
+    std::set<std::string> digests{module_digest(input)};
+    for (size_t i = 0; i < input.size() * 8; ++i)
+    {
+        auto changed = input;
+        changed[i / 8] = static_cast<uint8_t>(1 << (i % 8));
+        digests.insert(module_digest(changed));
+    }
+    EXPECT_EQ(digests.size(), input.size() * 8 + 1);
+}
+
+TEST(module_cache, parse_cached)
+{
+    const TempDirectory dir;
+
+    const auto module = parse_cached(wasm, dir.path());
+    ASSERT_EQ(module->exportsec.size(), 1);
+    EXPECT_EQ(module->exportsec[0].name, "f");
+
+    // The file is named by the digest, the library version and the format version.
+    const auto files = dir.files();
+    ASSERT_EQ(files.size(), 1);
+    const auto cache_file = *files.begin();
+    const auto format_suffix = ".v" + std::to_string(SerializedModuleVersion) + ".fzm";
+    EXPECT_EQ(cache_file.find(module_digest(wasm) + ".fizzy-"), 0);
+    EXPECT_EQ(cache_file.rfind(format_suffix), cache_file.size() - format_suffix.size());
+    const auto cache_path = dir.path() + "/" + cache_file;
+
+    // The module is loaded from the cache, not parsed.
+    save_module(cache_path, parse(wasm_prefix), wasm);
+    EXPECT_TRUE(parse_cached(wasm, dir.path())->exportsec.empty());
+
+    // The cached module of another binary of the same name is not used, but replaced.
+    save_module(cache_path, parse(wasm_prefix), wasm_prefix);
+    EXPECT_EQ(parse_cached(wasm, dir.path())->exportsec.size(), 1);
+    EXPECT_EQ(load_module(cache_path, wasm)->exportsec.size(), 1);
+
+    // The unusable cached file is replaced.
+    std::ofstream{cache_path, std::ios::trunc} << "garbage";
+    EXPECT_EQ(parse_cached(wasm, dir.path())->exportsec.size(), 1);
+    EXPECT_EQ(load_module(cache_path, wasm)->exportsec.size(), 1);
+    EXPECT_EQ(dir.files(), std::set<std::string>{cache_file});
+}
+
+TEST(module_cache, parse_cached_invalid)
+{
+    const TempDirectory dir;
+    EXPECT_THROW_MESSAGE(parse_cached(from_hex("0061736d010000000c00"), dir.path()),
+        parser_error, "unknown section encountered 12");
+    EXPECT_TRUE(dir.files().empty());
+}
+
+TEST(module_cache, parse_cached_shared_directory)
+{
+    // The directory writable by other users is not used.
+    const TempDirectory dir;
+    ASSERT_EQ(chmod(dir.path().c_str(), 0777), 0);
+    EXPECT_EQ(parse_cached(wasm, dir.path())->exportsec.size(), 1);
+    EXPECT_TRUE(dir.files().empty());
+}
+
+TEST(module_cache, parse_cached_missing_directory)
+{
+    const auto module = parse_cached(wasm, "/nonexistent/fizzy-cache");
+    EXPECT_EQ(module->exportsec.size(), 1);
+}
@@ -2,6 +2,7 @@
 // Copyright 2019-2020 The Fizzy Authors.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "instructions.hpp"
 #include "parser.hpp"
 #include <gtest/gtest.h>
 #include <test/utils/asserts.hpp>
@@ -13,9 +14,13 @@ using namespace fizzy::test;
 
 namespace
 {
-inline auto parse_expr(const bytes& input)
+/// Parses the expr as the body of the only function in a module, of type [] -> [results].
+inline auto parse_expr(const bytes& input, std::vector<ValType> results = {})
 {
-    return fizzy::parse_expr(input.data(), input.data() + input.size(), false);
+    Module module;
+    module.typesec.emplace_back(FuncType{{}, std::move(results)});
+    module.funcsec.emplace_back(TypeIdx{0});
+    return fizzy::parse_expr(input.data(), input.data() + input.size(), 0, module);
 }
 }  // namespace
 
@@ -23,25 +28,40 @@ TEST(parser_expr, instr_loop)
 {
     const auto loop_void_empty = "03400b0b"_bytes;
     const auto [code1, pos1] = parse_expr(loop_void_empty);
-    EXPECT_EQ(code1.instructions, (std::vector{Instr::loop, Instr::end, Instr::end}));
+    EXPECT_EQ(code1.instructions, (std::vector{Instr::end}));
     EXPECT_EQ(code1.immediates.size(), 0);
 
-    const auto loop_i32_empty = "037f0b0b"_bytes;
-    const auto [code2, pos2] = parse_expr(loop_i32_empty);
-    EXPECT_EQ(code2.instructions, (std::vector{Instr::loop, Instr::end, Instr::end}));
-    EXPECT_EQ(code2.immediates.size(), 0);
+    const auto loop_i32 = "037f41000b1a0b"_bytes;
+    const auto [code2, pos2] = parse_expr(loop_i32);
+    EXPECT_EQ(code2.instructions, (std::vector{Instr::i32_const, Instr::drop, Instr::end}));
+    EXPECT_EQ(code2.immediates, "00000000"_bytes);
 
-    const auto loop_f32_empty = "037d0b0b"_bytes;
-    const auto [code3, pos3] = parse_expr(loop_f32_empty);
-    EXPECT_EQ(code3.instructions, (std::vector{Instr::loop, Instr::end, Instr::end}));
+    const auto loop_f32 = "037d000b1a0b"_bytes;
+    const auto [code3, pos3] = parse_expr(loop_f32);
+    EXPECT_EQ(code3.instructions, (std::vector{Instr::unreachable, Instr::drop, Instr::end}));
     EXPECT_EQ(code3.immediates.size(), 0);
 
-    const auto loop_f64_empty = "037d0b0b"_bytes;
-    const auto [code4, pos4] = parse_expr(loop_f64_empty);
-    EXPECT_EQ(code4.instructions, (std::vector{Instr::loop, Instr::end, Instr::end}));
+    const auto loop_f64 = "037c000b1a0b"_bytes;
+    const auto [code4, pos4] = parse_expr(loop_f64);
+    EXPECT_EQ(code4.instructions, (std::vector{Instr::unreachable, Instr::drop, Instr::end}));
     EXPECT_EQ(code4.immediates.size(), 0);
 }
 
+TEST(parser_expr, loop_br)
+{
+    // loop
+    //   br 0
+    // end
+    const auto code_bin = "03400c000b0b"_bytes;
+    const auto [code, pos] = parse_expr(code_bin);
+    EXPECT_EQ(code.instructions, (std::vector{Instr::br, Instr::end}));
+    EXPECT_EQ(code.immediates,
+        "00000000"
+        "00000000"
+        "00000000"
+        "00000000"_bytes);
+}
+
 TEST(parser_expr, instr_loop_input_buffer_overflow)
 {
     // The function end opcode 0b is missing causing reading out of input buffer.
@@ -56,28 +76,18 @@ TEST(parser_expr, instr_block)
 
     const auto empty = "010102400b0b"_bytes;
     const auto [code1, pos1] = parse_expr(empty);
-    EXPECT_EQ(code1.instructions,
-        (std::vector{Instr::nop, Instr::nop, Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code1.immediates,
-        "00"
-        "04000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code1.instructions, (std::vector{Instr::nop, Instr::nop, Instr::end}));
+    EXPECT_EQ(code1.immediates.size(), 0);
 
-    const auto block_i64 = "027e0b0b"_bytes;
+    const auto block_i64 = "027e000b1a0b"_bytes;
     const auto [code2, pos2] = parse_expr(block_i64);
-    EXPECT_EQ(code2.instructions, (std::vector{Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code2.immediates,
-        "01"
-        "02000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code2.instructions, (std::vector{Instr::unreachable, Instr::drop, Instr::end}));
+    EXPECT_EQ(code2.immediates.size(), 0);
 
-    const auto block_f64 = "027c0b0b"_bytes;
+    const auto block_f64 = "027c000b1a0b"_bytes;
     const auto [code3, pos3] = parse_expr(block_f64);
-    EXPECT_EQ(code3.instructions, (std::vector{Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code3.immediates,
-        "01"
-        "02000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code3.instructions, (std::vector{Instr::unreachable, Instr::drop, Instr::end}));
+    EXPECT_EQ(code3.immediates.size(), 0);
 }
 
 TEST(parser_expr, instr_block_input_buffer_overflow)
@@ -101,22 +111,171 @@ TEST(parser_expr, block_br)
     // end
 
     const auto code_bin = "010240410a21010c00410b21010b20010b"_bytes;
-    const auto [code, pos] = parse_expr(code_bin);
+    const auto [code, pos] = parse_expr(code_bin, {ValType::i32});
     EXPECT_EQ(code.instructions,
-        (std::vector{Instr::nop, Instr::block, Instr::i32_const, Instr::local_set, Instr::br,
-            Instr::i32_const, Instr::local_set, Instr::end, Instr::local_get, Instr::end}));
+        (std::vector{Instr::nop, Instr::i32_const, Instr::local_set, Instr::br, Instr::i32_const,
+            Instr::local_set, Instr::local_get, Instr::end}));
     EXPECT_EQ(code.immediates,
-        "00"
-        "08000000"
-        "1d000000"
         "0a000000"
         "01000000"
+        "06000000"
+        "20000000"
+        "00000000"
         "00000000"
         "0b000000"
         "01000000"
         "01000000"_bytes);
 }
 
+TEST(parser_expr, block_br_drop)
+{
+    // block (result i32)
+    //   i32.const 1
+    //   i32.const 2
+    //   br 0
+    // end
+    // end
+
+    const auto code_bin = "027f410141020c000b0b"_bytes;
+    const auto [code, pos] = parse_expr(code_bin, {ValType::i32});
+    EXPECT_EQ(code.instructions,
+        (std::vector{Instr::i32_const, Instr::i32_const, Instr::br, Instr::end}));
+    EXPECT_EQ(code.immediates,
+        "01000000"
+        "02000000"
+        "03000000"
+        "18000000"
+        "01000000"
+        "01000000"_bytes);
+}
+
+TEST(parser_expr, if_else)
+{
+    // i32.const 0
+    // if (result i32)
+    //   i32.const 1
+    // else
+    //   i32.const 2
+    // end
+    // end
+
+    const auto code_bin = "4100047f41010541020b0b"_bytes;
+    const auto [code, pos] = parse_expr(code_bin, {ValType::i32});
+    EXPECT_EQ(code.instructions, (std::vector{Instr::i32_const, Instr::if_, Instr::i32_const,
+                                     Instr::else_, Instr::i32_const, Instr::end}));
+    EXPECT_EQ(code.immediates,
+        "00000000"
+        "04000000"
+        "18000000"
+        "01000000"
+        "05000000"
+        "1c000000"
+        "02000000"_bytes);
+
+    // i32.const 0 if (result i32) i32.const 1 end
+    EXPECT_THROW_MESSAGE(parse_expr("4100047f41010b0b"_bytes, {ValType::i32}), validation_error,
+        "if without else must not return a value");
+}
+
+TEST(parser_expr, superinstructions)
+{
+    // local.get 0
+    // local.get 1
+    // drop
+    // drop
+    const auto [code1, pos1] = parse_expr("200020011a1a0b"_bytes);
+    EXPECT_EQ(code1.instructions,
+        (std::vector{superinstr::local_get_local_get, Instr::drop, Instr::drop, Instr::end}));
+    EXPECT_EQ(code1.immediates,
+        "00000000"
+        "01000000"_bytes);
+
+    // i64.const 1
+    // i64.const 2
+    // i64.and
+    // drop
+    const auto [code2, pos2] = parse_expr("42014202831a0b"_bytes);
+    EXPECT_EQ(code2.instructions,
+        (std::vector{Instr::i64_const, superinstr::i64_and_imm, Instr::drop, Instr::end}));
+    EXPECT_EQ(code2.immediates,
+        "0100000000000000"
+        "0200000000000000"_bytes);
+}
+
+TEST(parser_expr, superinstructions_not_in_input)
+{
+    // The superinstruction opcodes are not accepted in the binary.
+    EXPECT_THROW_MESSAGE(parse_expr("e00b"_bytes), parser_error, "invalid instruction 224");
+    EXPECT_THROW_MESSAGE(parse_expr("e70b"_bytes), parser_error, "invalid instruction 231");
+
+    // The superinstructions do not use the sign-extension opcodes 0xc0-0xc4.
+    for (const auto opcode : {superinstr::local_get_local_get, superinstr::local_tee_local_get,
+             superinstr::i32_add_imm, superinstr::i64_and_imm, superinstr::i64_shr_u_imm,
+             superinstr::local_get_i32_load, superinstr::local_get_i64_load,
+             superinstr::local_get_i32_add_imm_local_set})
+    {
+        EXPECT_GE(static_cast<uint8_t>(opcode), 0xe0);
+        EXPECT_LE(static_cast<uint8_t>(opcode), 0xe7);
+    }
+}
+
+TEST(parser_expr, superinstructions_jump_target)
+{
+    // local.get 0
+    // loop
+    //   local.get 1
+    //   drop
+    // end
+    // drop
+    const auto [code1, pos1] = parse_expr("2000034020011a0b1a0b"_bytes);
+    EXPECT_EQ(code1.instructions,
+        (std::vector{Instr::local_get, Instr::local_get, Instr::drop, Instr::drop, Instr::end}));
+
+    // i32.const 1
+    // block (result i32)
+    //   i32.const 2
+    // end
+    // i32.add
+    // drop
+    const auto [code2, pos2] = parse_expr("4101027f41020b6a1a0b"_bytes);
+    EXPECT_EQ(code2.instructions, (std::vector{Instr::i32_const, Instr::i32_const, Instr::i32_add,
+                                      Instr::drop, Instr::end}));
+}
+
+TEST(parser_expr, max_stack_height)
+{
+    const auto [code1, pos1] = parse_expr("0b"_bytes);
+    EXPECT_EQ(code1.max_stack_height, 0);
+
+    // i32.const 1
+    // i32.const 2
+    // i32.add
+    // drop
+    const auto [code2, pos2] = parse_expr("410141026a1a0b"_bytes);
+    EXPECT_EQ(code2.max_stack_height, 2);
+
+    // i32.const 1
+    // block (result i32)
+    //   i32.const 2
+    //   i32.const 3
+    //   i32.add
+    // end
+    // i32.add
+    const auto [code3, pos3] = parse_expr("4101027f410241036a0b6a0b"_bytes, {ValType::i32});
+    EXPECT_EQ(code3.max_stack_height, 3);
+
+    // i32.const 0
+    // if (result i32)
+    //   i32.const 1
+    //   i32.const 2
+    //   drop
+    // else
+    //   i32.const 3
+    // end
+    const auto [code4, pos4] = parse_expr("4100047f410141021a0541030b0b"_bytes, {ValType::i32});
+    EXPECT_EQ(code4.max_stack_height, 2);
+}
+
 TEST(parser_expr, instr_br_table)
 {
     /*
@@ -144,25 +303,29 @@ TEST(parser_expr, instr_br_table)
         "000f0b41e4000f0b41e5000f0b41e6000f0b41e7000f0b41e8000b000c04"
         "6e616d6502050100010000"_bytes;
 
-    const auto [code, pos] = parse_expr(code_bin);
+    const auto [code, pos] = parse_expr(code_bin, {ValType::i32});
 
     EXPECT_EQ(code.instructions,
-        (std::vector{Instr::block, Instr::block, Instr::block, Instr::block, Instr::block,
-            Instr::local_get, Instr::br_table, Instr::i32_const, Instr::return_, Instr::end,
-            Instr::i32_const, Instr::return_, Instr::end, Instr::i32_const, Instr::return_,
-            Instr::end, Instr::i32_const, Instr::return_, Instr::end, Instr::i32_const,
-            Instr::return_, Instr::end, Instr::i32_const, Instr::end}));
-
-    // 5 blocks + 1 local_get before br_table
-    const auto br_table_imm_offset = 5 * (1 + 2 * 4) + 4;
+        (std::vector{Instr::local_get, Instr::br_table, Instr::i32_const, Instr::return_,
+            Instr::i32_const, Instr::return_, Instr::i32_const, Instr::return_, Instr::i32_const,
+            Instr::return_, Instr::i32_const, Instr::return_, Instr::i32_const, Instr::end}));
+
+    // local_get before br_table
+    const auto br_table_imm_offset = 4;
     const auto expected_br_imm =
         "04000000"
-        "03000000"
-        "02000000"
-        "01000000"
-        "00000000"
-        "04000000"_bytes;
+        "0a000000a80000000000000000000000"
+        "08000000940000000000000000000000"
+        "06000000800000000000000000000000"
+        "040000006c0000000000000000000000"
+        "0c000000bc0000000000000000000000"_bytes;
     EXPECT_EQ(code.immediates.substr(br_table_imm_offset, expected_br_imm.size()), expected_br_imm);
+
+    // The return keeps the result and targets the function's end instruction.
+    const auto return_imm_offset = br_table_imm_offset + expected_br_imm.size() + 4;
+    const auto expected_return_imm = "0d000000c00000000100000000000000"_bytes;
+    EXPECT_EQ(code.immediates.substr(return_imm_offset, expected_return_imm.size()),
+        expected_return_imm);
 }
 
 TEST(parser_expr, instr_br_table_empty_vector)
@@ -177,15 +340,17 @@ TEST(parser_expr, instr_br_table_empty_vector)
 
     const auto code_bin = "024020000e000041e3000f0b41e4000b000c046e616d6502050100010000"_bytes;
 
-    const auto [code, pos] = parse_expr(code_bin);
+    const auto [code, pos] = parse_expr(code_bin, {ValType::i32});
 
-    EXPECT_EQ(code.instructions,
-        (std::vector{Instr::block, Instr::local_get, Instr::br_table, Instr::i32_const,
-            Instr::return_, Instr::end, Instr::i32_const, Instr::end}));
+    EXPECT_EQ(code.instructions, (std::vector{Instr::local_get, Instr::br_table, Instr::i32_const,
+                                     Instr::return_, Instr::i32_const, Instr::end}));
 
-    // blocks + local_get before br_table
-    const auto br_table_imm_offset = 1 + 2 * 4 + 4;
+    // local_get before br_table
+    const auto br_table_imm_offset = 4;
     const auto expected_br_imm =
+        "00000000"
+        "04000000"
+        "2c000000"
         "00000000"
         "00000000"_bytes;
     EXPECT_EQ(code.immediates.substr(br_table_imm_offset, expected_br_imm.size()), expected_br_imm);
@@ -206,15 +371,24 @@ TEST(parser_expr, unexpected_else)
 
 TEST(parser_expr, call_indirect_table_index)
 {
-    const auto code1_bin = i32_const(0) + "1122000b"_bytes;
+    const auto code1_bin = i32_const(0) + "1100000b"_bytes;
     const auto [code, pos] = parse_expr(code1_bin);
     EXPECT_EQ(code.instructions, (std::vector{Instr::i32_const, Instr::call_indirect, Instr::end}));
 
-    const auto code2_bin = i32_const(0) + "1122010b"_bytes;
+    const auto code2_bin = i32_const(0) + "1100010b"_bytes;
     EXPECT_THROW_MESSAGE(
         parse_expr(code2_bin), parser_error, "invalid tableidx encountered with call_indirect");
 }
 
+TEST(parser_expr, call_invalid_index)
+{
+    EXPECT_THROW_MESSAGE(
+        parse_expr("10010b"_bytes), validation_error, "invalid funcidx encountered with call");
+
+    EXPECT_THROW_MESSAGE(parse_expr(i32_const(0) + "1101000b"_bytes), validation_error,
+        "invalid type index encountered with call_indirect");
+}
+
 TEST(parser_expr, control_instr_out_of_bounds)
 {
     EXPECT_THROW_MESSAGE(parse_expr("02"_bytes), parser_error, "Unexpected EOF");
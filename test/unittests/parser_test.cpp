@@ -2,12 +2,14 @@
 // Copyright 2019-2020 The Fizzy Authors.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "instructions.hpp"
 #include "parser.hpp"
 #include <gtest/gtest.h>
 #include <test/utils/asserts.hpp>
 #include <test/utils/hex.hpp>
 #include <test/utils/leb128_encode.hpp>
 #include <test/utils/wasm_binary.hpp>
+#include <thread>
 
 using namespace fizzy;
 using namespace fizzy::test;
@@ -1002,14 +1004,11 @@ TEST(parser, code_section_with_basic_instructions)
     EXPECT_EQ(module.typesec[0].outputs.size(), 0);
     ASSERT_EQ(module.codesec.size(), 1);
     EXPECT_EQ(module.codesec[0].local_count, 0);
-    ASSERT_EQ(module.codesec[0].instructions.size(), 7);
-    EXPECT_EQ(module.codesec[0].instructions[0], Instr::local_get);
-    EXPECT_EQ(module.codesec[0].instructions[1], Instr::i32_const);
-    EXPECT_EQ(module.codesec[0].instructions[2], Instr::i32_add);
-    EXPECT_EQ(module.codesec[0].instructions[3], Instr::local_set);
-    EXPECT_EQ(module.codesec[0].instructions[4], Instr::nop);
-    EXPECT_EQ(module.codesec[0].instructions[5], Instr::unreachable);
-    EXPECT_EQ(module.codesec[0].instructions[6], Instr::end);
+    ASSERT_EQ(module.codesec[0].instructions.size(), 4);
+    EXPECT_EQ(module.codesec[0].instructions[0], superinstr::local_get_i32_add_imm_local_set);
+    EXPECT_EQ(module.codesec[0].instructions[1], Instr::nop);
+    EXPECT_EQ(module.codesec[0].instructions[2], Instr::unreachable);
+    EXPECT_EQ(module.codesec[0].instructions[3], Instr::end);
     ASSERT_EQ(module.codesec[0].immediates.size(), 3 * 4);
     EXPECT_EQ(module.codesec[0].immediates, "010000000200000003000000"_bytes);
 }
@@ -1319,8 +1318,8 @@ TEST(parser, milestone1)
     const auto& c = m.codesec[0];
     EXPECT_EQ(c.local_count, 1);
     EXPECT_EQ(c.instructions,
-        (std::vector{Instr::local_get, Instr::local_get, Instr::i32_add, Instr::local_get,
-            Instr::i32_add, Instr::local_tee, Instr::local_get, Instr::i32_add, Instr::end}));
+        (std::vector{superinstr::local_get_local_get, Instr::i32_add, Instr::local_get,
+            Instr::i32_add, superinstr::local_tee_local_get, Instr::i32_add, Instr::end}));
     EXPECT_EQ(c.immediates,
         "00000000"
         "01000000"
@@ -1328,3 +1327,173 @@ TEST(parser, milestone1)
         "02000000"
         "00000000"_bytes);
 }
+
+namespace
+{
+/// Makes the module of the functions of type () -> i32 with the given bodies.
+bytes make_module_of_functions(const std::vector<bytes>& bodies)
+{
+    bytes funcsec = test::leb128u_encode(bodies.size());
+    bytes codesec = funcsec;
+    for (const auto& body : bodies)
+    {
+        funcsec += uint8_t{0x00};
+        codesec += add_size_prefix(uint8_t{0x00} + body);
+    }
+    return bytes{wasm_prefix} + make_section(1, make_vec({make_functype({}, {i32})})) +
+           make_section(3, funcsec) + make_section(10, codesec);
+}
+}  // namespace
+
+TEST(parser, parallel)
+{
+    std::vector<bytes> bodies;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        // Bodies of different lengths: i32.const i, then (i % 5) x (i32.const 1, i32.add).
+        auto body = i32_const(i);
+        for (uint32_t j = 0; j < i % 5; ++j)
+            body += i32_const(1) + "6a"_bytes;
+        bodies.emplace_back(body + "0b"_bytes);
+    }
+    const auto wasm = make_module_of_functions(bodies);
+
+    const auto module = parse(wasm);
+    for (const auto num_threads : {0u, 2u, 4u, 200u})
+    {
+        const auto parallel_module = parse(wasm, {num_threads});
+        ASSERT_EQ(parallel_module.codesec.size(), module.codesec.size());
+        for (size_t i = 0; i < module.codesec.size(); ++i)
+        {
+            const auto& code = parallel_module.codesec[i];
+            EXPECT_EQ(code.instructions, module.codesec[i].instructions);
+            EXPECT_EQ(code.immediates, module.codesec[i].immediates);
+            EXPECT_EQ(code.max_stack_height, module.codesec[i].max_stack_height);
+        }
+    }
+}
+
+TEST(parser, parallel_first_error)
+{
+    std::vector<bytes> bodies(200, i32_const(0) + "0b"_bytes);
+    bodies[150] = "ff0b"_bytes;
+    const auto wasm_parser_error = make_module_of_functions(bodies);
+    bodies[100] = "1a0b"_bytes;  // drop
+    const auto wasm_validation_error = make_module_of_functions(bodies);
+
+    // The error of the function of the lowest index is reported, whichever thread finds it first.
+    for (int i = 0; i < 20; ++i)
+    {
+        EXPECT_THROW_MESSAGE(
+            parse(wasm_validation_error, {4}), validation_error, "stack underflow");
+        EXPECT_THROW_MESSAGE(
+            parse(wasm_parser_error, {4}), parser_error, "invalid instruction 255");
+    }
+}
+
+TEST(parser, lazy)
+{
+    std::vector<bytes> bodies;
+    for (uint32_t i = 0; i < 10; ++i)
+        bodies.emplace_back(i32_const(i) + "0b"_bytes);
+    bodies[7] = "1a0b"_bytes;  // drop
+    const auto wasm = make_module_of_functions(bodies);
+    EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
+
+    ParseOptions options;
+    options.lazy = true;
+    const auto module = parse(wasm, options);
+    EXPECT_TRUE(module.codesec.empty());
+    ASSERT_NE(module.lazy_code, nullptr);
+
+    bodies[7] = i32_const(7) + "0b"_bytes;
+    const auto eager_module = parse(make_module_of_functions(bodies));
+    for (const auto i : {0, 9, 3, 0})
+    {
+        const auto& code = get_code(module, size_t(i));
+        EXPECT_EQ(code.instructions, eager_module.codesec[size_t(i)].instructions);
+        EXPECT_EQ(code.immediates, eager_module.codesec[size_t(i)].immediates);
+        EXPECT_EQ(&get_code(module, size_t(i)), &code);
+    }
+
+    // The invalid function is reported each time it is accessed, but parsed once: the kept error
+    // is rethrown.
+    EXPECT_THROW_MESSAGE(get_code(module, 7), validation_error, "stack underflow");
+    EXPECT_THROW_MESSAGE(get_code(module, 7), validation_error, "stack underflow");
+    EXPECT_EQ(find_lazy_code(module, 7), nullptr);
+    EXPECT_EQ(find_lazy_code(module, 3), &get_code(module, 3));
+    const auto get_error = [&module] {
+        try
+        {
+            get_code(module, 7);
+        }
+        catch (...)
+        {
+            return std::current_exception();
+        }
+        return std::exception_ptr{};
+    };
+    EXPECT_EQ(get_error(), get_error());
+
+    EXPECT_THROW_MESSAGE(validate_lazy_code(module), validation_error, "stack underflow");
+    EXPECT_NO_THROW(validate_lazy_code(eager_module));
+
+    // The copies of the module share the code.
+    const auto module_copy = module;
+    EXPECT_EQ(&get_code(module_copy, 3), &get_code(module, 3));
+}
+
+TEST(parser, lazy_structure)
+{
+    ParseOptions options;
+    options.lazy = true;
+
+    // The sizes of the function bodies are checked up front.
+    const auto code_size_too_big = bytes{wasm_prefix} +
+                                   make_section(1, make_vec({make_functype({}, {})})) +
+                                   make_section(3, "0100"_bytes) + make_section(10, "01050b"_bytes);
+    EXPECT_THROW_MESSAGE(parse(code_size_too_big, options), parser_error, "Unexpected EOF");
+
+    const auto code_count_mismatch = bytes{wasm_prefix} +
+                                     make_section(1, make_vec({make_functype({}, {})})) +
+                                     make_section(3, "020000"_bytes) +
+                                     make_section(10, "0102000b"_bytes);
+    EXPECT_THROW_MESSAGE(parse(code_count_mismatch, options), parser_error,
+        "malformed binary: number of function and code entries must match");
+}
+
+TEST(parser, lazy_concurrent)
+{
+    std::vector<bytes> bodies;
+    for (uint32_t i = 0; i < 100; ++i)
+        bodies.emplace_back(i32_const(i) + i32_const(1) + "6a0b"_bytes);
+    const auto wasm = make_module_of_functions(bodies);
+    const auto eager_module = parse(wasm);
+
+    ParseOptions options;
+    options.lazy = true;
+    const auto module = parse(wasm, options);
+
+    // The threads parse the functions in different orders.
+    std::vector<const Code*> codes[4];
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::size(codes); ++t)
+    {
+        threads.emplace_back([&module, &codes, t] {
+            for (size_t i = 0; i < 100; ++i)
+                codes[t].push_back(&get_code(module, (i * (2 * t + 1)) % 100));
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t t = 0; t < std::size(codes); ++t)
+    {
+        for (size_t i = 0; i < 100; ++i)
+        {
+            const auto code_idx = (i * (2 * t + 1)) % 100;
+            EXPECT_EQ(codes[t][i], &get_code(module, code_idx));
+            EXPECT_EQ(codes[t][i]->immediates, eager_module.codesec[code_idx].immediates);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "execute.hpp"
+#include "parser.hpp"
+#include "serialize.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <unistd.h>
+#include <cstdlib>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(func $f (import "env" "f") (param i32) (result i32))
+(global (import "env" "g") i32)
+(memory 1 2)
+(table 2 funcref)
+(global $m (mut i32) (global.get 0))
+(global i64 (i64.const -1))
+(elem (i32.const 1) $add)
+(data (i32.const 8) "\2a")
+(export "add" (func $add))
+(export "mem" (memory 0))
+(func $add (param i32) (result i32)
+  (i32.add (call $f (local.get 0)) (i32.load8_u (i32.const 8))))
+(func $start (global.set $m (i32.const 3)))
+(start $start)
+*/
+const auto wasm = from_hex(
+    "0061736d0100000001090260017f017f60000002120203656e760166000003656e760167037f000303020001"
+    "040401700002050401010102060b027f0123000b7e00427f0b070d02036164640001036d656d020008010209"
+    "07010041010b01010a15020c002000100041082d00006a0b0600410324010b0b07010041080b012a");
+
+void check_module(const Module& module)
+{
+    ASSERT_EQ(module.importsec.size(), 2);
+    EXPECT_EQ(module.importsec[0].module, "env");
+    EXPECT_EQ(module.importsec[0].name, "f");
+    EXPECT_EQ(module.importsec[1].kind, ExternalKind::Global);
+    EXPECT_FALSE(module.importsec[1].desc.global_mutable);
+    ASSERT_EQ(module.memorysec.size(), 1);
+    EXPECT_EQ(module.memorysec[0].limits.max, 2);
+    ASSERT_EQ(module.globalsec.size(), 2);
+    EXPECT_TRUE(module.globalsec[0].is_mutable);
+    EXPECT_EQ(module.globalsec[0].expression.kind, ConstantExpression::Kind::GlobalGet);
+    EXPECT_EQ(module.globalsec[1].expression.value.constant, uint64_t(-1));
+    EXPECT_EQ(module.startfunc, 2);
+    ASSERT_EQ(module.exportsec.size(), 2);
+    EXPECT_EQ(module.exportsec[1].name, "mem");
+    EXPECT_EQ(module.imported_function_types.size(), 1);
+    EXPECT_EQ(module.imported_globals_mutability, std::vector<bool>{false});
+
+    const auto host_f = [](Instance&, std::vector<uint64_t> args, int) -> execution_result {
+        return {false, {args[0] * 2}};
+    };
+    uint64_t g = 5;
+    auto instance = instantiate(std::make_shared<const Module>(module),
+        {{host_f, module.typesec[0]}}, {}, {}, {{&g, false}});
+    EXPECT_EQ(instance->globals[0], 3);
+    EXPECT_THAT(execute(*instance, 1, {10}), Result(62));
+}
+}  // namespace
+
+TEST(serialize, roundtrip)
+{
+    const auto module = parse(wasm);
+    const auto serialized = serialize_module(module);
+
+    const auto deserialized = deserialize_module(serialized);
+    check_module(deserialized);
+    EXPECT_EQ(serialize_module(deserialized), serialized);
+
+    ASSERT_EQ(deserialized.codesec.size(), module.codesec.size());
+    for (size_t i = 0; i < module.codesec.size(); ++i)
+    {
+        EXPECT_EQ(deserialized.codesec[i].instructions, module.codesec[i].instructions);
+        EXPECT_EQ(deserialized.codesec[i].immediates, module.codesec[i].immediates);
+        EXPECT_EQ(deserialized.codesec[i].max_stack_height, module.codesec[i].max_stack_height);
+    }
+}
+
+TEST(serialize, empty_module)
+{
+    const auto module = parse(wasm_prefix);
+    const auto deserialized = deserialize_module(serialize_module(module));
+    EXPECT_TRUE(deserialized.typesec.empty());
+    EXPECT_TRUE(deserialized.codesec.empty());
+    EXPECT_FALSE(deserialized.startfunc.has_value());
+}
+
+TEST(serialize, invalid)
+{
+    const auto serialized = serialize_module(parse(wasm));
+
+    EXPECT_THROW_MESSAGE(deserialize_module({}), parser_error, "Unexpected EOF");
+    EXPECT_THROW_MESSAGE(deserialize_module(wasm), parser_error, "Unexpected EOF");
+
+    auto bad_magic = serialized;
+    bad_magic[5] = 'x';
+    EXPECT_THROW_MESSAGE(
+        deserialize_module(bad_magic), parser_error, "invalid serialized module magic");
+
+    auto bad_version = serialized;
+    bad_version[8] = uint8_t{SerializedModuleVersion + 1};
+    EXPECT_THROW_MESSAGE(
+        deserialize_module(bad_version), parser_error, "unsupported serialized module version");
+
+    for (size_t size = 0; size < serialized.size(); ++size)
+        EXPECT_THROW(deserialize_module(bytes_view{serialized}.substr(0, size)), parser_error);
+
+    EXPECT_THROW_MESSAGE(deserialize_module(serialized + uint8_t{0}), parser_error,
+        "serialized module checksum mismatch");
+
+    for (const auto pos : {size_t{16}, serialized.size() / 2, serialized.size() - 1})
+    {
+        auto corrupted = serialized;
+        corrupted[pos] ^= 1;
+        EXPECT_THROW_MESSAGE(
+            deserialize_module(corrupted), parser_error, "serialized module checksum mismatch");
+    }
+}
+
+TEST(serialize, invalid_indexes)
+{
+    // The modules are serialized as they are, the deserialization checks them.
+    const auto make_module = [] {
+        Module module;
+        module.typesec.emplace_back();
+        module.funcsec.emplace_back(0);
+        module.codesec.emplace_back().instructions = {Instr::end};
+        return module;
+    };
+    EXPECT_NO_THROW(deserialize_module(serialize_module(make_module())));
+
+    auto module = make_module();
+    module.funcsec[0] = 1;
+    EXPECT_THROW_MESSAGE(deserialize_module(serialize_module(module)), parser_error,
+        "invalid function type index");
+
+    module = make_module();
+    module.exportsec.push_back({"f", ExternalKind::Function, 1});
+    EXPECT_THROW_MESSAGE(
+        deserialize_module(serialize_module(module)), parser_error, "invalid export index");
+
+    module = make_module();
+    module.startfunc = 1;
+    EXPECT_THROW_MESSAGE(deserialize_module(serialize_module(module)), parser_error,
+        "invalid start function index");
+
+    module = make_module();
+    module.tablesec.push_back({{2, std::nullopt}});
+    module.elementsec.push_back({{}, {0, 1}});
+    EXPECT_THROW_MESSAGE(deserialize_module(serialize_module(module)), parser_error,
+        "invalid function index in element section");
+
+    module = make_module();
+    module.codesec[0].instructions = {Instr::nop};
+    EXPECT_THROW_MESSAGE(
+        deserialize_module(serialize_module(module)), parser_error, "invalid serialized code");
+}
+
+TEST(serialize, save_load)
+{
+    const auto* const tmpdir_env = std::getenv("TMPDIR");
+    auto path = std::string{tmpdir_env != nullptr ? tmpdir_env : "/tmp"} + "/fizzy-module-XXXXXX";
+    const auto fd = mkstemp(path.data());
+    ASSERT_NE(fd, -1);
+    close(fd);
+
+    save_module(path, parse(wasm));
+    const auto module = load_module(path);
+    unlink(path.c_str());
+    check_module(*module);
+
+    EXPECT_THROW(load_module(path), std::runtime_error);
+}
@@ -0,0 +1,46 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "span.hpp"
+#include <gtest/gtest.h>
+
+using namespace fizzy;
+
+TEST(span, vector)
+{
+    std::vector<uint64_t> vec{1, 2, 3, 4};
+    const span<uint64_t> s = vec;
+    EXPECT_EQ(s.data(), vec.data());
+    EXPECT_EQ(s.size(), 4);
+    EXPECT_FALSE(s.empty());
+
+    s[0] = 5;
+    EXPECT_EQ(vec[0], 5);
+
+    const auto& const_vec = vec;
+    const span<const uint64_t> const_s = const_vec;
+    EXPECT_EQ(const_s.data(), vec.data());
+    EXPECT_EQ(const_s.size(), 4);
+
+    const span<const uint64_t> converted = s;
+    EXPECT_EQ(converted.data(), vec.data());
+    EXPECT_EQ(converted.size(), 4);
+}
+
+TEST(span, pointer_and_size)
+{
+    const uint64_t values[]{1, 2, 3};
+    const span<const uint64_t> s{&values[1], 2};
+    EXPECT_EQ(s[0], 2);
+    EXPECT_EQ(s[1], 3);
+    EXPECT_EQ(s.begin(), &values[1]);
+    EXPECT_EQ(s.end(), &values[3]);
+
+    uint64_t sum = 0;
+    for (const auto v : s)
+        sum += v;
+    EXPECT_EQ(sum, 5);
+
+    EXPECT_TRUE(span<const uint64_t>{}.empty());
+}
@@ -10,11 +10,19 @@
 using namespace fizzy;
 using namespace fizzy::test;
 
+namespace
+{
+constexpr decltype(&create_fizzy_engine) all_engines[] = {create_fizzy_engine,
+    create_fizzy_guarded_engine, create_fizzy_fork_engine, create_fizzy_reset_engine,
+    create_fizzy_lazy_engine, create_fizzy_register_engine, create_fizzy_jit_engine,
+    create_fizzy_aot_engine, create_wabt_engine, create_wasm3_engine};
+}  // namespace
+
 TEST(wasm_engine, parse_error)
 {
     const auto wasm = "0102"_bytes;
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_FALSE(engine->parse(wasm));
@@ -36,7 +44,9 @@ TEST(wasm_engine, instantiate_error)
     // TODO: parse/instantiate is not properly separated in wabt and wasm3
     // (and wasm3 doesn't care about imports, until execution)
 
-    for (auto engine_create_fn : {create_fizzy_engine})
+    for (auto engine_create_fn : {create_fizzy_engine, create_fizzy_guarded_engine,
+             create_fizzy_fork_engine, create_fizzy_reset_engine, create_fizzy_lazy_engine,
+             create_fizzy_register_engine, create_fizzy_jit_engine, create_fizzy_aot_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -61,7 +71,7 @@ TEST(wasm_engine, trapped)
     const auto wasm =
         from_hex("0061736d0100000001040160000003020100070801047465737400000a05010300000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -89,7 +99,7 @@ TEST(wasm_engine, multi_i32_args_ret_i32)
         "0061736d0100000001080160037f7f7f017f03020100070801047465737400000a0c010a00200020026b20016c"
         "0b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -122,7 +132,7 @@ TEST(wasm_engine, multi_mixed_args_ret_i32)
         "0061736d0100000001080160037f7e7f017f03020100070801047465737400000a0e010c00200020026bad2001"
         "7ea70b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -154,7 +164,7 @@ TEST(wasm_engine, multi_mixed_args_ret_i64)
         "0061736d0100000001080160037f7e7f017e03020100070801047465737400000a0d010b00200020026bad2001"
         "7e0b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -178,7 +188,7 @@ TEST(wasm_engine, no_memory)
     const auto wasm =
         from_hex("0061736d0100000001040160000003020100070801047465737400000a040102000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -206,7 +216,7 @@ TEST(wasm_engine, memory)
         "0061736d0100000001060160027f7f00030201000503010001071102066d656d6f72790200047465737400000a"
         "0e010c00200120002802003602000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn : all_engines)
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -234,5 +244,9 @@ TEST(wasm_engine, memory)
 
         // Try initialising with oversized buffer.
         EXPECT_FALSE(engine->init_memory(bytes(PageSize + 4, 0)));
+
+        // The memory is in the initial state after instantiating again.
+        ASSERT_TRUE(engine->instantiate());
+        EXPECT_EQ(bytes{engine->get_memory()}, bytes(64 * 1024, 0));
     }
 }
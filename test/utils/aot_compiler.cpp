@@ -0,0 +1,57 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <test/utils/aot_compiler.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace fizzy::test
+{
+#if defined(__unix__) || defined(__APPLE__)
+std::shared_ptr<const AotCode> compile_aot(const Module& module)
+{
+    const auto* const tmpdir_env = std::getenv("TMPDIR");
+    auto dir = std::string{tmpdir_env != nullptr ? tmpdir_env : "/tmp"} + "/fizzy-aot-XXXXXX";
+    if (mkdtemp(dir.data()) == nullptr)
+        return nullptr;
+
+    const auto source_path = dir + "/module.c";
+    const auto object_path = dir + "/module.so";
+    std::ofstream{source_path} << translate_to_c(module);
+
+    const auto* const cc_env = std::getenv("CC");
+    const auto command = std::string{cc_env != nullptr ? cc_env : "cc"} +
+                         " -O2 -shared -fPIC -o " + object_path + " " + source_path + " -lm" +
+                         " > /dev/null 2>&1";
+
+    std::shared_ptr<const AotCode> code;
+    if (std::system(command.c_str()) == 0)
+    {
+        try
+        {
+            code = load_aot(object_path, module);
+        }
+        catch (const std::runtime_error&)
+        {}
+    }
+
+    // The loaded shared object stays mapped after its file is removed.
+    unlink(object_path.c_str());
+    unlink(source_path.c_str());
+    rmdir(dir.c_str());
+    return code;
+}
+#else
+std::shared_ptr<const AotCode> compile_aot(const Module&)
+{
+    return nullptr;
+}
+#endif
+}  // namespace fizzy::test
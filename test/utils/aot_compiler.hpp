@@ -0,0 +1,19 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "aot.hpp"
+#include "types.hpp"
+#include <memory>
+
+namespace fizzy::test
+{
+/// Translates the module to C, compiles it with the system C compiler and loads the result.
+///
+/// The compiler is taken from the CC environment variable, "cc" by default.
+///
+/// @return  The loaded code or nullptr if the C compiler is not available or failed.
+std::shared_ptr<const AotCode> compile_aot(const Module& module);
+}  // namespace fizzy::test
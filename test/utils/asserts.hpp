@@ -5,6 +5,7 @@
 #pragma once
 
 #include "execute.hpp"
+#include "numeric.hpp"
 #include <gmock/gmock.h>
 #include <iosfwd>
 
@@ -20,7 +21,14 @@ MATCHER(Result, "empty result")
 
 MATCHER_P(Result, value, "")
 {
-    return !arg.trapped && arg.stack.size() == 1 && arg.stack[0] == uint64_t(value);
+    if (arg.trapped || arg.stack.size() != 1)
+        return false;
+
+    // The floating point results are compared by their bits, so NaNs are matched exactly.
+    if constexpr (std::is_floating_point_v<value_type>)
+        return arg.stack[0] == fizzy::to_value(value);
+    else
+        return arg.stack[0] == uint64_t(value);
 }
 
 #define EXPECT_THROW_MESSAGE(stmt, ex_type, expected)                                        \
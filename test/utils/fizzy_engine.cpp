@@ -3,19 +3,90 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "execute.hpp"
+#include "jit.hpp"
 #include "parser.hpp"
+#include "register_ir.hpp"
 
+#include <test/utils/aot_compiler.hpp>
 #include <test/utils/wasm_engine.hpp>
 #include <cassert>
 #include <cstring>
+#include <map>
+#include <mutex>
 
 namespace fizzy::test
 {
+/// The way the Fizzy engine creates the instances after the first one.
+enum class Reinstantiation
+{
+    instantiate,  ///< Instantiates the module again.
+    fork,         ///< Forks the instance from the template made at the first instantiation.
+    reset,        ///< Resets the instance forked from the template to its state.
+};
+
+/// The execution tier of the Fizzy engine.
+enum class Tier
+{
+    interpreter,
+    register_ir,
+    jit,
+    aot,
+};
+
+namespace
+{
+/// Returns the ahead-of-time compiled code of the module.
+/// The code is cached by the wasm binary, so the C compiler is invoked once for each module
+/// in the process, not on every parse.
+std::shared_ptr<const AotCode> get_aot_code(bytes_view input, const Module& module)
+{
+    static std::mutex mutex;
+    static std::map<bytes, std::shared_ptr<const AotCode>, std::less<>> cache;
+
+    const std::lock_guard lock{mutex};
+    const auto it = cache.find(input);
+    if (it != cache.end())
+        return it->second;
+    auto code = compile_aot(module);
+    cache.emplace(input, code);
+    return code;
+}
+}  // namespace
+
 class FizzyEngine : public WasmEngine
 {
     std::unique_ptr<Instance> m_instance;
 
+    Tier m_tier = Tier::interpreter;
+
+    MemoryMode m_memory_mode = MemoryMode::checked;
+
+    Reinstantiation m_reinstantiation = Reinstantiation::instantiate;
+
+    ParseOptions m_parse_options;
+
+    InstanceTemplate m_template;
+
+    /// The register IR of the module's functions, used in the register IR tier.
+    std::vector<RegCode> m_register_code;
+
+    /// The machine code of the module's functions, used in the JIT tier.
+    std::shared_ptr<const JitCode> m_jit_code;
+
+    /// The ahead-of-time compiled code of the module's functions, used in the AOT tier.
+    std::shared_ptr<const AotCode> m_aot_code;
+
 public:
+    explicit FizzyEngine(Tier tier = Tier::interpreter,
+        MemoryMode memory_mode = MemoryMode::checked,
+        Reinstantiation reinstantiation = Reinstantiation::instantiate,
+        ParseOptions parse_options = {}) noexcept
+      : m_tier{tier},
+        m_memory_mode{memory_mode},
+        m_reinstantiation{reinstantiation},
+        m_parse_options{parse_options}
+    {}
+
     bool parse(bytes_view input) final;
     std::optional<FuncRef> find_function(std::string_view name) const final;
     bool instantiate() final;
@@ -29,15 +100,62 @@ std::unique_ptr<WasmEngine> create_fizzy_engine()
     return std::make_unique<FizzyEngine>();
 }
 
+std::unique_ptr<WasmEngine> create_fizzy_guarded_engine()
+{
+    return std::make_unique<FizzyEngine>(Tier::interpreter, MemoryMode::guarded);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_fork_engine()
+{
+    return std::make_unique<FizzyEngine>(
+        Tier::interpreter, MemoryMode::checked, Reinstantiation::fork);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_reset_engine()
+{
+    return std::make_unique<FizzyEngine>(
+        Tier::interpreter, MemoryMode::checked, Reinstantiation::reset);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_lazy_engine()
+{
+    ParseOptions parse_options;
+    parse_options.lazy = true;
+    return std::make_unique<FizzyEngine>(
+        Tier::interpreter, MemoryMode::checked, Reinstantiation::instantiate, parse_options);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_register_engine()
+{
+    return std::make_unique<FizzyEngine>(Tier::register_ir);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_jit_engine()
+{
+    return std::make_unique<FizzyEngine>(Tier::jit);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_aot_engine()
+{
+    return std::make_unique<FizzyEngine>(Tier::aot);
+}
+
 bool FizzyEngine::parse(bytes_view input)
 {
+    m_template = {};
     try
     {
-        auto module = fizzy::parse(input);
-        m_instance =
-            std::make_unique<Instance>(std::move(module), bytes_ptr{nullptr, [](bytes*) {}}, 0,
-                table_ptr{nullptr, [](table_elements*) {}}, std::vector<uint64_t>{},
-                std::vector<ExternalFunction>{}, std::vector<ExternalGlobal>{});
+        auto module = fizzy::parse(input, m_parse_options);
+        if (m_tier == Tier::register_ir)
+            m_register_code = translate_to_register_ir(module);
+        else if (m_tier == Tier::jit)
+            m_jit_code = compile_jit(module);
+        else if (m_tier == Tier::aot)
+            m_aot_code = get_aot_code(input, module);
+        m_instance = std::make_unique<Instance>(std::make_shared<const Module>(std::move(module)),
+            memory_ptr{nullptr, [](LinearMemory*) {}}, 0,
+            table_ptr{nullptr, [](table_elements*) {}}, std::vector<uint64_t>{},
+            std::vector<ExternalFunction>{}, std::vector<ExternalGlobal>{});
     }
     catch (const fizzy::parser_error&)
     {
@@ -50,7 +168,25 @@ bool FizzyEngine::instantiate()
 {
     try
     {
-        m_instance = fizzy::instantiate(std::move(m_instance->module));
+        if (m_template.instance != nullptr)
+        {
+            if (m_reinstantiation == Reinstantiation::reset)
+                reset_instance(*m_instance, m_template);
+            else
+                m_instance = fork_instance(m_template);
+            return true;
+        }
+
+        m_instance =
+            fizzy::instantiate(std::move(m_instance->module), {}, {}, {}, {}, m_memory_mode);
+        m_instance->jit_code = m_jit_code;
+        m_instance->aot_code = m_aot_code;
+
+        if (m_reinstantiation != Reinstantiation::instantiate)
+        {
+            m_template = make_instance_template(std::move(m_instance));
+            m_instance = fork_instance(m_template);
+        }
     }
     catch (const fizzy::instantiate_error&)
     {
@@ -78,14 +214,21 @@ bytes_view FizzyEngine::get_memory() const
 
 std::optional<WasmEngine::FuncRef> FizzyEngine::find_function(std::string_view name) const
 {
-    return fizzy::find_exported_function(m_instance->module, name);
+    return fizzy::find_exported_function(*m_instance->module, name);
 }
 
 WasmEngine::Result FizzyEngine::execute(
     WasmEngine::FuncRef func_ref, const std::vector<uint64_t>& args)
 {
+    const auto func_idx = static_cast<uint32_t>(func_ref);
+    if (m_tier != Tier::register_ir)
+    {
+        const auto [trapped, value] = fizzy::execute_span(*m_instance, func_idx, args);
+        return {trapped, value};
+    }
+
     const auto [trapped, result_stack] =
-        fizzy::execute(*m_instance, static_cast<uint32_t>(func_ref), args);
+        fizzy::execute_register_ir(*m_instance, m_register_code, func_idx, args);
     assert(result_stack.size() <= 1);
     return {trapped, !result_stack.empty() ? result_stack.back() : std::optional<uint64_t>{}};
 }
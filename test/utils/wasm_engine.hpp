@@ -60,6 +60,34 @@ public:
 };
 
 std::unique_ptr<WasmEngine> create_fizzy_engine();
+
+/// Creates the Fizzy engine interpreting the functions with the guarded memory,
+/// see fizzy::MemoryMode::guarded.
+std::unique_ptr<WasmEngine> create_fizzy_guarded_engine();
+
+/// Creates the Fizzy engine forking the instances from the template made at the first
+/// instantiation, see fizzy::fork_instance().
+std::unique_ptr<WasmEngine> create_fizzy_fork_engine();
+
+/// Creates the Fizzy engine resetting the instance forked from the template made at the first
+/// instantiation, see fizzy::reset_instance().
+std::unique_ptr<WasmEngine> create_fizzy_reset_engine();
+
+/// Creates the Fizzy engine parsing the functions on first call, see fizzy::ParseOptions::lazy.
+std::unique_ptr<WasmEngine> create_fizzy_lazy_engine();
+
+/// Creates the Fizzy engine executing the functions in the register IR tier.
+std::unique_ptr<WasmEngine> create_fizzy_register_engine();
+
+/// Creates the Fizzy engine executing the functions compiled by the baseline JIT compiler.
+/// The engine falls back to the interpreter where the JIT compiler is not supported.
+std::unique_ptr<WasmEngine> create_fizzy_jit_engine();
+
+/// Creates the Fizzy engine executing the functions translated to C and compiled ahead of time
+/// with the system C compiler. The engine falls back to the interpreter if the compiler
+/// is not available.
+std::unique_ptr<WasmEngine> create_fizzy_aot_engine();
+
 std::unique_ptr<WasmEngine> create_wabt_engine();
 std::unique_ptr<WasmEngine> create_wasm3_engine();
 }  // namespace fizzy::test
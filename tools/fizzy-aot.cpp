@@ -0,0 +1,51 @@
+// Fizzy: A fast WebAssembly interpreter
+// Copyright 2020 The Fizzy Authors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "aot.hpp"
+#include "parser.hpp"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+/// Translates the wasm module to the C source to be compiled ahead of time, e.g.
+///
+///     fizzy-aot module.wasm module.c
+///     cc -O2 -shared -fPIC module.c -o module.so -lm
+///
+/// The shared object is then loaded with fizzy::load_aot().
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.wasm> <output.c>\n";
+        return -1;
+    }
+
+    try
+    {
+        std::ifstream input{argv[1], std::ios::binary};
+        if (!input)
+        {
+            std::cerr << "Cannot open " << argv[1] << "\n";
+            return -1;
+        }
+        const fizzy::bytes wasm{std::istreambuf_iterator<char>{input}, {}};
+
+        const auto module = fizzy::parse(wasm);
+
+        std::ofstream output{argv[2]};
+        output << fizzy::translate_to_c(module);
+        if (!output)
+        {
+            std::cerr << "Cannot write " << argv[2] << "\n";
+            return -1;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception: " << ex.what() << "\n";
+        return -2;
+    }
+}